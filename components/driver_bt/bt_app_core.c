@@ -9,60 +9,145 @@
 #include "bt_app_core.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 #include "esp_system.h"
 #include <string.h>
 #include <stdbool.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "freertos/xtensa_api.h"
 #include "freertos/FreeRTOSConfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 
+#define STATS_REPORT_DELAY_US	(60 * 1000 * 1000LL)
+
 static const char * TAG = "btappcore";
 
+/*
+ Messages live in slots taken from a bitmap with CAS, so BT stack callbacks and
+ timers can dispatch concurrently without locking nor touching the heap. The
+ queue only carries slot pointers, in order, and the task releases the slot
+ once the handler returns
+*/
+typedef struct {
+    bt_app_msg_t msg;            /*!< must be first, see bt_app_msg_alloc */
+    int64_t time;
+    size_t used;
+    bool heap;
+    uint8_t param[BT_APP_PARAM_SIZE] __attribute__((aligned(8)));
+    uint8_t arena[BT_APP_ARENA_SIZE] __attribute__((aligned(4)));
+} bt_app_slot_t;
+
 static void bt_app_task_handler(void *arg);
-static bool bt_app_send_msg(bt_app_msg_t *msg);
+static bool bt_app_send_msg(bt_app_slot_t *slot);
 static void bt_app_work_dispatched(bt_app_msg_t *msg);
 
 static xQueueHandle s_bt_app_task_queue = NULL;
 static xTaskHandle s_bt_app_task_handle = NULL;
 
+static EXT_RAM_ATTR bt_app_slot_t s_pool[BT_APP_POOL_SIZE];
+static uint32_t s_pool_busy;
+
+static struct {
+    uint32_t events, allocs, dropped, busy_max;
+    int64_t latency, latency_max, start;
+} s_stats;
+
+static bt_app_slot_t *bt_app_slot_get(void)
+{
+    uint32_t busy = __atomic_load_n(&s_pool_busy, __ATOMIC_RELAXED);
+    int n;
+
+    do {
+        if (busy == (uint32_t) ((1ULL << BT_APP_POOL_SIZE) - 1)) {
+            return NULL;
+        }
+        n = __builtin_ctz(~busy);
+    } while (!__atomic_compare_exchange_n(&s_pool_busy, &busy, busy | (1 << n), true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    // no need to be exact
+    if (__builtin_popcount(busy) + 1 > s_stats.busy_max) {
+        s_stats.busy_max = __builtin_popcount(busy) + 1;
+    }
+
+    return s_pool + n;
+}
+
+static void bt_app_slot_put(bt_app_slot_t *slot)
+{
+    if (slot->heap) {
+        free(slot->msg.param);
+    }
+    __atomic_fetch_and(&s_pool_busy, ~(1 << (slot - s_pool)), __ATOMIC_RELEASE);
+}
+
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback)
 {
 	ESP_LOGV(TAG,"%s event 0x%x, param len %d", __func__, event, param_len);
 
-    bt_app_msg_t msg;
-    memset(&msg, 0, sizeof(bt_app_msg_t));
-
-    msg.sig = BT_APP_SIG_WORK_DISPATCH;
-    msg.event = event;
-    msg.cb = p_cback;
-
-    if (param_len == 0) {
-        return bt_app_send_msg(&msg);
-    } else if (p_params && param_len > 0) {
-        if ((msg.param = malloc(param_len)) != NULL) {
-            memcpy(msg.param, p_params, param_len);
-            /* check if caller has provided a copy callback to do the deep copy */
-            if (p_copy_cback) {
-                p_copy_cback(&msg, msg.param, p_params);
-            }
-            return bt_app_send_msg(&msg);
+    if (param_len && (!p_params || param_len < 0)) {
+        return false;
+    }
+
+    bt_app_slot_t *slot = bt_app_slot_get();
+
+    if (!slot) {
+        ESP_LOGE(TAG,"%s no free slot for event 0x%x", __func__, event);
+        s_stats.dropped++;
+        return false;
+    }
+
+    memset(&slot->msg, 0, sizeof(bt_app_msg_t));
+    slot->msg.sig = BT_APP_SIG_WORK_DISPATCH;
+    slot->msg.event = event;
+    slot->msg.cb = p_cback;
+    slot->used = 0;
+    slot->heap = param_len > BT_APP_PARAM_SIZE;
+
+    if (param_len) {
+        if (!slot->heap) {
+            slot->msg.param = slot->param;
+        } else if ((slot->msg.param = malloc(param_len)) != NULL) {
+            s_stats.allocs++;
+        } else {
+            slot->heap = false;
+            bt_app_slot_put(slot);
+            return false;
+        }
+        memcpy(slot->msg.param, p_params, param_len);
+        /* check if caller has provided a copy callback to do the deep copy */
+        if (p_copy_cback) {
+            p_copy_cback(&slot->msg, slot->msg.param, p_params);
         }
     }
 
-    return false;
+    slot->time = esp_timer_get_time();
+    return bt_app_send_msg(slot);
 }
 
-static bool bt_app_send_msg(bt_app_msg_t *msg)
+void *bt_app_msg_alloc(bt_app_msg_t *msg, size_t size)
 {
-    if (msg == NULL) {
-        return false;
+    bt_app_slot_t *slot = (bt_app_slot_t*) msg;
+    void *p = slot->arena + slot->used;
+
+    size = (size + 3) & ~3;
+    if (size > BT_APP_ARENA_SIZE - slot->used) {
+        return NULL;
     }
 
-    if (xQueueSend(s_bt_app_task_queue, msg, 10 / portTICK_RATE_MS) != pdTRUE) {
+    slot->used += size;
+    return p;
+}
+
+static bool bt_app_send_msg(bt_app_slot_t *slot)
+{
+    if (xQueueSend(s_bt_app_task_queue, &slot, 10 / portTICK_RATE_MS) != pdTRUE) {
     	ESP_LOGE(TAG,"%s xQueue send failed", __func__);
+        s_stats.dropped++;
+        bt_app_slot_put(slot);
         return false;
     }
     return true;
@@ -75,24 +160,49 @@ static void bt_app_work_dispatched(bt_app_msg_t *msg)
     }
 }
 
+static void bt_app_stats(int64_t now)
+{
+    s_stats.events++;
+
+    if (now - s_stats.start < STATS_REPORT_DELAY_US) {
+        return;
+    }
+
+    uint32_t minutes = (now - s_stats.start + STATS_REPORT_DELAY_US / 2) / STATS_REPORT_DELAY_US;
+
+    ESP_LOGI(TAG, "events %u/min, heap allocations %u/min, dropped %u, slots max %u/%u, dispatch latency avg %u us max %u us",
+             s_stats.events / minutes, s_stats.allocs / minutes, s_stats.dropped, s_stats.busy_max, BT_APP_POOL_SIZE,
+             (uint32_t) (s_stats.latency / s_stats.events), (uint32_t) s_stats.latency_max);
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.start = now;
+}
+
 static void bt_app_task_handler(void *arg)
 {
-    bt_app_msg_t msg;
+    bt_app_slot_t *slot;
     for (;;) {
-        if (pdTRUE == xQueueReceive(s_bt_app_task_queue, &msg, (portTickType)portMAX_DELAY)) {
-        	ESP_LOGV(TAG,"%s, sig 0x%x, 0x%x", __func__, msg.sig, msg.event);
-            switch (msg.sig) {
+        if (pdTRUE == xQueueReceive(s_bt_app_task_queue, &slot, (portTickType)portMAX_DELAY)) {
+            int64_t now = esp_timer_get_time();
+            bt_app_msg_t *msg = &slot->msg;
+
+            s_stats.latency += now - slot->time;
+            if (now - slot->time > s_stats.latency_max) {
+                s_stats.latency_max = now - slot->time;
+            }
+
+        	ESP_LOGV(TAG,"%s, sig 0x%x, 0x%x", __func__, msg->sig, msg->event);
+            switch (msg->sig) {
             case BT_APP_SIG_WORK_DISPATCH:
-                bt_app_work_dispatched(&msg);
+                bt_app_work_dispatched(msg);
                 break;
             default:
-                ESP_LOGW(TAG,"%s, unhandled sig: %d", __func__, msg.sig);
+                ESP_LOGW(TAG,"%s, unhandled sig: %d", __func__, msg->sig);
                 break;
             } // switch (msg.sig)
 
-            if (msg.param) {
-                free(msg.param);
-            }
+            bt_app_slot_put(slot);
+            bt_app_stats(now);
         }
         else
         {
@@ -103,8 +213,11 @@ static void bt_app_task_handler(void *arg)
 
 void bt_app_task_start_up(void)
 {
+    s_pool_busy = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.start = esp_timer_get_time();
 
-    s_bt_app_task_queue = xQueueCreate(10, sizeof(bt_app_msg_t));
+    s_bt_app_task_queue = xQueueCreate(BT_APP_POOL_SIZE, sizeof(bt_app_slot_t*));
     assert(s_bt_app_task_queue!=NULL);
     assert(xTaskCreate(bt_app_task_handler, "BtAppT", 4096, NULL, configMAX_PRIORITIES - 3, &s_bt_app_task_handle)==pdPASS);
     return;
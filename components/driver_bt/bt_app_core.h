@@ -18,6 +18,11 @@
 
 #define BT_APP_SIG_WORK_DISPATCH          (0x01)
 
+/* events are carried in a fixed pool of slots, nothing is allocated per event */
+#define BT_APP_POOL_SIZE                  16
+#define BT_APP_PARAM_SIZE                 64     /*!< parameters inlined in slot, larger ones are malloc'ed */
+#define BT_APP_ARENA_SIZE                 160    /*!< room for deep copies (metadata text) */
+
 /**
  * @brief     handler for the dispatched work
  */
@@ -41,6 +46,12 @@ typedef void (* bt_app_copy_cb_t) (bt_app_msg_t *msg, void *p_dest, void *p_src)
  */
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback);
 
+/**
+ * @brief     room for deep copies, from a copy callback only. Released with the
+ *            message, NULL if it does not fit in BT_APP_ARENA_SIZE
+ */
+void *bt_app_msg_alloc(bt_app_msg_t *msg, size_t size);
+
 void bt_app_task_start_up(void);
 
 void bt_app_task_shut_down(void);
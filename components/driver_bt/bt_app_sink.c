@@ -223,22 +223,31 @@ void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
     }
 }
 
-void bt_app_alloc_meta_buffer(esp_avrc_ct_cb_param_t *param)
+static void bt_app_copy_meta(bt_app_msg_t *msg, void *p_dest, void *p_src)
 {
-    esp_avrc_ct_cb_param_t *rc = (esp_avrc_ct_cb_param_t *)(param);
-    uint8_t *attr_text = (uint8_t *) malloc (rc->meta_rsp.attr_length + 1);
-    memcpy(attr_text, rc->meta_rsp.attr_text, rc->meta_rsp.attr_length);
-    attr_text[rc->meta_rsp.attr_length] = 0;
+    esp_avrc_ct_cb_param_t *dst = (esp_avrc_ct_cb_param_t *) p_dest, *src = (esp_avrc_ct_cb_param_t *) p_src;
+    // we never use more than METADATA_LEN anyway
+    int len = src->meta_rsp.attr_length < METADATA_LEN ? src->meta_rsp.attr_length : METADATA_LEN;
+    uint8_t *attr_text = bt_app_msg_alloc(msg, len + 1);
+
+    if (!attr_text) {
+        dst->meta_rsp.attr_text = (uint8_t*) "";
+        dst->meta_rsp.attr_length = 0;
+        return;
+    }	
 
-    rc->meta_rsp.attr_text = attr_text;
+    memcpy(attr_text, src->meta_rsp.attr_text, len);
+    attr_text[len] = 0;
+    dst->meta_rsp.attr_text = attr_text;
+    dst->meta_rsp.attr_length = len;
 }
 
 void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param)
 {
     switch (event) {
     case ESP_AVRC_CT_METADATA_RSP_EVT:
-        bt_app_alloc_meta_buffer(param);
-        /* fall through */
+        bt_app_work_dispatch(bt_av_hdl_avrc_ct_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), bt_app_copy_meta);
+        break;
     case ESP_AVRC_CT_CONNECTION_STATE_EVT:
     case ESP_AVRC_CT_PASSTHROUGH_RSP_EVT:
     case ESP_AVRC_CT_CHANGE_NOTIFY_EVT:
@@ -457,8 +466,6 @@ static void bt_av_hdl_avrc_ct_evt(uint16_t event, void *p_param)
 		else if (rc->meta_rsp.attr_id == ESP_AVRC_MD_ATTR_ARTIST) strncpy(s_metadata.artist, (char*) rc->meta_rsp.attr_text, METADATA_LEN);
 		else if (rc->meta_rsp.attr_id == ESP_AVRC_MD_ATTR_ALBUM) strncpy(s_metadata.album, (char*) rc->meta_rsp.attr_text, METADATA_LEN);
 		update_metadata(true);
-		
-        free(rc->meta_rsp.attr_text);
         break;
     }
     case ESP_AVRC_CT_CHANGE_NOTIFY_EVT: {
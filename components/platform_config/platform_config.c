@@ -27,6 +27,7 @@
 #include <string.h>
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_console.h"
 #include "esp_vfs_dev.h"
 #include "driver/uart.h"
@@ -42,10 +43,29 @@
 
 
 #define CONFIG_COMMIT_DELAY 1000
+#define CONFIG_COMMIT_MAX_DELAY 5000
+#define CONFIG_JOURNAL_SIZE 32
 #define LOCK_MAX_WAIT 20*CONFIG_COMMIT_DELAY
 static const char * TAG = "config";
 static cJSON * nvs_json=NULL;
 static TimerHandle_t timer;
+/* @brief keys changed since last commit. On overflow, all entries are scanned for their chg flag */
+static struct {
+	char keys[CONFIG_JOURNAL_SIZE][NVS_KEY_NAME_MAX_SIZE];
+	int count;
+	bool overflow;
+	TickType_t first;
+} journal;
+static config_commit_stats_t commit_stats;
+/* @brief open addressing hash index of nvs_json entries, so lookups don't walk the
+ * whole cJSON list. When full, lookups fall back to cJSON */
+#define CONFIG_INDEX_SIZE 128
+static struct config_slot_s {
+	uint32_t hash;
+	cJSON * entry;
+} config_index[CONFIG_INDEX_SIZE];
+static int config_index_count;
+static config_access_stats_t access_stats;
 static SemaphoreHandle_t config_mutex = NULL;
 static EventGroupHandle_t config_group;
 /* @brief indicate that the ESP32 is currently connected. */
@@ -60,15 +80,22 @@ cJSON_bool config_is_entry_changed(cJSON * entry);
 bool config_set_group_bit(int bit_num,bool flag);
 cJSON * config_set_value_safe(nvs_type_t nvs_type, const char *key,const void * value);
 static void vCallbackFunction( TimerHandle_t xTimer );
+static void config_journal_add(const char * key);
 void config_set_entry_changed_flag(cJSON * entry, cJSON_bool flag);
+/* @brief entries are only serialized when the log level will display them */
+#define LOG_ENTRY(level, entry, fmt, ...) do { if (LOG_LOCAL_LEVEL >= level) {	\
+		char * entry_str = cJSON_PrintUnformatted(entry);						\
+		ESP_LOG_LEVEL_LOCAL(level, TAG, fmt, ##__VA_ARGS__, str_or_null(entry_str));	\
+		FREE_AND_NULL(entry_str);												\
+	} } while(0)
 #define IMPLEMENT_SET_DEFAULT(t,nt) void config_set_default_## t (const char *key, t  value){\
 	void * pval = malloc(sizeof(value));\
 	*((t *) pval) = value;\
 	config_set_default(nt, key,pval,0);\
 	free(pval); }
 #define IMPLEMENT_GET_NUM(t,nt) esp_err_t config_get_## t (const char *key, t *  value){\
-		void * pval = config_alloc_get(nt, key);\
-		if(pval!=NULL){ *value = *(t * )pval; free(pval); return ESP_OK; }\
+		double dval;\
+		if(config_get_num(nt, key, &dval) == ESP_OK){ *value = (t) dval; return ESP_OK; }\
 		return ESP_FAIL;}
 static void * malloc_fn(size_t sz){
 
@@ -83,6 +110,53 @@ void init_cJSON(){
 	hooks.malloc_fn=&malloc_fn;
 	cJSON_InitHooks(&hooks);
 }
+/* @brief FNV-1a */
+static uint32_t config_hash(const char * key){
+	uint32_t hash = 2166136261u;
+	while(*key) hash = (hash ^ (uint8_t) *key++) * 16777619u;
+	return hash;
+}
+
+static struct config_slot_s * config_index_slot(const char * key, uint32_t hash){
+	uint32_t i = hash;
+	for(int n = 0; n < CONFIG_INDEX_SIZE; n++, i++){
+		struct config_slot_s * slot = config_index + (i & (CONFIG_INDEX_SIZE - 1));
+		access_stats.probes++;
+		if(!slot->entry || (slot->hash == hash && !strcmp(slot->entry->string, key))) return slot;
+	}
+	return NULL;
+}
+
+static void config_index_set(const char * key, cJSON * entry){
+	uint32_t hash = config_hash(key);
+	struct config_slot_s * slot = config_index_slot(key, hash);
+	// keep 1/4 empty so that probing stays short
+	if(!slot || (!slot->entry && config_index_count >= CONFIG_INDEX_SIZE * 3 / 4)){
+		ESP_LOGW(TAG, "Config index full, [%s] will be looked up linearly", key);
+		return;
+	}
+	if(!slot->entry) config_index_count++;
+	slot->hash = hash;
+	slot->entry = entry;
+}
+
+/* @brief deletions are rare, just rebuild the index from nvs_json */
+static void config_index_rebuild(){
+	memset(config_index, 0, sizeof(config_index));
+	config_index_count = 0;
+	for(cJSON * entry = nvs_json ? nvs_json->child : NULL; entry; entry = entry->next){
+		config_index_set(entry->string, entry);
+	}
+}
+
+static cJSON * config_find(const char * key){
+	struct config_slot_s * slot = config_index_slot(key, config_hash(key));
+	access_stats.lookups++;
+	if(slot && slot->entry) return slot->entry;
+	if(config_index_count < CONFIG_INDEX_SIZE * 3 / 4) return NULL;
+	return cJSON_GetObjectItemCaseSensitive(nvs_json, key);
+}
+
 void config_init(){
 	ESP_LOGD(TAG, "Creating mutex for Config");
 	config_mutex = xSemaphoreCreateMutex();
@@ -95,6 +169,7 @@ void config_init(){
 		cJSON_Delete(nvs_json);
 	}
 	nvs_json = cJSON_CreateObject();
+	config_index_rebuild();
 
 	config_set_group_bit(CONFIG_LOAD_BIT,true);
 	nvs_load_config();
@@ -103,12 +178,15 @@ void config_init(){
 }
 
 void config_start_timer(){
-	ESP_LOGD(TAG, "Starting config timer");
+	ESP_LOGD(TAG, "Creating config timer");
+	// one shot, armed by config_journal_add when something changes
 	timer = xTimerCreate("configTimer", CONFIG_COMMIT_DELAY / portTICK_RATE_MS, pdFALSE, NULL, vCallbackFunction);
-    if( xTimerStart( timer , CONFIG_COMMIT_DELAY/ portTICK_RATE_MS ) != pdPASS )    {
-        ESP_LOGE(TAG, "config commitment timer failed to start.");
-    }
-
+	if(timer == NULL){
+		ESP_LOGE(TAG, "config commitment timer failed to create.");
+	}
+	else if(config_has_changes() && xTimerStart( timer , CONFIG_COMMIT_DELAY/ portTICK_RATE_MS ) != pdPASS )    {
+		ESP_LOGE(TAG, "config commitment timer failed to start.");
+	}
 }
 
 nvs_type_t  config_get_item_type(cJSON * entry){
@@ -135,7 +213,7 @@ cJSON * config_set_value_safe(nvs_type_t nvs_type, const char *key,  const void
 		return NULL;
 	}
 
-	cJSON * existing = cJSON_GetObjectItemCaseSensitive(nvs_json, key);
+	cJSON * existing = config_find(key);
 	if(existing !=NULL && nvs_type == NVS_TYPE_STR && config_get_item_type(existing) != NVS_TYPE_STR  ) {
 		ESP_LOGW(TAG, "Storing numeric value from string");
 		numvalue = atof((char *)value);
@@ -177,37 +255,18 @@ cJSON * config_set_value_safe(nvs_type_t nvs_type, const char *key,  const void
 	}
 	if(existing!=NULL ) {
 		ESP_LOGV(TAG, "Changing existing entry [%s].", key);
-		char * exist_str = cJSON_PrintUnformatted(existing);
-		if(exist_str!=NULL){
-			ESP_LOGV(TAG,"Existing entry: %s", exist_str);
-			free(exist_str);
-		}
-		else {
-			ESP_LOGV(TAG,"Failed to print existing entry");
-		}
+		LOG_ENTRY(ESP_LOG_VERBOSE, existing, "Existing entry: %s");
 		// set commit flag as equal so we can compare
 		cJSON_AddBoolToObject(entry,"chg",config_is_entry_changed(existing));
 		if(!cJSON_Compare(entry,existing,false)){
-			char * entry_str = cJSON_PrintUnformatted(entry);
-			if(entry_str!=NULL){
-				ESP_LOGD(TAG,"New config object: \n%s", entry_str );
-				free(entry_str);
-			}
-			else {
-				ESP_LOGD(TAG,"Failed to print entry");
-			}
 			ESP_LOGI(TAG, "Setting changed flag config [%s]", key);
 			config_set_entry_changed_flag(entry,true);
+			config_journal_add(key);
 			ESP_LOGI(TAG, "Updating config [%s]", key);
+			// index first, existing entry is freed when replaced
+			config_index_set(key, entry);
 			cJSON_ReplaceItemInObject(nvs_json,key, entry);
-			entry_str = cJSON_PrintUnformatted(entry);
-			if(entry_str!=NULL){
-				ESP_LOGD(TAG,"New config: %s", entry_str );
-				free(entry_str);
-			}
-			else {
-				ESP_LOGD(TAG,"Failed to print entry");
-			}
+			LOG_ENTRY(ESP_LOG_DEBUG, entry, "New config: %s");
 		}
 		else {
 			ESP_LOGD(TAG, "Config not changed. ");
@@ -218,7 +277,9 @@ cJSON * config_set_value_safe(nvs_type_t nvs_type, const char *key,  const void
 	else {
 		// This is a new entry.
 		config_set_entry_changed_flag(entry,true);
+		config_journal_add(key);
 		cJSON_AddItemToObject(nvs_json, key, entry);
+		config_index_set(key, entry);
 	}
 
 	return entry;
@@ -381,7 +442,107 @@ void * config_safe_alloc_get_entry_value(nvs_type_t nvs_type, cJSON * entry){
 	return value;
 }
 
+/* @brief record key to be committed and (re)arm the commit timer. Bursts of changes
+ * (volume, jack...) are coalesced in a single write, but never delayed more than
+ * CONFIG_COMMIT_MAX_DELAY. Must be called with config locked. */
+static void config_journal_add(const char * key){
+	TickType_t now = xTaskGetTickCount();
+	int i;
+
+	if(xEventGroupGetBits(config_group) & CONFIG_LOAD_BIT) return;
+	if(!journal.count && !journal.overflow) journal.first = now;
+
+	for(i = 0; i < journal.count && strcmp(journal.keys[i], key); i++);
+	if(i < journal.count || journal.overflow){
+		commit_stats.coalesced++;
+	}
+	else if(journal.count < CONFIG_JOURNAL_SIZE){
+		strlcpy(journal.keys[journal.count++], key, NVS_KEY_NAME_MAX_SIZE);
+	}
+	else {
+		ESP_LOGW(TAG, "Config journal full, next commit will scan all entries");
+		journal.overflow = true;
+	}
+
+	if(timer == NULL) return;
+	if(now - journal.first < pdMS_TO_TICKS(CONFIG_COMMIT_MAX_DELAY)) xTimerReset(timer, 0);
+	else if(!xTimerIsTimerActive(timer)) xTimerStart(timer, 0);
+}
+
+/* @brief write one entry using an already opened nvs handle, no commit */
+static esp_err_t config_store_entry(nvs_handle nvs, cJSON * entry){
+	cJSON * value = cJSON_GetObjectItemCaseSensitive(entry, "value");
+	nvs_type_t type = config_get_entry_type(entry);
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	esp_err_t err = ESP_ERR_NVS_TYPE_MISMATCH;
+
+	if(value == NULL || entry->string == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// nvs wants key and string value in DMA capable memory, cJSON is in SPIRAM
+	strlcpy(key, entry->string, sizeof(key));
+
+	switch (type) {
+		case NVS_TYPE_I8:
+			err = nvs_set_i8(nvs, key, (int8_t) value->valuedouble);
+			break;
+		case NVS_TYPE_U8:
+			err = nvs_set_u8(nvs, key, (uint8_t) value->valuedouble);
+			break;
+		case NVS_TYPE_I16:
+			err = nvs_set_i16(nvs, key, (int16_t) value->valuedouble);
+			break;
+		case NVS_TYPE_U16:
+			err = nvs_set_u16(nvs, key, (uint16_t) value->valuedouble);
+			break;
+		case NVS_TYPE_I32:
+			err = nvs_set_i32(nvs, key, (int32_t) value->valuedouble);
+			break;
+		case NVS_TYPE_U32:
+			err = nvs_set_u32(nvs, key, (uint32_t) value->valuedouble);
+			break;
+		case NVS_TYPE_I64:
+			err = nvs_set_i64(nvs, key, (int64_t) value->valuedouble);
+			break;
+		case NVS_TYPE_U64:
+			err = nvs_set_u64(nvs, key, (uint64_t) value->valuedouble);
+			break;
+		case NVS_TYPE_STR:
+			if(cJSON_IsString(value)){
+				char * str = heap_caps_malloc(strlen(value->valuestring) + 1, MALLOC_CAP_DMA);
+				if(str == NULL) return ESP_ERR_NO_MEM;
+				strcpy(str, value->valuestring);
+				err = nvs_set_str(nvs, key, str);
+				free(str);
+			}
+			break;
+		default:
+			break;
+	}
+
+	return err;
+}
+
+static bool config_commit_entry(nvs_handle nvs, cJSON * entry){
+	ESP_LOGD(TAG, "Committing entry %s value to nvs.",str_or_unknown(entry->string));
+	LOG_ENTRY(ESP_LOG_VERBOSE, entry, "config_commit_to_nvs processing item %s");
+	esp_err_t err = config_store_entry(nvs, entry);
+	if(err!=ESP_OK){
+		ESP_LOGE(TAG, "Error comitting value to nvs for key %s: %s",str_or_unknown(entry->string), esp_err_to_name(err));
+		commit_stats.failures++;
+		return false;
+	}
+	config_set_entry_changed_flag(entry, false);
+	commit_stats.writes++;
+	return true;
+}
+
 void config_commit_to_nvs(){
+	nvs_handle nvs;
+	int64_t start = esp_timer_get_time();
+	int count = 0, failed = 0;
+
 	ESP_LOGI(TAG,"Committing configuration to nvs. Locking config object.");
 	if(!config_lock(LOCK_MAX_WAIT/portTICK_PERIOD_MS)){
 		ESP_LOGE(TAG, "config_commit_to_nvs: Unable to lock config for commit ");
@@ -389,67 +550,74 @@ void config_commit_to_nvs(){
 	}
 	if(nvs_json==NULL){
 		ESP_LOGE(TAG, ": cJSON nvs cache object not set.");
+		config_unlock();
+		return;
+	}
+	esp_err_t err = nvs_open_from_partition(settings_partition, current_namespace, NVS_READWRITE, &nvs);
+	if(err != ESP_OK){
+		ESP_LOGE(TAG, "Error opening nvs: %s. Unable to commit configuration.",esp_err_to_name(err));
+		config_unlock();
 		return;
 	}
 	ESP_LOGV(TAG,"config_commit_to_nvs. Config Locked!");
-	cJSON * entry=nvs_json->child;
-	while(entry!= NULL){
-		char * entry_str = cJSON_PrintUnformatted(entry);
-		if(entry_str!=NULL){
-			ESP_LOGV(TAG,"config_commit_to_nvs processing item %s",entry_str);
-			free(entry_str);
-		}
 
-		if(config_is_entry_changed(entry)){
-			ESP_LOGD(TAG, "Committing entry %s value to nvs.",(entry->string==NULL)?"UNKNOWN":entry->string);
-			nvs_type_t type = config_get_entry_type(entry);
-			void * value = config_safe_alloc_get_entry_value(type, entry);
-			if(value!=NULL){
-				size_t len=strlen(entry->string);
-				char * key=(void *)heap_caps_malloc(len+1, MALLOC_CAP_DMA);
-				memset(key,0x00,len+1);
-				memcpy(key,entry->string,len);
-				esp_err_t err = store_nvs_value(type,key,value);
-				free(key);
-				free(value);
-
-				if(err!=ESP_OK){
-					char * entry_str = cJSON_PrintUnformatted(entry);
-					if(entry_str!=NULL){
-						ESP_LOGE(TAG, "Error comitting value to nvs for key %s, Object: \n%s",entry->string,entry_str);
-						free(entry_str);
-					}
-					else {
-						ESP_LOGE(TAG, "Error comitting value to nvs for key %s",entry->string);
-					}
-				}
-				else {
-					config_set_entry_changed_flag(entry, false);
-				}
+	if(journal.overflow){
+		for(cJSON * entry=nvs_json->child; entry!= NULL; entry = entry->next){
+			if(config_is_entry_changed(entry)){
+				if(!config_commit_entry(nvs, entry)) failed++;
+				count++;
 			}
-			else {
-				char * entry_str = cJSON_PrintUnformatted(entry);
-				if(entry_str!=NULL){
-					ESP_LOGE(TAG, "Unable to retrieve value. Error comitting value to nvs for key %s, Object: \n%s",entry->string,entry_str);
-					free(entry_str);
-				}
-				else {
-					ESP_LOGE(TAG, "Unable to retrieve value. Error comitting value to nvs for key %s",entry->string);
+		}
+	}
+	else {
+		// failed keys are moved to the front of the journal to be retried
+		for(int i = 0; i < journal.count; i++){
+			cJSON * entry = config_find(journal.keys[i]);
+			// might have been deleted since
+			if(entry && config_is_entry_changed(entry)){
+				if(!config_commit_entry(nvs, entry)) {
+					if(failed != i) strlcpy(journal.keys[failed], journal.keys[i], NVS_KEY_NAME_MAX_SIZE);
+					failed++;
 				}
+				count++;
 			}
 		}
-		else {
-			ESP_LOGV(TAG,"config_commit_to_nvs. Item already committed.  Ignoring.");
-		}
-		taskYIELD();  /* allows the freeRTOS scheduler to take over if needed. */
-		entry = entry->next;
 	}
-	ESP_LOGV(TAG,"config_commit_to_nvs. Resetting the global commit flag.");
-	config_raise_change(false);
+
+	// all values are written to flash in one go
+	if((err = nvs_commit(nvs)) != ESP_OK){
+		ESP_LOGE(TAG, "Unable to commit nvs: %s",esp_err_to_name(err));
+		commit_stats.failures++;
+	}
+	nvs_close(nvs);
+
+	if(failed){
+		// keep them pending (still flagged as changed when overflowed) and try again later
+		ESP_LOGW(TAG, "%d entries failed, retrying in %d ms", failed, CONFIG_COMMIT_DELAY);
+		if(!journal.overflow) journal.count = failed;
+		journal.first = xTaskGetTickCount();
+		if(timer) xTimerStart(timer, 0);
+	}
+	else {
+		journal.count = 0;
+		journal.overflow = false;
+		ESP_LOGV(TAG,"config_commit_to_nvs. Resetting the global commit flag.");
+		config_raise_change(false);
+	}
 	ESP_LOGV(TAG,"config_commit_to_nvs. Releasing the lock object.");
 	config_unlock();
-	ESP_LOGI(TAG,"Done Committing configuration to nvs.");
+
+	commit_stats.commits++;
+	commit_stats.last_us = esp_timer_get_time() - start;
+	if(commit_stats.last_us > commit_stats.max_us) commit_stats.max_us = commit_stats.last_us;
+	ESP_LOGI(TAG,"Done Committing %d entries to nvs in %u us (commits:%u writes:%u coalesced:%u failures:%u).", count, commit_stats.last_us,
+			commit_stats.commits, commit_stats.writes, commit_stats.coalesced, commit_stats.failures);
+}
+
+void config_get_commit_stats(config_commit_stats_t * stats){
+	*stats = commit_stats;
 }
+
 bool config_has_changes(){
 	return  (xEventGroupGetBits(config_group) & CONFIG_NO_COMMIT_PENDING)==0;
 }
@@ -457,6 +625,12 @@ bool config_has_changes(){
 
 bool wait_for_commit(){
 	bool commit_pending=(xEventGroupGetBits(config_group) & CONFIG_NO_COMMIT_PENDING)==0;
+	// no need to wait for the timer when someone is waiting
+	if(commit_pending){
+		if(timer) xTimerStop(timer, 0);
+		config_commit_to_nvs();
+		commit_pending=(xEventGroupGetBits(config_group) & CONFIG_NO_COMMIT_PENDING)==0;
+	}
 	while (commit_pending){
 		ESP_LOGW(TAG,"Waiting for config commit ...");
 		commit_pending = (xEventGroupWaitBits(config_group, CONFIG_NO_COMMIT_PENDING,pdFALSE, pdTRUE, (CONFIG_COMMIT_DELAY*2) / portTICK_PERIOD_MS) & CONFIG_NO_COMMIT_PENDING)==0;
@@ -488,18 +662,10 @@ void config_unlock() {
 }
 
 static void vCallbackFunction( TimerHandle_t xTimer ) {
-	static int cnt=0;
 	if(config_has_changes()){
 		ESP_LOGI(TAG, "configuration has some uncommitted entries");
 		config_commit_to_nvs();
 	}
-	else{
-		if(++cnt>=15){
-			ESP_LOGV(TAG,"commit timer: commit flag not set");
-			cnt=0;
-		}
-	}
-	xTimerReset( xTimer, 10 );
 }
 void config_raise_change(bool change_found){
 	if(config_set_group_bit(CONFIG_NO_COMMIT_PENDING,!change_found))
@@ -540,7 +706,7 @@ void config_set_default(nvs_type_t type, const char *key, void * default_value,
 	}
 
 	ESP_LOGV(TAG, "Checking if key %s exists in nvs cache for type %s.", key,type_to_str(type));
-	cJSON * entry = cJSON_GetObjectItemCaseSensitive(nvs_json, key);
+	cJSON * entry = config_find(key);
 
 	if(entry !=NULL){
 		ESP_LOGV(TAG, "Entry found.");
@@ -552,11 +718,7 @@ void config_set_default(nvs_type_t type, const char *key, void * default_value,
 		if(entry == NULL){
 			ESP_LOGE(TAG, "Failed to add value to cache!");
 		}
-		char * entry_str = cJSON_PrintUnformatted(entry);
-		if(entry_str!=NULL){
-			ESP_LOGD(TAG, "Value added to default for object: \n%s",entry_str);
-			free(entry_str);
-		}
+		LOG_ENTRY(ESP_LOG_DEBUG, entry, "Value added to default for object: \n%s");
 	}
 
 	config_unlock();
@@ -591,20 +753,13 @@ void config_delete_key(const char *key){
 	else {
 		ESP_LOGE(TAG, "Error opening nvs: %s. Unable to delete nvs key [%s].",esp_err_to_name(err),key);
 	}
-	char * struc_str = cJSON_PrintUnformatted(nvs_json);
-	if(struc_str!=NULL){
-		ESP_LOGV(TAG, "Structure before delete \n%s", struc_str);
-		free(struc_str);
-	}
+	LOG_ENTRY(ESP_LOG_VERBOSE, nvs_json, "Structure before delete \n%s");
 	cJSON * entry = cJSON_DetachItemFromObjectCaseSensitive(nvs_json, key);
 	if(entry !=NULL){
 		ESP_LOGI(TAG, "Removing config key [%s]", entry->string);
 		cJSON_Delete(entry);
-		struc_str = cJSON_PrintUnformatted(nvs_json);
-		if(struc_str!=NULL){
-			ESP_LOGV(TAG, "Structure after delete \n%s", struc_str);
-			free(struc_str);
-		}
+		config_index_rebuild();
+		LOG_ENTRY(ESP_LOG_VERBOSE, nvs_json, "Structure after delete \n%s");
 	}
 	else {
 		ESP_LOGW(TAG, "Unable to remove config key [%s]: not found.", key);
@@ -639,7 +794,8 @@ void * config_alloc_get_default(nvs_type_t nvs_type, const char *key, void * def
 		return value;
 	}
 	ESP_LOGD(TAG,"Getting config entry for key %s",key);
-	cJSON * entry = cJSON_GetObjectItemCaseSensitive(nvs_json, key);
+	int64_t start = esp_timer_get_time();
+	cJSON * entry = config_find(key);
 	if(entry !=NULL){
 		ESP_LOGV(TAG, "Entry found, getting value.");
 		value = config_safe_alloc_get_entry_value(nvs_type, entry);
@@ -652,23 +808,68 @@ void * config_alloc_get_default(nvs_type_t nvs_type, const char *key, void * def
 			ESP_LOGE(TAG, "Failed to add value to cache");
 		}
 		else {
-			char * entry_str = cJSON_PrintUnformatted(entry);
-			if(entry_str!=NULL){
-				ESP_LOGV(TAG, "Value added configuration object for key [%s]: \n%s", entry->string,entry_str);
-				free(entry_str);
-			}
-			else {
-				ESP_LOGV(TAG, "Value added configuration object for key [%s]", entry->string);
-			}
+			LOG_ENTRY(ESP_LOG_VERBOSE, entry, "Value added configuration object for key [%s]: \n%s", entry->string);
 			value = config_safe_alloc_get_entry_value(nvs_type, entry);
 		}
 	}
 	else{
 		ESP_LOGW(TAG,"Value not found for key %s",key);
 	}
+	if(value) access_stats.allocs++;
+	access_stats.us += esp_timer_get_time() - start;
 	config_unlock();
 	return value;
 }
+
+/* @brief copy a string value in caller's buffer, no allocation. Returns ESP_ERR_NOT_FOUND
+ * when key does not exist and ESP_ERR_INVALID_SIZE when value was truncated */
+esp_err_t config_get_str(const char *key, char * value, size_t size){
+	esp_err_t err = ESP_OK;
+	if(nvs_json==NULL || !config_lock(LOCK_MAX_WAIT/portTICK_PERIOD_MS)){
+		ESP_LOGE(TAG, "Unable to lock config");
+		return ESP_FAIL;
+	}
+	int64_t start = esp_timer_get_time();
+	cJSON * item = cJSON_GetObjectItemCaseSensitive(config_find(key), "value");
+	if(!cJSON_IsString(item)){
+		err = item ? ESP_ERR_NVS_TYPE_MISMATCH : ESP_ERR_NOT_FOUND;
+	}
+	else if(strlcpy(value, item->valuestring, size) >= size){
+		err = ESP_ERR_INVALID_SIZE;
+	}
+	access_stats.us += esp_timer_get_time() - start;
+	config_unlock();
+	return err;
+}
+
+/* @brief numeric value, no allocation */
+esp_err_t config_get_num(nvs_type_t nvs_type, const char *key, double * value){
+	esp_err_t err = ESP_ERR_NOT_FOUND;
+	if(nvs_json==NULL || !config_lock(LOCK_MAX_WAIT/portTICK_PERIOD_MS)){
+		ESP_LOGE(TAG, "Unable to lock config");
+		return ESP_FAIL;
+	}
+	int64_t start = esp_timer_get_time();
+	cJSON * entry = config_find(key);
+	cJSON * item = cJSON_GetObjectItemCaseSensitive(entry, "value");
+	if(item){
+		if(config_get_entry_type(entry) != nvs_type || !cJSON_IsNumber(item)){
+			ESP_LOGE(TAG, "Requested value type %s for key %s, found %s instead", type_to_str(nvs_type), key, type_to_str(config_get_entry_type(entry)));
+			err = ESP_ERR_NVS_TYPE_MISMATCH;
+		}
+		else {
+			*value = item->valuedouble;
+			err = ESP_OK;
+		}
+	}
+	access_stats.us += esp_timer_get_time() - start;
+	config_unlock();
+	return err;
+}
+
+void config_get_access_stats(config_access_stats_t * stats){
+	*stats = access_stats;
+}
 char * config_alloc_get_json(bool bFormatted){
 	char * json_buffer = NULL;
 	if(!config_lock(LOCK_MAX_WAIT/portTICK_PERIOD_MS)){
@@ -695,14 +896,7 @@ esp_err_t config_set_value(nvs_type_t nvs_type, const char *key, const void * va
 		result = ESP_FAIL;
 	}
 	else{
-		char * entry_str = cJSON_PrintUnformatted(entry);
-		if(entry_str!=NULL){
-			ESP_LOGV(TAG,"config_set_value result: \n%s",entry_str);
-			free(entry_str);
-		}
-		else {
-			ESP_LOGV(TAG,"config_set_value completed");
-		}
+		LOG_ENTRY(ESP_LOG_VERBOSE, entry, "config_set_value result: \n%s");
 	}
 	config_unlock();
 	return result;
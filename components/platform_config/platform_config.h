@@ -30,8 +30,21 @@ DECLARE_GET_NUM(int8_t);
 DECLARE_GET_NUM(int16_t);
 DECLARE_GET_NUM(int32_t);
 
+typedef struct {
+	uint32_t commits, writes, coalesced, failures;
+	uint32_t last_us, max_us;
+} config_commit_stats_t;
+
+/* @brief config access cost, mainly useful to measure boot */
+typedef struct {
+	uint32_t lookups, probes;
+	uint32_t allocs;
+	uint32_t us;
+} config_access_stats_t;
+
 bool config_has_changes();
 void config_commit_to_nvs();
+void config_get_commit_stats(config_commit_stats_t * stats);
 void config_start_timer();
 void config_init();
 void * config_alloc_get_default(nvs_type_t type, const char *key, void * default_value, size_t blob_size);
@@ -39,6 +52,9 @@ void * config_alloc_get_str(const char *key, char *lead, char *fallback);
 void config_delete_key(const char *key);
 void config_set_default(nvs_type_t type, const char *key, void * default_value, size_t blob_size);
 void * config_alloc_get(nvs_type_t nvs_type, const char *key) ;
+esp_err_t config_get_str(const char *key, char * value, size_t size);
+esp_err_t config_get_num(nvs_type_t nvs_type, const char *key, double * value);
+void config_get_access_stats(config_access_stats_t * stats);
 bool wait_for_commit();
 char * config_alloc_get_json(bool bFormatted);
 esp_err_t config_set_value(nvs_type_t nvs_type, const char *key, const void * value);
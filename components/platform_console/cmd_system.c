@@ -32,6 +32,8 @@
 #include "messaging.h"				  
 #include "platform_console.h"
 #include "trace.h"
+#include "profiler.h"
+#include "esp_timer.h"
 #ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
 #define WITH_TASKS_INFO 1
 #endif
@@ -53,6 +55,15 @@ static struct {
 #endif  
     struct arg_end *end;
 } set_services_args;
+static struct {
+	struct arg_lit *reset;
+	struct arg_str *enable;
+	struct arg_end *end;
+} perf_args;
+static struct {
+	struct arg_int *count;
+	struct arg_end *end;
+} msgbench_args;
 static const char * TAG = "cmd_system";
 
 //static void register_setbtsource();
@@ -68,6 +79,8 @@ static void register_restart_ota();
 static void register_update_certs();
 static void register_set_services();
 static void register_set_wifi_parms();
+static void register_perf();
+static void register_msgbench();
 #if WITH_TASKS_INFO
 static void register_tasks();
 #endif
@@ -87,6 +100,8 @@ void register_system()
     register_update_certs();
     register_factory_boot();
     register_restart_ota();
+    register_perf();
+    register_msgbench();
 #if WITH_TASKS_INFO
     register_tasks();
 #endif
@@ -513,6 +528,91 @@ static void register_update_certs()
 }
 
 
+/** 'perf' command prints audio pipeline profiling information */
+static int perf_info(int argc, char **argv)
+{
+    int nerrors = arg_parse_msg(argc, argv,(struct arg_hdr **)&perf_args);
+    if (nerrors != 0) {
+        return 1;
+    }
+	if(perf_args.enable->count){
+		const char * value = perf_args.enable->sval[0];
+		if(!strcasecmp(value,"on")) profiler_enable(true);
+		else if(!strcasecmp(value,"off")) profiler_enable(false);
+		else {
+			cmd_send_messaging(argv[0],MESSAGING_ERROR,"Invalid value %s, use on or off", value);
+			return 1;
+		}
+	}
+	if(perf_args.reset->count){
+		profiler_reset();
+	}
+	char * table = profiler_alloc_get_table();
+	if(!table){
+		cmd_send_messaging(argv[0],MESSAGING_ERROR,"Unable to allocate profiler table");
+		return 1;
+	}
+	cmd_send_messaging(argv[0],MESSAGING_INFO,"%s",table);
+	free(table);
+	return 0;
+}
+
+static void register_perf()
+{
+	perf_args.reset = arg_lit0("r", "reset", "Reset counters");
+	perf_args.enable = arg_str0("e", "enable", "on|off", "Enable or disable profiling");
+	perf_args.end = arg_end(2);
+	const esp_console_cmd_t cmd = {
+		.command = "perf",
+		.help = "Get audio pipeline profiling information",
+		.hint = NULL,
+		.func = &perf_info,
+		.argtable = &perf_args
+	};
+	ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+/** 'msgbench' posts OTA-like progress messages and reports post rate and heap use */
+static int msgbench(int argc, char **argv)
+{
+	int nerrors = arg_parse_msg(argc, argv,(struct arg_hdr **)&msgbench_args);
+	if (nerrors != 0) {
+		return 1;
+	}
+	int count = msgbench_args.count->count ? msgbench_args.count->ival[0] : 1000;
+	messaging_stats_t before, after;
+	size_t heap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL) + heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+	size_t min_heap = heap;
+
+	messaging_get_stats(&before);
+	int64_t start = esp_timer_get_time();
+	for(int i = 0; i < count; i++){
+		messaging_post_message(MESSAGING_INFO, MESSAGING_CLASS_OTA, "{\"ota_dsc\":\"Downloading firmware\",\"ota_pct\":%d}", i * 100 / count);
+		size_t now = heap_caps_get_free_size(MALLOC_CAP_INTERNAL) + heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+		if(now < min_heap) min_heap = now;
+	}
+	uint32_t elapsed = esp_timer_get_time() - start;
+	messaging_get_stats(&after);
+
+	cmd_send_messaging(argv[0],MESSAGING_INFO,"%d posts in %u us (%u posts/s), max post %u us, heap churn %u bytes, %u messages overwritten",
+			count, elapsed, elapsed ? (uint32_t) (count * 1000000LL / elapsed) : 0, after.max_post_us,
+			heap - min_heap, after.dropped - before.dropped);
+	return 0;
+}
+
+static void register_msgbench()
+{
+	msgbench_args.count = arg_int0("n", "count", "<n>", "Number of messages to post (default 1000)");
+	msgbench_args.end = arg_end(2);
+	const esp_console_cmd_t cmd = {
+		.command = "msgbench",
+		.help = "Benchmark message bus posts",
+		.hint = NULL,
+		.func = &msgbench,
+		.argtable = &msgbench_args
+	};
+	ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
 
 /** 'deep_sleep' command puts the chip into deep sleep mode */
 
@@ -685,15 +785,14 @@ static int do_set_services(int argc, char **argv)
 
 cJSON * configure_wifi_cb(){
 	cJSON * values = cJSON_CreateObject();
-	char * p=NULL;
+	char p[4];
     // disable_ps 
 	// if ((p = config_alloc_get(NVS_TYPE_STR, "disable_ps")) != NULL) {
 	// 	cJSON_AddBoolToObject(values,"disable_power_save",strcmp(p,"1") == 0 || strcasecmp(p,"y") == 0);
 	// 	FREE_AND_NULL(p);
 	// }
-    if ((p = config_alloc_get(NVS_TYPE_STR, "wifi_smode")) != NULL) {
+    if (config_get_str("wifi_smode", p, sizeof(p)) == ESP_OK) {
         cJSON_AddStringToObject(values,"scanmode",strcasecmp(p,"a") == 0 ?"Comprehensive":"Fast");
-        FREE_AND_NULL(p);
 	}
     return values;
 }
@@ -702,16 +801,14 @@ cJSON * configure_wifi_cb(){
 
 cJSON * set_services_cb(){
 	cJSON * values = cJSON_CreateObject();
-	char * p=NULL;
-	if ((p = config_alloc_get(NVS_TYPE_STR, "enable_bt_sink")) != NULL) {
+	char p[4];
+	if (config_get_str("enable_bt_sink", p, sizeof(p)) == ESP_OK) {
 		cJSON_AddBoolToObject(values,"BT_Speaker",strcmp(p,"1") == 0 || strcasecmp(p,"y") == 0);
-		FREE_AND_NULL(p);
 	}
-	if ((p = config_alloc_get(NVS_TYPE_STR, "enable_airplay")) != NULL) {
+	if (config_get_str("enable_airplay", p, sizeof(p)) == ESP_OK) {
 		cJSON_AddBoolToObject(values,"AirPlay",strcmp(p,"1") == 0 || strcasecmp(p,"y") == 0);
-		FREE_AND_NULL(p);
 	}
-	if ((p = config_alloc_get(NVS_TYPE_STR, "telnet_enable")) != NULL) {
+	if (config_get_str("telnet_enable", p, sizeof(p)) == ESP_OK) {
         if(strcasestr("YX",p)!=NULL){
 		    cJSON_AddStringToObject(values,"telnet","Telnet Only");
         }
@@ -721,13 +818,11 @@ cJSON * set_services_cb(){
         else {
             cJSON_AddStringToObject(values,"telnet","Disabled");
         }
-
-		FREE_AND_NULL(p);
 	}
 #if WITH_TASKS_INFO        
-	if((p = config_alloc_get_default(NVS_TYPE_STR, "stats", "n", 0))!=NULL){
-		cJSON_AddBoolToObject(values,"stats",(*p == '1' || *p == 'Y' || *p == 'y')) ;
-	}
+	strcpy(p, "n");
+	config_get_str("stats", p, sizeof(p));
+	cJSON_AddBoolToObject(values,"stats",(*p == '1' || *p == 'Y' || *p == 'y')) ;
 #endif
 	return values;
 }
@@ -50,12 +50,15 @@
 #include <openssl/aes.h>
 #include "alac_wrapper.h"
 #define MSG_DONTWAIT 0
+#define PROFILE_START(m)
+#define PROFILE_STOP(stage, m)
 #else
 #include "esp_pthread.h"
 #include "esp_system.h"
 #include <mbedtls/version.h>
 #include <mbedtls/aes.h>
 #include "alac_wrapper.h"
+#include "profiler.h"
 #endif
 
 #define NTP2MS(ntp) ((((ntp) >> 10) * 1000L) >> 22)
@@ -489,7 +492,9 @@ static void buffer_put_packet(rtp_t *ctx, seq_t seqno, unsigned rtptime, bool fi
 	}
 
 	if (abuf) {
+		PROFILE_START(mark);
 		alac_decode(ctx, abuf->data, data, len, &abuf->len);
+		PROFILE_STOP(PROF_RTP_DECODE, mark);
 		abuf->ready = 1;
 		// this is the local rtptime when this frame is expected to play
 		abuf->rtptime = rtptime;
@@ -816,8 +816,8 @@ cJSON * get_gpio_list() {
 	}
 	gpio_list = cJSON_CreateArray();	
 #ifndef CONFIG_BAT_LOCKED
-	char *bat_config = config_alloc_get_default(NVS_TYPE_STR, "bat_config", NULL, 0);
-	if (bat_config) {
+	char bat_config[64];
+	if (config_get_str("bat_config", bat_config, sizeof(bat_config)) == ESP_OK) {
 		char *p;
 		int channel;
 		if ((p = strcasestr(bat_config, "channel") ) != NULL) {
@@ -828,7 +828,6 @@ cJSON * get_gpio_list() {
 				}
 			}
 		}
-		free(bat_config);
 	}
 #else
 		if(adc1_pad_get_io_num(CONFIG_BAT_CHANNEL,&gpio_num )==ESP_OK){
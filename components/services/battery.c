@@ -75,15 +75,14 @@ void battery_svc_init(void) {
 	battery.scale = atof(CONFIG_BAT_SCALE);
 #endif	
 
-	char *nvs_item = config_alloc_get_default(NVS_TYPE_STR, "bat_config", "n", 0);
-	if (nvs_item) {
+	char nvs_item[64];
+	if (config_get_str("bat_config", nvs_item, sizeof(nvs_item)) == ESP_OK) {
 		char *p;		
 #ifndef CONFIG_BAT_LOCKED		
 		if ((p = strcasestr(nvs_item, "channel")) != NULL) battery.channel = atoi(strchr(p, '=') + 1);
 		if ((p = strcasestr(nvs_item, "scale")) != NULL) battery.scale = atof(strchr(p, '=') + 1);
 #endif		
 		if ((p = strcasestr(nvs_item, "cells")) != NULL) battery.cells = atof(strchr(p, '=') + 1);		
-		free(nvs_item);
 	}	
 
 	if (battery.channel != -1) {
@@ -34,6 +34,8 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_pm.h"
+#include "esp_timer.h"
+#include "i2s_clock.h"
 
 static const char* I2S_TAG = "I2S";
 
@@ -90,6 +92,16 @@ typedef struct {
     bool tx_desc_auto_clear;    /*!< I2S auto clear tx descriptor on underflow */
     int fixed_mclk;             /*!< I2S fixed MLCK clock */
     double real_rate;
+    bool tx_running;            /*!< TX DMA is running */
+    uint32_t tx_played;         /*!< TX frames consumed by DMA, updated on each out_eof */
+    int64_t tx_eof_time;        /*!< time of last out_eof (or of start) in us */
+    uint32_t tx_underruns;      /*!< out_eof with nothing written after it, descriptor is replayed (or cleared) */
+    uint32_t apll_sdm;          /*!< APLL sdm2:sdm1:sdm0 at nominal rate, 0 when APLL can't be trimmed */
+    uint32_t apll_trim;         /*!< APLL sdm currently set */
+    int apll_odir;
+    int apll_fi2s;              /*!< APLL frequency requested, 0 when not on APLL */
+    double apll_rate;           /*!< APLL frequency obtained */
+    int clock_master;           /*!< port whose APLL clocks this one (see i2s_share_clock), -1 if none */
 #ifdef CONFIG_PM_ENABLE
     esp_pm_lock_handle_t pm_lock;
 #endif
@@ -297,6 +309,18 @@ static esp_err_t i2s_apll_calculate_fi2s(int rate, int bits_per_sample, int *sdm
 	else return ESP_ERR_INVALID_ARG;
  }
 
+/**
+ * @brief     Bit clock divider to get rate from the APLL set by another port (BCK_M is 2..63), 0 if none
+ */
+static int i2s_apll_divider(const i2s_obj_t *p_master, uint32_t rate, int bits, int channel)
+{
+    int m = p_master->apll_fi2s / (rate * channel * bits);
+    if (!p_master->apll_fi2s || p_master->apll_fi2s % (rate * channel * bits) || m < 2 || m > 63) {
+        return 0;
+    }
+    return m;
+}
+
 esp_err_t i2s_set_clk(i2s_port_t i2s_num, uint32_t rate, i2s_bits_per_sample_t bits, i2s_channel_t ch)
 {
     int factor = (256%bits)? 384 : 256; // According to hardware codec requirement(supported 256fs or 384fs)
@@ -451,9 +475,37 @@ esp_err_t i2s_set_clk(i2s_port_t i2s_num, uint32_t rate, i2s_bits_per_sample_t b
         fi2s_clk = p_i2s_obj[i2s_num]->fixed_mclk;
         m_scale = fi2s_clk/bits/rate/channel;
     }
-    if(p_i2s_obj[i2s_num]->use_apll && i2s_apll_calculate_fi2s(fi2s_clk, bits, &sdm0, &sdm1, &sdm2, &odir) == ESP_OK) {
+
+    // there is only one APLL, so a port sharing it can only divide it down
+    i2s_obj_t *p_master = p_i2s_obj[i2s_num]->clock_master >= 0 ? p_i2s_obj[p_i2s_obj[i2s_num]->clock_master] : NULL;
+    if (p_master && !i2s_apll_divider(p_master, rate, bits, channel)) {
+        ESP_LOGE(I2S_TAG, "can't divide APLL of I2S%d for rate %u, bits %u", p_i2s_obj[i2s_num]->clock_master, rate, bits);
+        p_master = NULL;
+    }
+
+    if (p_master) {
+        m_scale = i2s_apll_divider(p_master, rate, bits, channel);
+        p_i2s_obj[i2s_num]->apll_sdm = 0;
+        p_i2s_obj[i2s_num]->apll_fi2s = 0;
+        I2S[i2s_num]->clkm_conf.clkm_div_num = 1;
+        I2S[i2s_num]->clkm_conf.clkm_div_b = 0;
+        I2S[i2s_num]->clkm_conf.clkm_div_a = 1;
+        I2S[i2s_num]->sample_rate_conf.tx_bck_div_num = m_scale;
+        I2S[i2s_num]->sample_rate_conf.rx_bck_div_num = m_scale;
+        I2S[i2s_num]->clkm_conf.clka_en = 1;
+        p_i2s_obj[i2s_num]->real_rate = p_master->apll_rate/bits/channel/m_scale;
+        ESP_LOGI(I2S_TAG, "APLL of I2S%d: Req RATE: %d, real rate: %0.3f, BITS: %u, BCK_M: %u",
+            p_i2s_obj[i2s_num]->clock_master, rate, p_i2s_obj[i2s_num]->real_rate, bits, m_scale);
+    } else if(p_i2s_obj[i2s_num]->use_apll && i2s_apll_calculate_fi2s(fi2s_clk, bits, &sdm0, &sdm1, &sdm2, &odir) == ESP_OK) {
         ESP_LOGD(I2S_TAG, "sdm0=%d, sdm1=%d, sdm2=%d, odir=%d", sdm0, sdm1, sdm2, odir);
         rtc_clk_apll_enable(1, sdm0, sdm1, sdm2, odir);
+        // rev0 ignores sdm0 and sdm1, steps are too large for trimming
+        if (GET_PERI_REG_BITS2(EFUSE_BLK0_RDATA3_REG, 1, 15) != 0) {
+            p_i2s_obj[i2s_num]->apll_trim = p_i2s_obj[i2s_num]->apll_sdm = (sdm2 << 16) | (sdm1 << 8) | sdm0;
+            p_i2s_obj[i2s_num]->apll_odir = odir;
+        } else {
+            p_i2s_obj[i2s_num]->apll_sdm = 0;
+        }
         I2S[i2s_num]->clkm_conf.clkm_div_num = 1;
         I2S[i2s_num]->clkm_conf.clkm_div_b = 0;
         I2S[i2s_num]->clkm_conf.clkm_div_a = 1;
@@ -461,10 +513,14 @@ esp_err_t i2s_set_clk(i2s_port_t i2s_num, uint32_t rate, i2s_bits_per_sample_t b
         I2S[i2s_num]->sample_rate_conf.rx_bck_div_num = m_scale;
         I2S[i2s_num]->clkm_conf.clka_en = 1;
         double fi2s_rate = i2s_apll_get_fi2s(bits, sdm0, sdm1, sdm2, odir);
+        p_i2s_obj[i2s_num]->apll_fi2s = fi2s_clk;
+        p_i2s_obj[i2s_num]->apll_rate = fi2s_rate;
         p_i2s_obj[i2s_num]->real_rate = fi2s_rate/bits/channel/m_scale;
         ESP_LOGI(I2S_TAG, "APLL: Req RATE: %d, real rate: %0.3f, BITS: %u, CLKM: %u, BCK_M: %u, MCLK: %0.3f, SCLK: %f, diva: %d, divb: %d",
             rate, fi2s_rate/bits/channel/m_scale, bits, 1, m_scale, fi2s_rate, fi2s_rate/8, 1, 0);
     } else {
+        p_i2s_obj[i2s_num]->apll_sdm = 0;
+        p_i2s_obj[i2s_num]->apll_fi2s = 0;
         I2S[i2s_num]->clkm_conf.clka_en = 0;
         I2S[i2s_num]->clkm_conf.clkm_div_a = 63;
         I2S[i2s_num]->clkm_conf.clkm_div_b = clkmDecimals;
@@ -515,10 +571,15 @@ static void IRAM_ATTR i2s_intr_handler_default(void *arg)
     }
 
     if (i2s_reg->int_st.out_eof && p_i2s->tx) {
+        // clock and queue must be seen consistent by i2s_get_clock
+        I2S_ENTER_CRITICAL_ISR();
+        p_i2s->tx_eof_time = esp_timer_get_time();
+        p_i2s->tx_played += p_i2s->dma_buf_len;
         finish_desc = (lldesc_t*) i2s_reg->out_eof_des_addr;
         // All buffers are empty. This means we have an underflow on our hands.
         if (xQueueIsQueueFullFromISR(p_i2s->tx->queue)) {
             xQueueReceiveFromISR(p_i2s->tx->queue, &dummy, &high_priority_task_awoken);
+            p_i2s->tx_underruns++;
             // See if tx descriptor needs to be auto cleared:
             // This will avoid any kind of noise that may get introduced due to transmission
             // of previous data from tx descriptor on I2S line.
@@ -534,6 +595,7 @@ static void IRAM_ATTR i2s_intr_handler_default(void *arg)
             }
             xQueueSendFromISR(p_i2s->i2s_queue, (void * )&i2s_event, &high_priority_task_awoken);
         }
+        I2S_EXIT_CRITICAL_ISR();
     }
 
     if (i2s_reg->int_st.in_suc_eof && p_i2s->rx) {
@@ -676,6 +738,8 @@ esp_err_t i2s_start(i2s_port_t i2s_num)
         i2s_enable_tx_intr(i2s_num);
         I2S[i2s_num]->out_link.start = 1;
         I2S[i2s_num]->conf.tx_start = 1;
+        p_i2s_obj[i2s_num]->tx_eof_time = esp_timer_get_time();
+        p_i2s_obj[i2s_num]->tx_running = true;
     }
     if (p_i2s_obj[i2s_num]->mode & I2S_MODE_RX) {
         i2s_enable_rx_intr(i2s_num);
@@ -696,6 +760,7 @@ esp_err_t i2s_stop(i2s_port_t i2s_num)
         I2S[i2s_num]->out_link.stop = 1;
         I2S[i2s_num]->conf.tx_start = 0;
         i2s_disable_tx_intr(i2s_num);
+        p_i2s_obj[i2s_num]->tx_running = false;
     }
     if (p_i2s_obj[i2s_num]->mode & I2S_MODE_RX) {
         I2S[i2s_num]->in_link.stop = 1;
@@ -707,6 +772,118 @@ esp_err_t i2s_stop(i2s_port_t i2s_num)
     return ESP_OK;
 }
 
+bool i2s_get_clock(int i2s_num, i2s_clock_t *clock)
+{
+    if (i2s_num >= I2S_NUM_MAX || !p_i2s_obj[i2s_num] || !p_i2s_obj[i2s_num]->tx) {
+        return false;
+    }
+    i2s_obj_t *p_i2s = p_i2s_obj[i2s_num];
+    int frame_size = p_i2s->tx->buf_size / p_i2s->dma_buf_len;
+    int owned;
+
+    I2S_ENTER_CRITICAL();
+    // descriptors not given back by DMA yet (including the one being played) are ahead of the write buffer
+    owned = p_i2s->dma_buf_count - uxQueueMessagesWaitingFromISR(p_i2s->tx->queue) - (p_i2s->tx->curr_ptr ? 1 : 0);
+    clock->played = p_i2s->tx_played;
+    clock->time = p_i2s->tx_eof_time;
+    clock->underruns = p_i2s->tx_underruns;
+    I2S_EXIT_CRITICAL();
+
+    // writer is the caller, so write position can't move
+    clock->queued = owned * p_i2s->dma_buf_len + (p_i2s->tx->curr_ptr ? p_i2s->tx->rw_pos / frame_size : 0);
+    clock->desc_frames = p_i2s->dma_buf_len;
+    clock->rate = p_i2s->sample_rate;
+    return p_i2s->tx_running;
+}
+
+bool i2s_trim_clock(int i2s_num, int32_t ppm)
+{
+    if (i2s_num >= I2S_NUM_MAX || !p_i2s_obj[i2s_num] || !p_i2s_obj[i2s_num]->apll_sdm) {
+        return false;
+    }
+    i2s_obj_t *p_i2s = p_i2s_obj[i2s_num];
+    // APLL is xtal * (4 + sdm / 65536), so one sdm step is about 1.5 ppm
+    int64_t sdm = p_i2s->apll_sdm + ((int64_t) (p_i2s->apll_sdm + (4 << 16)) * ppm) / 1000000;
+    if (sdm < 0) {
+        sdm = 0;
+    } else if (sdm > 0x3fffff) {
+        sdm = 0x3fffff;
+    }
+    if (sdm != p_i2s->apll_trim) {
+        rtc_clk_apll_enable(1, sdm & 0xff, (sdm >> 8) & 0xff, sdm >> 16, p_i2s->apll_odir);
+        p_i2s->apll_trim = sdm;
+    }
+    return true;
+}
+
+bool i2s_share_clock(int i2s_num, int master)
+{
+    if (i2s_num >= I2S_NUM_MAX || master >= I2S_NUM_MAX || i2s_num == master || !p_i2s_obj[i2s_num] || !p_i2s_obj[master] ||
+        !i2s_apll_divider(p_i2s_obj[master], p_i2s_obj[i2s_num]->sample_rate, p_i2s_obj[i2s_num]->bits_per_sample, p_i2s_obj[i2s_num]->channel_num)) {
+        return false;
+    }
+    p_i2s_obj[i2s_num]->clock_master = master;
+    return i2s_set_clk(i2s_num, p_i2s_obj[i2s_num]->sample_rate, p_i2s_obj[i2s_num]->bits_per_sample,
+                       p_i2s_obj[i2s_num]->channel_num) == ESP_OK;
+}
+
+esp_err_t i2s_set_dma_geometry(int i2s_num, int dma_buf_count, int dma_buf_len)
+{
+    I2S_CHECK((i2s_num < I2S_NUM_MAX), "i2s_num error", ESP_ERR_INVALID_ARG);
+    I2S_CHECK((p_i2s_obj[i2s_num] && p_i2s_obj[i2s_num]->tx && !p_i2s_obj[i2s_num]->rx), "tx only", ESP_ERR_INVALID_STATE);
+    I2S_CHECK((dma_buf_count >= 2 && dma_buf_count <= 128), "I2S buffer count less than 128 and more than 2", ESP_ERR_INVALID_ARG);
+    I2S_CHECK((dma_buf_len >= 8 && dma_buf_len <= 1024), "I2S buffer length at most 1024 and more than 8", ESP_ERR_INVALID_ARG);
+
+    i2s_obj_t *p_i2s = p_i2s_obj[i2s_num];
+    int old_count = p_i2s->dma_buf_count, old_len = p_i2s->dma_buf_len;
+    i2s_dma_t *tx;
+
+    if (dma_buf_len * p_i2s->bytes_per_sample * p_i2s->channel_num > 4092) {
+        ESP_LOGE(I2S_TAG, "DMA buffer of %d frames is larger than 4092 bytes", dma_buf_len);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (dma_buf_count == old_count && dma_buf_len == old_len) {
+        return ESP_OK;
+    }
+
+    // caller is the writer and restarts (i2s_set_clk or i2s_start), mux goes with the old queue
+    xSemaphoreTake(p_i2s->tx->mux, (portTickType)portMAX_DELAY);
+    i2s_stop(i2s_num);
+
+    // destroy walks dma_buf_count descriptors, so it must match the queue being created or destroyed
+    p_i2s->dma_buf_count = dma_buf_count;
+    tx = i2s_create_dma_queue(i2s_num, dma_buf_count, dma_buf_len);
+    p_i2s->dma_buf_count = old_count;
+    // mutex is deleted with its queue, give it back first so that we don't stay its holder
+    xSemaphoreGive(p_i2s->tx->mux);
+    i2s_destroy_dma_queue(i2s_num, p_i2s->tx);
+    p_i2s->tx = NULL;
+
+    // there was no room for both, try again now that the old queue is gone
+    if (tx == NULL) {
+        p_i2s->dma_buf_count = dma_buf_count;
+        tx = i2s_create_dma_queue(i2s_num, dma_buf_count, dma_buf_len);
+    }
+
+    if (tx == NULL) {
+        ESP_LOGE(I2S_TAG, "Failed to create tx dma buffer of %dx%d, back to %dx%d", dma_buf_count, dma_buf_len, old_count, old_len);
+        p_i2s->dma_buf_count = old_count;
+        p_i2s->tx = i2s_create_dma_queue(i2s_num, old_count, old_len);
+        if (p_i2s->tx == NULL) {
+            ESP_LOGE(I2S_TAG, "Failed to re-create tx dma buffer, uninstalling driver");
+            i2s_driver_uninstall(i2s_num);
+            return ESP_FAIL;
+        }
+        I2S[i2s_num]->out_link.addr = (uint32_t) p_i2s->tx->desc[0];
+        return ESP_ERR_NO_MEM;
+    }
+
+    p_i2s->dma_buf_len = dma_buf_len;
+    p_i2s->tx = tx;
+    I2S[i2s_num]->out_link.addr = (uint32_t) p_i2s->tx->desc[0];
+    return ESP_OK;
+}
+
 esp_err_t i2s_set_dac_mode(i2s_dac_mode_t dac_mode)
 {
     I2S_CHECK((dac_mode < I2S_DAC_CHANNEL_MAX), "i2s dac mode error", ESP_ERR_INVALID_ARG);
@@ -1059,6 +1236,7 @@ esp_err_t i2s_driver_install(i2s_port_t i2s_num, const i2s_config_t *i2s_config,
         memset(p_i2s_obj[i2s_num], 0, sizeof(i2s_obj_t));
 
         p_i2s_obj[i2s_num]->i2s_num = i2s_num;
+        p_i2s_obj[i2s_num]->clock_master = -1;
         p_i2s_obj[i2s_num]->dma_buf_count = i2s_config->dma_buf_count;
         p_i2s_obj[i2s_num]->dma_buf_len = i2s_config->dma_buf_len;
         p_i2s_obj[i2s_num]->i2s_queue = i2s_queue;
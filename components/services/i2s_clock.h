@@ -0,0 +1,81 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ I2S playback clock. The TX interrupt timestamps every DMA descriptor it
+ completes (out_eof) and counts the frames consumed, so the position of the
+ play head is known exactly at each EOF and interpolated in between, but
+ never beyond the next EOF. Frames are DMA frames (one slot per channel at the
+ I2S sample rate), callers convert to audio frames when these differ (SPDIF).
+ Estimators are plain functions of a snapshot, so they can be tested on host.
+*/
+
+typedef struct {
+	uint32_t played;	// frames consumed at last EOF (wraps)
+	int64_t time;		// µs timestamp of last EOF (or of start)
+	uint32_t queued;	// frames between play head at last EOF and write position
+	uint32_t desc_frames;
+	uint32_t rate;
+	uint32_t underruns;	// EOF with nothing written, since install (wraps)
+} i2s_clock_t;
+
+/*
+ @brief snapshot of TX clock, must be called from the task that writes to I2S
+ @return false if TX is not running
+*/
+bool i2s_get_clock(int i2s_num, i2s_clock_t *clock);
+
+/*
+ @brief set clock at nominal rate + ppm by trimming the APLL, back to nominal at
+ each rate change
+ @return false if APLL is not used (or can't be trimmed)
+*/
+bool i2s_trim_clock(int i2s_num, int32_t ppm);
+
+/*
+ @brief clock i2s_num by dividing the APLL set by master, as there is only one.
+ Master's rate must be set first, then this port's rate is set again at each
+ change. Trimming master trims both
+ @return false if master is not on APLL or can't be divided to this rate
+*/
+bool i2s_share_clock(int i2s_num, int master);
+
+/*
+ @brief rebuild TX DMA queue with count descriptors of len (DMA) frames, without
+ re-installing driver. Port is stopped and buffers are lost, so it must be
+ called by the writer, before setting rate or restarting
+ @return ESP_ERR_NO_MEM if it can't be allocated, previous geometry is then kept,
+ ESP_FAIL if even that can't be re-allocated, driver is then uninstalled
+*/
+esp_err_t i2s_set_dma_geometry(int i2s_num, int count, int len);
+
+/* @brief frames consumed from the current descriptor at time now */
+static inline uint32_t i2s_clock_elapsed(const i2s_clock_t *clock, int64_t now) {
+	if (now <= clock->time) return 0;
+	uint64_t frames = (uint64_t) (now - clock->time) * clock->rate / 1000000;
+	return frames < clock->desc_frames ? frames : clock->desc_frames;
+}
+
+/* @brief frames played at time now */
+static inline uint32_t i2s_clock_played(const i2s_clock_t *clock, int64_t now) {
+	return clock->played + i2s_clock_elapsed(clock, now);
+}
+
+/* @brief frames still to be played at time now before what is written next */
+static inline uint32_t i2s_clock_pending(const i2s_clock_t *clock, int64_t now) {
+	uint32_t elapsed = i2s_clock_elapsed(clock, now);
+	return clock->queued > elapsed ? clock->queued - elapsed : 0;
+}
@@ -0,0 +1,200 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "log_ring.h"
+
+#define LOG_RING_SIZE	4096		// per core, power of 2
+#define LOG_LINE_MAX	256			// including the terminating zero
+#define LOG_DRAIN_MS	20
+#define LOG_READY		0x80000000
+#define LOG_TRUNCATED	0x40000000
+#define LOG_PAD			0x20000000	// skips the end of the ring, records don't wrap
+#define LOG_LEN_MASK	0x0000ffff
+#define LOG_HEADER		8			// sequence and length|flags, records are 8 bytes aligned
+
+static const char TAG[] = "log_ring";
+
+static struct log_ring_s {
+	volatile uint32_t head, tail;
+	uint8_t *buf;
+} rings[portNUM_PROCESSORS];
+
+static volatile uint32_t sequence;
+static bool running;
+static log_ring_stats_t stats;
+
+/****************************************************************************************
+ * Can be called from any task, never blocks
+ */
+int log_ring_vprintf(const char *fmt, va_list args) {
+	uint32_t head, need, pad, flags = LOG_READY;
+	va_list copy;
+
+	// same as before the ring (logprint used stderr)
+	if (!running) {
+		int len = vfprintf(stderr, fmt, args);
+		fflush(stderr);
+		return len;
+	}
+
+	int64_t start = esp_timer_get_time();
+
+	// only size the line here, it is formatted in its slot so that callers' stack is spared
+	va_copy(copy, args);
+	int len = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+
+	if (len < 0) return len;
+	if (len >= LOG_LINE_MAX) {
+		len = LOG_LINE_MAX - 1;
+		flags |= LOG_TRUNCATED;
+		__sync_fetch_and_add(&stats.truncated, 1);
+	}
+
+	// the core is just to avoid contention, a task that moved meanwhile is still safe
+	struct log_ring_s *ring = rings + xPortGetCoreID();
+	need = LOG_HEADER + ((len + 1 + 7) & ~7);
+
+	do {
+		head = ring->head;
+		// vsnprintf needs a contiguous slot, so skip what's left at the end of the ring
+		pad = LOG_RING_SIZE - (head & (LOG_RING_SIZE - 1));
+		if (pad >= need) pad = 0;
+		if (head + pad + need - ring->tail > LOG_RING_SIZE) {
+			__sync_fetch_and_add(&stats.dropped, 1);
+			return len;
+		}
+	} while (!__sync_bool_compare_and_swap(&ring->head, head, head + pad + need));
+
+	uint32_t seq = __sync_fetch_and_add(&sequence, 1);
+	uint32_t *header = (uint32_t*) (ring->buf + (head & (LOG_RING_SIZE - 1)));
+
+	if (pad) {
+		header[0] = seq;
+		__sync_synchronize();
+		header[1] = (pad - LOG_HEADER) | LOG_PAD | LOG_READY;
+		header = (uint32_t*) ring->buf;
+	}
+
+	vsnprintf((char*) (header + 2), len + 1, fmt, args);
+	header[0] = seq;
+	__sync_synchronize();
+	header[1] = len | flags;
+
+	uint32_t us = esp_timer_get_time() - start;
+	if (us > stats.max_us) stats.max_us = us;
+	__sync_fetch_and_add(&stats.lines, 1);
+
+	return len;
+}
+
+/****************************************************************************************
+ * Oldest ready record of all rings
+ */
+static struct log_ring_s *log_ring_oldest(void) {
+	struct log_ring_s *oldest = NULL;
+	uint32_t oldest_seq = 0;
+
+	for (int i = 0; i < portNUM_PROCESSORS; i++) {
+		struct log_ring_s *ring = rings + i;
+		if (ring->tail == ring->head) continue;
+
+		uint32_t *header = (uint32_t*) (ring->buf + (ring->tail & (LOG_RING_SIZE - 1)));
+		// writer still busy
+		if (!(header[1] & LOG_READY)) continue;
+		if (!oldest || (int32_t) (header[0] - oldest_seq) < 0) {
+			oldest = ring;
+			oldest_seq = header[0];
+		}
+	}
+
+	return oldest;
+}
+
+/****************************************************************************************
+ *
+ */
+static void log_ring_task(void *arg) {
+	while (1) {
+		struct log_ring_s *ring;
+		bool written = false;
+
+		while ((ring = log_ring_oldest()) != NULL) {
+			uint32_t *header = (uint32_t*) (ring->buf + (ring->tail & (LOG_RING_SIZE - 1)));
+			size_t len = header[1] & LOG_LEN_MASK;
+			uint32_t size = LOG_HEADER + ((len + 1 + 7) & ~7);
+
+			if (header[1] & LOG_PAD) {
+				size = LOG_HEADER + len;
+			} else {
+				fwrite(header + 2, 1, len, stdout);
+				if (header[1] & LOG_TRUNCATED) fputs(" [...]\n", stdout);
+				written = true;
+			}
+
+			// writers reserve space before they write a header, so it must not look ready
+			memset(header, 0, size);
+			__sync_synchronize();
+			ring->tail += size;
+		}
+
+		if (written) fflush(stdout);
+		vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+	}
+}
+
+/****************************************************************************************
+ *
+ */
+void log_ring_get_stats(log_ring_stats_t *p) {
+	*p = stats;
+}
+
+/****************************************************************************************
+ *
+ */
+static void log_ring_free(void) {
+	for (int i = 0; i < portNUM_PROCESSORS; i++) {
+		free(rings[i].buf);
+		rings[i].buf = NULL;
+	}
+}
+
+/****************************************************************************************
+ *
+ */
+void log_ring_init(void) {
+	for (int i = 0; i < portNUM_PROCESSORS; i++) {
+		rings[i].buf = heap_caps_calloc(1, LOG_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+		if (!rings[i].buf) {
+			ESP_LOGE(TAG, "can't allocate log ring, logging stays direct");
+			log_ring_free();
+			return;
+		}
+	}
+
+	if (xTaskCreate(log_ring_task, "log_ring", 3 * 1024, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "can't start log drain task, logging stays direct");
+		log_ring_free();
+		return;
+	}
+
+	running = true;
+	esp_log_set_vprintf(log_ring_vprintf);
+	ESP_LOGI(TAG, "log ring started (%u bytes per core)", LOG_RING_SIZE);
+}
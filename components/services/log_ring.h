@@ -0,0 +1,32 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdarg.h>
+
+/*
+ Log sink that never blocks the caller. Lines are sized, then formatted in
+ a slot of a per-core ring (string formatting takes no stdio lock) where space
+ is reserved with a compare-and-swap, so callers don't need a line buffer on
+ their stack. A low priority task drains rings in sequence order to stdout,
+ which telnet and/or UART redirection take from there. When rings are full,
+ lines are dropped and counted. Lines over 255 bytes are cut and marked.
+*/
+
+typedef struct {
+	uint32_t lines, dropped, truncated;
+	uint32_t max_us;
+} log_ring_stats_t;
+
+void log_ring_init(void);
+int  log_ring_vprintf(const char *fmt, va_list args);
+void log_ring_get_stats(log_ring_stats_t *stats);
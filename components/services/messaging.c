@@ -10,6 +10,8 @@
 #include <string.h>
 #include "esp_app_trace.h"
 #include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
 #include "config.h"
 #include "nvs_utilities.h"
 #include "platform_esp32.h"
@@ -19,15 +21,40 @@
  * Globals
  */
 
+/*
+ All messages are posted once in a broadcast ring of fixed size slots, a message
+ longer than a slot uses consecutive slots and never wraps (the end of the ring
+ is skipped instead). Each subscriber only has a cursor (sequence and slot) so
+ nothing is copied on post, and a subscriber that is lapped restarts from the
+ oldest message still in the ring. A new subscriber catches up from the oldest
+ message. Text is formatted in place and JSON is only created when a subscriber
+ retrieves messages, i.e. at the HTTP edge.
+*/
+
+#define MSG_SLOT_SIZE 256
+#define MSG_SLOTS 64
+#define MSG_MAX_SPAN (MSG_SLOTS / 2)
+#define MSG_LOCK_WAIT pdMS_TO_TICKS(50)
+
 const static char tag[] = "messaging";
 typedef struct {
 	struct messaging_list_t * next;
 	char * subscriber_name;
 	size_t max_count;
-	RingbufHandle_t buf_handle;
+	uint32_t seq, slot;
+	uint32_t dropped;
 } messaging_list_t;
 static messaging_list_t top;
-#define MSG_LENGTH_AVG 1024
+
+static struct {
+	SemaphoreHandle_t mutex;
+	single_message_t slots[MSG_SLOTS];
+	char * text;
+	uint32_t head, next_seq;		// where and what to write next
+	uint32_t oldest, oldest_seq;	// first slot/sequence still in the ring
+	uint32_t used;					// slots used between oldest and head, including skipped ones
+	messaging_stats_t stats;
+} bus;
 
 messaging_list_t * get_struct_ptr(messaging_handle_t handle){
 	return (messaging_list_t *)handle;
@@ -36,41 +63,21 @@ messaging_handle_t  get_handle_ptr(messaging_list_t * handle){
 	return (messaging_handle_t )handle;
 }
 
-RingbufHandle_t messaging_create_ring_buffer(uint8_t max_count){
-	RingbufHandle_t buf_handle = NULL;
-	StaticRingbuffer_t *buffer_struct = malloc(sizeof(StaticRingbuffer_t));
-	if (buffer_struct != NULL) {
-		size_t buf_size = (size_t )(sizeof(single_message_t)+8+MSG_LENGTH_AVG)*(size_t )(max_count>0?max_count:5); // no-split buffer requires an additional 8 bytes
-		buf_size = buf_size - (buf_size % 4);
-		uint8_t *buffer_storage = (uint8_t *)heap_caps_malloc(buf_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_32BIT);
-		if (buffer_storage== NULL) {
-			ESP_LOGE(tag,"buff alloc failed");
-		}
-		else {
-			buf_handle = xRingbufferCreateStatic(buf_size, RINGBUF_TYPE_NOSPLIT, buffer_storage, buffer_struct);
-		}
-	}
-	else {
-		ESP_LOGE(tag,"ringbuf alloc failed");
-	}
-	return buf_handle;
+/* @brief the end of the ring is skipped when a message does not fit, it's marked with a 0 span */
+static uint32_t messaging_slot(uint32_t slot){
+	return (slot >= MSG_SLOTS || bus.slots[slot].span == 0) ? 0 : slot;
 }
-void messaging_fill_messages(messaging_list_t * target_subscriber){
-	single_message_t * message=NULL;
-    UBaseType_t uxItemsWaiting;
 
-    vRingbufferGetInfo(top.buf_handle, NULL, NULL, NULL, NULL, &uxItemsWaiting);
-    for(size_t i=0;i<uxItemsWaiting;i++){
-    	message= messaging_retrieve_message(top.buf_handle);
-    	if(message){
-			//re-post to original queue so it is available to future subscribers
-			messaging_post_to_queue(get_handle_ptr(&top), message, message->msg_size);
-			// post to new subscriber
-			messaging_post_to_queue(get_handle_ptr(target_subscriber) , message, message->msg_size);
-			FREE_AND_NULL(message);
-    	}
-    }
+static void messaging_drop_oldest(){
+	if(bus.slots[bus.oldest].span == 0){
+		bus.used -= MSG_SLOTS - bus.oldest;
+		bus.oldest = 0;
+	}
+	bus.used -= bus.slots[bus.oldest].span;
+	bus.oldest = (bus.oldest + bus.slots[bus.oldest].span) % MSG_SLOTS;
+	bus.oldest_seq++;
 }
+
 messaging_handle_t messaging_register_subscriber(uint8_t max_count, char * name){
 	messaging_list_t * cur=&top;
 	while(cur->next){
@@ -83,22 +90,24 @@ messaging_handle_t messaging_register_subscriber(uint8_t max_count, char * name)
 	}
 	memset(cur->next,0x00,sizeof(messaging_list_t));
 	cur = get_struct_ptr(cur->next);
-	cur->max_count=max_count;
+	cur->max_count=max_count>0?max_count:5;
 	cur->subscriber_name=strdup(name);
-	cur->buf_handle = messaging_create_ring_buffer(max_count);
-	if(cur->buf_handle){
-		messaging_fill_messages(cur);
+	// start from the oldest message, so that subscribers get what happened before they came
+	if(bus.mutex && xSemaphoreTake(bus.mutex, portMAX_DELAY)){
+		cur->seq = bus.oldest_seq;
+		cur->slot = bus.oldest;
+		xSemaphoreGive(bus.mutex);
 	}
-	return cur->buf_handle;
+	return get_handle_ptr(cur);
 }
 void messaging_service_init(){
-	size_t max_count=15;
-	top.buf_handle = messaging_create_ring_buffer(max_count);
-	if(!top.buf_handle){
+	bus.text = heap_caps_malloc(MSG_SLOTS * MSG_SLOT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	bus.mutex = xSemaphoreCreateMutex();
+	if(!bus.text || !bus.mutex){
 		ESP_LOGE(tag, "messaging service init failed.");
+		FREE_AND_NULL(bus.text);
 	}
 	else {
-		top.max_count = max_count;
 		top.subscriber_name = strdup("messaging");
 	}
 	return;
@@ -126,84 +135,81 @@ const char * messaging_get_class_desc(messaging_classes msg_class){
 	}
 }
 
-cJSON *  messaging_retrieve_messages(RingbufHandle_t buf_handle){
-	single_message_t * message=NULL;
+cJSON * messaging_message_to_json(const single_message_t * message){
+	cJSON * json_message = cJSON_CreateObject();
+	cJSON_AddStringToObject(json_message, "message", message->message);
+	cJSON_AddStringToObject(json_message, "type", messaging_get_type_desc(message->type));
+	cJSON_AddStringToObject(json_message, "class", messaging_get_class_desc(message->msg_class));
+	cJSON_AddNumberToObject(json_message,"sent_time",message->sent_time);
+	cJSON_AddNumberToObject(json_message,"current_time",esp_timer_get_time() / 1000);
+	return json_message;
+}
+/* @brief messages are copied with the bus locked and JSON is built once it's released, so
+ * posters never wait on cJSON. A subscriber keeps at most max_count messages, older ones
+ * are skipped and counted as dropped. */
+cJSON *  messaging_retrieve_messages(messaging_handle_t handle){
+	messaging_list_t * subscriber=get_struct_ptr(handle);
 	cJSON * json_messages=cJSON_CreateArray();
-	cJSON * json_message=NULL;
-	size_t item_size;
-    UBaseType_t uxItemsWaiting;
-    vRingbufferGetInfo(buf_handle, NULL, NULL, NULL, NULL, &uxItemsWaiting);
-	for(int i = 0;i<uxItemsWaiting;i++){
-		message = (single_message_t *)xRingbufferReceive(buf_handle, &item_size, pdMS_TO_TICKS(50));
-		//Check received data
-		if (message== NULL) {
-			ESP_LOGE(tag,"received null ptr");
-		}
-		else {
-			json_message = cJSON_CreateObject();
-			cJSON_AddStringToObject(json_message, "message", message->message);
-			cJSON_AddStringToObject(json_message, "type", messaging_get_type_desc(message->type));
-			cJSON_AddStringToObject(json_message, "class", messaging_get_class_desc(message->msg_class));
-			cJSON_AddNumberToObject(json_message,"sent_time",message->sent_time);
-			cJSON_AddNumberToObject(json_message,"current_time",esp_timer_get_time() / 1000);
-			cJSON_AddItemToArray(json_messages,json_message);
-			vRingbufferReturnItem(buf_handle, (void *)message);
-		}
+	single_message_t * messages = NULL;
+	uint32_t count = 0, size = 0;
+
+	if(!subscriber || !bus.text || !xSemaphoreTake(bus.mutex, MSG_LOCK_WAIT)){
+		return json_messages;
 	}
-	return json_messages;
-}
-single_message_t *  messaging_retrieve_message(RingbufHandle_t buf_handle){
-	single_message_t * message=NULL;
-	single_message_t * message_copy=NULL;
-	size_t item_size;
-    UBaseType_t uxItemsWaiting;
-    vRingbufferGetInfo(buf_handle, NULL, NULL, NULL, NULL, &uxItemsWaiting);
-	if(uxItemsWaiting>0){
-		message = (single_message_t *)xRingbufferReceive(buf_handle, &item_size, pdMS_TO_TICKS(50));
-		message_copy  = heap_caps_malloc(item_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-		if(message_copy){
-			memcpy(message_copy,message,item_size);
-		}
-		vRingbufferReturnItem(buf_handle, (void *)message);
+	// lapped by writer, restart from oldest
+	if((int32_t) (subscriber->seq - bus.oldest_seq) < 0){
+		ESP_LOGD(tag,"%s missed %u messages",str_or_unknown(subscriber->subscriber_name), bus.oldest_seq - subscriber->seq);
+		subscriber->dropped += bus.oldest_seq - subscriber->seq;
+		subscriber->seq = bus.oldest_seq;
+		subscriber->slot = bus.oldest;
 	}
-	return message_copy;
-}
-
-esp_err_t messaging_post_to_queue(messaging_handle_t subscriber_handle, single_message_t * message, size_t message_size){
-	size_t item_size=0;
-	messaging_list_t * subscriber=get_struct_ptr(subscriber_handle);
-	if(!subscriber->buf_handle){
-		ESP_LOGE(tag,"post failed: null buffer for %s", str_or_unknown(subscriber->subscriber_name));
-		return ESP_FAIL;
+	// only the last max_count messages are kept
+	while(bus.next_seq - subscriber->seq > subscriber->max_count){
+		subscriber->slot = messaging_slot(subscriber->slot);
+		subscriber->slot = (subscriber->slot + bus.slots[subscriber->slot].span) % MSG_SLOTS;
+		subscriber->seq++;
+		subscriber->dropped++;
 	}
-	void * pItem=NULL;
-	UBaseType_t res=pdFALSE;
-	while(1){
-		ESP_LOGD(tag,"Attempting to reserve %d bytes for %s",message_size, str_or_unknown(subscriber->subscriber_name));
-		res =  xRingbufferSendAcquire(subscriber->buf_handle, &pItem, message_size, pdMS_TO_TICKS(50));
-		if(res == pdTRUE && pItem){
-			ESP_LOGD(tag,"Reserving complete for %s", str_or_unknown(subscriber->subscriber_name));
-			memcpy(pItem,message,message_size);
-			xRingbufferSendComplete(subscriber->buf_handle, pItem);
-			break;
-		}
-		ESP_LOGD(tag,"Dropping for %s",str_or_unknown(subscriber->subscriber_name));
-		single_message_t * dummy = (single_message_t *)xRingbufferReceive(subscriber->buf_handle, &item_size, pdMS_TO_TICKS(50));
-		if (dummy== NULL) {
-			ESP_LOGE(tag,"Dropping message failed");
-			break;
-		}
-		else {
-			ESP_LOGD(tag,"Dropping message of %d bytes for %s",item_size, str_or_unknown(subscriber->subscriber_name));
-			vRingbufferReturnItem(subscriber->buf_handle, (void *)dummy);
+	// a single allocation holds messages followed by their text
+	for(uint32_t seq = subscriber->seq, slot = subscriber->slot; seq != bus.next_seq; seq++){
+		slot = messaging_slot(slot);
+		size += bus.slots[slot].msg_size;
+		slot = (slot + bus.slots[slot].span) % MSG_SLOTS;
+		count++;
+	}
+	if(count){
+		messages = heap_caps_malloc(count * sizeof(single_message_t) + size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	}
+	if(messages){
+		char * text = (char *) (messages + count);
+		for(int i = 0; i < count; i++){
+			subscriber->slot = messaging_slot(subscriber->slot);
+			single_message_t * message = bus.slots + subscriber->slot;
+			messages[i] = *message;
+			messages[i].message = text;
+			memcpy(text, message->message, message->msg_size);
+			text += message->msg_size;
+			subscriber->slot = (subscriber->slot + message->span) % MSG_SLOTS;
+			subscriber->seq++;
 		}
 	}
-	if (res != pdTRUE) {
-		ESP_LOGE(tag,"post to %s failed",str_or_unknown(subscriber->subscriber_name));
-		return ESP_FAIL;
+	else if(count){
+		ESP_LOGE(tag,"can't allocate %u messages for %s", count, str_or_unknown(subscriber->subscriber_name));
+		count = 0;
 	}
-	return ESP_OK;
+	xSemaphoreGive(bus.mutex);
+
+	for(int i = 0; i < count; i++){
+		cJSON_AddItemToArray(json_messages,messaging_message_to_json(messages + i));
+	}
+	free(messages);
+	return json_messages;
 }
+
+void messaging_get_stats(messaging_stats_t * stats){
+	*stats = bus.stats;
+}
+
 	esp_err_t messaging_type_to_err_type(messaging_types type){
 		switch (type) {
 		case MESSAGING_INFO:
@@ -221,41 +227,73 @@ esp_err_t messaging_post_to_queue(messaging_handle_t subscriber_handle, single_m
 		}
 		return ESP_LOG_DEBUG;
 	}
-void messaging_post_message(messaging_types type,messaging_classes msg_class, const char *fmt, ...){
-	single_message_t * message=NULL;
-	size_t msg_size=0;
-	size_t ln =0;
-	messaging_list_t * cur=&top;
-	va_list va;
-	va_start(va, fmt);
-	ln = vsnprintf(NULL, 0, fmt, va)+1;
-	msg_size = sizeof(single_message_t)+ln;
-	message = (single_message_t *)heap_caps_malloc(msg_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-	vsprintf(message->message, fmt, va);
-	va_end(va);
-	message->msg_size = msg_size;
+static void messaging_post_va(messaging_types type,messaging_classes msg_class, const char *fmt, va_list va){
+	va_list args;
+	size_t ln, span;
+
+	if(!bus.text || !xSemaphoreTake(bus.mutex, MSG_LOCK_WAIT)){
+		ESP_LOGW(tag,"messaging not ready, message dropped");
+		return;
+	}
+	int64_t start = esp_timer_get_time();
+	va_copy(args, va);
+	ln = vsnprintf(NULL, 0, fmt, args)+1;
+	va_end(args);
+	if(ln > MSG_MAX_SPAN * MSG_SLOT_SIZE){
+		ln = MSG_MAX_SPAN * MSG_SLOT_SIZE;
+		bus.stats.truncated++;
+	}
+	span = (ln + MSG_SLOT_SIZE - 1) / MSG_SLOT_SIZE;
+
+	// skip end of ring if message does not fit
+	uint32_t need = span + (bus.head + span > MSG_SLOTS ? MSG_SLOTS - bus.head : 0);
+	while(MSG_SLOTS - bus.used < need && bus.used){
+		messaging_drop_oldest();
+		bus.stats.dropped++;
+	}
+	if(bus.head + span > MSG_SLOTS){
+		bus.slots[bus.head].span = 0;
+		bus.used += MSG_SLOTS - bus.head;
+		bus.head = 0;
+	}
+
+	single_message_t * message = bus.slots + bus.head;
+	message->message = bus.text + bus.head * MSG_SLOT_SIZE;
+	vsnprintf(message->message, ln, fmt, va);
+	message->msg_size = ln;
+	message->span = span;
+	message->seq = bus.next_seq++;
 	message->type = type;
 	message->msg_class = msg_class;
 	message->sent_time = esp_timer_get_time() / 1000;
-	ESP_LOGD(tag,"Post: %s",message->message);
-	while(cur){
-		messaging_post_to_queue(get_handle_ptr(cur),  message, msg_size);
-		cur = get_struct_ptr(cur->next);
-	}
-	FREE_AND_NULL(message);
-	return;
+	bus.head = (bus.head + span) % MSG_SLOTS;
+	bus.used += span;
 
+	bus.stats.posts++;
+	bus.stats.bytes += ln;
+	uint32_t us = esp_timer_get_time() - start;
+	if(us > bus.stats.max_post_us) bus.stats.max_post_us = us;
+	ESP_LOGD(tag,"Post: %s",message->message);
+	xSemaphoreGive(bus.mutex);
+}
+void messaging_post_message(messaging_types type,messaging_classes msg_class, const char *fmt, ...){
+	va_list va;
+	va_start(va, fmt);
+	messaging_post_va(type, msg_class, fmt, va);
+	va_end(va);
 }
 void log_send_messaging(messaging_types msgtype,const char *fmt, ...) {
 	va_list va;
 	va_start(va, fmt);
 	size_t ln = vsnprintf(NULL, 0, fmt, va)+1;
+	va_end(va);
 	char * message_txt = malloc(ln);
 	if(message_txt){
+		va_start(va, fmt);
 		vsprintf(message_txt, fmt, va);
 		va_end(va);
 		ESP_LOG_LEVEL_LOCAL(messaging_type_to_err_type(msgtype),tag, "%s",message_txt);
-		messaging_post_message(msgtype, MESSAGING_CLASS_SYSTEM, message_txt );
+		messaging_post_message(msgtype, MESSAGING_CLASS_SYSTEM, "%s", message_txt );
 		free(message_txt);
 	}
 	else{
@@ -267,14 +305,16 @@ void cmd_send_messaging(const char * cmdname,messaging_types msgtype, const char
 	va_start(va, fmt);
 	size_t cmd_len = strlen(cmdname)+1;
 	size_t ln = vsnprintf(NULL, 0, fmt, va)+1;
+	va_end(va);
 	char * message_txt = malloc(ln+cmd_len);
 	if(message_txt){
 		strcpy(message_txt,cmdname);
 		strcat(message_txt,"\n");
+		va_start(va, fmt);
 		vsprintf((message_txt+cmd_len), fmt, va);
 		va_end(va);
 		ESP_LOG_LEVEL_LOCAL(messaging_type_to_err_type(msgtype),tag, "%s",message_txt);
-		messaging_post_message(msgtype, MESSAGING_CLASS_CFGCMD, message_txt );
+		messaging_post_message(msgtype, MESSAGING_CLASS_CFGCMD, "%s", message_txt );
 		free(message_txt);
 	}
 	else{
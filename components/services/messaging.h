@@ -1,6 +1,5 @@
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/ringbuf.h"
 #include "cJSON.h"
 #pragma once
 typedef enum {
@@ -17,20 +16,28 @@ typedef enum {
 
 typedef struct messaging_list_t *messaging_handle_t;
 
+/* @brief a message in the bus, message points to its text in the ring and is
+ * only valid while the bus is locked (retrieved messages are copied out of it) */
 typedef struct {
+	uint32_t seq;
 	time_t sent_time;
 	messaging_types type;
 	messaging_classes msg_class;
 	size_t msg_size;
-	char message[];
+	uint8_t span;
+	char * message;
 } single_message_t;
 
-cJSON *  messaging_retrieve_messages(RingbufHandle_t buf_handle);
+typedef struct {
+	uint32_t posts, bytes, dropped, truncated;
+	uint32_t max_post_us;
+} messaging_stats_t;
+
 messaging_handle_t messaging_register_subscriber(uint8_t max_count, char * name);
-esp_err_t messaging_post_to_queue(messaging_handle_t subscriber_handle, single_message_t * message, size_t message_size);
 void messaging_post_message(messaging_types type,messaging_classes msg_class, const char * fmt, ...);
-cJSON *  messaging_retrieve_messages(RingbufHandle_t buf_handle);
-single_message_t *  messaging_retrieve_message(RingbufHandle_t buf_handle);
+cJSON *  messaging_retrieve_messages(messaging_handle_t subscriber);
+cJSON * messaging_message_to_json(const single_message_t * message);
+void messaging_get_stats(messaging_stats_t * stats);
 void log_send_messaging(messaging_types msgtype,const char *fmt, ...);
 void cmd_send_messaging(const char * cmdname,messaging_types msgtype, const char *fmt, ...);
 esp_err_t messaging_type_to_err_type(messaging_types type);
@@ -22,11 +22,12 @@
 #include "platform_config.h"
 #include "accessors.h"
 #include "messaging.h"
-#include "cJSON.h"
 #include "trace.h"
+#include "log_ring.h"
+#include "task_monitor.h"
 
 #define MONITOR_TIMER	(10*1000)
-#define SCRATCH_SIZE	256
+#define STATS_SIZE		4096
 
 static const char *TAG = "monitor";
 
@@ -41,97 +42,43 @@ bool jack_inserted_svc(void);
 void (*spkfault_handler_svc)(bool inserted);
 bool spkfault_svc(void);
 
-/****************************************************************************************
- * 
- */
-static void task_stats( cJSON* top ) {
-#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY 
-	static struct {
-		TaskStatus_t *tasks;
-		uint32_t total, n;
-	} current, previous;
-	cJSON * tlist=cJSON_CreateArray();
-	current.n = uxTaskGetNumberOfTasks();
-	current.tasks = malloc( current.n * sizeof( TaskStatus_t ) );
-	current.n = uxTaskGetSystemState( current.tasks, current.n, &current.total );
-	cJSON_AddNumberToObject(top,"ntasks",current.n);
-	
-	static EXT_RAM_ATTR char scratch[SCRATCH_SIZE];
-	*scratch = '\0';
-
-#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
-	uint32_t elapsed = current.total - previous.total;
-    
-	for(int i = 0, n = 0; i < current.n; i++ ) {
-		for (int j = 0; j < previous.n; j++) {
-			if (current.tasks[i].xTaskNumber == previous.tasks[j].xTaskNumber) {
-				n += snprintf(scratch + n, SCRATCH_SIZE - n, "%16s (%u) %2u%% s:%5u", current.tasks[i].pcTaskName, 
-																		   current.tasks[i].eCurrentState,
-																		   100 * (current.tasks[i].ulRunTimeCounter - previous.tasks[j].ulRunTimeCounter) / elapsed, 
-																		   current.tasks[i].usStackHighWaterMark);
-				cJSON * t=cJSON_CreateObject();
-				cJSON_AddNumberToObject(t,"cpu",100 * (current.tasks[i].ulRunTimeCounter - previous.tasks[j].ulRunTimeCounter) / elapsed);
-				cJSON_AddNumberToObject(t,"minstk",current.tasks[i].usStackHighWaterMark);
-				cJSON_AddNumberToObject(t,"bprio",current.tasks[i].uxBasePriority);
-				cJSON_AddNumberToObject(t,"cprio",current.tasks[i].uxCurrentPriority);
-				cJSON_AddStringToObject(t,"nme",current.tasks[i].pcTaskName);
-				cJSON_AddNumberToObject(t,"st",current.tasks[i].eCurrentState);
-				cJSON_AddNumberToObject(t,"num",current.tasks[i].xTaskNumber);
-				cJSON_AddItemToArray(tlist,t);
-				if (i % 3 == 2 || i == current.n - 1) {
-					ESP_LOGI(TAG, "%s", scratch);
-					n = 0;
-				}	
-				break;
-			}
-		}
-	}	
-#else
-	for (int i = 0, n = 0; i < current.n; i ++) {
-		n += sprintf(scratch + n, "%16s s:%5u\t", current.tasks[i].pcTaskName, current.tasks[i].usStackHighWaterMark);
-		cJSON * t=cJSON_CreateObject();
-		cJSON_AddNumberToObject(t,"minstk",current.tasks[i].usStackHighWaterMark);
-		cJSON_AddNumberToObject(t,"bprio",current.tasks[i].uxBasePriority);
-		cJSON_AddNumberToObject(t,"cprio",current.tasks[i].uxCurrentPriority);
-		cJSON_AddStringToObject(t,"nme",current.tasks[i].pcTaskName);
-		cJSON_AddNumberToObject(t,"st",current.tasks[i].eCurrentState);
-		cJSON_AddNumberToObject(t,"num",current.tasks[i].xTaskNumber);
-		cJSON_AddItemToArray(tlist,t);
-		if (i % 3 == 2 || i == current.n - 1) {
-			ESP_LOGI(TAG, "%s", scratch);
-			n = 0;
-		}	
-	}
-#endif	
-	cJSON_AddItemToObject(top,"tasks",tlist);
-	if (previous.tasks) free(previous.tasks);
-	previous = current;
-#endif	
-}
- 
 /****************************************************************************************
  * 
  */
 static void monitor_callback(TimerHandle_t xTimer) {
-	cJSON * top=cJSON_CreateObject();
-	cJSON_AddNumberToObject(top,"free_iram",heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
-	cJSON_AddNumberToObject(top,"min_free_iram",heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
-	cJSON_AddNumberToObject(top,"free_spiram",heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
-	cJSON_AddNumberToObject(top,"min_free_spiram",heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+	// stats message is formatted in place, nothing is allocated on each tick
+	static EXT_RAM_ATTR char stats[STATS_SIZE];
+	config_commit_stats_t commit;
+	log_ring_stats_t log;
+	messaging_stats_t msg;
+	size_t n;
+
+	task_monitor_tick();
+
+	config_get_commit_stats(&commit);
+	log_ring_get_stats(&log);
+	messaging_get_stats(&msg);
+
+	n = snprintf(stats, STATS_SIZE, "{\"nvs_commits\":%u,\"nvs_writes\":%u,\"nvs_coalesced\":%u,\"nvs_commit_us\":%u,\"nvs_commit_max_us\":%u,"
+									"\"log_lines\":%u,\"log_dropped\":%u,\"log_max_us\":%u,"
+									"\"msg_posts\":%u,\"msg_dropped\":%u,\"msg_max_post_us\":%u,",
+									commit.commits, commit.writes, commit.coalesced, commit.last_us, commit.max_us,
+									log.lines, log.dropped, log.max_us,
+									msg.posts, msg.dropped, msg.max_post_us);
 
 	ESP_LOGI(TAG, "Heap internal:%zu (min:%zu) external:%zu (min:%zu)", 
 			heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
 			heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
 			heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
 			heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
-			
-	task_stats(top);
-	char * top_a= cJSON_PrintUnformatted(top);
-	if(top_a){
-		messaging_post_message(MESSAGING_INFO, MESSAGING_CLASS_STATS,top_a);
-		FREE_AND_NULL(top_a);
+
+	size_t len = task_monitor_print_stats(stats + n, STATS_SIZE - n - 1);
+	if (len) {
+		strcpy(stats + n + len, "}");
+		messaging_post_message(MESSAGING_INFO, MESSAGING_CLASS_STATS, "%s", stats);
+	} else {
+		ESP_LOGW(TAG, "stats do not fit in %u bytes", STATS_SIZE);
 	}
-	cJSON_Delete(top);
 }
 
 /****************************************************************************************
@@ -235,12 +182,16 @@ void monitor_svc_init(void) {
 	}	
 
 	// do we want stats
-	char *p = config_alloc_get_default(NVS_TYPE_STR, "stats", "n", 0);
-	if (p && (*p == '1' || *p == 'Y' || *p == 'y')) {
+	char p[8] = "n";
+	config_get_str("stats", p, sizeof(p));
+	if (*p == '1' || *p == 'Y' || *p == 'y') {
+		// histograms window, in seconds
+		strcpy(p, "60");
+		config_get_str("stats_window", p, sizeof(p));
+		task_monitor_init(atoi(p) * 1000 / MONITOR_TIMER);
 		monitor_timer = xTimerCreate("monitor", MONITOR_TIMER / portTICK_RATE_MS, pdTRUE, NULL, monitor_callback);
 		xTimerStart(monitor_timer, portMAX_DELAY);
 	}	
-	FREE_AND_NULL(p);
 	
 	ESP_LOGI(TAG, "Heap internal:%zu (min:%zu) external:%zu (min:%zu)", 
 			heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
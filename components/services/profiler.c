@@ -0,0 +1,174 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "platform_config.h"
+#include "trace.h"
+#include "profiler.h"
+
+#define TABLE_LINE	96
+
+static const char *TAG = "profiler";
+
+bool profiler_enabled;
+
+static struct prof_stage_s {
+	uint32_t count, dropped;
+	uint32_t min, max;
+	uint64_t total;
+	uint32_t buckets[PROF_BUCKETS];
+} stages[PROF_STAGES];
+
+static int64_t since;
+
+static const char *stage_names[PROF_STAGES] = {
+	"stream_recv", "decode", "process", "eq", "pack", "spdif",
+	"dual", "i2s_write", "rtp_decode", "visu", "lock_streambuf", "wait_streambuf",
+	"lock_outbuf_dec", "lock_outbuf_out",
+	"stream_burst"
+};
+
+/****************************************************************************************
+ *
+ */
+void profiler_record_value(prof_stage_e stage, uint32_t value) {
+	struct prof_stage_s *p = stages + stage;
+	int bucket = value ? 32 - __builtin_clz(value) : 0;
+
+	if (bucket >= PROF_BUCKETS) bucket = PROF_BUCKETS - 1;
+	p->buckets[bucket]++;
+
+	if (value < p->min || !p->count) p->min = value;
+	if (value > p->max) p->max = value;
+	p->total += value;
+	p->count++;
+}
+
+/****************************************************************************************
+ *
+ */
+void profiler_record(prof_stage_e stage, prof_mark_t *mark) {
+	// cycle counters are not synchronized between cores
+	if (mark->core != xPortGetCoreID()) {
+		stages[stage].dropped++;
+		return;
+	}
+
+	profiler_record_value(stage, (xthal_get_ccount() - mark->ccount) / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+/****************************************************************************************
+ *
+ */
+void profiler_reset(void) {
+	memset(stages, 0, sizeof(stages));
+	since = esp_timer_get_time();
+}
+
+/****************************************************************************************
+ *
+ */
+void profiler_enable(bool enable) {
+	if (enable && !profiler_enabled) profiler_reset();
+	profiler_enabled = enable;
+	ESP_LOGI(TAG, "profiler %s", enable ? "enabled" : "disabled");
+}
+
+/****************************************************************************************
+ *
+ */
+cJSON* profiler_get_json(void) {
+	cJSON *top = cJSON_CreateObject();
+	cJSON *list = cJSON_CreateArray();
+	cJSON *limits = cJSON_CreateArray();
+
+	cJSON_AddBoolToObject(top, "enabled", profiler_enabled);
+	cJSON_AddNumberToObject(top, "period_ms", (esp_timer_get_time() - since) / 1000);
+
+	// upper bound (µs) of each bucket, last one is unbounded
+	for (int i = 0; i < PROF_BUCKETS - 1; i++) cJSON_AddItemToArray(limits, cJSON_CreateNumber(1 << i));
+	cJSON_AddItemToObject(top, "buckets_us", limits);
+
+	for (int i = 0; i < PROF_STAGES; i++) {
+		struct prof_stage_s p = stages[i];
+		cJSON *stage = cJSON_CreateObject();
+
+		cJSON_AddStringToObject(stage, "name", stage_names[i]);
+		cJSON_AddStringToObject(stage, "unit", i < PROF_VALUES ? "us" : "bytes");
+		cJSON_AddNumberToObject(stage, "count", p.count);
+		cJSON_AddNumberToObject(stage, "dropped", p.dropped);
+		cJSON_AddNumberToObject(stage, "min", p.min);
+		cJSON_AddNumberToObject(stage, "max", p.max);
+		cJSON_AddNumberToObject(stage, "avg", p.count ? p.total / p.count : 0);
+		cJSON_AddNumberToObject(stage, "total", p.total);
+
+		cJSON *hist = cJSON_CreateArray();
+		for (int j = 0; j < PROF_BUCKETS; j++) cJSON_AddItemToArray(hist, cJSON_CreateNumber(p.buckets[j]));
+		cJSON_AddItemToObject(stage, "hist", hist);
+
+		cJSON_AddItemToArray(list, stage);
+	}
+
+	cJSON_AddItemToObject(top, "stages", list);
+
+	return top;
+}
+
+/****************************************************************************************
+ *
+ */
+char* profiler_alloc_get_table(void) {
+	int len = (PROF_STAGES + 3) * TABLE_LINE, n = 0;
+	char *table = malloc(len);
+	uint32_t elapsed = (esp_timer_get_time() - since) / 1000;
+
+	if (!table) return NULL;
+
+	n += snprintf(table + n, len - n, "profiler %s, over %u ms (times in us, %s in bytes)\n", profiler_enabled ? "enabled" : "disabled", elapsed, stage_names[PROF_VALUES]);
+	n += snprintf(table + n, len - n, "%-15s|%10s|%8s|%8s|%8s|%5s|%8s|%8s\n", "stage", "count", "min", "avg", "max", "cpu%", "p90<", "dropped");
+
+	for (int i = 0; i < PROF_STAGES && n < len; i++) {
+		struct prof_stage_s p = stages[i];
+		uint32_t cumul = 0, p90 = 0;
+
+		// upper bound of the bucket reaching 90% of samples
+		for (int j = 0; j < PROF_BUCKETS && p.count; j++) {
+			cumul += p.buckets[j];
+			if (cumul * 10 >= p.count * 9) {
+				p90 = 1 << j;
+				break;
+			}
+		}
+
+		n += snprintf(table + n, len - n, "%-15s|%10u|%8u|%8u|%8u|%5u|%8u|%8u\n", stage_names[i], p.count, p.min,
+					  p.count ? (uint32_t) (p.total / p.count) : 0, p.max,
+					  elapsed && i < PROF_VALUES ? (uint32_t) (p.total / 10 / elapsed) : 0, p90, p.dropped);
+	}
+
+	return table;
+}
+
+/****************************************************************************************
+ *
+ */
+void profiler_init(void) {
+	// profiler follows the stats setting but can be toggled from the console
+	char p[4] = "n";
+	config_get_str("stats", p, sizeof(p));
+	profiler_enable(*p == '1' || *p == 'Y' || *p == 'y');
+}
@@ -0,0 +1,66 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "xtensa/hal.h"
+#include "cJSON.h"
+
+/*
+ Audio pipeline profiler. Each stage accumulates durations measured with the
+ CPU cycle counter into power-of-two buckets (in µs). The cycle counter is per
+ core, so a sample taken by a task that migrated between start and stop is
+ dropped rather than recorded. Updates are not locked, so each stage must be
+ fed by a single task: a buffer shared by two tasks has one lock stage per
+ side (hold time) and decoders record how long they wait for streambuf. A
+ reader may still see a torn 64 bits total. Stages after PROF_VALUES record a
+ value (e.g. bytes) instead of a duration.
+*/
+
+typedef enum { 	PROF_STREAM_RECV = 0, PROF_DECODE, PROF_PROCESS, PROF_EQ, PROF_PACK,
+				PROF_SPDIF, PROF_DUAL, PROF_I2S_WRITE, PROF_RTP_DECODE, PROF_VISU,
+				PROF_LOCK_STREAMBUF, PROF_WAIT_STREAMBUF, PROF_LOCK_OUTPUTBUF_DEC, PROF_LOCK_OUTPUTBUF_OUT,
+				PROF_VALUES, PROF_STREAM_BURST = PROF_VALUES, PROF_STAGES } prof_stage_e;
+
+// bucket n holds durations in [2^(n-1), 2^n[ µs, last one holds everything above
+#define PROF_BUCKETS	16
+
+typedef struct {
+	uint32_t ccount;
+	int core;
+} prof_mark_t;
+
+extern bool profiler_enabled;
+
+static inline prof_mark_t profiler_mark(void) {
+	prof_mark_t mark = { 0, -1 };
+	if (profiler_enabled) {
+		mark.core = xPortGetCoreID();
+		mark.ccount = xthal_get_ccount();
+	}
+	return mark;
+}
+
+#define PROFILE_START(m)		prof_mark_t m = profiler_mark()
+#define PROFILE_RESTART(m)		m = profiler_mark()
+#define PROFILE_STOP(stage, m)	if ((m).core >= 0) profiler_record(stage, &(m))
+#define PROFILE_VALUE(stage, v)	if (profiler_enabled) profiler_record_value(stage, v)
+#define PROFILE_WAIT(stage, op)	do { PROFILE_START(_wait); op; PROFILE_STOP(stage, _wait); } while (0)
+
+void 	profiler_init(void);
+void 	profiler_enable(bool enable);
+void 	profiler_reset(void);
+void 	profiler_record(prof_stage_e stage, prof_mark_t *mark);
+void 	profiler_record_value(prof_stage_e stage, uint32_t value);
+cJSON* 	profiler_get_json(void);
+char*	profiler_alloc_get_table(void);
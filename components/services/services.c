@@ -18,6 +18,8 @@
 #include "globdefs.h"
 #include "accessors.h"
 #include "messaging.h"
+#include "profiler.h"
+#include "log_ring.h"
 
 extern void battery_svc_init(void);
 extern void monitor_svc_init(void);
@@ -60,6 +62,8 @@ void set_power_gpio(int gpio, char *value) {
  */
 void services_init(void) {
 	messaging_service_init();
+	log_ring_init();
+	profiler_init();
 	gpio_install_isr_service(0);
 	
 #ifdef CONFIG_I2C_LOCKED
@@ -0,0 +1,362 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "task_monitor.h"
+
+#define MONITOR_MAX_TASKS	64		// power of 2
+#define MONITOR_NAME_LEN	16
+#define MONITOR_SLACK		4		// extra status entries so that each new task does not realloc
+#define MONITOR_VERSION		1
+#define SCRATCH_SIZE		256
+
+static const char *TAG = "task_monitor";
+
+static const uint8_t limits[MONITOR_BUCKETS] = { 1, 5, 10, 25, 50, 75, 100, UINT8_MAX };
+static const char *heap_names[] = { "internal", "spiram" };
+
+struct monitor_task_s {
+	uint32_t num;			// task numbers start at 1, 0 is a free slot
+	uint32_t seen;			// tick of last update
+	uint32_t runtime;
+	uint32_t min_stack;
+	uint8_t cpu, state, bprio, cprio;
+	char name[MONITOR_NAME_LEN];
+	uint16_t hist[MONITOR_BUCKETS], last[MONITOR_BUCKETS];
+};
+
+struct monitor_heap_s {
+	uint32_t free, min_free;
+	uint32_t largest, min_largest;
+	uint8_t frag, max_frag, last_max_frag;
+};
+
+static EXT_RAM_ATTR struct {
+	SemaphoreHandle_t mutex;
+	struct monitor_task_s tasks[MONITOR_MAX_TASKS];
+	uint32_t count, untracked, ntasks;
+	TaskStatus_t *status;
+	uint32_t status_size;
+	uint32_t total, ticks, window, windows;
+	struct monitor_heap_s heap[2];
+} monitor;
+
+/****************************************************************************************
+ * Open addressing on task number, with linear probing
+ */
+static struct monitor_task_s *monitor_find(uint32_t num, bool create) {
+	for (int i = 0, slot = num & (MONITOR_MAX_TASKS - 1); i < MONITOR_MAX_TASKS; i++, slot = (slot + 1) & (MONITOR_MAX_TASKS - 1)) {
+		struct monitor_task_s *task = monitor.tasks + slot;
+
+		if (task->num == num) return task;
+		if (task->num) continue;
+
+		// keep one free slot so that probing always ends
+		if (!create || monitor.count >= MONITOR_MAX_TASKS - 1) return NULL;
+		memset(task, 0, sizeof(*task));
+		task->num = num;
+		task->min_stack = UINT32_MAX;
+		monitor.count++;
+		return task;
+	}
+
+	return NULL;
+}
+
+/****************************************************************************************
+ * Free a slot and re-insert the followers of the probe sequence
+ */
+static void monitor_remove(int slot) {
+	monitor.tasks[slot].num = 0;
+	monitor.count--;
+
+	for (int i = 1; i < MONITOR_MAX_TASKS; i++) {
+		struct monitor_task_s *task = monitor.tasks + ((slot + i) & (MONITOR_MAX_TASKS - 1));
+		struct monitor_task_s moved = *task;
+
+		if (!moved.num) break;
+		task->num = 0;
+		monitor.count--;
+		*monitor_find(moved.num, true) = moved;
+	}
+}
+
+/****************************************************************************************
+ *
+ */
+static void heap_update(struct monitor_heap_s *heap, uint32_t caps) {
+	heap->free = heap_caps_get_free_size(caps);
+	heap->min_free = heap_caps_get_minimum_free_size(caps);
+	heap->largest = heap_caps_get_largest_free_block(caps);
+	heap->frag = heap->free ? 100 - (uint64_t) 100 * heap->largest / heap->free : 0;
+	if (heap->frag > heap->max_frag) heap->max_frag = heap->frag;
+	if (!heap->min_largest || heap->largest < heap->min_largest) heap->min_largest = heap->largest;
+}
+
+/****************************************************************************************
+ * Called periodically from the monitor timer, never allocates except when the
+ * number of tasks has grown beyond what was ever seen
+ */
+void task_monitor_tick(void) {
+	// exporter is busy, deltas will just span two periods
+	if (!monitor.mutex || !xSemaphoreTake(monitor.mutex, 0)) return;
+
+	monitor.ticks++;
+	heap_update(monitor.heap + 0, MALLOC_CAP_INTERNAL);
+	heap_update(monitor.heap + 1, MALLOC_CAP_SPIRAM);
+
+#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
+	static EXT_RAM_ATTR char scratch[SCRATCH_SIZE];
+	UBaseType_t n = uxTaskGetNumberOfTasks();
+	uint32_t total = 0;
+
+	if (n > monitor.status_size) {
+		TaskStatus_t *status = realloc(monitor.status, (n + MONITOR_SLACK) * sizeof(TaskStatus_t));
+		if (status) {
+			monitor.status = status;
+			monitor.status_size = n + MONITOR_SLACK;
+		}
+	}
+
+	// fails when tasks were created meanwhile, next time will be better
+	n = monitor.status ? uxTaskGetSystemState(monitor.status, monitor.status_size, &total) : 0;
+	if (!n) {
+		xSemaphoreGive(monitor.mutex);
+		return;
+	}
+
+	uint32_t elapsed = total - monitor.total;
+	monitor.total = total;
+	monitor.ntasks = n;
+	monitor.untracked = 0;
+
+	for (int i = 0, len = 0; i < n; i++) {
+		TaskStatus_t *status = monitor.status + i;
+		struct monitor_task_s *task = monitor_find(status->xTaskNumber, true);
+
+		if (!task) {
+			monitor.untracked++;
+			continue;
+		}
+
+		if (!task->seen) strlcpy(task->name, status->pcTaskName, MONITOR_NAME_LEN);
+		task->seen = monitor.ticks;
+		task->state = status->eCurrentState;
+		task->bprio = status->uxBasePriority;
+		task->cprio = status->uxCurrentPriority;
+		if (status->usStackHighWaterMark < task->min_stack) task->min_stack = status->usStackHighWaterMark;
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+		// a new task's counter started at 0 as well
+		uint64_t cpu = elapsed ? 100ULL * (status->ulRunTimeCounter - task->runtime) / elapsed : 0;
+		int bucket = 0;
+
+		task->runtime = status->ulRunTimeCounter;
+		task->cpu = cpu < UINT8_MAX ? cpu : UINT8_MAX;
+		while (task->cpu >= limits[bucket] && bucket < MONITOR_BUCKETS - 1) bucket++;
+		if (task->hist[bucket] < UINT16_MAX) task->hist[bucket]++;
+
+		len += snprintf(scratch + len, SCRATCH_SIZE - len, "%16s (%u) %2u%% s:%5u", task->name, task->state, task->cpu, task->min_stack);
+#else
+		len += snprintf(scratch + len, SCRATCH_SIZE - len, "%16s s:%5u\t", task->name, task->min_stack);
+#endif
+		if (i % 3 == 2 || i == n - 1) {
+			ESP_LOGI(TAG, "%s", scratch);
+			len = 0;
+		}
+	}
+
+	// tasks that are gone, removal moves entries around so restart each time
+	for (int i = 0; i < MONITOR_MAX_TASKS; i++) {
+		if (monitor.tasks[i].num && monitor.tasks[i].seen != monitor.ticks) {
+			ESP_LOGD(TAG, "task %s (%u) is gone", monitor.tasks[i].name, monitor.tasks[i].num);
+			monitor_remove(i);
+			i = -1;
+		}
+	}
+#endif
+
+	if (monitor.ticks % monitor.window == 0) {
+		for (int i = 0; i < MONITOR_MAX_TASKS; i++) {
+			struct monitor_task_s *task = monitor.tasks + i;
+			if (!task->num) continue;
+			memcpy(task->last, task->hist, sizeof(task->last));
+			memset(task->hist, 0, sizeof(task->hist));
+		}
+		for (int i = 0; i < 2; i++) {
+			monitor.heap[i].last_max_frag = monitor.heap[i].max_frag;
+			monitor.heap[i].max_frag = monitor.heap[i].frag;
+		}
+		monitor.windows++;
+	}
+
+	xSemaphoreGive(monitor.mutex);
+}
+
+/****************************************************************************************
+ * JSON members (without braces) of the stats message, in caller's buffer
+ */
+size_t task_monitor_print_stats(char *buf, size_t size) {
+	size_t len;
+
+	if (!monitor.mutex || !xSemaphoreTake(monitor.mutex, pdMS_TO_TICKS(50))) return 0;
+
+	len = snprintf(buf, size, "\"free_iram\":%u,\"min_free_iram\":%u,\"frag_iram\":%u,"
+							  "\"free_spiram\":%u,\"min_free_spiram\":%u,\"frag_spiram\":%u,\"ntasks\":%u,\"tasks\":[",
+							  monitor.heap[0].free, monitor.heap[0].min_free, monitor.heap[0].frag,
+							  monitor.heap[1].free, monitor.heap[1].min_free, monitor.heap[1].frag, monitor.ntasks);
+
+	for (int i = 0, n = 0; i < MONITOR_MAX_TASKS && len < size; i++) {
+		struct monitor_task_s *task = monitor.tasks + i;
+		if (!task->num) continue;
+		len += snprintf(buf + len, size - len, "%s{"
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+						"\"cpu\":%u,"
+#endif
+						"\"minstk\":%u,\"bprio\":%u,\"cprio\":%u,\"nme\":\"%s\",\"st\":%u,\"num\":%u}", n++ ? "," : "",
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+						task->cpu,
+#endif
+						task->min_stack, task->bprio, task->cprio, task->name, task->state, task->num);
+	}
+
+	if (len < size) len += snprintf(buf + len, size - len, "]");
+	xSemaphoreGive(monitor.mutex);
+
+	return len < size ? len : 0;
+}
+
+/****************************************************************************************
+ *
+ */
+cJSON* task_monitor_get_json(void) {
+	cJSON *json = cJSON_CreateObject();
+
+	if (!monitor.mutex || !xSemaphoreTake(monitor.mutex, pdMS_TO_TICKS(50))) return json;
+
+	cJSON_AddNumberToObject(json, "ticks", monitor.ticks);
+	cJSON_AddNumberToObject(json, "window", monitor.window);
+	cJSON_AddNumberToObject(json, "windows", monitor.windows);
+	cJSON_AddNumberToObject(json, "ntasks", monitor.ntasks);
+	cJSON_AddNumberToObject(json, "untracked", monitor.untracked);
+
+	cJSON *list = cJSON_AddArrayToObject(json, "limits");
+	for (int i = 0; i < MONITOR_BUCKETS - 1; i++) cJSON_AddItemToArray(list, cJSON_CreateNumber(limits[i]));
+
+	cJSON *heaps = cJSON_AddObjectToObject(json, "heap");
+	for (int i = 0; i < 2; i++) {
+		struct monitor_heap_s *heap = monitor.heap + i;
+		cJSON *item = cJSON_AddObjectToObject(heaps, heap_names[i]);
+		cJSON_AddNumberToObject(item, "free", heap->free);
+		cJSON_AddNumberToObject(item, "min_free", heap->min_free);
+		cJSON_AddNumberToObject(item, "largest", heap->largest);
+		cJSON_AddNumberToObject(item, "min_largest", heap->min_largest);
+		cJSON_AddNumberToObject(item, "frag", heap->frag);
+		cJSON_AddNumberToObject(item, "max_frag", monitor.windows ? heap->last_max_frag : heap->max_frag);
+	}
+
+	list = cJSON_AddArrayToObject(json, "tasks");
+	for (int i = 0; i < MONITOR_MAX_TASKS; i++) {
+		struct monitor_task_s *task = monitor.tasks + i;
+		if (!task->num) continue;
+
+		cJSON *item = cJSON_CreateObject();
+		cJSON_AddNumberToObject(item, "num", task->num);
+		cJSON_AddStringToObject(item, "nme", task->name);
+		cJSON_AddNumberToObject(item, "st", task->state);
+		cJSON_AddNumberToObject(item, "bprio", task->bprio);
+		cJSON_AddNumberToObject(item, "cprio", task->cprio);
+		cJSON_AddNumberToObject(item, "minstk", task->min_stack);
+		cJSON_AddNumberToObject(item, "cpu", task->cpu);
+		// last full window, or current one until there is any
+		uint16_t *hist = monitor.windows ? task->last : task->hist;
+		cJSON *buckets = cJSON_AddArrayToObject(item, "hist");
+		for (int j = 0; j < MONITOR_BUCKETS; j++) cJSON_AddItemToArray(buckets, cJSON_CreateNumber(hist[j]));
+		cJSON_AddItemToArray(list, item);
+	}
+
+	xSemaphoreGive(monitor.mutex);
+	return json;
+}
+
+/****************************************************************************************
+ * Native (little endian) packed records, returns needed size when buf is NULL
+ * 	header:	version, buckets, tasks, untracked (u8), ticks, window (u32)
+ *	heap:	free, min_free, largest, min_largest (u32), frag, max_frag (u8) x 2
+ *	task:	num, minstk (u32), state, bprio, cprio, cpu (u8), name[16], hist (u16 x buckets)
+ */
+#define PUT(p, v) do { __typeof__(v) _v = (v); memcpy(p, &_v, sizeof(_v)); p += sizeof(_v); } while (0)
+#define BINARY_HEADER	(4 + 2 * 4 + 2 * (4 * 4 + 2))
+#define BINARY_TASK		(2 * 4 + 4 + MONITOR_NAME_LEN + MONITOR_BUCKETS * 2)
+
+size_t task_monitor_get_binary(uint8_t *buf, size_t size) {
+	uint8_t *p = buf;
+
+	if (!buf) return BINARY_HEADER + MONITOR_MAX_TASKS * BINARY_TASK;
+	if (size < BINARY_HEADER || !monitor.mutex || !xSemaphoreTake(monitor.mutex, pdMS_TO_TICKS(50))) return 0;
+
+	uint32_t count = (size - BINARY_HEADER) / BINARY_TASK;
+	if (count > monitor.count) count = monitor.count;
+
+	PUT(p, (uint8_t) MONITOR_VERSION);
+	PUT(p, (uint8_t) MONITOR_BUCKETS);
+	PUT(p, (uint8_t) count);
+	PUT(p, (uint8_t) (monitor.untracked + monitor.count - count));
+	PUT(p, monitor.ticks);
+	PUT(p, monitor.window);
+
+	for (int i = 0; i < 2; i++) {
+		struct monitor_heap_s *heap = monitor.heap + i;
+		PUT(p, heap->free);
+		PUT(p, heap->min_free);
+		PUT(p, heap->largest);
+		PUT(p, heap->min_largest);
+		PUT(p, heap->frag);
+		PUT(p, monitor.windows ? heap->last_max_frag : heap->max_frag);
+	}
+
+	for (int i = 0; i < MONITOR_MAX_TASKS && count; i++) {
+		struct monitor_task_s *task = monitor.tasks + i;
+		if (!task->num) continue;
+
+		PUT(p, task->num);
+		PUT(p, task->min_stack);
+		PUT(p, task->state);
+		PUT(p, task->bprio);
+		PUT(p, task->cprio);
+		PUT(p, task->cpu);
+		memcpy(p, task->name, MONITOR_NAME_LEN);
+		p += MONITOR_NAME_LEN;
+		memcpy(p, monitor.windows ? task->last : task->hist, MONITOR_BUCKETS * 2);
+		p += MONITOR_BUCKETS * 2;
+		count--;
+	}
+
+	xSemaphoreGive(monitor.mutex);
+	return p - buf;
+}
+
+/****************************************************************************************
+ *
+ */
+void task_monitor_init(uint32_t window_ticks) {
+	monitor.window = window_ticks ? window_ticks : 1;
+	monitor.mutex = xSemaphoreCreateMutex();
+	ESP_LOGI(TAG, "task monitor started with %u ticks window", monitor.window);
+}
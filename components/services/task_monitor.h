@@ -0,0 +1,33 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cJSON.h"
+
+/*
+ Task and heap monitor. Tasks are kept in a persistent table indexed by their
+ task number, so each tick only computes deltas against the last run time of
+ the same entry. CPU load of each tick goes in fixed buckets accumulated over a
+ window (the last full window is kept for export), stack high-water is the
+ lowest ever seen and heap fragmentation is the ratio between largest block
+ and free size. Buffers are sized once, ticks don't allocate.
+*/
+
+// buckets upper bounds are 1, 5, 10, 25, 50, 75, 100 % and above
+#define MONITOR_BUCKETS		8
+
+void	task_monitor_init(uint32_t window_ticks);
+void	task_monitor_tick(void);
+size_t	task_monitor_print_stats(char *buf, size_t size);
+cJSON*	task_monitor_get_json(void);
+size_t	task_monitor_get_binary(uint8_t *buf, size_t size);
@@ -55,7 +55,8 @@ static void headset(bool active);
 static bool volume(unsigned left, unsigned right);
 static void power(adac_power_e mode);
 
-const struct adac_s dac_ac101 = { "AC101", init, deinit, power, speaker, headset, volume };
+// DAC digital volume has no ramp, changes are stepped by caller
+const struct adac_s dac_ac101 = { "AC101", init, deinit, power, speaker, headset, volume, ADAC_CAP_VOLUME };
 
 static esp_err_t i2c_write_reg(uint8_t reg, uint16_t val);
 static uint16_t i2c_read_reg(uint8_t reg);
@@ -164,8 +165,11 @@ static void deinit(void)	{
  * change volume
  */
 static bool volume(unsigned left, unsigned right) {
-	// nothing at that point, volume is handled by backend
-	return false;
+	// 0xa0 is 0dB with 0.75dB steps, left in MSB
+	uint16_t value = (0xa0 - adac_attenuation(left, 0.75, 0xa0)) << 8;
+	value |= 0xa0 - adac_attenuation(right, 0.75, 0xa0);
+	i2c_write_reg(DAC_VOL_CTRL, value);
+	return true;
 } 
 
 /****************************************************************************************
@@ -13,6 +13,8 @@
 #include "driver/i2s.h"
 
 typedef enum { ADAC_ON = 0, ADAC_STANDBY, ADAC_OFF } adac_power_e;
+// VOLUME: volume() is done by DAC, RAMP: and DAC ramps changes by itself
+typedef enum { ADAC_CAP_VOLUME = 0x01, ADAC_CAP_RAMP = 0x02 } adac_cap_e;
 
 struct adac_s {
 	char *model;
@@ -22,6 +24,7 @@ struct adac_s {
 	void (*speaker)(bool active);
 	void (*headset)(bool active);
 	bool (*volume)(unsigned left, unsigned right);
+	int caps;
 };
 
 extern const struct adac_s dac_tas57xx;
@@ -29,3 +32,21 @@ extern const struct adac_s dac_tas5713;
 extern const struct adac_s dac_ac101;
 extern const struct adac_s dac_muse;
 extern const struct adac_s dac_external;
+
+typedef struct {
+	uint8_t reg;
+	uint8_t value;
+} adac_reg_t;
+
+// one I2C transaction for a set of registers, addr is 8 bits (shifted)
+esp_err_t adac_write_regs(int i2c_port, uint8_t addr, const adac_reg_t *regs, int count);
+// 16.16 gain to number of step_db attenuation steps, 0 is 0dB and max is mute
+unsigned adac_attenuation(unsigned gain, float step_db, unsigned max);
+
+// DAC control from a low priority task once init is done, requests do not wait
+void adac_async_start(const struct adac_s *dac);
+void adac_async_stop(void);
+void adac_power(adac_power_e mode);
+void adac_speaker(bool active);
+void adac_headset(bool active);
+bool adac_volume(unsigned left, unsigned right);
@@ -0,0 +1,233 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "adac.h"
+
+/*
+ Once a DAC is initialized, all its I2C traffic is done by a low priority task
+ so that callers (output thread mainly) never wait for the bus. Callers only
+ set what they want and notify, so requests made before the task gets to run
+ are coalesced and only the last one is applied. Volume changes are ramped in
+ small steps, one per tick, unless DAC does it by itself (finer and in sync
+ with samples).
+*/
+
+#define ADAC_STACK_SIZE		(3*1024)
+#define ADAC_RAMP_MS		80
+#define ADAC_RAMP_STEP_MS	10
+// ramp is geometric, so start/end from that when volume is 0 (-60dB)
+#define ADAC_RAMP_FLOOR		(65536 / 1024)
+
+enum { ADAC_POWER = 0x01, ADAC_SPEAKER = 0x02, ADAC_HEADSET = 0x04, ADAC_VOLUME = 0x08, ADAC_EXIT = 0x80 };
+
+static const char TAG[] = "DAC control";
+
+static struct {
+	const struct adac_s *dac;
+	TaskHandle_t task, joiner;
+	// what callers want
+	volatile adac_power_e power;
+	volatile bool speaker, headset, volume_set;
+	volatile unsigned volume[2];
+	// what DAC has
+	struct {
+		int power, speaker, headset;
+		float volume[2];
+		bool valid;
+	} applied;
+	struct {
+		float from[2];
+		int step;
+	} ramp;
+} ctrl;
+
+/****************************************************************************************
+ * One I2C transaction for all registers, each with its own (repeated) start
+ */
+esp_err_t adac_write_regs(int i2c_port, uint8_t addr, const adac_reg_t *regs, int count) {
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+	esp_err_t ret;
+
+	for (int i = 0; i < count; i++) {
+		i2c_master_start(cmd);
+		i2c_master_write_byte(cmd, addr | I2C_MASTER_WRITE, I2C_MASTER_NACK);
+		i2c_master_write_byte(cmd, regs[i].reg, I2C_MASTER_NACK);
+		i2c_master_write_byte(cmd, regs[i].value, I2C_MASTER_NACK);
+	}
+
+	i2c_master_stop(cmd);
+	ret = i2c_master_cmd_begin(i2c_port, cmd, 100 / portTICK_RATE_MS);
+	i2c_cmd_link_delete(cmd);
+
+	if (ret != ESP_OK) {
+		ESP_LOGW(TAG, "I2C write of %d registers @0x%x failed %d", count, addr, ret);
+	}
+
+	return ret;
+}
+
+/****************************************************************************************
+ * Attenuation of a 16.16 gain in steps of step_db, from 0 (0dB) to max (mute)
+ */
+unsigned adac_attenuation(unsigned gain, float step_db, unsigned max) {
+	if (!gain) return max;
+	if (gain >= 0x10000) return 0;
+	
+	float steps = -20 * log10f(gain / 65536.0f) / step_db + 0.5f;
+	return steps < max ? steps : max;
+}
+
+/****************************************************************************************
+ * Next volume step, returns false when target is reached
+ */
+static bool volume_step(const struct adac_s *dac) {
+	unsigned target[2] = { ctrl.volume[0], ctrl.volume[1] };
+	int steps = ADAC_RAMP_MS / ADAC_RAMP_STEP_MS;
+
+	// first volume is set at once
+	if (!ctrl.applied.valid || (dac->caps & ADAC_CAP_RAMP) || ++ctrl.ramp.step >= steps) {
+		dac->volume(target[0], target[1]);
+		ctrl.applied.volume[0] = target[0];
+		ctrl.applied.volume[1] = target[1];
+		ctrl.applied.valid = true;
+		return false;
+	}
+
+	unsigned gain[2];
+	for (int i = 0; i < 2; i++) {
+		float from = ctrl.ramp.from[i] > ADAC_RAMP_FLOOR ? ctrl.ramp.from[i] : ADAC_RAMP_FLOOR;
+		float to = target[i] > ADAC_RAMP_FLOOR ? target[i] : ADAC_RAMP_FLOOR;
+		ctrl.applied.volume[i] = from * powf(to / from, (float) ctrl.ramp.step / steps);
+		gain[i] = ctrl.applied.volume[i];
+	}
+
+	dac->volume(gain[0], gain[1]);
+	return true;
+}
+
+/****************************************************************************************
+ * DAC control task
+ */
+static void adac_task(void *arg) {
+	const struct adac_s *dac = arg;
+	TickType_t wait = portMAX_DELAY;
+	uint32_t bits;
+
+	while (1) {
+		if (xTaskNotifyWait(0, UINT32_MAX, &bits, wait) != pdTRUE) bits = 0;
+		if (bits & ADAC_EXIT) break;
+
+		adac_power_e power = ctrl.power;
+		bool speaker = ctrl.speaker, headset = ctrl.headset;
+
+		// power up before anything else but down only once speaker is off
+		if (power == ADAC_ON && power != ctrl.applied.power) {
+			dac->power(power);
+			ctrl.applied.power = power;
+		}
+
+		if (speaker != ctrl.applied.speaker) {
+			dac->speaker(speaker);
+			ctrl.applied.speaker = speaker;
+		}
+
+		if (headset != ctrl.applied.headset) {
+			dac->headset(headset);
+			ctrl.applied.headset = headset;
+		}
+
+		if (power != ctrl.applied.power) {
+			dac->power(power);
+			ctrl.applied.power = power;
+		}
+
+		// new volume (re)starts ramp from where we are
+		if (bits & ADAC_VOLUME) {
+			memcpy(ctrl.ramp.from, ctrl.applied.volume, sizeof(ctrl.ramp.from));
+			ctrl.ramp.step = 0;
+			wait = 0;
+		}
+
+		if (wait != portMAX_DELAY) {
+			wait = volume_step(dac) ? pdMS_TO_TICKS(ADAC_RAMP_STEP_MS) : portMAX_DELAY;
+		}
+	}
+
+	xTaskNotifyGive(ctrl.joiner);
+	vTaskSuspend(NULL);
+}
+
+/****************************************************************************************
+ * Start control task for an initialized DAC
+ */
+void adac_async_start(const struct adac_s *dac) {
+	static DRAM_ATTR StaticTask_t xTaskBuffer __attribute__ ((aligned (4)));
+	static EXT_RAM_ATTR StackType_t xStack[ADAC_STACK_SIZE] __attribute__ ((aligned (4)));
+
+	ctrl.applied.power = ctrl.applied.speaker = ctrl.applied.headset = -1;
+	ctrl.applied.valid = false;
+	ctrl.task = xTaskCreateStatic( (TaskFunction_t) adac_task, "adac", ADAC_STACK_SIZE, (void*) dac, ESP_TASK_PRIO_MIN + 1, xStack, &xTaskBuffer);
+	ctrl.dac = dac;
+
+	// apply what has been requested so far
+	xTaskNotify(ctrl.task, ctrl.volume_set && (dac->caps & ADAC_CAP_VOLUME) ? ADAC_VOLUME : 0, eSetBits);
+}
+
+/****************************************************************************************
+ * Wait for pending I2C to be done and stop task, DAC can then be de-initialized
+ */
+void adac_async_stop(void) {
+	if (!ctrl.task) return;
+
+	ctrl.dac = NULL;
+	ctrl.joiner = xTaskGetCurrentTaskHandle();
+	xTaskNotify(ctrl.task, ADAC_EXIT, eSetBits);
+	ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+	vTaskDelete(ctrl.task);
+	ctrl.task = NULL;
+}
+
+/****************************************************************************************
+ * Requests, none of these wait
+ */
+void adac_power(adac_power_e mode) {
+	ctrl.power = mode;
+	if (ctrl.task) xTaskNotify(ctrl.task, ADAC_POWER, eSetBits);
+}
+
+void adac_speaker(bool active) {
+	ctrl.speaker = active;
+	if (ctrl.task) xTaskNotify(ctrl.task, ADAC_SPEAKER, eSetBits);
+}
+
+void adac_headset(bool active) {
+	ctrl.headset = active;
+	if (ctrl.task) xTaskNotify(ctrl.task, ADAC_HEADSET, eSetBits);
+}
+
+bool adac_volume(unsigned left, unsigned right) {
+	const struct adac_s *dac = ctrl.dac;
+	
+	ctrl.volume[0] = left;
+	ctrl.volume[1] = right;
+	ctrl.volume_set = true;
+	
+	if (!dac || !(dac->caps & ADAC_CAP_VOLUME)) return false;
+	
+	if (ctrl.task) xTaskNotify(ctrl.task, ADAC_VOLUME, eSetBits);
+	return true;
+}
@@ -23,18 +23,6 @@
 
 #include <alac_wrapper.h>
 
-#if BYTES_PER_FRAME == 4		
-#define ALIGN8(n) 	(n << 8)		
-#define ALIGN16(n) 	(n)
-#define ALIGN24(n)	(n >> 8) 
-#define ALIGN32(n)	(n >> 16)
-#else
-#define ALIGN8(n) 	(n << 24)		
-#define ALIGN16(n) 	(n << 16)
-#define ALIGN24(n)	(n << 8) 
-#define ALIGN32(n)	(n)
-#endif
-
 #define BLOCK_SIZE (4096 * BYTES_PER_FRAME)
 #define MIN_READ    BLOCK_SIZE
 #define MIN_SPACE  (MIN_READ * 4)
@@ -43,6 +31,14 @@ struct chunk_table {
 	u32_t sample, offset;
 };
 
+// mp4 index tables are kept from one track to the next and only grow
+enum { STORE_CHUNK = 0, STORE_STSC, STORE_BLOCK, STORE_MAX };
+
+struct mp4_store {
+	void *data;
+	size_t size;
+};
+
 struct alac {
 	void *decoder;
 	u8_t *writebuf;
@@ -57,7 +53,10 @@ struct alac {
 	u64_t sttssamples;
 	bool  empty;
 	struct chunk_table *chunkinfo;
-	u32_t  *block_size, default_block_size, block_index;
+	void   *block_size;
+	bool   block_size16;
+	u32_t  default_block_size, block_index;
+	struct mp4_store store[STORE_MAX];
 	unsigned sample_rate;
 	unsigned char channels, sample_size;
 	unsigned trak, play;
@@ -74,7 +73,7 @@ extern struct outputstate output;
 extern struct decodestate decode;
 extern struct processstate process;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -94,6 +93,30 @@ extern struct processstate process;
 #define IF_PROCESS(x)
 #endif
 
+static void *store_get(int which, size_t size) {
+	struct mp4_store *store = l->store + which;
+	if (size > store->size) {
+		void *data = realloc(store->data, size);
+		if (!data) return NULL;
+		store->data = data;
+		store->size = size;
+	}
+	return store->data;
+}
+
+static void store_free(void) {
+	for (int i = 0; i < STORE_MAX; i++) {
+		free(l->store[i].data);
+		l->store[i].data = NULL;
+		l->store[i].size = 0;
+	}
+}
+
+static inline u32_t get_block_size(u32_t index) {
+	if (l->default_block_size || !l->block_size) return l->default_block_size;
+	return l->block_size16 ? ((u16_t*) l->block_size)[index] : ((u32_t*) l->block_size)[index];
+}
+
 // read mp4 header to extract config data
 static int read_mp4_header(void) {
 	size_t bytes = min(_buf_used(streambuf), _buf_cont_read(streambuf));
@@ -129,13 +152,21 @@ static int read_mp4_header(void) {
 			u8_t *ptr = streambuf->readp + 12;
 			l->default_block_size = unpackN((u32_t *) ptr); ptr += 4;
 			if (!l->default_block_size) {
-				u32_t entries = unpackN((u32_t *)ptr); ptr += 4;
-				l->block_size = malloc((entries + 1)* 4);
-				for (i = 0; i < entries; i++) {
-					l->block_size[i] = unpackN((u32_t *)ptr); ptr += 4;
+				u32_t entries = unpackN((u32_t *)ptr), largest = 0; ptr += 4;
+				// blocks are almost always less than 64kB so use half the memory when possible
+				for (i = 0; i < entries; i++) if (unpackN((u32_t *)(ptr + i * 4)) > largest) largest = unpackN((u32_t *)(ptr + i * 4));
+				l->block_size16 = largest <= 0xffff;
+				l->block_size = store_get(STORE_BLOCK, (entries + 1) * (l->block_size16 ? 2 : 4));
+				if (l->block_size == NULL) {
+					LOG_WARN("malloc fail");
+					return -1;
 				}
-				l->block_size[entries] = 0;
-				LOG_DEBUG("total blocksize contained in stsz %u", entries);
+				for (i = 0; i <= entries; i++, ptr += 4) {
+					u32_t size = i < entries ? unpackN((u32_t *)ptr) : 0;
+					if (l->block_size16) ((u16_t*) l->block_size)[i] = size;
+					else ((u32_t*) l->block_size)[i] = size;
+				}
+				LOG_DEBUG("total blocksize contained in stsz %u (%u bits)", entries, l->block_size16 ? 16 : 32);
 			} else {
 				LOG_DEBUG("fixed blocksize in stsz %u", l->default_block_size);
             }
@@ -158,7 +189,7 @@ static int read_mp4_header(void) {
 
 		// stash sample to chunk info, assume it comes before stco
 		if (!strcmp(type, "stsc") && bytes > len && !l->chunkinfo) {
-			l->stsc = malloc(len - 12);
+			l->stsc = store_get(STORE_STSC, len - 12);
 			if (l->stsc == NULL) {
 				LOG_WARN("malloc fail");
 				return -1;
@@ -173,7 +204,7 @@ static int read_mp4_header(void) {
 			u8_t *ptr = streambuf->readp + 12;
 			u32_t entries = unpackN((u32_t *)ptr);
 			ptr += 4;
-			l->chunkinfo = malloc(sizeof(struct chunk_table) * (entries + 1));
+			l->chunkinfo = store_get(STORE_CHUNK, sizeof(struct chunk_table) * (entries + 1));
 			if (l->chunkinfo == NULL) {
 				LOG_WARN("malloc fail");
 				return -1;
@@ -210,7 +241,6 @@ static int read_mp4_header(void) {
 					last_samples = samples;
 					ptr += 12;
 				}
-				free(l->stsc);
 				l->stsc = NULL;
 			}
 		}
@@ -355,7 +385,7 @@ static decode_state alac_decode(void) {
 	}
 
 	bytes = _buf_used(streambuf);
-	block_size = l->default_block_size ? l->default_block_size : l->block_size[l->block_index];
+	block_size = get_block_size(l->block_index);
 
 	// stream terminated
 	if (stream.state <= DISCONNECT && (bytes == 0 || block_size == 0)) {
@@ -436,7 +466,7 @@ static decode_state alac_decode(void) {
 		LOG_DEBUG("gapless: skipping %u frames at start", skip);
 		frames -= skip;
 		l->skip -= skip;
-		iptr += skip * l->channels * l->sample_size;
+		iptr += skip * l->channels * l->sample_size / 8;
 	}
 
 	if (l->samples) {
@@ -450,7 +480,7 @@ static decode_state alac_decode(void) {
 	LOCK_O_direct;
 
 	while (frames > 0) {
-		size_t f, count;
+		size_t f;
 		ISAMPLE_T *optr;
 
 		IF_DIRECT(
@@ -463,35 +493,13 @@ static decode_state alac_decode(void) {
 		);
 
 		f = min(f, frames);
-		count = f;
 
-		if (l->sample_size == 8) {
-			while (count--) {
-				*optr++ = ALIGN8(*iptr++);
-				*optr++ = ALIGN8(*iptr++);
-			}
-		} else if (l->sample_size == 16) {
-			u16_t *_iptr = (u16_t*) iptr;
-			while (count--) {
-				*optr++ = ALIGN16(*_iptr++);
-				*optr++ = ALIGN16(*_iptr++);
-			}
-		} else if (l->sample_size == 24) {
-			while (count--) {
-				*optr++ = ALIGN24(*(u32_t*) iptr);
-				*optr++ = ALIGN24(*(u32_t*) (iptr + 3));
-				iptr += 6;
-			}
-		} else if (l->sample_size == 32) {
-			u32_t *_iptr = (u32_t*) iptr;
-			while (count--) {
-				*optr++ = ALIGN32(*_iptr++);
-				*optr++ = ALIGN32(*_iptr++);
-			}
-		} else {
+		// decoder output is little endian
+		if (!_pack_bytes_frames(optr, iptr, f, l->channels, l->sample_size / 8, false)) {
 			LOG_ERROR("unsupported bits per sample: %u", l->sample_size);
 		}
-		
+
+		iptr += f * l->channels * l->sample_size / 8;
 		frames -= f;
 
 		IF_DIRECT(
@@ -511,11 +519,9 @@ static decode_state alac_decode(void) {
 
 static void alac_open(u8_t size, u8_t rate, u8_t chan, u8_t endianness) {
 	if (l->decoder)	alac_delete_decoder(l->decoder);
-	else l->writebuf = malloc(BLOCK_SIZE * 2);
+	else if (!l->writebuf) l->writebuf = malloc(BLOCK_SIZE * 2);
 	
-	if (l->chunkinfo) free(l->chunkinfo);
-	if (l->block_size) free(l->block_size);
-	if (l->stsc) free(l->stsc);
+	// index tables are reused, not freed
 	l->decoder = l->chunkinfo = l->stsc = l->block_size = NULL;
 	l->skip = 0;
 	l->samples = l->sttssamples = 0;
@@ -525,11 +531,10 @@ static void alac_open(u8_t size, u8_t rate, u8_t chan, u8_t endianness) {
 
 static void alac_close(void) {
 	if (l->decoder) alac_delete_decoder(l->decoder);
-	if (l->chunkinfo) free(l->chunkinfo);
-	if (l->block_size) free(l->block_size);
-	if (l->stsc) free(l->stsc);
+	store_free();
 	l->decoder = l->chunkinfo = l->stsc = l->block_size = NULL;
 	free(l->writebuf);
+	l->writebuf = NULL;
 }
 
 struct codec *register_alac(void) {
@@ -548,7 +553,7 @@ struct codec *register_alac(void) {
 		return NULL;
 	}	
 	
-	l->decoder = l->chunkinfo = l->stsc = l->block_size = NULL;
+	memset(l, 0, sizeof(struct alac));
 	
 	LOG_INFO("using alac to decode alc");
 	return &ret;
@@ -0,0 +1,142 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "bt_jitter.h"
+
+/*
+ Level swings between the bottom (just before a packet) and the top (just
+ after) so the target is that swing plus a margin. It follows the swing up
+ immediately but only goes down by a step after each full calm window. Average level
+ is what drift moves, it is held at target by trimming rate.
+*/
+
+#define BT_JITTER_MARGIN_MS		50
+#define BT_JITTER_HYSTERESIS_MS	40
+// beyond that, it's not drift so insert silence (or skip twice that)
+#define BT_JITTER_GROSS_MS		60
+// after a correction, wait till level has settled
+#define BT_JITTER_HOLDOFF_MS	3000
+#define BT_JITTER_PERIOD_MS		1000
+#define BT_JITTER_AVERAGE_MS	4000
+// level only needs to stay around target, so much softer than AirPlay sync
+#define BT_JITTER_KP			4
+#define BT_JITTER_KI			0.02
+
+#define MS(f)		((f) * 1000.0f / jitter->rate)
+#define FRAMES(ms)	((int32_t) ((ms) * jitter->rate / 1000))
+
+/****************************************************************************************
+ *
+ */
+void bt_jitter_init(bt_jitter_t *jitter, uint32_t rate, uint32_t min_ms, uint32_t max_ms) {
+	memset(jitter, 0, sizeof(*jitter));
+	jitter->rate = rate;
+	jitter->min_ms = min_ms;
+	jitter->max_ms = max_ms > min_ms ? max_ms : min_ms;
+	jitter->target_ms = min_ms;
+	rate_trim_init(&jitter->trim, BT_JITTER_KP, BT_JITTER_KI, RATE_TRIM_LIMIT);
+}
+
+/****************************************************************************************
+ * level jumps after a correction, so window and average start over once it's done
+ */
+static void restart(bt_jitter_t *jitter, uint32_t now, int32_t correction) {
+	jitter->filled = 0;
+	jitter->holdoff = now + BT_JITTER_HOLDOFF_MS + (correction > 0 ? MS(correction) : 0);
+}
+
+/****************************************************************************************
+ *
+ */
+int32_t bt_jitter_update(bt_jitter_t *jitter, uint32_t now, uint32_t frames, uint32_t level) {
+	uint32_t pre = level > frames ? level - frames : 0;
+	// level went down linearly since last packet
+	float sample = MS(jitter->top + pre) / 2;
+	int32_t correction = 0;
+	uint32_t gap = now - jitter->last;
+
+	jitter->last = now;
+	jitter->top = level;
+
+	// first packet or source paused, fill up to target
+	if (!jitter->stats.packets++ || gap > jitter->max_ms) {
+		correction = FRAMES(jitter->target_ms) - (int32_t) level;
+		if (correction < 0) correction = 0;
+		restart(jitter, now, correction);
+		return correction;
+	}
+
+	// ran dry, that's a swing we did not absorb
+	if (!pre) jitter->stats.underruns++;
+
+	if ((int32_t) (now - jitter->holdoff) < 0) {
+		jitter->level_ms = MS(pre + level) / 2;
+		jitter->trimmed = now;
+		return 0;
+	}
+
+	// record level swing in current bucket
+	if (!jitter->filled || now - jitter->bucket_start >= BT_JITTER_BUCKET_MS) {
+		jitter->bucket = (jitter->bucket + 1) % BT_JITTER_BUCKETS;
+		jitter->buckets[jitter->bucket].lo = pre;
+		jitter->buckets[jitter->bucket].hi = level;
+		jitter->bucket_start = now;
+		if (jitter->filled < BT_JITTER_BUCKETS) jitter->filled++;
+	} else {
+		if (pre < jitter->buckets[jitter->bucket].lo) jitter->buckets[jitter->bucket].lo = pre;
+		if (level > jitter->buckets[jitter->bucket].hi) jitter->buckets[jitter->bucket].hi = level;
+	}
+
+	// adapt target to swing over the window
+	uint32_t lo = UINT32_MAX, hi = 0;
+	for (int i = 0; i < jitter->filled; i++) {
+		int n = (jitter->bucket + BT_JITTER_BUCKETS - i) % BT_JITTER_BUCKETS;
+		if (jitter->buckets[n].lo < lo) lo = jitter->buckets[n].lo;
+		if (jitter->buckets[n].hi > hi) hi = jitter->buckets[n].hi;
+	}
+
+	uint32_t wanted = MS(hi - lo) + BT_JITTER_MARGIN_MS;
+	if (wanted < jitter->min_ms) wanted = jitter->min_ms;
+	else if (wanted > jitter->max_ms) wanted = jitter->max_ms;
+
+	if (wanted > jitter->target_ms) {
+		// the burst that made us raise target also refills, so let average catch up
+		jitter->target_ms = wanted;
+		jitter->raised = now;
+	} else if (jitter->filled == BT_JITTER_BUCKETS && wanted + BT_JITTER_HYSTERESIS_MS < jitter->target_ms) {
+		// one step down per calm window, trim takes it (mostly)
+		jitter->target_ms -= BT_JITTER_HYSTERESIS_MS;
+		jitter->filled = 0;
+	}
+
+	// then hold average level at target, packets come in bursts so weight by time
+	jitter->level_ms += (sample - jitter->level_ms) * (gap < BT_JITTER_AVERAGE_MS ? gap : BT_JITTER_AVERAGE_MS) / BT_JITTER_AVERAGE_MS;
+	float error = jitter->level_ms - jitter->target_ms;
+
+	if (now - jitter->raised < BT_JITTER_AVERAGE_MS) {
+		// wait
+	} else if (error < -BT_JITTER_GROSS_MS) {
+		correction = FRAMES(-error);
+		jitter->stats.silence += correction;
+		restart(jitter, now, correction);
+	} else if (error > 2 * BT_JITTER_GROSS_MS) {
+		correction = -FRAMES(error);
+		jitter->stats.dropped -= correction;
+		restart(jitter, now, correction);
+	} else if (now - jitter->trimmed >= BT_JITTER_PERIOD_MS) {
+		// level above target means we are late
+		rate_trim_update(&jitter->trim, -error, now - jitter->trimmed);
+		jitter->trimmed = now;
+	}
+
+	return correction;
+}
@@ -0,0 +1,58 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "rate_trim.h"
+
+/*
+ BT sink jitter buffer. A2DP has no timing information and phones send in
+ bursts, so outputbuf level is held around a target depth: the target grows
+ with the swing of the level observed over a window (burstiness) and slowly
+ shrinks back when things calm down. Drift between the phone and us is taken
+ by a rate trim on the average level, gross deviations (bursts larger than
+ the depth, underruns, target changes) are corrected with inserted silence or
+ skipped frames. It does not depend on the platform so it can run on host
+ against recorded packet traces.
+*/
+
+#define BT_JITTER_MIN_MS		150
+#define BT_JITTER_MAX_MS		1000
+
+#define BT_JITTER_BUCKETS		16
+#define BT_JITTER_BUCKET_MS		8000
+
+typedef struct {
+	uint32_t rate;
+	uint32_t min_ms, max_ms;	// bounds of target
+	uint32_t target_ms;
+	float level_ms;				// average level over time
+	uint32_t top;				// level after last packet
+	struct {
+		uint32_t lo, hi;		// min level before and max level after a packet (frames)
+	} buckets[BT_JITTER_BUCKETS];
+	uint32_t bucket, filled, bucket_start;
+	uint32_t last, holdoff, raised, trimmed;
+	rate_trim_t trim;
+	struct {
+		uint32_t packets, underruns;
+		uint32_t dropped, silence;	// frames
+	} stats;
+} bt_jitter_t;
+
+void	bt_jitter_init(bt_jitter_t *jitter, uint32_t rate, uint32_t min_ms, uint32_t max_ms);
+
+/*
+ @brief account for a packet of frames received at now (ms), level being the
+ buffer level (frames) once the packet is written. Rate correction is in trim.ppm
+ @return frames of silence to insert (> 0) or to skip (< 0)
+*/
+int32_t	bt_jitter_update(bt_jitter_t *jitter, uint32_t now, uint32_t frames, uint32_t level);
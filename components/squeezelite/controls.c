@@ -299,9 +299,9 @@ static bool ir_handler(u16_t addr, u16_t cmd) {
  * Initialize controls - shall be called once from output_init_embedded
  */
 void sb_controls_init(void) {
-	char *p = config_alloc_get_default(NVS_TYPE_STR, "lms_ctrls_raw", "n", 0);
-	raw_mode = p && (*p == '1' || *p == 'Y' || *p == 'y');
-	free(p);
+	char p[4] = "n";
+	config_get_str("lms_ctrls_raw", p, sizeof(p));
+	raw_mode = *p == '1' || *p == 'Y' || *p == 'y';
 	
 	LOG_INFO("initializing audio (buttons/rotary/ir) controls (raw:%u)", raw_mode);
 	
@@ -36,7 +36,7 @@ struct codec *codecs[MAX_CODECS];
 struct codec *codec;
 static bool running = true;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -83,7 +83,9 @@ static void *decode_thread() {
 
 			if (space > min_space && (bytes > codec->min_read_bytes || toend)) {
 				
+				PROFILE_START(mark);
 				decode.state = codec->decode();
+				PROFILE_STOP(PROF_DECODE, mark);
 
 				IF_PROCESS(
 					if (process.in_frames) {
@@ -13,6 +13,8 @@
 #include "squeezelite.h"
 #include "bt_app_sink.h"
 #include "raop_sink.h"
+#include "rate_trim.h"
+#include "bt_jitter.h"
 #include <math.h>
 
 #define LOCK_O   mutex_lock(outputbuf->mutex)
@@ -35,6 +37,8 @@ static bool enable_airplay;
 #define SYNC_WIN_SLOW	32
 #define SYNC_WIN_CHECK	8
 #define SYNC_WIN_FAST	2
+// beyond that, error is not drift and we skip/pause
+#define SYNC_GROSS_MS	30
 
 static raop_event_t	raop_state;
 
@@ -42,13 +46,20 @@ static EXT_RAM_ATTR struct {
 	bool enabled;
 	int sum, count, win, errors[SYNC_WIN_SLOW];
 	s32_t len;
-	u32_t start_time, playtime;
+	u32_t start_time, playtime, trimmed;
+	rate_trim_t trim;
 } raop_sync;
 
+static EXT_RAM_ATTR struct {
+	u32_t min_ms, max_ms;
+	s32_t ppm;
+	bt_jitter_t jitter;
+} bt_sync;
+
 /****************************************************************************************
- * Common sink data handler
+ * Common sink data handler, returns what could not be written
  */
-static void sink_data_handler(const uint8_t *data, uint32_t len)
+static size_t sink_data_handler(const uint8_t *data, uint32_t len, bool drop)
 {
     size_t bytes, space;
 	int wait = 5;
@@ -56,7 +67,7 @@ static void sink_data_handler(const uint8_t *data, uint32_t len)
 	// would be better to lock output, but really, it does not matter
 	if (!output.external) {
 		LOG_SDEBUG("Cannot use external sink while LMS is controlling player");
-		return;
+		return 0;
 	} 
 	
 	// there will always be room at some point
@@ -84,12 +95,81 @@ static void sink_data_handler(const uint8_t *data, uint32_t len)
 		UNLOCK_O;
 		
 		// allow i2s to empty the buffer if needed
-		if (len && !space && wait--) usleep(20000);
+		if (len && !space) {
+			if (drop) break;
+			if (wait--) usleep(20000);
+		}	
 	}	
 	
-	if (!wait) {
+	if (len) {
+		LOG_WARN("Buffer full, dropping %u frames", len / BYTES_PER_FRAME);
+	} else if (!wait) {
 		LOG_WARN("Waited too long, dropping frames");
 	}
+	
+	return len;
+}
+
+/****************************************************************************************
+ * BT sink data handler
+ */
+static void bt_sink_data_handler(const uint8_t *data, uint32_t len)
+{
+	u32_t now = gettime_ms();
+	// never block BT, jitter buffer leaves room anyway
+	size_t dropped = sink_data_handler(data, len, true);
+
+	// to record traces for test/bench/jitter
+	LOG_SDEBUG("rx %u %u", now, len);
+
+	if (output.external != DECODE_BT || output.state < OUTPUT_RUNNING) return;
+	
+	LOCK_O;
+	
+	bt_sync.jitter.stats.dropped += dropped / BYTES_PER_FRAME;
+	s32_t correction = bt_jitter_update(&bt_sync.jitter, now, (len - dropped) / BYTES_PER_FRAME, _buf_used(outputbuf) / BYTES_PER_FRAME);
+	
+	// corrections are only asked once the previous one is done
+	if (correction > 0 && output.state == OUTPUT_RUNNING) {
+		output.pause_frames = correction;
+		output.state = OUTPUT_PAUSE_FRAMES;
+		LOG_INFO("BT buffer %d ms below %u ms target, pausing %u frames", (int) bt_sync.jitter.level_ms, bt_sync.jitter.target_ms, correction);
+	} else if (correction < 0 && output.state == OUTPUT_RUNNING) {
+		output.skip_frames = -correction;
+		output.state = OUTPUT_SKIP_FRAMES;
+		LOG_INFO("BT buffer %d ms above %u ms target, skipping %u frames", (int) bt_sync.jitter.level_ms, bt_sync.jitter.target_ms, -correction);
+	}
+	
+	if (bt_sync.jitter.trim.ppm != bt_sync.ppm) {
+		bt_sync.ppm = bt_sync.jitter.trim.ppm;
+		set_rate_trim(bt_sync.ppm);
+	}
+	
+	UNLOCK_O;
+}
+
+/****************************************************************************************
+ * BT sink jitter buffer reset, with output locked
+ */
+static void bt_sync_init(void) {
+	// leave room in outputbuf for bursts
+	u32_t max_ms = (u64_t) outputbuf->size / BYTES_PER_FRAME * 1000 / output.current_sample_rate / 2;
+	
+	bt_jitter_init(&bt_sync.jitter, output.current_sample_rate, bt_sync.min_ms, min(bt_sync.max_ms, max_ms));
+	bt_sync.ppm = 0;
+	set_rate_trim(0);
+}
+
+/****************************************************************************************
+ * 
+ */
+static void bt_sync_stats(void) {
+	bt_jitter_t *jitter = &bt_sync.jitter;
+	
+	if (!jitter->stats.packets) return;
+	
+	LOG_INFO("BT jitter buffer: %u packets, target %u ms, trim %d ppm, %u underruns, dropped %u frames, inserted %u frames of silence", 
+			 jitter->stats.packets, jitter->target_ms, jitter->trim.ppm, jitter->stats.underruns, jitter->stats.dropped, jitter->stats.silence);
 }
 
 /****************************************************************************************
@@ -122,17 +202,22 @@ static bool bt_sink_cmd_handler(bt_sink_cmd_t cmd, va_list args)
 		if (output.external == DECODE_BT) {
 			if (output.state > OUTPUT_STOPPED) output.state = OUTPUT_STOPPED;
 			output.stop_time = gettime_ms();
+			bt_sync_stats();
+			set_rate_trim(0);
 			LOG_INFO("BT sink stopped");
 		}	
 		break;
 	case BT_SINK_PLAY:
 		output.state = OUTPUT_RUNNING;
+		bt_sync_init();
 		LOG_INFO("BT playing");
 		break;
 	case BT_SINK_STOP:		
 		_buf_flush(outputbuf);
 		output.state = OUTPUT_STOPPED;
 		output.stop_time = gettime_ms();
+		bt_sync_stats();
+		set_rate_trim(0);
 		LOG_INFO("BT stopped");
 		break;
 	case BT_SINK_PAUSE:		
@@ -141,6 +226,7 @@ static bool bt_sink_cmd_handler(bt_sink_cmd_t cmd, va_list args)
 		break;
 	case BT_SINK_RATE:
 		output.next_sample_rate = output.current_sample_rate = va_arg(args, u32_t);
+		if (output.state >= OUTPUT_RUNNING) bt_sync_init();
 		LOG_INFO("Setting BT sample rate %u", output.next_sample_rate);
 		break;
 	case BT_SINK_VOLUME: {
@@ -167,7 +253,7 @@ static void raop_sink_data_handler(const uint8_t *data, uint32_t len, u32_t play
 	raop_sync.playtime = playtime;
 	raop_sync.len = len;
 
-	sink_data_handler(data, len);
+	sink_data_handler(data, len, false);
 }	
 
 /****************************************************************************************
@@ -207,12 +293,15 @@ static bool raop_sink_cmd_handler(raop_event_t event, va_list args)
 			}	
 			
 			// calculate sum, error and update sliding window
+			raop_sync.sum -= raop_sync.errors[raop_sync.count % raop_sync.win];
 			raop_sync.errors[raop_sync.count++ % raop_sync.win] = error;
 			raop_sync.sum += error;
 			error = raop_sync.sum / min(raop_sync.count, raop_sync.win);
 
-			// wait till we have enough data or there is a strong deviation
-			if ((raop_sync.count >= raop_sync.win && abs(error) > 10) || (raop_sync.count >= SYNC_WIN_CHECK && abs(error) > 100)) {
+			// wait till we have enough data or there is a strong deviation, once in slow mode
+			// only gross errors skip or pause, drift is handled by trimming playback rate
+			if ((raop_sync.count >= raop_sync.win && abs(error) > (raop_sync.win == SYNC_WIN_SLOW ? SYNC_GROSS_MS : 10)) || 
+				(raop_sync.count >= SYNC_WIN_CHECK && abs(error) > 100)) {
 				if (error < 0) {
 					output.skip_frames = -(error * RAOP_SAMPLE_RATE) / 1000;
 					output.state = OUTPUT_SKIP_FRAMES;					
@@ -225,7 +314,11 @@ static bool raop_sink_cmd_handler(raop_event_t event, va_list args)
 				
 				raop_sync.sum = raop_sync.count = 0;
 				memset(raop_sync.errors, 0, sizeof(raop_sync.errors));
-			}	
+			} else if (raop_sync.win == SYNC_WIN_SLOW && raop_sync.count >= raop_sync.win) {
+				set_rate_trim(rate_trim_update(&raop_sync.trim, error, now - raop_sync.trimmed));
+				LOG_DEBUG("trimming rate by %d ppm (error:%d)", raop_sync.trim.ppm, error);
+			}
+			raop_sync.trimmed = now;
 			
 			// move to normal mode if possible			
 			if (raop_sync.win == 1) {
@@ -254,12 +347,14 @@ static bool raop_sink_cmd_handler(raop_event_t event, va_list args)
 			raop_sync.sum = raop_sync.count = 0;
 			memset(raop_sync.errors, 0, sizeof(raop_sync.errors));
 			raop_sync.enabled = !strcasestr(output.device, "BT");
+			rate_trim_init(&raop_sync.trim, RATE_TRIM_KP, RATE_TRIM_KI, RATE_TRIM_LIMIT);
+			set_rate_trim(0);
 			output.next_sample_rate = output.current_sample_rate = RAOP_SAMPLE_RATE;
 			break;
 		case RAOP_STOP:
 		case RAOP_FLUSH:
 			if (event == RAOP_FLUSH) { LOG_INFO("Flush", NULL); }
-			else { LOG_INFO("Stop", NULL); }
+			else { LOG_INFO("Stop", NULL); set_rate_trim(0); }
 			raop_state = event;
 			_buf_flush(outputbuf);		
 			if (output.state > OUTPUT_STOPPED) output.state = OUTPUT_STOPPED;
@@ -298,21 +393,26 @@ static bool raop_sink_cmd_handler(raop_event_t event, va_list args)
  * We provide the generic codec register option
  */
 void register_external(void) {
-	char *p;
+	char p[16];
 
-	if ((p = config_alloc_get(NVS_TYPE_STR, "enable_bt_sink")) != NULL) {
+	if (config_get_str("enable_bt_sink", p, sizeof(p)) == ESP_OK) {
 		enable_bt_sink = strcmp(p,"1") == 0 || strcasecmp(p,"y") == 0;
-		free(p);
 	}
 
-	if ((p = config_alloc_get(NVS_TYPE_STR, "enable_airplay")) != NULL) {
+	if (config_get_str("enable_airplay", p, sizeof(p)) == ESP_OK) {
 		enable_airplay = strcmp(p,"1") == 0 || strcasecmp(p,"y") == 0;
-		free(p);
+	}
+
+	// BT sink jitter buffer depth, min[:max] in ms
+	bt_sync.min_ms = BT_JITTER_MIN_MS;
+	bt_sync.max_ms = BT_JITTER_MAX_MS;
+	if (config_get_str("bt_sink_latency", p, sizeof(p)) == ESP_OK) {
+		sscanf(p, "%u:%u", &bt_sync.min_ms, &bt_sync.max_ms);
 	}
 
 	if (!strcasestr(output.device, "BT ") ) {
 		if(enable_bt_sink){
-			bt_sink_init(bt_sink_cmd_handler, sink_data_handler);
+			bt_sink_init(bt_sink_cmd_handler, bt_sink_data_handler);
 			LOG_INFO("Initializing BT sink");
 		}
 	} else {
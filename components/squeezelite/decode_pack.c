@@ -0,0 +1,172 @@
+/*
+ *  Squeezelite - lightweight headless squeezebox emulator
+ *
+ *  (c) Adrian Smith 2012-2015, triode1@btinternet.com
+ *      Ralph Irving 2015-2017, ralph_irving@hotmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Decoders output conversion (interleave, sample size, mono to stereo) into ISAMPLE_T frames
+
+#include "squeezelite.h"
+
+/*
+ Loops are unrolled by 4 frames and, with 16 bits samples, each frame is written
+ with a single 32 bits store. Xtensa has no integer SIMD and esp-dsp only offers
+ float kernels, so that's where most of the gain is. Alignment of output is the
+ one of outputbuf/process buffers (BYTES_PER_FRAME), input can be anything.
+*/
+
+#define UNROLL4(n, x) do { 					\
+	for (; n >= 4; n -= 4) { x; x; x; x; }	\
+	while (n--) { x; }						\
+} while (0)
+
+#if BYTES_PER_FRAME == 4
+#if SL_LITTLE_ENDIAN
+#define FRAME(l, r) ((u32_t) (u16_t) (l) | (u32_t) (u16_t) (r) << 16)
+#else
+#define FRAME(l, r) ((u32_t) (u16_t) (l) << 16 | (u32_t) (u16_t) (r))
+#endif
+#define PUT_FRAME(l, r) do { *(u32_t*) optr = FRAME(l, r); optr += 2; } while (0)
+#define PUT_FRAME_BACK(l, r) do { optr -= 2; *(u32_t*) optr = FRAME(l, r); } while (0)
+#else
+#define PUT_FRAME(l, r) do { *optr++ = (l); *optr++ = (r); } while (0)
+#define PUT_FRAME_BACK(l, r) do { optr -= 2; *optr = (l); *(optr + 1) = (r); } while (0)
+#endif
+
+// libmad fixed point format (mad_fixed_t), see MAD_F_FRACBITS
+#define MAD_FRACBITS	28
+#define MAD_ONE			(1L << MAD_FRACBITS)
+
+/*---------------------------------------------------------------------------------------------*/
+// planar 32 bits samples holding 'bits' significant bits (flac)
+bool _pack_planar_frames(ISAMPLE_T *optr, s32_t *lptr, s32_t *rptr, frames_t frames, unsigned bits) {
+	switch (bits) {
+#if BYTES_PER_FRAME == 4
+	case 8:  UNROLL4(frames, PUT_FRAME(*lptr++ << 8, *rptr++ << 8)); break;
+	case 16: UNROLL4(frames, PUT_FRAME(*lptr++, *rptr++)); break;
+	case 24: UNROLL4(frames, PUT_FRAME(*lptr++ >> 8, *rptr++ >> 8)); break;
+	case 32: UNROLL4(frames, PUT_FRAME(*lptr++ >> 16, *rptr++ >> 16)); break;
+#else
+	case 8:  UNROLL4(frames, PUT_FRAME(*lptr++ << 24, *rptr++ << 24)); break;
+	case 16: UNROLL4(frames, PUT_FRAME(*lptr++ << 16, *rptr++ << 16)); break;
+	case 24: UNROLL4(frames, PUT_FRAME(*lptr++ << 8, *rptr++ << 8)); break;
+	case 32: UNROLL4(frames, PUT_FRAME(*lptr++, *rptr++)); break;
+#endif
+	default: return false;
+	}
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------------------------*/
+// based on libmad minimad.c scale
+static inline s32_t mad_scale(s32_t sample) {
+	sample += (1L << (MAD_FRACBITS - 24));
+
+	if (sample >= MAD_ONE)
+		sample = MAD_ONE - 1;
+	else if (sample < -MAD_ONE)
+		sample = -MAD_ONE;
+#if BYTES_PER_FRAME == 4
+	return (sample >> (MAD_FRACBITS + 1 - 24)) >> 8;
+#else
+	return (sample >> (MAD_FRACBITS + 1 - 24)) << 8;
+#endif
+}
+
+// planar libmad fixed point samples
+void _pack_mad_frames(ISAMPLE_T *optr, s32_t *lptr, s32_t *rptr, frames_t frames) {
+	UNROLL4(frames, PUT_FRAME(mad_scale(*lptr++), mad_scale(*rptr++)));
+}
+
+/*---------------------------------------------------------------------------------------------*/
+// interleaved native 16 bits samples, mono or stereo (vorbis, opus, aac). Works backward so
+// that it can unpack in place, i.e. when optr and iptr are the same buffer
+void _pack_s16_frames(ISAMPLE_T *optr, s16_t *iptr, frames_t frames, unsigned channels) {
+	if (channels == 2) {
+#if BYTES_PER_FRAME == 4
+		if ((void*) optr != (void*) iptr) memmove(optr, iptr, frames * BYTES_PER_FRAME);
+#else
+		iptr += frames * 2;
+		optr += frames * 2;
+		UNROLL4(frames, { s16_t r = *--iptr; s16_t l = *--iptr; PUT_FRAME_BACK(l << 16, r << 16); });
+#endif
+	} else if (channels == 1) {
+		iptr += frames;
+		optr += frames * 2;
+#if BYTES_PER_FRAME == 4
+		UNROLL4(frames, { s16_t s = *--iptr; PUT_FRAME_BACK(s, s); });
+#else
+		UNROLL4(frames, { s32_t s = *--iptr << 16; PUT_FRAME_BACK(s, s); });
+#endif
+	}
+}
+
+/*---------------------------------------------------------------------------------------------*/
+// interleaved byte packed samples of 'size' bytes, mono or stereo (pcm, alac)
+#if BYTES_PER_FRAME == 4
+// keep the 16 most significant bits
+#define BE_1(p)	((p)[0] << 8)
+#define BE_2(p)	((p)[0] << 8 | (p)[1])
+#define BE_3(p)	BE_2(p)
+#define BE_4(p)	BE_2(p)
+#define LE_1(p)	BE_1(p)
+#define LE_2(p)	((p)[0] | (p)[1] << 8)
+#define LE_3(p)	LE_2((p) + 1)
+#define LE_4(p)	LE_2((p) + 2)
+#else
+#define BE_1(p)	((p)[0] << 24)
+#define BE_2(p)	((p)[0] << 24 | (p)[1] << 16)
+#define BE_3(p)	((p)[0] << 24 | (p)[1] << 16 | (p)[2] << 8)
+#define BE_4(p)	((p)[0] << 24 | (p)[1] << 16 | (p)[2] << 8 | (p)[3])
+#define LE_1(p)	BE_1(p)
+#define LE_2(p)	((p)[0] << 16 | (p)[1] << 24)
+#define LE_3(p)	((p)[0] << 8 | (p)[1] << 16 | (p)[2] << 24)
+#define LE_4(p)	((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (p)[3] << 24)
+#endif
+
+#define PACK_STEREO(GET, size) UNROLL4(frames, { PUT_FRAME(GET(iptr), GET(iptr + size)); iptr += 2 * size; })
+#define PACK_MONO(GET, size) UNROLL4(frames, { ISAMPLE_T s = GET(iptr); PUT_FRAME(s, s); iptr += size; })
+#define PACK_SIZE(PACK, E) 										\
+	switch (size) {												\
+	case 1: PACK(E##_1, 1); break;								\
+	case 2: PACK(E##_2, 2); break;								\
+	case 3: PACK(E##_3, 3); break;								\
+	case 4: PACK(E##_4, 4); break;								\
+	default: return false;										\
+	}
+
+bool _pack_bytes_frames(ISAMPLE_T *optr, u8_t *iptr, frames_t frames, unsigned channels, unsigned size, bool bigendian) {
+#if BYTES_PER_FRAME == 4
+	// that's the typical 16 bits stereo case, samples are already what we need
+	if (channels == 2 && size == 2 && bigendian == !SL_LITTLE_ENDIAN) {
+		memcpy(optr, iptr, frames * BYTES_PER_FRAME);
+		return true;
+	}
+#endif
+
+	if (channels == 2) {
+		if (bigendian) { PACK_SIZE(PACK_STEREO, BE) }
+		else { PACK_SIZE(PACK_STEREO, LE) }
+	} else if (channels == 1) {
+		if (bigendian) { PACK_SIZE(PACK_MONO, BE) }
+		else { PACK_SIZE(PACK_MONO, LE) }
+	} else return false;
+
+	return true;
+}
@@ -850,6 +850,7 @@ static void visu_update(void) {
 	}	
 	
 	int mode = visu.mode & ~VISU_ESP32;
+	PROFILE_START(mark);
 				
 	// not enough samples
 	if (visu_export.level < (mode == VISU_VUMETER ? RMS_LEN : FFT_LEN) * 2 && visu_export.running) {
@@ -927,6 +928,7 @@ static void visu_update(void) {
 	// we took what we want, we can release the buffer
 	visu_export.level = 0;
 	pthread_mutex_unlock(&visu_export.mutex);
+	PROFILE_STOP(PROF_VISU, mark);
 
 	// don't refresh screen if all max are 0 (we were are somewhat idle)
 	int clear = 0;
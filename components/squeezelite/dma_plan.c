@@ -0,0 +1,67 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <string.h>
+#include "dma_plan.h"
+
+/****************************************************************************************
+ * Can a descriptor have that length
+ */
+static bool valid_len(const dma_plan_req_t *req, uint32_t len) {
+	if (req->block && req->block % len && len % req->block) return false;
+	if (req->frames && req->frames % len) return false;
+	return true;
+}
+
+/****************************************************************************************
+ *
+ */
+bool dma_plan(const dma_plan_req_t *req, dma_plan_t *plan) {
+	uint32_t max_len = DMA_PLAN_DESC_BYTES / req->frame_bytes;
+	uint32_t min_len = req->irq_max ? (req->rate + req->irq_max - 1) / req->irq_max : max_len;
+	uint32_t len = 0;
+
+	memset(plan, 0, sizeof(*plan));
+
+	// shortest within budget or, when budget can't be met, the longest
+	for (uint32_t l = 1; l <= max_len; l++) {
+		if (!valid_len(req, l)) continue;
+		len = l;
+		if (l >= min_len) break;
+	}
+
+	if (!len || !req->rate) return false;
+	if (len < min_len) plan->limits |= DMA_PLAN_IRQ;
+
+	if (req->frames) {
+		plan->count = req->frames / len;
+		if (plan->count * len * req->frame_bytes > req->bytes_max) plan->limits |= DMA_PLAN_MEMORY;
+	} else {
+		uint64_t frames = (uint64_t) req->latency_ms * req->rate / 1000;
+		uint32_t count_max = req->bytes_max / (len * req->frame_bytes);
+		if (count_max > DMA_PLAN_MAX_COUNT) count_max = DMA_PLAN_MAX_COUNT;
+		plan->count = (frames + len / 2) / len;
+		if (plan->count > count_max) {
+			plan->count = count_max;
+			plan->limits |= DMA_PLAN_MEMORY;
+		}
+		if (plan->count < DMA_PLAN_MIN_COUNT) plan->count = DMA_PLAN_MIN_COUNT;
+	}
+
+	if (plan->count < 2 || plan->count > DMA_PLAN_MAX_COUNT) return false;
+
+	plan->len = len;
+	plan->frames = plan->count * len;
+	plan->bytes = plan->frames * req->frame_bytes;
+	plan->latency_us = (uint64_t) plan->frames * 1000000 / req->rate;
+	plan->irq = (req->rate + len - 1) / len;
+
+	return true;
+}
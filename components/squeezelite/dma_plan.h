@@ -0,0 +1,56 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ I2S DMA is a ring of descriptors, each one interrupts when played. Their
+ length sets the interrupt rate and the granularity of what DMA gives back,
+ and their total sets the latency (and how long the output thread can be
+ late). Both are in time, so they must be re-planned at each sample rate:
+ descriptors are the shortest that stay within the interrupt budget and
+ have an integer ratio with the block that output thread writes at once
+ (which is larger than any descriptor, so they divide it), and there are as many
+ as the target latency needs, within the DMA memory budget. Frames are audio
+ frames, SPDIF uses more DMA bytes per frame. It does not depend on the
+ platform so it can run on host.
+*/
+
+#define DMA_PLAN_DESC_BYTES	4092	// largest DMA descriptor
+#define DMA_PLAN_MIN_COUNT	3
+#define DMA_PLAN_MAX_COUNT	128		// i2s driver limit
+
+typedef enum { DMA_PLAN_IRQ = 0x01, DMA_PLAN_MEMORY = 0x02 } dma_plan_limit_e;
+
+typedef struct {
+	uint32_t rate;			// audio frames per second
+	uint32_t frame_bytes;	// DMA bytes per audio frame
+	uint32_t block;			// frames written at once, descriptors must have an integer ratio with it
+	uint32_t latency_ms;	// wanted depth, unless frames is set
+	uint32_t frames;		// exact depth (same as another port), 0 when latency_ms is used
+	uint32_t irq_max;		// interrupts per second
+	uint32_t bytes_max;		// DMA memory, not enforced when frames is set
+} dma_plan_req_t;
+
+typedef struct {
+	uint32_t len, count;	// descriptor length in frames and number of descriptors
+	uint32_t frames, bytes;
+	uint32_t latency_us, irq;
+	int limits;				// budgets not met (dma_plan_limit_e)
+} dma_plan_t;
+
+/*
+ @brief descriptors geometry for a request
+ @return false when there is none (frames can't be split)
+*/
+bool dma_plan(const dma_plan_req_t *req, dma_plan_t *plan);
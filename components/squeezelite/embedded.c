@@ -15,6 +15,7 @@
 #include "esp_timer.h"
 #include "esp_wifi.h"
 #include "monitor.h"
+#include "platform_config.h"
 
 mutex_type slimp_mutex;
 
@@ -43,6 +44,10 @@ uint32_t _gettime_ms_(void) {
 	return (uint32_t) (esp_timer_get_time() / 1000);
 }
 
+u64_t _gettime_us_(void) {
+	return esp_timer_get_time();
+}
+
 extern void sb_controls_init(void);
 extern bool sb_display_init(void);
 
@@ -69,3 +74,17 @@ u16_t get_plugged(void) {
 u8_t get_battery(void) {
 	return (battery_level_svc() * 16) / 100;
 }	 
+
+in_addr_t get_server_cache(void) {
+	char ip[16];
+	if (config_get_str("lms_cache", ip, sizeof(ip)) != ESP_OK) return 0;
+	in_addr_t addr = inet_addr(ip);
+	return addr == INADDR_NONE ? 0 : addr;
+}
+
+void set_server_cache(in_addr_t ip) {
+	// only write when it changes, it goes to flash
+	if (ip == get_server_cache()) return;
+	struct in_addr addr = { .s_addr = ip };
+	config_set_value(NVS_TYPE_STR, "lms_cache", inet_ntoa(addr));
+}
@@ -2,6 +2,7 @@
 #define EMBEDDED_H
 #include <ctype.h>
 #include <inttypes.h>
+#include "profiler.h"
 
 /* 	must provide 
 		- mutex_create_p
@@ -13,6 +14,7 @@
 	can overload (use #define)
 		- exit
 		- gettime_ms
+		- gettime_us
 		- BASE_CAP
 		- EXT_BSS 		
 	recommended to add platform specific include(s) here
@@ -49,9 +51,11 @@ extern u8_t custom_player_id;
 // all exit() calls are made from main thread (or a function called in main thread)
 #define exit(code) { int ret = code; pthread_exit(&ret); }
 #define gettime_ms _gettime_ms_
+#define gettime_us _gettime_us_
 #define mutex_create_p(m) mutex_create(m)
 
 uint32_t 	_gettime_ms_(void);
+u64_t		_gettime_us_(void);
 
 int			pthread_create_name(pthread_t *thread, _CONST pthread_attr_t  *attr, 
 				   void *(*start_routine)( void * ), void *arg, char *name);
@@ -74,6 +78,10 @@ u16_t	get_RSSI(void);			// must provide or define as 0xffff
 u16_t	get_plugged(void);		// must provide or define as 0x0
 u8_t	get_battery(void);		// must provide 0..15 or define as 0x0
 
+// last server found, to be tried first on next discovery
+in_addr_t	get_server_cache(void);			// must provide or define as 0
+void		set_server_cache(in_addr_t ip);	// must provide or define as empty macro
+
 // to be defined to nothing if you don't want to support these
 extern struct visu_export_s {
 	pthread_mutex_t mutex;
@@ -83,6 +83,8 @@ void equalizer_process(u8_t *buf, u32_t bytes, u32_t sample_rate) {
 	}
 	
 	if (equalizer.handle) {
+		PROFILE_START(mark);
 		esp_equalizer_process(equalizer.handle, buf, bytes, sample_rate, 2);
+		PROFILE_STOP(PROF_EQ, mark);
 	}	
 }
\ No newline at end of file
@@ -93,6 +93,8 @@ static void power(adac_power_e mode) {
 bool i2c_json_execute(char *set) {
 	cJSON *json_set = cJSON_GetObjectItemCaseSensitive(i2c_json, set);
 	cJSON *item;
+	adac_reg_t burst[16];
+	int count = 0;
 
 	if (!json_set) return true;
 	
@@ -104,8 +106,20 @@ bool i2c_json_execute(char *set) {
 
 		if (!reg || !val) continue;
 
+		// plain writes go together, until a read-modify-write needs them done
 		if (!mode) {
-			i2c_write_reg(reg->valueint, val->valueint);
+			burst[count].reg = reg->valueint;
+			burst[count].value = val->valueint;
+			if (++count < sizeof(burst) / sizeof(adac_reg_t)) continue;
+		}
+		
+		if (count) {
+			adac_write_regs(i2c_port, i2c_addr << 1, burst, count);
+			count = 0;
+		}
+		
+		if (!mode) {
+			continue;
 		} else if (!strcasecmp(mode->valuestring, "or")) {
 			uint8_t data = i2c_read_reg(reg->valueint);
 			data |= (uint8_t) val->valueint;
@@ -117,6 +131,8 @@ bool i2c_json_execute(char *set) {
         }
 	}
 	
+	if (count) adac_write_regs(i2c_port, i2c_addr << 1, burst, count);
+	
 	return true;
 }	
 
@@ -53,6 +53,8 @@
 
 
 
+#define ES8388_ADDR 0x10
+
 static const char TAG[] = "es8388";	
 static bool init(char *config, int i2c_port_num, i2s_config_t *i2s_config);
 static void deinit(void);
@@ -62,7 +64,8 @@ static bool volume(unsigned left, unsigned right);
 static void power(adac_power_e mode);
 static void click(void *data);
 
-const struct adac_s dac_muse = { "Muse", init, deinit, power, speaker, headset, volume };
+// DAC digital volume with soft ramp (register 25)
+const struct adac_s dac_muse = { "Muse", init, deinit, power, speaker, headset, volume, ADAC_CAP_VOLUME | ADAC_CAP_RAMP };
 
 void ES8388_Write_Reg(uint8_t reg, uint8_t val);
 	
@@ -149,8 +152,8 @@ static bool init(char *config, int i2c_port_num, i2s_config_t *i2s_config) {
 	ES8388_Write_Reg(29, 0x1C);
 // DAC power-up LOUT1/ROUT1 enabled
 	ES8388_Write_Reg(4, 0x30);
-// unmute
-	ES8388_Write_Reg(25, 0x00);
+// unmute, volume changes ramp by 0.5dB every 4 LRCK
+	ES8388_Write_Reg(25, 0x20);
 // max volume
 	ES8388_Write_Reg(46, 0x21);
 	ES8388_Write_Reg(47, 0x21);
@@ -169,14 +172,10 @@ static void deinit(void)	{
  * change volume
  */
 static bool volume(unsigned left, unsigned right) {
-
-        printf("VOLUME=============>Vgauche %u  Vdroit %u\n",left,right);
-        uint8_t l, r;
-        l = left >> 11;
-        r = right >> 11;
-        ES8388_Write_Reg(46, l);
-	ES8388_Write_Reg(47, r);
-	return false;
+	// DAC digital volume, 0 is 0dB and 0.5dB steps down to -96dB, LOUT1/ROUT1 stay at init
+	adac_reg_t regs[] = { { 26, adac_attenuation(left, 0.5, 0xc0) }, { 27, adac_attenuation(right, 0.5, 0xc0) } };
+	adac_write_regs(i2c_port, ES8388_ADDR << 1, regs, 2);
+	return true;
 } 
 
 /****************************************************************************************
@@ -204,7 +203,6 @@ static void headset(bool active) {
 ///////////////////////////////////////////////////////////////////////
 // Write ES8388 register (Muse board)
 ///////////////////////////////////////////////////////////////////////
-#define ES8388_ADDR 0x10
 
 void ES8388_Write_Reg(uint8_t reg, uint8_t val) {
 	esp_err_t ret;
@@ -22,18 +22,6 @@
 
 #include <FLAC/stream_decoder.h>
 
-#if BYTES_PER_FRAME == 4		
-#define ALIGN8(n) 	(n << 8)		
-#define ALIGN16(n) 	(n)
-#define ALIGN24(n)	(n >> 8) 
-#define ALIGN32(n)	(n >> 16)
-#else
-#define ALIGN8(n) 	(n << 24)		
-#define ALIGN16(n) 	(n << 16)
-#define ALIGN24(n)	(n << 8) 
-#define ALIGN32(n)	(n)
-#endif
-
 struct flac {
 	FLAC__StreamDecoder *decoder;
 	u8_t container;
@@ -84,7 +72,7 @@ extern struct outputstate output;
 extern struct decodestate decode;
 extern struct processstate process;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -173,7 +161,6 @@ static FLAC__StreamDecoderWriteStatus write_cb(const FLAC__StreamDecoder *decode
 
 	while (frames > 0) {
 		frames_t f;
-		frames_t count;
 		ISAMPLE_T *optr;
 
 		IF_DIRECT( 
@@ -187,32 +174,12 @@ static FLAC__StreamDecoderWriteStatus write_cb(const FLAC__StreamDecoder *decode
 
 		f = min(f, frames);
 
-		count = f;
-				
-		if (bits_per_sample == 8) {
-			while (count--) {
-				*optr++ = ALIGN8(*lptr++);
-				*optr++ = ALIGN8(*rptr++);
-			}
-		} else if (bits_per_sample == 16) {
-			while (count--) {
-				*optr++ = ALIGN16(*lptr++);
-				*optr++ = ALIGN16(*rptr++);
-			}
-		} else if (bits_per_sample == 24) {
-			while (count--) {
-				*optr++ = ALIGN24(*lptr++);
-				*optr++ = ALIGN24(*rptr++);
-			}
-		} else if (bits_per_sample == 32) {
-			while (count--) {
-				*optr++ = ALIGN32(*lptr++);
-				*optr++ = ALIGN32(*rptr++);
-			}
-		} else {
+		if (!_pack_planar_frames(optr, lptr, rptr, f, bits_per_sample)) {
 			LOG_ERROR("unsupported bits per sample: %u", bits_per_sample);
 		}
-				
+
+		lptr += f;
+		rptr += f;
 		frames -= f;
 
 		IF_DIRECT(
@@ -27,12 +27,6 @@
 // AAC_MAX_SAMPLES is the number of samples for one channel
 #define FRAME_BUF (AAC_MAX_NSAMPS*2)
 
-#if BYTES_PER_FRAME == 4		
-#define ALIGN(n) 	(n)
-#else
-#define ALIGN(n) 	(n << 8)		
-#endif
-
 #define WRAPBUF_LEN 2048
 
 static unsigned rates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
@@ -41,6 +35,14 @@ struct chunk_table {
 	u32_t sample, offset;
 };
 
+// mp4 index tables are kept from one track to the next and only grow
+enum { STORE_CHUNK = 0, STORE_STSC, STORE_MAX };
+
+struct mp4_store {
+	void *data;
+	size_t size;
+};
+
 struct helixaac {
 	HAACDecoder hAac;
 	u8_t type;
@@ -57,6 +59,7 @@ struct helixaac {
 	u64_t sttssamples;
 	bool  empty;
 	struct chunk_table *chunkinfo;
+	struct mp4_store store[STORE_MAX];
 #if !LINKALL
 #endif
 };
@@ -72,7 +75,7 @@ extern struct outputstate output;
 extern struct decodestate decode;
 extern struct processstate process;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -94,6 +97,25 @@ extern struct processstate process;
 #define HAAC(h, fn, ...) (h)->AAC##fn(__VA_ARGS__)
 #endif
 
+static void *store_get(int which, size_t size) {
+	struct mp4_store *store = a->store + which;
+	if (size > store->size) {
+		void *data = realloc(store->data, size);
+		if (!data) return NULL;
+		store->data = data;
+		store->size = size;
+	}
+	return store->data;
+}
+
+static void store_free(void) {
+	for (int i = 0; i < STORE_MAX; i++) {
+		free(a->store[i].data);
+		a->store[i].data = NULL;
+		a->store[i].size = 0;
+	}
+}
+
 // minimal code for mp4 file parsing to extract audio config and find media data
 
 // adapted from faad2/common/mp4ff
@@ -181,7 +203,7 @@ static int read_mp4_header(unsigned long *samplerate_p, unsigned char *channels_
 
 		// stash sample to chunk info, assume it comes before stco
 		if (!strcmp(type, "stsc") && bytes > len && !a->chunkinfo) {
-			a->stsc = malloc(len - 12);
+			a->stsc = store_get(STORE_STSC, len - 12);
 			if (a->stsc == NULL) {
 				LOG_WARN("malloc fail");
 				return -1;
@@ -196,7 +218,7 @@ static int read_mp4_header(unsigned long *samplerate_p, unsigned char *channels_
 			u8_t *ptr = streambuf->readp + 12;
 			u32_t entries = unpackN((u32_t *)ptr);
 			ptr += 4;
-			a->chunkinfo = malloc(sizeof(struct chunk_table) * (entries + 1));
+			a->chunkinfo = store_get(STORE_CHUNK, sizeof(struct chunk_table) * (entries + 1));
 			if (a->chunkinfo == NULL) {
 				LOG_WARN("malloc fail");
 				return -1;
@@ -233,7 +255,6 @@ static int read_mp4_header(unsigned long *samplerate_p, unsigned char *channels_
 					last_samples = samples;
 					ptr += 12;
 				}
-				free(a->stsc);
 				a->stsc = NULL;
 			}
 		}
@@ -332,7 +353,7 @@ static decode_state helixaac_decode(void) {
 	size_t bytes_total, bytes_wrap;
 	int res, bytes;
 	static AACFrameInfo info;
-	ISAMPLE_T *iptr;
+	s16_t *iptr;
 	u8_t *sptr;
 	bool endstream;
 	frames_t frames;
@@ -450,7 +471,7 @@ static decode_state helixaac_decode(void) {
 	}
 
 	HAAC(a, GetLastFrameInfo, a->hAac, &info);
-	iptr = (ISAMPLE_T *) a->write_buf;
+	iptr = (s16_t *) a->write_buf;
 	bytes = bytes_wrap - bytes;
 	endstream = false;
 
@@ -523,7 +544,6 @@ static decode_state helixaac_decode(void) {
 
 	while (frames > 0) {
 		frames_t f;
-		frames_t count;
 		ISAMPLE_T *optr;
 		
 		IF_DIRECT(
@@ -536,23 +556,10 @@ static decode_state helixaac_decode(void) {
 		);
 
 		f = min(f, frames);
-		count = f;
-		
-		if (info.nChans == 2) {
-#if BYTES_PER_FRAME == 4			
-			memcpy(optr, iptr, count * BYTES_PER_FRAME);
-			iptr += count * 2;
-#else 			
-			while (count--) {
-				*optr++ = *iptr++ << 8;
-				*optr++ = *iptr++ << 8;
-			}
-#endif			
-		} else if (info.nChans == 1) {
-			while (count--) {
-				*optr++ = ALIGN(*iptr);
-				*optr++ = ALIGN(*iptr++);
-			}
+
+		if (info.nChans == 1 || info.nChans == 2) {
+			_pack_s16_frames(optr, iptr, f, info.nChans);
+			iptr += f * info.nChans;
 		} else {
 			LOG_WARN("unsupported number of channels");
 		}
@@ -579,14 +586,7 @@ static void helixaac_open(u8_t size, u8_t rate, u8_t chan, u8_t endianness) {
 	a->type = size;
 	a->pos = a->consume = a->sample = a->nextchunk = 0;
 	
-	if (a->chunkinfo) {
-		free(a->chunkinfo);
-	}
-	
-	if (a->stsc) {
-		free(a->stsc);
-	}
-	
+	// index tables are reused, not freed
 	a->chunkinfo = NULL;
 	a->stsc = NULL;
 	a->skip = 0;
@@ -608,14 +608,9 @@ static void helixaac_open(u8_t size, u8_t rate, u8_t chan, u8_t endianness) {
 static void helixaac_close(void) {
 	HAAC(a, FreeDecoder, a->hAac);
 	a->hAac = NULL;
-	if (a->chunkinfo) {
-		free(a->chunkinfo);
-		a->chunkinfo = NULL;
-	}
-	if (a->stsc) {
-		free(a->stsc);
-		a->stsc = NULL;
-	}
+	a->chunkinfo = NULL;
+	a->stsc = NULL;
+	store_free();
 	free(a->write_buf);
 	free(a->wrap_buf);
 }
@@ -659,9 +654,7 @@ struct codec *register_helixaac(void) {
 		return NULL;
 	}
 
-	a->hAac = NULL;
-	a->chunkinfo = NULL;
-	a->stsc = NULL;
+	memset(a, 0, sizeof(struct helixaac));
 
 	if (!load_helixaac()) {
 		return NULL;
@@ -65,7 +65,7 @@ extern struct outputstate output;
 extern struct decodestate decode;
 extern struct processstate process;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -87,21 +87,6 @@ extern struct processstate process;
 #define MAD(h, fn, ...) (h)->mad_##fn(__VA_ARGS__)
 #endif
 
-// based on libmad minimad.c scale
-static inline ISAMPLE_T scale(mad_fixed_t sample) {
-	sample += (1L << (MAD_F_FRACBITS - 24));
-	
-	if (sample >= MAD_F_ONE)
-		sample = MAD_F_ONE - 1;
-	else if (sample < -MAD_F_ONE)
-		sample = -MAD_F_ONE;
-#if BYTES_PER_FRAME == 4	
-	return (ISAMPLE_T)((sample >> (MAD_F_FRACBITS + 1 - 24)) >> 8);
-#else	
-	return (ISAMPLE_T)((sample >> (MAD_F_FRACBITS + 1 - 24)) << 8);
-#endif	
-}
-
 // check for id3.2 tag at start of file - http://id3.org/id3v2.4.0-structure, return length
 static unsigned _check_id3_tag(size_t bytes) {
 	u8_t *ptr = streambuf->readp;
@@ -302,7 +287,7 @@ static decode_state mad_decode(void) {
 		LOG_SDEBUG("write %u frames", frames);
 
 		while (frames > 0) {
-			size_t f, count;
+			size_t f;
 			ISAMPLE_T *optr;
 
 			IF_DIRECT(
@@ -314,13 +299,10 @@ static decode_state mad_decode(void) {
 				optr = (ISAMPLE_T *)((u8_t *)process.inbuf + process.in_frames * BYTES_PER_FRAME);
 			);
 
-			count = f;
+			_pack_mad_frames(optr, iptrl, iptrr, f);
 
-			while (count--) {
-				*optr++ = scale(*iptrl++);
-				*optr++ = scale(*iptrr++);
-			}
-			
+			iptrl += f;
+			iptrr += f;
 			frames -= f;
 
 			IF_DIRECT(
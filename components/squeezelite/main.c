@@ -71,7 +71,7 @@ static void usage(const char *argv0) {
 #endif
 #endif
 		   "  -a <f>\t\tSpecify sample format (16|24|32) of output file when using -o - to output samples to stdout (interleaved little endian only)\n"
-		   "  -b <stream>:<output>\tSpecify internal Stream and Output buffer sizes in Kbytes\n"
+		   "  -b <stream>:<output>[:<socket>]\tSpecify internal Stream and Output buffer sizes in Kbytes, optionally stream socket receive buffer\n"
 		   "  -c <codec1>,<codec2>\tRestrict codecs to those specified, otherwise load all available codecs; known codecs: " CODECS "\n"
 		   "  \t\t\tCodecs reported to LMS in order listed, allowing codec priority refinement.\n"
 		   "  -C <timeout>\t\tClose output device when idle after timeout seconds, default is to keep it open while player is 'on'\n"
@@ -289,6 +289,7 @@ int main(int argc, char **argv) {
 	u8_t mac[6];
 	unsigned stream_buf_size = STREAMBUF_SIZE;
 	unsigned output_buf_size = 0; // set later
+	unsigned stream_rcv_size = 0; // system default
 	unsigned rates[MAX_SUPPORTED_SAMPLERATES] = { 0 };
 	unsigned rate_delay = 0;
 	char *resample = NULL;
@@ -403,8 +404,10 @@ int main(int argc, char **argv) {
 			{
 				char *s = next_param(optarg, ':');
 				char *o = next_param(NULL, ':');
+				char *r = next_param(NULL, ':');
 				if (s) stream_buf_size = atoi(s) * 1024;
 				if (o) output_buf_size = atoi(o) * 1024;
+				if (r) stream_rcv_size = atoi(r) * 1024;
 			}
 			break;
 		case 'c':
@@ -760,7 +763,7 @@ int main(int argc, char **argv) {
 	winsock_init();
 #endif
 
-	stream_init(log_stream, stream_buf_size);
+	stream_init(log_stream, stream_buf_size, stream_rcv_size);
 
 #if EMBEDDED
 	embedded_init();
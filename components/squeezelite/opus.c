@@ -34,12 +34,6 @@
 #define FRAME_BUF 2048
 #endif
 
-#if BYTES_PER_FRAME == 4		
-#define ALIGN(n) 	(n)
-#else
-#define ALIGN(n) 	(n << 16)		
-#endif
-
 #include <opusfile.h>
 
 struct opus {
@@ -67,7 +61,7 @@ extern struct outputstate output;
 extern struct decodestate decode;
 extern struct processstate process;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -179,36 +173,17 @@ static decode_state opus_decompress(void) {
 #endif
 
 	if (n > 0) {
-		frames_t count;
-		s16_t *iptr;
-		ISAMPLE_T *optr;
+		ISAMPLE_T *optr = (ISAMPLE_T *) write_buf;
 
 		frames = n;
-		count = frames * channels;
-
-		// work backward to unpack samples (if needed)
-		iptr = (s16_t *) write_buf + count;
-		optr = (ISAMPLE_T *) write_buf + frames * 2;
-		
-		if (channels == 2) {
-#if BYTES_PER_FRAME == 4
+
 #if FRAME_BUF
-			// copy needed only when DIRECT and FRAME_BUF
-			IF_DIRECT(
-				memcpy(outputbuf->writep, write_buf, frames * BYTES_PER_FRAME);
-			)	
-#endif			
-#else
-			while (count--) {
-				*--optr = ALIGN(*--iptr);
-			}
+		// when DIRECT, unpack from frame buffer into outputbuf, otherwise unpack in place
+		IF_DIRECT(
+			optr = (ISAMPLE_T *) outputbuf->writep;
+		)
 #endif
-		} else if (channels == 1) {
-			while (count--) {
-				*--optr = ALIGN(*--iptr);
-				*--optr = ALIGN(*iptr);
-			}
-		}
+		_pack_s16_frames(optr, (s16_t *) write_buf, frames, channels);
 
 		IF_DIRECT(
 			_buf_inc_writep(outputbuf, frames * BYTES_PER_FRAME);
@@ -65,6 +65,26 @@ frames_t _output_frames(frames_t avail) {
 		wake_controller();
 	}
 	
+	// start at - play silence so that first frame reaches the device at jiffies, what
+	// we write now plays after device_frames. When already late, skip what's overdue
+	if (output.state == OUTPUT_START_AT) {
+		u64_t now = gettime_us();
+		s64_t delta = (s64_t) (s32_t) (output.start_at - (u32_t) (now / 1000)) * 1000 - (s64_t) (now % 1000);
+		delta -= (u64_t) output.device_frames * 1000000 / output.current_sample_rate;
+		frames_t delta_frames = delta > 0 ? (delta * output.current_sample_rate + 500000) / 1000000 : 0;
+		if (delta > 10000000LL || delta < -1000000LL) {
+			output.state = OUTPUT_RUNNING;
+		} else if (delta_frames) {
+			silence = true;
+			frames = min(avail, delta_frames);
+			frames = min(frames, MAX_SILENCE_FRAMES);
+		} else {
+			output.skip_frames = delta < 0 ? -delta * output.current_sample_rate / 1000000 : 0;
+			output.state = output.skip_frames ? OUTPUT_SKIP_FRAMES : OUTPUT_RUNNING;
+			if (output.skip_frames) LOG_INFO("start at %u is %d us late", output.start_at, (int) -delta);
+		}
+	}
+	
 	// skip ahead - consume outputbuf but play nothing
 	if (output.state == OUTPUT_SKIP_FRAMES) {
 		if (frames > 0) {
@@ -94,19 +114,6 @@ frames_t _output_frames(frames_t avail) {
 		}
 	}
 	
-	// start at - play silence until jiffies reached
-	if (output.state == OUTPUT_START_AT) {
-		u32_t now = gettime_ms();
-		if (now >= output.start_at || output.start_at > now + 10000) {
-			output.state = OUTPUT_RUNNING;
-		} else {
-			u32_t delta_frames = (output.start_at - now) * output.current_sample_rate / 1000;
-			silence = true;
-			frames = min(avail, delta_frames);
-			frames = min(frames, MAX_SILENCE_FRAMES);
-		}
-	}
-	
 	// play silence if buffering or no frames
 	if (output.state <= OUTPUT_BUFFER || frames == 0) {
 		silence = true;
@@ -125,21 +132,24 @@ frames_t _output_frames(frames_t avail) {
 		if (output.track_start && !silence) {
 			if (output.track_start == outputbuf->readp) {
 				unsigned delay = 0;
+				bool seamless = output.current_sample_rate == output.next_sample_rate;
 				if (output.current_sample_rate != output.next_sample_rate) {
 					delay = output.rate_delay;
 				}
 				IF_DSD(
 				   if (output.outfmt != output.next_fmt) {
 					   delay = output.dsd_delay;
+					   seamless = false;
 				   }
 				)
-				frames -= size;
 				// add silence delay in two halves, before and after track start on rate or pcm-dop change
 				if (delay) {
+					seamless = false;
 					output.state = OUTPUT_PAUSE_FRAMES;
 					if (!output.delay_active) {
 						output.pause_frames = output.current_sample_rate * delay / 2000;
 						output.delay_active = true;  // first delay - don't process track start
+						frames -= size;
 						break;
 					} else {
 						output.pause_frames = output.next_sample_rate * delay / 2000;
@@ -158,6 +168,14 @@ frames_t _output_frames(frames_t avail) {
 					output.current_replay_gain = output.next_replay_gain;
 				}
 				output.track_start = NULL;
+				// device does not need to be reconfigured, so carry on with next track to fill the whole request (gapless)
+				if (seamless) {
+					gainL = output.current_replay_gain ? gain(output.gainL, output.current_replay_gain) : output.gainL;
+					gainR = output.current_replay_gain ? gain(output.gainR, output.current_replay_gain) : output.gainR;
+					if (output.invert) { gainL = -gainL; gainR = -gainR; }
+					continue;
+				}
+				frames -= size;
 				break;
 			} else if (output.track_start > outputbuf->readp) {
 				// reduce cont_frames so we find the next track start at beginning of next chunk
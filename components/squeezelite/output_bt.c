@@ -14,6 +14,7 @@
 #include "equalizer.h"
 #include "perf_trace.h"
 #include "platform_config.h"
+#include "esp_pthread.h"
 #include <assert.h>
 
 extern struct outputstate output;
@@ -30,6 +31,18 @@ extern u8_t *silencebuf;
 
 #define STATS_REPORT_DELAY_MS 15000
 
+/* 
+The A2DP data callback runs in BT stack's task, so it must not wait for
+outputbuf (and decoders). A dedicated task renders audio in a FIFO ahead of
+the callback, which only copies what is ready. FIFO is single producer, 
+single consumer with free running indexes, so nothing is locked. When output
+is flushed, producer asks consumer to drop what was rendered before, as only
+consumer moves the read index
+*/
+#define BT_FIFO_SIZE	(4096 * BYTES_PER_FRAME)
+#define BT_CHUNK_FRAMES	512
+#define BT_WAIT_MS		20
+
 extern void hal_bluetooth_init(const char * options);
 extern void hal_bluetooth_stop(void);
 extern u8_t config_spdif_gpio;
@@ -39,6 +52,15 @@ static bool running = false;
 static uint8_t *btout;
 static frames_t oframes;
 static bool stats;
+static pthread_t thread;
+static TaskHandle_t task;
+
+static struct {
+	u8_t *buf;
+	u32_t wp, rp;
+	u32_t flush_wp, flush_req;	// producer
+	u32_t flush_ack;			// consumer
+} fifo;
 
 static int _write_frames(frames_t out_frames, bool silence, s32_t gainL, s32_t gainR,
 								s32_t cross_gain_in, s32_t cross_gain_out, ISAMPLE_T **cross_ptr);
@@ -49,7 +71,9 @@ static int _write_frames(frames_t out_frames, bool silence, s32_t gainL, s32_t g
 	DECLARE_MIN_MAX(bt);\
 	DECLARE_MIN_MAX(under);\
 	DECLARE_MIN_MAX(stream_buf);\
-	DECLARE_MIN_MAX_DURATION(lock_out_time)								
+	DECLARE_MIN_MAX(fifo_buf);\
+	DECLARE_MIN_MAX_DURATION(lock_out_time);\
+	DECLARE_MIN_MAX_DURATION(cb_time)
 	
 #define RESET_ALL_MIN_MAX \
 	RESET_MIN_MAX(bt);	\
@@ -57,18 +81,39 @@ static int _write_frames(frames_t out_frames, bool silence, s32_t gainL, s32_t g
 	RESET_MIN_MAX(rec);  \
 	RESET_MIN_MAX(under);  \
 	RESET_MIN_MAX(stream_buf); \
-	RESET_MIN_MAX_DURATION(lock_out_time)
+	RESET_MIN_MAX(fifo_buf); \
+	RESET_MIN_MAX_DURATION(lock_out_time); \
+	RESET_MIN_MAX_DURATION(cb_time)
 	
 DECLARE_ALL_MIN_MAX;	
 	
+static void *output_thread_bt(void *arg);
+
 void output_init_bt(log_level level, char *device, unsigned output_buf_size, char *params, unsigned rates[], unsigned rate_delay, unsigned idle) {
 	loglevel = level;
-	running = true;
 	output.write_cb = &_write_frames;
+	
+	fifo.buf = malloc(BT_FIFO_SIZE);
+	if (!fifo.buf) {
+		LOG_ERROR("Cannot allocate BT FIFO");
+		return;
+	}
+	fifo.wp = fifo.rp = 0;
+	fifo.flush_wp = fifo.flush_req = fifo.flush_ack = 0;
+	running = true;
+	
+	esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+	cfg.thread_name = "output_bt";
+	cfg.inherit_cfg = false;
+	cfg.prio = CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT + 1;
+	cfg.stack_size = PTHREAD_STACK_MIN + OUTPUT_THREAD_STACK_SIZE;
+	esp_pthread_set_cfg(&cfg);
+	pthread_create(&thread, NULL, output_thread_bt, NULL);
+	
 	hal_bluetooth_init(device);
-	char *p = config_alloc_get_default(NVS_TYPE_STR, "stats", "n", 0);
-	stats = p && (*p == '1' || *p == 'Y' || *p == 'y');
-	free(p);
+	char p[4] = "n";
+	config_get_str("stats", p, sizeof(p));
+	stats = *p == '1' || *p == 'Y' || *p == 'y';
 }
 
 void output_close_bt(void) {
@@ -76,6 +121,12 @@ void output_close_bt(void) {
 	running = false;
 	UNLOCK;
 	hal_bluetooth_stop();
+	if (fifo.buf) {
+		if (task) xTaskNotifyGive(task);
+		pthread_join(thread, NULL);
+		free(fifo.buf);
+		fifo.buf = NULL;
+	}	
 	equalizer_close();
 }	
 
@@ -121,37 +172,117 @@ static int _write_frames(frames_t out_frames, bool silence, s32_t gainL, s32_t g
 	return (int)out_frames;
 }
 
-int32_t output_bt_data(uint8_t *data, int32_t len) {
-	int32_t iframes = len / BYTES_PER_FRAME, start_timer = 0;
+/****************************************************************************************
+ * Outputbuf has been flushed (stop, seek, skip), so must be what FIFO holds. Called
+ * with outputbuf locked, returns true when consumer has been asked to flush
+ */
+static bool _check_flush(output_state *state) {
+	bool flush = output.state <= OUTPUT_STOPPED && *state > OUTPUT_STOPPED;
+	
+	if (flush) {
+		__atomic_store_n(&fifo.flush_wp, fifo.wp, __ATOMIC_RELAXED);
+		__atomic_store_n(&fifo.flush_req, fifo.flush_req + 1, __ATOMIC_RELEASE);
+	}
+	
+	*state = output.state;
+	return flush;
+}
 
+/****************************************************************************************
+ * Render audio ahead of A2DP callback, directly in FIFO
+ */
+static void *output_thread_bt(void *arg) {
+	int64_t start_timer = 0;
+	output_state state = OUTPUT_STOPPED;
+	
+	task = xTaskGetCurrentTaskHandle();
+	
+	while (running) {
+		u32_t used = fifo.wp - __atomic_load_n(&fifo.rp, __ATOMIC_ACQUIRE);
+		u32_t wp = fifo.wp % BT_FIFO_SIZE;
+		
+		// wait for callback to make room (with timeout to keep an eye on running and flush)
+		if (BT_FIFO_SIZE - used < BT_CHUNK_FRAMES * BYTES_PER_FRAME) {
+			LOCK;
+			_check_flush(&state);
+			UNLOCK;
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_WAIT_MS));
+			continue;
+		}
+		
+		// render up to the end of FIFO, next round will wrap
+		frames_t iframes = min(BT_FIFO_SIZE - used, BT_FIFO_SIZE - wp) / BYTES_PER_FRAME;
+		btout = fifo.buf + wp;
+		oframes = 0;
+		
+		TIME_MEASUREMENT_START(start_timer);
+		LOCK;
+		PROFILE_START(lock);
+		if (_check_flush(&state)) used = 0;
+		// what is in the FIFO has not been played yet
+		output.device_frames = used / BYTES_PER_FRAME;
+		output.updated = gettime_ms();
+		output.frames_played_dmp = output.frames_played;
+		PROFILE_START(mark);
+		_output_frames(min(iframes, BT_CHUNK_FRAMES));
+		PROFILE_STOP(PROF_PACK, mark);
+		output.frames_in_process = oframes;
+		PROFILE_STOP(PROF_LOCK_OUTPUTBUF_OUT, lock);
+		UNLOCK;
+		SET_MIN_MAX(TIME_MEASUREMENT_GET(start_timer), lock_out_time);
+		
+		equalizer_process(btout, oframes * BYTES_PER_FRAME, output.current_sample_rate);
+		
+		// publish only once data is complete
+		__atomic_store_n(&fifo.wp, fifo.wp + oframes * BYTES_PER_FRAME, __ATOMIC_RELEASE);
+	}
+	
+	return NULL;
+}
+
+/****************************************************************************************
+ * A2DP callback, runs in BT task so it only copies what's ready
+ */
+int32_t output_bt_data(uint8_t *data, int32_t len) {
+	int64_t start_timer = 0;
+	
 	if (len < 0 || data == NULL || !running) {
 		return 0;
 	}
 	
-	btout = data;
-	oframes = 0;
-
-	// This is how the BTC layer calculates the number of bytes to
-	// for us to send. (BTC_SBC_DEC_PCM_DATA_LEN * sizeof(OI_INT16) - availPcmBytes
-	SET_MIN_MAX(len,req);
 	TIME_MEASUREMENT_START(start_timer);
-	SET_MIN_MAX_SIZED(_buf_used(outputbuf),bt,outputbuf->size);
-	
-	LOCK;	
-	output.device_frames = 0; 
-	output.updated = gettime_ms();
-	output.frames_played_dmp = output.frames_played;
-	_output_frames(iframes); 
-	output.frames_in_process = oframes;
-	UNLOCK;
 	
-	equalizer_process(data, oframes * BYTES_PER_FRAME, output.current_sample_rate);
+	// drop what was rendered before a flush (what we have already taken can't be)
+	u32_t flush_req = __atomic_load_n(&fifo.flush_req, __ATOMIC_ACQUIRE);
+	if (flush_req != fifo.flush_ack) {
+		u32_t flush_wp = __atomic_load_n(&fifo.flush_wp, __ATOMIC_RELAXED);
+		if ((s32_t) (flush_wp - fifo.rp) > 0) fifo.rp = flush_wp;
+		fifo.flush_ack = flush_req;
+	}
+	
+	u32_t used = __atomic_load_n(&fifo.wp, __ATOMIC_ACQUIRE) - fifo.rp;
+	u32_t rp = fifo.rp % BT_FIFO_SIZE;
+	u32_t bytes = min(used, len / BYTES_PER_FRAME * BYTES_PER_FRAME);
+	u32_t cont = min(bytes, BT_FIFO_SIZE - rp);
+	
+	memcpy(data, fifo.buf + rp, cont);
+	memcpy(data + cont, fifo.buf, bytes - cont);
+	__atomic_store_n(&fifo.rp, fifo.rp + bytes, __ATOMIC_RELEASE);
+	
+	// non-blocking, producer will refill
+	if (task) xTaskNotifyGive(task);
 
-	SET_MIN_MAX(TIME_MEASUREMENT_GET(start_timer),lock_out_time);
-	SET_MIN_MAX((len-oframes*BYTES_PER_FRAME), rec);
-	TIME_MEASUREMENT_START(start_timer);
+	// This is how the BTC layer calculates the number of bytes to
+	// for us to send. (BTC_SBC_DEC_PCM_DATA_LEN * sizeof(OI_INT16) - availPcmBytes
+	SET_MIN_MAX(len, req);
+	SET_MIN_MAX(bytes, rec);
+	SET_MIN_MAX_SIZED(used, fifo_buf, BT_FIFO_SIZE);
+	if (bytes < len / BYTES_PER_FRAME * BYTES_PER_FRAME) {
+		SET_MIN_MAX(len - bytes, under);
+	}	
+	SET_MIN_MAX(TIME_MEASUREMENT_GET(start_timer), cb_time);
 
-	return oframes * BYTES_PER_FRAME;
+	return bytes;
 }
 
 void output_bt_tick(void) {
@@ -163,6 +294,9 @@ void output_bt_tick(void) {
     SET_MIN_MAX_SIZED(_buf_used(streambuf), stream_buf, streambuf->size);
     UNLOCK_S;
 	
+	// no need to lock
+	SET_MIN_MAX_SIZED(_buf_used(outputbuf), bt, outputbuf->size);
+	
 	if (stats && lastTime <= gettime_ms() )
 	{
 		lastTime = gettime_ms() + STATS_REPORT_DELAY_MS;
@@ -173,6 +307,7 @@ void output_bt_tick(void) {
 		LOG_INFO("              +==========+==========+================+=====+================+");
 		LOG_INFO(LINE_MIN_MAX_FORMAT,LINE_MIN_MAX("stream avl",stream_buf));
 		LOG_INFO(LINE_MIN_MAX_FORMAT,LINE_MIN_MAX("output avl",bt));
+		LOG_INFO(LINE_MIN_MAX_FORMAT,LINE_MIN_MAX("fifo avl",fifo_buf));
 		LOG_INFO(LINE_MIN_MAX_FORMAT,LINE_MIN_MAX("requested",req));
 		LOG_INFO(LINE_MIN_MAX_FORMAT,LINE_MIN_MAX("received",rec));
 		LOG_INFO(LINE_MIN_MAX_FORMAT,LINE_MIN_MAX("underrun",under));
@@ -182,6 +317,7 @@ void output_bt_tick(void) {
 		LOG_INFO("              max (us)  | min (us) |   avg(us) |  count    |  ");
 		LOG_INFO("              ==========+==========+===========+===========+  ");
 		LOG_INFO(LINE_MIN_MAX_DURATION_FORMAT,LINE_MIN_MAX_DURATION("Out Buf Lock",lock_out_time));
+		LOG_INFO(LINE_MIN_MAX_DURATION_FORMAT,LINE_MIN_MAX_DURATION("Callback",cb_time));
 		LOG_INFO("              ==========+==========+===========+===========+");
 		RESET_ALL_MIN_MAX;
 	}	
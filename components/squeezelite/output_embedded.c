@@ -30,6 +30,7 @@ extern void output_close_bt(void);
 extern void output_init_i2s(log_level level, char *device, unsigned output_buf_size, char *params, 
 						  unsigned rates[], unsigned rate_delay, unsigned idle);					
 extern bool output_volume_i2s(unsigned left, unsigned right); 
+extern bool output_trim_i2s(s32_t ppm);
 extern void output_close_i2s(void); 
 
 // controls.c
@@ -38,6 +39,7 @@ extern void cli_controls_init(void);
 static log_level loglevel;
 
 static bool (*volume_cb)(unsigned left, unsigned right);
+static bool (*trim_cb)(s32_t ppm);
 static void (*close_cb)(void);
 
 #pragma pack(push, 1)
@@ -86,6 +88,7 @@ void output_init_embedded(log_level level, char *device, unsigned output_buf_siz
 		LOG_INFO("init I2S/SPDIF");
 		close_cb = &output_close_i2s;
 		volume_cb = &output_volume_i2s;
+		trim_cb = &output_trim_i2s;
 		output_init_i2s(level, device, output_buf_size, params, rates, rate_delay, idle);
 	}	
 	
@@ -103,12 +106,18 @@ void output_close_embedded(void) {
 
 void set_volume(unsigned left, unsigned right) { 
 	LOG_DEBUG("setting internal gain left: %u right: %u", left, right);
-	if (!volume_cb || !(*volume_cb)(left, right)) {
-		LOCK;
-		output.gainL = left;
-		output.gainR = right;
-		UNLOCK;
-	} 
+	// when DAC does volume, samples are only scaled for fades and replay gain
+	bool hw = volume_cb && (*volume_cb)(left, right);
+	LOCK;
+	output.gainL = hw ? FIXED_ONE : left;
+	output.gainR = hw ? FIXED_ONE : right;
+	UNLOCK;
+}
+
+bool set_rate_trim(s32_t ppm) {
+	LOG_DEBUG("setting rate trim %d ppm", ppm);
+	if (trim_cb) (*trim_cb)(ppm);
+	return trim_cb != NULL;
 }
 
 bool test_open(const char *device, unsigned rates[], bool userdef_rates) {
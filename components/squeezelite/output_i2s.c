@@ -18,11 +18,18 @@ has been written (it uses a queue with produce / consume).
 The first hack is to consume that length at the beginning of tracks when
 synchronization is active. It's about ~180ms @ 44.1kHz
 
-The second hack is that we never know exactly the number of frames in the 
-DMA buffers when we update the output.frames_played_dmp. We assume that
-after i2s_write, these buffers are always full so by measuring the gap
-between time after i2s_write and update of frames_played_dmp, we have a
-good idea of the error. 
+The number of frames in the DMA buffers when we update frames_played_dmp
+is given by the driver's clock, which timestamps each DMA descriptor end
+(EOF interrupt) and interpolates in between.
+
+In dual mode (device "I2S+SPDIF"), the DAC and the SPDIF are on both I2S
+ports, fed from the same frames. They share the APLL so they consume at the
+same pace and DMA depths are the same, which puts them on the same timeline.
+
+DMA descriptors are re-planned at each sample rate (see dma_plan.h) so that
+latency and interrupt rate are in time, not in frames. Defaults give at 
+44.1kHz what fixed buffers did, higher rates are limited by DMA memory unless
+NVS "dma_config" allows more.
 
 The third hack is when sample rate changes, buffers are reset and we also
 do the change too early, but can't do that exaclty at the right time. So 
@@ -46,15 +53,20 @@ sure that using rate_delay would fix that
 #include "accessors.h"
 #include "equalizer.h"
 #include "globdefs.h"
+#include "i2s_clock.h"
+#include "esp_timer.h"
+#include "rate_trim.h"
+#include "dma_plan.h"
 
 #define LOCK   mutex_lock(outputbuf->mutex)
 #define UNLOCK mutex_unlock(outputbuf->mutex)
 
 #define FRAME_BLOCK MAX_SILENCE_FRAMES
 
-// must have an integer ratio with FRAME_BLOCK (see spdif comment)
-#define DMA_BUF_LEN		512	
-#define DMA_BUF_COUNT	12
+// DMA budgets, memory is what 24x128 frames of SPDIF (or 12x512 of 32 bits DAC) use
+#define DMA_LATENCY_MS	140
+#define DMA_IRQ_MAX		200
+#define DMA_BYTES		(48*1024)
 
 #define DECLARE_ALL_MIN_MAX 	\
 	DECLARE_MIN_MAX(o); 		\
@@ -90,7 +102,21 @@ static i2s_config_t i2s_config;
 static u8_t *obuf;
 static frames_t oframes;
 static bool spdif;
+// DAC and SPDIF at once, SPDIF on the other port owns the APLL and DAC port divides it
+static struct {
+	bool enabled, eq, fixed;
+	int port;
+	s32_t gain[2][2];		// DAC and SPDIF, left and right
+	u8_t *buf;				// DAC frames
+} dual = { .gain = { { FIXED_ONE, FIXED_ONE }, { FIXED_ONE, FIXED_ONE } } };
 static size_t dma_buf_frames;
+// plan of CONFIG_I2S_NUM and of SPDIF port in dual mode
+static struct {
+	u32_t latency_ms, irq_max, bytes_max;
+	dma_plan_t plan[2];
+	u32_t since, base[2];
+	volatile u32_t underruns[2];
+} dma;
 static pthread_t thread;
 static TaskHandle_t stats_task;
 static bool stats;
@@ -99,13 +125,20 @@ static struct {
 } amp_control = { -1, 1 },
   mute_control = { CONFIG_MUTE_GPIO, CONFIG_MUTE_GPIO_LEVEL };
 
+static struct {
+	volatile s32_t ppm;
+	s32_t applied;
+	bool apll;
+	u8_t *buf;
+	rate_trim_asrc_t asrc;
+} trim;
+
 DECLARE_ALL_MIN_MAX;
 
 static int _i2s_write_frames(frames_t out_frames, bool silence, s32_t gainL, s32_t gainR,
 								s32_t cross_gain_in, s32_t cross_gain_out, ISAMPLE_T **cross_ptr);
 static void *output_thread_i2s(void *arg);
 static void output_thread_i2s_stats(void *arg);
-static void spdif_convert(ISAMPLE_T *src, size_t frames, u32_t *dst, size_t *count);
 static void (*jack_handler_chain)(bool inserted);
 
 #define I2C_PORT	0
@@ -125,8 +158,8 @@ static bool handler(u8_t *data, int len){
 			jack_mutes_amp = pkt->config == 0;
 			config_set_value(NVS_TYPE_STR, "jack_mutes_amp", jack_mutes_amp ? "y" : "n");		
 			
-			if (jack_mutes_amp && jack_inserted_svc()) adac->speaker(false);
-			else adac->speaker(true);
+			if (jack_mutes_amp && jack_inserted_svc()) adac_speaker(false);
+			else adac_speaker(true);
 		}
 
 		LOG_INFO("got AUDO %02x", pkt->config);
@@ -147,13 +180,13 @@ static void jack_handler(bool inserted) {
 	// jack detection bounces a bit but that seems fine
 	if (jack_mutes_amp) {
 		LOG_INFO("switching amplifier %s", inserted ? "OFF" : "ON");
-		if (inserted) adac->speaker(false);
-		else adac->speaker(true);
+		if (inserted) adac_speaker(false);
+		else adac_speaker(true);
 	}
 	
 	// activate headset
-	if (inserted) adac->headset(true);
-	else adac->headset(false);
+	if (inserted) adac_headset(true);
+	else adac_headset(false);
 	
 	// and chain if any
 	if (jack_handler_chain) (jack_handler_chain)(inserted);
@@ -188,22 +221,152 @@ static void set_i2s_pin(char *config, i2s_pin_config_t *pin_config) {
 	if ((p = strcasestr(config, "do")) != NULL) pin_config->data_out_num = atoi(strchr(p, '=') + 1);
 }
 
+/****************************************************************************************
+ * DMA budgets from NVS, latency (ms), interrupts per second and memory (kB) 
+ */
+static void dma_init(void) {
+	char p[64] = "", *q;
+	
+	dma.latency_ms = DMA_LATENCY_MS;
+	dma.bytes_max = DMA_BYTES;
+	dma.irq_max = DMA_IRQ_MAX;
+
+	config_get_str("dma_config", p, sizeof(p));
+	if ((q = strcasestr(p, "latency")) != NULL) dma.latency_ms = atoi(strchr(q, '=') + 1);
+	if ((q = strcasestr(p, "irq")) != NULL) dma.irq_max = atoi(strchr(q, '=') + 1);
+	if ((q = strcasestr(p, "memory")) != NULL) dma.bytes_max = atoi(strchr(q, '=') + 1) * 1024;
+}
+
+/****************************************************************************************
+ * DMA geometry for a rate, SPDIF first as in dual mode DAC must have the same depth
+ */
+static bool dma_plan_rate(u32_t rate, dma_plan_t plan[2]) {
+	dma_plan_req_t req = { .rate = rate, .block = FRAME_BLOCK, .latency_ms = dma.latency_ms, 
+						   .irq_max = dma.irq_max, .bytes_max = dma.bytes_max };
+	
+	// SPDIF has 2 DMA frames of 2 x 32 bits per audio frame
+	if (spdif || dual.enabled) {
+		req.frame_bytes = 16;
+		if (!dma_plan(&req, plan + (dual.enabled ? 1 : 0))) return false;
+		if (spdif) return true;
+		req.frames = plan[1].frames;
+	}	
+	
+	req.frame_bytes = i2s_config.bits_per_sample / 8 * 2;
+	return dma_plan(&req, plan);
+}
+
+/****************************************************************************************
+ * Log current geometry and count underruns from now
+ */
+static void dma_start(u32_t rate) {
+	dma.since = gettime_ms();
+	
+	for (int i = 0; i < (dual.enabled ? 2 : 1); i++) {
+		i2s_clock_t clock = { 0 };
+		dma_plan_t *plan = dma.plan + i;
+		int port = i ? dual.port : CONFIG_I2S_NUM;
+		
+		i2s_get_clock(port, &clock);
+		dma.base[i] = dma.underruns[i] = clock.underruns;
+		LOG_INFO("DMA I2S%d @%uHz: %u x %u frames (%u bytes), latency %u ms, %u irq/s%s%s", port, rate, plan->count, plan->len, 
+				 plan->bytes, plan->latency_us / 1000, plan->irq, (plan->limits & DMA_PLAN_IRQ) ? ", over irq budget" : "",
+				 (plan->limits & DMA_PLAN_MEMORY) ? ", memory bound" : "");
+	}	
+}
+
+/****************************************************************************************
+ * Rebuild DMA queues for a new rate, ports are stopped and restarted by rate change.
+ * Returns false when a driver had to be uninstalled (no memory even for old queue)
+ */
+static bool dma_apply(u32_t from, u32_t rate) {
+	dma_plan_t plan[2] = { { 0 } };
+	esp_err_t err = ESP_OK;
+	
+	for (int i = 0; i < (dual.enabled ? 2 : 1); i++) {
+		LOG_INFO("DMA I2S%d @%uHz: %u underruns in %u s", i ? dual.port : CONFIG_I2S_NUM, from, 
+				 dma.underruns[i] - dma.base[i], (gettime_ms() - dma.since) / 1000);
+	}	
+	
+	if (!dma_plan_rate(rate, plan)) {
+		LOG_WARN("no DMA plan @%uHz, keeping %u x %u", rate, dma.plan[0].count, dma.plan[0].len);
+	} else if (dual.enabled && (err = i2s_set_dma_geometry(dual.port, plan[1].count, plan[1].len * 2)) != ESP_OK) {
+		LOG_WARN("can't set SPDIF DMA geometry");
+	} else if ((err = i2s_set_dma_geometry(CONFIG_I2S_NUM, plan[0].count, plan[0].len * (spdif ? 2 : 1))) != ESP_OK) {
+		LOG_WARN("can't set DMA geometry");
+		// both must have the same depth
+		if (dual.enabled && err != ESP_FAIL) err = i2s_set_dma_geometry(dual.port, dma.plan[1].count, dma.plan[1].len * 2);
+	} else {
+		memcpy(dma.plan, plan, sizeof(plan));
+		dma_buf_frames = dma.plan[0].frames;
+	}
+	
+	if (err == ESP_FAIL) return false;
+	
+	dma_start(rate);
+	return true;
+}
+
+/****************************************************************************************
+ * SPDIF port in dual mode, it only needs DO as the APLL clocks both ports
+ */
+static esp_err_t dual_init(i2s_pin_config_t *pin) {
+	i2s_config_t config = i2s_config;
+	esp_err_t res;
+	char p[8] = "follow";
+	
+	dual.port = CONFIG_I2S_NUM == I2S_NUM_0 ? I2S_NUM_1 : I2S_NUM_0;
+	
+	config_get_str("spdif_volume", p, sizeof(p));
+	dual.fixed = !strcasecmp(p, "fixed");
+	
+	strcpy(p, "y");
+	config_get_str("spdif_eq", p, sizeof(p));
+	dual.eq = *p == '1' || *p == 'Y' || *p == 'y';
+	
+	dual.buf = malloc((FRAME_BLOCK + 2) * BYTES_PER_FRAME);
+	if (!dual.buf) return ESP_ERR_NO_MEM;
+	
+	// see SPDIF mode in output_init_i2s 
+	config.sample_rate = output.current_sample_rate * 2;
+	config.bits_per_sample = 32;
+	config.dma_buf_len = dma.plan[1].len * 2;	
+	config.dma_buf_count = dma.plan[1].count;
+	config.use_apll = true;
+	pin->bck_io_num = pin->ws_io_num = -1;
+
+	res = i2s_driver_install(dual.port, &config, 0, NULL);
+	if (res == ESP_OK) {
+		res = i2s_set_pin(dual.port, pin);
+		if (res == ESP_OK && !i2s_share_clock(CONFIG_I2S_NUM, dual.port)) {
+			LOG_ERROR("DAC can't use SPDIF clock");
+			res = ESP_FAIL;
+		}	
+		if (res != ESP_OK) i2s_driver_uninstall(dual.port);
+	}	
+		
+	LOG_INFO("SPDIF using I2S%d do:%d, volume %s, equalizer %s (res:%d)", dual.port, pin->data_out_num, 
+			 dual.fixed ? "fixed" : "follows", dual.eq ? "on" : "off", res);
+	
+	if (res != ESP_OK) free(dual.buf);
+	return res;
+}
+
 /****************************************************************************************
  * Initialize the DAC output
  */
 void output_init_i2s(log_level level, char *device, unsigned output_buf_size, char *params, unsigned rates[], unsigned rate_delay, unsigned idle) {
 	loglevel = level;
 	int silent_do = -1;
-	char *p;
+	char *p, flag[4] = "n";
 	esp_err_t res;
 
 	// chain SLIMP handlers
 	slimp_handler_chain = slimp_handler;
 	slimp_handler = handler;	
 	
-	p = config_alloc_get_default(NVS_TYPE_STR, "jack_mutes_amp", "n", 0);
-	jack_mutes_amp = (strcmp(p,"1") == 0 ||strcasecmp(p,"y") == 0);
-	free(p);
+	config_get_str("jack_mutes_amp", flag, sizeof(flag));
+	jack_mutes_amp = (strcmp(flag,"1") == 0 ||strcasecmp(flag,"y") == 0);
 	
 #if BYTES_PER_FRAME == 8
 	output.format = S32_LE;
@@ -213,8 +376,10 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 
 	output.write_cb = &_i2s_write_frames;
 	
-	obuf = malloc(FRAME_BLOCK * BYTES_PER_FRAME);
-	if (!obuf) {
+	// rate trim resampler might output a couple of frames more
+	obuf = malloc((FRAME_BLOCK + 2) * BYTES_PER_FRAME);
+	trim.buf = malloc((FRAME_BLOCK + 2) * BYTES_PER_FRAME);
+	if (!obuf || !trim.buf) {
 		LOG_ERROR("Cannot allocate i2s buffer");
 		return;
 	}
@@ -248,7 +413,10 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 	i2s_config.use_apll = true;
 	i2s_config.intr_alloc_flags = ESP_INTR_FLAG_LEVEL1; //Interrupt level 1
 	
-	if (strcasestr(device, "spdif")) {
+	dual.enabled = strcasestr(device, "spdif") && strcasestr(device, "i2s");
+	dma_init();
+	
+	if (strcasestr(device, "spdif") && !dual.enabled) {
 		spdif = true;	
 
 		if (i2s_spdif_pin.bck_io_num == -1 || i2s_spdif_pin.ws_io_num == -1 || i2s_spdif_pin.data_out_num == -1) {
@@ -259,15 +427,16 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 									
 		i2s_config.sample_rate = output.current_sample_rate * 2;
 		i2s_config.bits_per_sample = 32;
+		dma_plan_rate(output.current_sample_rate, dma.plan);
 		// Normally counted in frames, but 16 sample are transformed into 32 bits in spdif
-		i2s_config.dma_buf_len = DMA_BUF_LEN / 2;	
-		i2s_config.dma_buf_count = DMA_BUF_COUNT * 2;
+		i2s_config.dma_buf_len = dma.plan[0].len * 2;	
+		i2s_config.dma_buf_count = dma.plan[0].count;
 		/* 
 		   In DMA, we have room for (LEN * COUNT) frames of 32 bits samples that 
-		   we push at sample_rate * 2. Each of these peuso-frames is a single true
+		   we push at sample_rate * 2. Two of these pseudo-frames are a single true
 		   audio frame. So the real depth is true frames is (LEN * COUNT / 2)
 		*/   
-		dma_buf_frames = DMA_BUF_COUNT * DMA_BUF_LEN / 2;	
+		dma_buf_frames = dma.plan[0].frames;	
 		
 		// silence DAC output if sharing the same ws/bck
 		if (i2s_dac_pin.ws_io_num == i2s_spdif_pin.ws_io_num && i2s_dac_pin.bck_io_num == i2s_spdif_pin.bck_io_num)	silent_do = i2s_dac_pin.data_out_num;		
@@ -278,13 +447,15 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 	} else {
 		i2s_config.sample_rate = output.current_sample_rate;
 		i2s_config.bits_per_sample = BYTES_PER_FRAME * 8 / 2;
-		// Counted in frames (but i2s allocates a buffer <= 4092 bytes)
-		i2s_config.dma_buf_len = DMA_BUF_LEN;	
-		i2s_config.dma_buf_count = DMA_BUF_COUNT;
-		dma_buf_frames = DMA_BUF_COUNT * DMA_BUF_LEN;	
 		
 		// silence SPDIF output
 		silent_do = i2s_spdif_pin.data_out_num;		
+		
+		// SPDIF sets the APLL
+		if (dual.enabled) {
+			i2s_config.use_apll = false;
+			silent_do = -1;
+		}
 
 		char model[32] = "i2s";
 		if ((p = strcasestr(dac_config, "model")) != NULL) sscanf(p, "%*[^=]=%31[^,]", model);
@@ -297,6 +468,12 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 
 		for (int i = 0; adac == &dac_external && dac_set[i]; i++) if (strcasestr(dac_set[i]->model, model)) adac = dac_set[i];
 		res = adac->init(dac_config, I2C_PORT, &i2s_config) ? ESP_OK : ESP_FAIL;
+		
+		// DAC sets bits per sample, in dual mode depth is SPDIF's (counted in frames, <= 4092 bytes)
+		dma_plan_rate(output.current_sample_rate, dma.plan);
+		i2s_config.dma_buf_len = dma.plan[0].len;	
+		i2s_config.dma_buf_count = dma.plan[0].count;
+		dma_buf_frames = dma.plan[0].frames;	
 
 		res |= i2s_driver_install(CONFIG_I2S_NUM, &i2s_config, 0, NULL);
 		res |= i2s_set_pin(CONFIG_I2S_NUM, &i2s_dac_pin);
@@ -309,6 +486,12 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 				
 		LOG_INFO("%s DAC using I2S bck:%d, ws:%d, do:%d, mute:%d:%d (res:%d)", model, i2s_dac_pin.bck_io_num, i2s_dac_pin.ws_io_num, 
 																   i2s_dac_pin.data_out_num, mute_control.gpio, mute_control.active, res);
+		
+		// DAC alone still works (on PLL_D2)
+		if (dual.enabled && res == ESP_OK && dual_init(&i2s_spdif_pin) != ESP_OK) {
+			LOG_WARN("SPDIF not available, using DAC only");
+			dual.enabled = false;
+		}	
 	}	
 			
 	free(dac_config);
@@ -326,23 +509,32 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 		gpio_set_level(silent_do, 0);
 	}	
 
+	dma_start(output.current_sample_rate);
+
 	LOG_INFO("Initializing I2S mode %s with rate: %d, bits per sample: %d, buffer frames: %d, number of buffers: %d ", 
-			spdif ? "S/PDIF" : "normal", 
+			spdif ? "S/PDIF" : (dual.enabled ? "normal + S/PDIF" : "normal"), 
 			i2s_config.sample_rate, i2s_config.bits_per_sample, i2s_config.dma_buf_len, i2s_config.dma_buf_count);
 	
 	i2s_stop(CONFIG_I2S_NUM);
 	i2s_zero_dma_buffer(CONFIG_I2S_NUM);
+	if (dual.enabled) {
+		i2s_stop(dual.port);
+		i2s_zero_dma_buffer(dual.port);
+	}	
 	isI2SStarted=false;
 	
-	adac->power(ADAC_STANDBY);
+	adac_power(ADAC_STANDBY);
 
 	jack_handler_chain = jack_handler_svc;
 	jack_handler_svc = jack_handler;
 	
-	if (jack_mutes_amp && jack_inserted_svc()) adac->speaker(false);
-	else adac->speaker(true);
+	if (jack_mutes_amp && jack_inserted_svc()) adac_speaker(false);
+	else adac_speaker(true);
+	
+	adac_headset(jack_inserted_svc());
 	
-	adac->headset(jack_inserted_svc());
+	// from now on, I2C is done by DAC control task (in all modes, external DAC can have a power sequence)
+	adac_async_start(adac);
 	
 	parse_set_GPIO(set_amp_gpio);
 		
@@ -356,9 +548,9 @@ void output_init_i2s(log_level level, char *device, unsigned output_buf_size, ch
 	pthread_create(&thread, NULL, output_thread_i2s, NULL);
 	
 	// do we want stats
-	p = config_alloc_get_default(NVS_TYPE_STR, "stats", "n", 0);
-	stats = p && (*p == '1' || *p == 'Y' || *p == 'y');
-	free(p);
+	strcpy(flag, "n");
+	config_get_str("stats", flag, sizeof(flag));
+	stats = *flag == '1' || *flag == 'Y' || *flag == 'y';
 	
 	// memory still used but at least task is not created
 	if (stats) {
@@ -380,10 +572,16 @@ void output_close_i2s(void) {
 	if (stats) vTaskDelete(stats_task);
 	
 	i2s_driver_uninstall(CONFIG_I2S_NUM);
+	if (dual.enabled) {
+		i2s_driver_uninstall(dual.port);
+		free(dual.buf);
+	}	
 	free(obuf);
+	free(trim.buf);
 	
 	equalizer_close();
 	
+	adac_async_stop();
 	adac->deinit();
 }
 
@@ -392,9 +590,25 @@ void output_close_i2s(void) {
  */
 bool output_volume_i2s(unsigned left, unsigned right) {
 	if (mute_control.gpio >= 0) gpio_set_level(mute_control.gpio, (left | right) ? !mute_control.active : mute_control.active);
-	return adac->volume(left, right);
+	if (!dual.enabled) return adac_volume(left, right);
+	
+	// each output has its own gain, so it is all done here 
+	bool hw = adac_volume(left, right);
+	dual.gain[0][0] = hw ? FIXED_ONE : left;
+	dual.gain[0][1] = hw ? FIXED_ONE : right;
+	dual.gain[1][0] = dual.fixed ? FIXED_ONE : left;
+	dual.gain[1][1] = dual.fixed ? FIXED_ONE : right;
+	return true;
 } 
 
+/****************************************************************************************
+ * change playback rate by ppm, applied by output thread
+ */
+bool output_trim_i2s(s32_t ppm) {
+	trim.ppm = ppm;
+	return true;
+}
+
 /****************************************************************************************
  * Write frames to the output buffer
  */
@@ -451,14 +665,14 @@ static void *output_thread_i2s(void *arg) {
 	size_t count = 0, bytes;
 	frames_t iframes = FRAME_BLOCK;
 	uint32_t timer_start = 0;
-	int discard = 0;
-	uint32_t fullness = gettime_ms();
 	bool synced;
+	i2s_clock_t clock;
 	output_state state = OUTPUT_OFF - 1;
 	char *sbuf = NULL;
+	prof_mark_t lock;
 	
 	// spdif needs 16 bytes per frame : 32 bits/sample, 2 channels, BMC encoded
-	if (spdif && (sbuf = malloc(FRAME_BLOCK * 16)) == NULL) {
+	if ((spdif || dual.enabled) && (sbuf = malloc((FRAME_BLOCK + 2) * 16)) == NULL) {
 		LOG_ERROR("Cannot allocate SPDIF buffer");
 	}
 	
@@ -467,6 +681,7 @@ static void *output_thread_i2s(void *arg) {
 		TIME_MEASUREMENT_START(timer_start);
 
 		LOCK;
+		PROFILE_RESTART(lock);
 		
 		// manage led display & analogue
 		if (state != output.state) {
@@ -476,21 +691,23 @@ static void *output_thread_i2s(void *arg) {
 				if (amp_control.gpio != -1) gpio_set_level(amp_control.gpio, !amp_control.active);
 				LOG_INFO("switching off amp GPIO %d", amp_control.gpio);
 			} else if (output.state == OUTPUT_STOPPED) {
-				adac->speaker(false);
+				adac_speaker(false);
 				led_blink(LED_GREEN, 200, 1000);
 			} else if (output.state == OUTPUT_RUNNING) {
-				if (!jack_mutes_amp || !jack_inserted_svc()) adac->speaker(true);
+				if (!jack_mutes_amp || !jack_inserted_svc()) adac_speaker(true);
 				led_on(LED_GREEN);
 			}	
 		}
 		state = output.state;
 		
 		if (output.state == OUTPUT_OFF) {
+			PROFILE_STOP(PROF_LOCK_OUTPUTBUF_OUT, lock);
 			UNLOCK;
 			if (isI2SStarted) {
 				isI2SStarted = false;
 				i2s_stop(CONFIG_I2S_NUM);
-				adac->power(ADAC_STANDBY);
+				if (dual.enabled) i2s_stop(dual.port);
+				adac_power(ADAC_STANDBY);
 				count = 0;
 			}
 			usleep(100000);
@@ -500,11 +717,21 @@ static void *output_thread_i2s(void *arg) {
 		}
 					
 		oframes = 0;
-		output.updated = gettime_ms();
+		output.updated_us = esp_timer_get_time();
+		output.updated = output.updated_us / 1000;
 		output.frames_played_dmp = output.frames_played;
-		// try to estimate how much we have consumed from the DMA buffer (calculation is incorrect at the very beginning ...)
-		output.device_frames = dma_buf_frames - ((output.updated - fullness) * output.current_sample_rate) / 1000;
+		// frames ahead of what we write next, when stopped DMA will restart with full (silent) buffers
+		if (isI2SStarted && i2s_get_clock(CONFIG_I2S_NUM, &clock)) {
+			// spdif uses 2 DMA frames per audio frame
+			output.device_frames = i2s_clock_pending(&clock, output.updated_us) / (spdif ? 2 : 1);
+			dma.underruns[0] = clock.underruns;
+			if (dual.enabled && i2s_get_clock(dual.port, &clock)) dma.underruns[1] = clock.underruns;
+		} else {
+			output.device_frames = dma_buf_frames;
+		}
+		PROFILE_START(mark);
 		_output_frames( iframes );
+		PROFILE_STOP(PROF_PACK, mark);
 		// oframes must be a global updated by the write callback
 		output.frames_in_process = oframes;
 						
@@ -513,19 +740,10 @@ static void *output_thread_i2s(void *arg) {
 		SET_MIN_MAX_SIZED(_buf_used(streambuf),s,streambuf->size);
 		SET_MIN_MAX( TIME_MEASUREMENT_GET(timer_start),buffering);
 		
-		/* must skip first whatever is in the pipe (but not when resuming). 
-		This test is incorrect when we pause a track that has just started, 
-		but this is higly unlikely and I don't have a better one for now */
-		if (output.state == OUTPUT_START_AT) {
-			discard = output.frames_played_dmp ? 0 : output.device_frames;
-			synced = true;
-		} else if (discard) {
-			discard -= oframes;
-			iframes = discard ? min(FRAME_BLOCK, discard) : FRAME_BLOCK;
-			UNLOCK;
-			continue;
-		}
+		// start at accounts for device_frames, so there is nothing to discard
+		if (output.state == OUTPUT_START_AT) synced = true;
 		
+		PROFILE_STOP(PROF_LOCK_OUTPUTBUF_OUT, lock);
 		UNLOCK;
 				
 		// now send all the data
@@ -535,8 +753,12 @@ static void *output_thread_i2s(void *arg) {
 			isI2SStarted = true;
 			LOG_INFO("Restarting I2S.");
 			i2s_zero_dma_buffer(CONFIG_I2S_NUM);
+			if (dual.enabled) {
+				i2s_zero_dma_buffer(dual.port);
+				i2s_start(dual.port);
+			}	
 			i2s_start(CONFIG_I2S_NUM);
-			adac->power(ADAC_ON);	
+			adac_power(ADAC_ON);	
 			if (amp_control.gpio != -1) gpio_set_level(amp_control.gpio, amp_control.active);
 		} 
 		
@@ -546,36 +768,84 @@ static void *output_thread_i2s(void *arg) {
 			if (synced) {
 			/* 				
 				//  can sleep for a buffer_queue - 1 and then eat a buffer (discard) if we are synced
-				usleep(((DMA_BUF_COUNT - 1) * DMA_BUF_LEN * BYTES_PER_FRAME * 1000) / 44100 * 1000);
-				discard = DMA_BUF_COUNT * DMA_BUF_LEN * BYTES_PER_FRAME;
+				usleep(((dma.plan[0].count - 1) * dma.plan[0].len * BYTES_PER_FRAME * 1000) / 44100 * 1000);
+				discard = dma.plan[0].frames * BYTES_PER_FRAME;
 			*/		
 			}	
+			// stops ports, set_sample_rates restarts them
+			if (!dma_apply(i2s_config.sample_rate, output.current_sample_rate)) {
+				LOG_ERROR("lost I2S driver, no memory for DMA, stopping output");
+				break;
+			}	
 			i2s_config.sample_rate = output.current_sample_rate;
+			// SPDIF first as it sets the APLL that DAC divides
+			if (dual.enabled) {
+				i2s_set_sample_rates(dual.port, i2s_config.sample_rate * 2);
+				i2s_zero_dma_buffer(dual.port);
+			}	
 			i2s_set_sample_rates(CONFIG_I2S_NUM, spdif ? i2s_config.sample_rate * 2 : i2s_config.sample_rate);
 			i2s_zero_dma_buffer(CONFIG_I2S_NUM);
+			// APLL is back to nominal rate
+			trim.applied = 0;
 			
 			equalizer_close();
 			equalizer_open(output.current_sample_rate);
 			//return;
 		}
 		
-		// run equalizer
-		equalizer_process(obuf, oframes * BYTES_PER_FRAME, output.current_sample_rate);
+		// run equalizer, in dual mode it's applied to DAC only if SPDIF does not want it
+		if (!dual.enabled || dual.eq) equalizer_process(obuf, oframes * BYTES_PER_FRAME, output.current_sample_rate);
+
+		// rate trim goes to APLL when possible, otherwise we resample
+		if (trim.ppm != trim.applied) {
+			trim.apll = i2s_trim_clock(dual.enabled ? dual.port : CONFIG_I2S_NUM, trim.ppm);
+			if (!trim.apll && !trim.applied) rate_trim_asrc_reset(&trim.asrc);
+			trim.applied = trim.ppm;
+		}
+#if BYTES_PER_FRAME == 4
+		if (trim.applied && !trim.apll) {
+			u8_t *p = obuf;
+			oframes = rate_trim_asrc(&trim.asrc, trim.applied, (s16_t*) obuf, oframes, (s16_t*) trim.buf);
+			obuf = trim.buf;
+			trim.buf = p;
+		}
+#endif
 		
 		// we assume that here we have been able to entirely fill the DMA buffers
 		if (spdif) {
+			PROFILE_RESTART(mark);
 			spdif_convert((ISAMPLE_T*) obuf, oframes, (u32_t*) sbuf, &count);
+			PROFILE_STOP(PROF_SPDIF, mark);
+			PROFILE_RESTART(mark);
 			i2s_write(CONFIG_I2S_NUM, sbuf, oframes * 16, &bytes, portMAX_DELAY);
 			bytes /= 4;
+		} else {
+			u8_t *dbuf = obuf;
+			
+			// one pass makes both, then DAC EQ if SPDIF has none
+			if (dual.enabled) {
+				PROFILE_RESTART(mark);
+				spdif_split((ISAMPLE_T*) obuf, oframes, (ISAMPLE_T*) dual.buf, dual.gain[0], (u32_t*) sbuf, dual.gain[1], &count);
+				PROFILE_STOP(PROF_DUAL, mark);
+				if (!dual.eq) equalizer_process(dual.buf, oframes * BYTES_PER_FRAME, output.current_sample_rate);
+				dbuf = dual.buf;
+			}	
+			
+			PROFILE_RESTART(mark);
 #if BYTES_PER_FRAME == 4		
-		} else if (i2s_config.bits_per_sample == 32) {  
-			i2s_write_expand(CONFIG_I2S_NUM, obuf, oframes * BYTES_PER_FRAME, 16, 32, &bytes, portMAX_DELAY);
+			if (i2s_config.bits_per_sample == 32) i2s_write_expand(CONFIG_I2S_NUM, dbuf, oframes * BYTES_PER_FRAME, 16, 32, &bytes, portMAX_DELAY);
+			else
 #endif			
-		} else {
-			i2s_write(CONFIG_I2S_NUM, obuf, oframes * BYTES_PER_FRAME, &bytes, portMAX_DELAY);
+			i2s_write(CONFIG_I2S_NUM, dbuf, oframes * BYTES_PER_FRAME, &bytes, portMAX_DELAY);
+			
+			// both drain at the same pace, so once DAC had room SPDIF has too
+			if (dual.enabled) {
+				size_t sbytes;
+				i2s_write(dual.port, sbuf, oframes * 16, &sbytes, portMAX_DELAY);
+				if (sbytes != oframes * 16) LOG_WARN("SPDIF DMA Overflow! available bytes: %d, I2S wrote %d bytes", oframes * 16, sbytes);
+			}	
 		}
-
-		fullness = gettime_ms();
+		PROFILE_STOP(PROF_I2S_WRITE, mark);
 			
 		if (bytes != oframes * BYTES_PER_FRAME) {
 			LOG_WARN("I2S DMA Overflow! available bytes: %d, I2S wrote %d bytes", oframes * BYTES_PER_FRAME, bytes);
@@ -585,7 +855,7 @@ static void *output_thread_i2s(void *arg) {
 		
 	}
 	
-	if (spdif) free(sbuf);
+	free(sbuf);
 	
 	return 0;
 }
@@ -616,108 +886,14 @@ static void output_thread_i2s_stats(void *arg) {
 			LOG_INFO(LINE_MIN_MAX_DURATION_FORMAT,LINE_MIN_MAX_DURATION("Buffering(us)",buffering));
 			LOG_INFO(LINE_MIN_MAX_DURATION_FORMAT,LINE_MIN_MAX_DURATION("i2s tfr(us)",i2s_time));
 			LOG_INFO("              ----------+----------+-----------+-----------+");
+			for (int i = 0; i < (dual.enabled ? 2 : 1); i++) {
+				dma_plan_t *plan = dma.plan + i;
+				LOG_INFO("DMA I2S%d: %u x %u frames, latency %u ms, %u irq/s, %u underruns in %u s", i ? dual.port : CONFIG_I2S_NUM, 
+						 plan->count, plan->len, plan->latency_us / 1000, plan->irq, dma.underruns[i] - dma.base[i], 
+						 (gettime_ms() - dma.since) / 1000);
+			}	
 			RESET_ALL_MIN_MAX;
 		}
 		vTaskDelay( pdMS_TO_TICKS( STATS_PERIOD_MS ) );
 	}
 }
-
-/****************************************************************************************
- * SPDIF support
- */
- 
-#define PREAMBLE_B  (0xE8) //11101000
-#define PREAMBLE_M  (0xE2) //11100010
-#define PREAMBLE_W  (0xE4) //11100100
-
-#define VUCP   		((0xCC) << 24)
-#define VUCP_MUTE 	((0xD4) << 24)	// To mute PCM, set VUCP = invalid.
-
-extern const u16_t spdif_bmclookup[256];
-
-/* 
- SPDIF is supposed to be (before BMC encoding, from LSB to MSB)				
-	PPPP AAAA  SSSS SSSS  SSSS SSSS  SSSS VUCP				
- after BMC encoding, each bits becomes 2 hence this becomes a 64 bits word. The
- the trick is to start not with a PPPP sequence but with an VUCP sequence to that
- the 16 bits samples are aligned with a BMC word boundary. Note that the LSB of the
- audio is transmitted first (not the MSB) and that ESP32 libray sends R then L, 
- contrary to what seems to be usually done, so (dst) order had to be changed
-*/
-void spdif_convert(ISAMPLE_T *src, size_t frames, u32_t *dst, size_t *count) {
-	u16_t hi, lo, aux;
-	
-	// frames are 2 channels of 16 bits
-	frames *= 2;
-
-	while (frames--) {
-#if BYTES_PER_FRAME == 4		
-		hi  = spdif_bmclookup[(u8_t)(*src >> 8)];
-		lo  = spdif_bmclookup[(u8_t) *src];
-#else
-		hi  = spdif_bmclookup[(u8_t)(*src >> 24)];
-		lo  = spdif_bmclookup[(u8_t) *src >> 16];
-#endif	
-		lo ^= ~((s16_t)hi) >> 16;
-
-		// 16 bits sample:
-		*(dst+0) = ((u32_t)lo << 16) | hi;
-
-		// 4 bits auxillary-audio-databits, the first used as parity
-		aux = 0xb333 ^ (((u32_t)((s16_t)lo)) >> 17);
-
-		// VUCP-Bits: Valid, Subcode, Channelstatus, Parity = 0
-		// As parity is always 0, we can use fixed preambles
-		if (++(*count) > 383) {
-			*(dst+1) =  VUCP | (PREAMBLE_B << 16 ) | aux; //special preamble for one of 192 frames
-			*count = 0;
-		} else {
-			*(dst+1) = VUCP | ((((*count) & 0x01) ? PREAMBLE_W : PREAMBLE_M) << 16) | aux;
-		}
-		
-		src++;
-		dst += 2;
-	}
-}
-
-const u16_t spdif_bmclookup[256] = { //biphase mark encoded values (least significant bit first)
-	0xcccc, 0x4ccc, 0x2ccc, 0xaccc, 0x34cc, 0xb4cc, 0xd4cc, 0x54cc,
-	0x32cc, 0xb2cc, 0xd2cc, 0x52cc, 0xcacc, 0x4acc, 0x2acc, 0xaacc,
-	0x334c, 0xb34c, 0xd34c, 0x534c, 0xcb4c, 0x4b4c, 0x2b4c, 0xab4c,
-	0xcd4c, 0x4d4c, 0x2d4c, 0xad4c, 0x354c, 0xb54c, 0xd54c, 0x554c,
-	0x332c, 0xb32c, 0xd32c, 0x532c, 0xcb2c, 0x4b2c, 0x2b2c, 0xab2c,
-	0xcd2c, 0x4d2c, 0x2d2c, 0xad2c, 0x352c, 0xb52c, 0xd52c, 0x552c,
-	0xccac, 0x4cac, 0x2cac, 0xacac, 0x34ac, 0xb4ac, 0xd4ac, 0x54ac,
-	0x32ac, 0xb2ac, 0xd2ac, 0x52ac, 0xcaac, 0x4aac, 0x2aac, 0xaaac,
-	0x3334, 0xb334, 0xd334, 0x5334, 0xcb34, 0x4b34, 0x2b34, 0xab34,
-	0xcd34, 0x4d34, 0x2d34, 0xad34, 0x3534, 0xb534, 0xd534, 0x5534,
-	0xccb4, 0x4cb4, 0x2cb4, 0xacb4, 0x34b4, 0xb4b4, 0xd4b4, 0x54b4,
-	0x32b4, 0xb2b4, 0xd2b4, 0x52b4, 0xcab4, 0x4ab4, 0x2ab4, 0xaab4,
-	0xccd4, 0x4cd4, 0x2cd4, 0xacd4, 0x34d4, 0xb4d4, 0xd4d4, 0x54d4,
-	0x32d4, 0xb2d4, 0xd2d4, 0x52d4, 0xcad4, 0x4ad4, 0x2ad4, 0xaad4,
-	0x3354, 0xb354, 0xd354, 0x5354, 0xcb54, 0x4b54, 0x2b54, 0xab54,
-	0xcd54, 0x4d54, 0x2d54, 0xad54, 0x3554, 0xb554, 0xd554, 0x5554,
-	0x3332, 0xb332, 0xd332, 0x5332, 0xcb32, 0x4b32, 0x2b32, 0xab32,
-	0xcd32, 0x4d32, 0x2d32, 0xad32, 0x3532, 0xb532, 0xd532, 0x5532,
-	0xccb2, 0x4cb2, 0x2cb2, 0xacb2, 0x34b2, 0xb4b2, 0xd4b2, 0x54b2,
-	0x32b2, 0xb2b2, 0xd2b2, 0x52b2, 0xcab2, 0x4ab2, 0x2ab2, 0xaab2,
-	0xccd2, 0x4cd2, 0x2cd2, 0xacd2, 0x34d2, 0xb4d2, 0xd4d2, 0x54d2,
-	0x32d2, 0xb2d2, 0xd2d2, 0x52d2, 0xcad2, 0x4ad2, 0x2ad2, 0xaad2,
-	0x3352, 0xb352, 0xd352, 0x5352, 0xcb52, 0x4b52, 0x2b52, 0xab52,
-	0xcd52, 0x4d52, 0x2d52, 0xad52, 0x3552, 0xb552, 0xd552, 0x5552,
-	0xccca, 0x4cca, 0x2cca, 0xacca, 0x34ca, 0xb4ca, 0xd4ca, 0x54ca,
-	0x32ca, 0xb2ca, 0xd2ca, 0x52ca, 0xcaca, 0x4aca, 0x2aca, 0xaaca,
-	0x334a, 0xb34a, 0xd34a, 0x534a, 0xcb4a, 0x4b4a, 0x2b4a, 0xab4a,
-	0xcd4a, 0x4d4a, 0x2d4a, 0xad4a, 0x354a, 0xb54a, 0xd54a, 0x554a,
-	0x332a, 0xb32a, 0xd32a, 0x532a, 0xcb2a, 0x4b2a, 0x2b2a, 0xab2a,
-	0xcd2a, 0x4d2a, 0x2d2a, 0xad2a, 0x352a, 0xb52a, 0xd52a, 0x552a,
-	0xccaa, 0x4caa, 0x2caa, 0xacaa, 0x34aa, 0xb4aa, 0xd4aa, 0x54aa,
-	0x32aa, 0xb2aa, 0xd2aa, 0x52aa, 0xcaaa, 0x4aaa, 0x2aaa, 0xaaaa
-};
-
-
-
-
-
-
-
@@ -21,14 +21,6 @@
 
 #include "squeezelite.h"
 
-#if BYTES_PER_FRAME == 4
-#define SHIFT 16
-#define OPTR_T	u16_t
-#else
-#define OPTR_T	u32_t	
-#define SHIFT 0
-#endif
-
 extern log_level loglevel;
 
 extern struct buffer *streambuf;
@@ -40,7 +32,7 @@ extern struct processstate process;
 
 bool pcm_check_header = false;
 
-#define LOCK_S   mutex_lock(streambuf->mutex)
+#define LOCK_S   PROFILE_WAIT(PROF_WAIT_STREAMBUF, mutex_lock(streambuf->mutex))
 #define UNLOCK_S mutex_unlock(streambuf->mutex)
 #define LOCK_O   mutex_lock(outputbuf->mutex)
 #define UNLOCK_O mutex_unlock(outputbuf->mutex)
@@ -182,8 +174,8 @@ static void _check_header(void) {
 
 static decode_state pcm_decode(void) {
 	unsigned bytes, in, out;
-	frames_t frames, count;
-	OPTR_T *optr;
+	frames_t frames;
+	ISAMPLE_T *optr;
 	u8_t  *iptr;
 	u8_t tmp[3*8];
 	
@@ -244,10 +236,10 @@ static decode_state pcm_decode(void) {
 	}
 
 	IF_DIRECT(
-		optr = (OPTR_T *)outputbuf->writep;
+		optr = (ISAMPLE_T *)outputbuf->writep;
 	);
 	IF_PROCESS(
-		optr = (OPTR_T *)process.inbuf;
+		optr = (ISAMPLE_T *)process.inbuf;
 	);
 	iptr = (u8_t *)streambuf->readp;
 
@@ -270,152 +262,10 @@ static decode_state pcm_decode(void) {
 		frames = audio_left / bytes_per_frame;
 	}
 	
-	count = frames * channels;
-
-	if (channels == 2) {
-		if (sample_size == 1) {
-			while (count--) {
-				*optr++ = *iptr++ << (24-SHIFT);
-			}
-		} else if (sample_size == 2) {
-			if (bigendian) {
-#if BYTES_PER_FRAME == 4 && !SL_LITTLE_ENDIAN			
-				// while loop below works as is, but memcpy is a win for that 16/16 typical case
-				memcpy(optr, iptr, count * BYTES_PER_FRAME / 2);
-#else				
-				while (count--) {
-					*optr++ = *(iptr) << (24-SHIFT) | *(iptr+1) << (16-SHIFT);
-					iptr += 2;
-				}
-#endif				
-			} else {
-#if BYTES_PER_FRAME == 4 && SL_LITTLE_ENDIAN			
-				// while loop below works as is, but memcpy is a win for that 16/16 typical case
-				memcpy(optr, iptr, count * BYTES_PER_FRAME / 2);
-#else
-				while (count--) {
-					*optr++ = *(iptr) << (16-SHIFT) | *(iptr+1) << (24-SHIFT);
-					iptr += 2;
-				}
-#endif	
-			}
-		} else if (sample_size == 3) {
-			if (bigendian) {
-				while (count--) {
-#if BYTES_PER_FRAME == 4				
-					*optr++ = *(iptr) << 8 | *(iptr+1);
-#else					
-					*optr++ = *(iptr) << 24 | *(iptr+1) << 16 | *(iptr+2) << 8;
-#endif	
-					iptr += 3;
-				}
-			} else {
-				while (count--) {
-#if BYTES_PER_FRAME == 4									
-					*optr++ = *(iptr+1) | *(iptr+2) << 8;
-#else
-					*optr++ = *(iptr) << 8 | *(iptr+1) << 16 | *(iptr+2) << 24;
-#endif	
-					iptr += 3;
-				}
-			}
-		} else if (sample_size == 4) {
-			if (bigendian) {
-				while (count--) {
-#if BYTES_PER_FRAME == 4														
-					*optr++ = *(iptr) << 8 | *(iptr+1);
-#else
-					*optr++ = *(iptr) << 24 | *(iptr+1) << 16 | *(iptr+2) << 8 | *(iptr+3);
-#endif	
-					iptr += 4;
-				}
-			} else {
-				while (count--) {
-#if BYTES_PER_FRAME == 4																			
-					*optr++ = *(iptr+2) | *(iptr+3) << 8;
-#else
-					*optr++ = *(iptr) | *(iptr+1) << 8 | *(iptr+2) << 16 | *(iptr+3) << 24;
-#endif	
-					iptr += 4;
-				}
-			}
-		}
-	} else if (channels == 1) {
-		if (sample_size == 1) {
-			while (count--) {
-				*optr = *iptr++ << (24-SHIFT);
-				*(optr+1) = *optr;
-				optr += 2;
-			}
-		} else if (sample_size == 2) {
-			if (bigendian) {
-				while (count--) {
-					*optr = *(iptr) << (24-SHIFT) | *(iptr+1) << (16-SHIFT);
-					*(optr+1) = *optr;
-					iptr += 2;
-					optr += 2;
-				}
-			} else {
-				while (count--) {
-					*optr = *(iptr) << (16-SHIFT) | *(iptr+1) << (24-SHIFT);
-					*(optr+1) = *optr;
-					iptr += 2;
-					optr += 2;
-				}
-			}
-		} else if (sample_size == 3) {
-			if (bigendian) {
-				while (count--) {
-#if BYTES_PER_FRAME == 4				
-					*optr++ = *(iptr) << 8 | *(iptr+1);
-#else					
-					*optr = *(iptr) << 24 | *(iptr+1) << 16 | *(iptr+2) << 8;
-#endif				
-					*(optr+1) = *optr;
-					iptr += 3;
-					optr += 2;
-				}
-			} else {
-				while (count--) {
-#if BYTES_PER_FRAME == 4														
-					*optr++ = *(iptr+1) | *(iptr+2) << 8;
-#else					
-					*optr = *(iptr) << 8 | *(iptr+1) << 16 | *(iptr+2) << 24;
-#endif				
-					*(optr+1) = *optr;
-					iptr += 3;
-					optr += 2;
-				}
-			}
-		} else if (sample_size == 4) {
-			if (bigendian) {
-				while (count--) {
-#if BYTES_PER_FRAME == 4														
-					*optr++ = *(iptr) << 8 | *(iptr+1);
-#else					
-					*optr++ = *(iptr) << 24 | *(iptr+1) << 16 | *(iptr+2) << 8 | *(iptr+3);
-#endif				
-					*(optr+1) = *optr;
-					iptr += 4;
-					optr += 2;
-				}
-			} else {
-				while (count--) {
-#if BYTES_PER_FRAME == 4																			
-					*optr++ = *(iptr+2) | *(iptr+3) << 8;
-#else					
-					*optr++ = *(iptr) | *(iptr+1) << 8 | *(iptr+2) << 16 | *(iptr+3) << 24;
-#endif				
-					*(optr+1) = *optr;
-					iptr += 4;
-					optr += 2;
-				}
-			}
-		}
-	} else {
-		LOG_ERROR("unsupported channels");
+	if (!_pack_bytes_frames(optr, iptr, frames, channels, sample_size, bigendian)) {
+		LOG_ERROR("unsupported channels %u or sample size %u", channels, sample_size);
 	}
-	
+
 	LOG_SDEBUG("decoded %u frames", frames);
 
 	_buf_inc_readp(streambuf, frames * bytes_per_frame);
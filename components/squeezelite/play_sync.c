@@ -0,0 +1,81 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "play_sync.h"
+
+/*
+ A correction of c ms received T s after the previous one means our clock is
+ c / T ms per s (so c * 1000 / T ppm) off. Server only corrects beyond its
+ threshold (30 ms) so c is large enough against its ms resolution to be learnt
+ entirely, as long as corrections are far enough apart. Learning only part of
+ it left a residual drift that wandered up to the threshold again. Start
+ counts as a correction, players are in sync then.
+*/
+
+#define PLAY_SYNC_LEARN_MIN_S	30
+
+/****************************************************************************************
+ *
+ */
+void play_sync_init(play_sync_t *sync, uint32_t now) {
+	memset(sync, 0, sizeof(*sync));
+	sync->last = now;
+}
+
+/****************************************************************************************
+ *
+ */
+bool play_sync_correct(play_sync_t *sync, int32_t ms, uint32_t now) {
+	// too much to slew, what is pending still is (server only sees corrected position)
+	if (abs(ms + play_sync_pending_ms(sync)) > PLAY_SYNC_SMOOTH_MS) {
+		sync->last = now;
+		sync->stats.hard++;
+		return false;
+	}
+
+	if (now - sync->last >= PLAY_SYNC_LEARN_MIN_S * 1000) {
+		sync->drift -= ms * 1000000.0f / (now - sync->last);
+		if (sync->drift > PLAY_SYNC_DRIFT_PPM) sync->drift = PLAY_SYNC_DRIFT_PPM;
+		else if (sync->drift < -PLAY_SYNC_DRIFT_PPM) sync->drift = -PLAY_SYNC_DRIFT_PPM;
+	}
+
+	sync->pending += ms * 1000;
+	sync->last = now;
+	sync->stats.smoothed++;
+
+	return true;
+}
+
+/****************************************************************************************
+ *
+ */
+int32_t play_sync_update(play_sync_t *sync, uint32_t now) {
+	uint32_t dt = sync->updated ? now - sync->updated : 0;
+	int32_t slew = 0;
+
+	sync->updated = now;
+
+	// what has been slewed since last update (at last rate)
+	if (sync->pending) {
+		int64_t done = (int64_t) (sync->ppm - sync->drift) * dt / 1000;
+		// running faster (ppm > 0) reduces how much we are behind
+		sync->pending += done;
+		if ((sync->pending > 0) != (sync->pending - done > 0)) sync->pending = 0;
+	}
+
+	// slow down when ahead, speed up when behind
+	if (sync->pending > 0) slew = -PLAY_SYNC_SLEW_PPM;
+	else if (sync->pending < 0) slew = PLAY_SYNC_SLEW_PPM;
+
+	sync->ppm = sync->drift + slew + (sync->drift >= 0 ? 0.5f : -0.5f);
+	return sync->ppm;
+}
@@ -0,0 +1,56 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ LMS keeps synchronized players together by asking them to pause ('strm p')
+ or skip ('strm a') a few ms whenever their reported positions drift apart.
+ Small corrections are instead slewed in with a rate trim, and the position
+ reported in STMt is what it will be once done, so that server does not ask
+ again meanwhile. Repeated corrections in the same direction are clock drift,
+ which is learnt and trimmed continuously. Large corrections are left to
+ pause/skip. It does not depend on the platform so it can run on host.
+*/
+
+#define PLAY_SYNC_SMOOTH_MS		100		// larger corrections pause/skip
+#define PLAY_SYNC_SLEW_PPM		1000		// speed of a correction
+#define PLAY_SYNC_DRIFT_PPM		300		// max learnt drift
+
+typedef struct {
+	int64_t pending;		// µs still to correct, > 0 when ahead
+	float drift;			// ppm learnt from corrections
+	int32_t ppm;			// current rate trim
+	uint32_t last, updated;	// ms of last correction and last update
+	struct {
+		uint32_t smoothed, hard;
+	} stats;
+} play_sync_t;
+
+/* @brief (re)start, at now players are in sync */
+void	play_sync_init(play_sync_t *sync, uint32_t now);
+
+/*
+ @brief correction requested by server at now, ms > 0 when ahead (pause)
+ and < 0 when behind (skip)
+ @return false if it must be applied with pause/skip
+*/
+bool	play_sync_correct(play_sync_t *sync, int32_t ms, uint32_t now);
+
+/* @brief slew pending correction up to now, returns rate trim in ppm */
+int32_t	play_sync_update(play_sync_t *sync, uint32_t now);
+
+/* @brief what must be removed from played position to report it once corrected */
+static inline int32_t play_sync_pending_ms(const play_sync_t *sync) {
+	return sync->pending / 1000;
+}
@@ -55,6 +55,7 @@ static void _write_samples(void) {
 	unsigned cnt  = 10;
 
 	LOCK_O;
+	PROFILE_START(mark);
 
 	while (frames > 0) {
 
@@ -75,27 +76,34 @@ static void _write_samples(void) {
 		} else if (cnt--) {
 
 			// there should normally be space in the output buffer, but may need to wait during drain phase
+			PROFILE_STOP(PROF_LOCK_OUTPUTBUF_DEC, mark);
 			UNLOCK_O;
 			usleep(10000);
 			LOCK_O;
+			PROFILE_RESTART(mark);
 
 		} else {
 
 			// bail out if no space found after 100ms to avoid locking
 			LOG_ERROR("unable to get space in output buffer");
+			PROFILE_STOP(PROF_LOCK_OUTPUTBUF_DEC, mark);
 			UNLOCK_O;
 			return;
 		}
 	}
 
+	PROFILE_STOP(PROF_LOCK_OUTPUTBUF_DEC, mark);
 	UNLOCK_O;
 }
 
 // process samples - called with decode mutex set
 void process_samples(void) {
+	PROFILE_START(mark);
 
 	SAMPLES_FUNC(&process);
 
+	PROFILE_STOP(PROF_PROCESS, mark);
+
 	_write_samples();
 
 	process.in_frames = 0;
@@ -0,0 +1,90 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#include <string.h>
+#include "rate_trim.h"
+
+/*
+ A 1 ppm rate correction moves the sync error by 1 µs per second, so the loop
+ is error' = -(ppm + drift) / 1000 with error in ms. Default gains give a
+ natural period of about 3 minutes with 0.6 damping: sync errors are noisy
+ (network, ms resolution) and drift between crystals barely moves, so there
+ is no point reacting fast. The integral term ends up holding the drift.
+*/
+
+/****************************************************************************************
+ *
+ */
+void rate_trim_init(rate_trim_t *trim, float kp, float ki, int32_t limit) {
+	memset(trim, 0, sizeof(*trim));
+	trim->kp = kp;
+	trim->ki = ki;
+	trim->limit = limit;
+}
+
+/****************************************************************************************
+ * error_ms is positive when we play ahead, returns the rate correction in ppm
+ */
+int32_t rate_trim_update(rate_trim_t *trim, float error_ms, uint32_t dt_ms) {
+	float ppm;
+
+	// anti-windup: integral alone can't ask for more than limit
+	trim->integral -= trim->ki * error_ms * dt_ms / 1000;
+	if (trim->integral > trim->limit) trim->integral = trim->limit;
+	else if (trim->integral < -trim->limit) trim->integral = -trim->limit;
+
+	ppm = trim->integral - trim->kp * error_ms;
+	if (ppm > trim->limit) ppm = trim->limit;
+	else if (ppm < -trim->limit) ppm = -trim->limit;
+
+	trim->ppm = ppm >= 0 ? ppm + 0.5f : ppm - 0.5f;
+	return trim->ppm;
+}
+
+/****************************************************************************************
+ *
+ */
+void rate_trim_asrc_reset(rate_trim_asrc_t *asrc) {
+	memset(asrc, 0, sizeof(*asrc));
+	// first output is the first input frame, last is not used (would blend toward silence)
+	asrc->phase = 1LL << 32;
+}
+
+/****************************************************************************************
+ * Resample interleaved 16 bits stereo by (1 + ppm / 10^6), i.e. consumes input
+ * faster when ppm > 0. Output must have room for frames + 2, returns frames
+ * written. Last input frame is kept so interpolation continues across calls.
+ */
+size_t rate_trim_asrc(rate_trim_asrc_t *asrc, int32_t ppm, const int16_t *in, size_t frames, int16_t *out) {
+	int64_t step = (1LL << 32) + ((int64_t) ppm << 32) / 1000000;
+	int64_t pos = asrc->phase - (1LL << 32);
+	int64_t end = (int64_t) (frames - 1) << 32;
+	size_t count = 0;
+
+	if (!frames) return 0;
+
+	// position is relative to in[0], -1 being the last frame of previous call
+	for (; pos < end; pos += step, count++) {
+		int i = pos >> 32;
+		// 15 bits so that a full scale difference times frac fits in 32 bits
+		int32_t frac = (pos >> 17) & 0x7fff;
+		const int16_t *a = i < 0 ? asrc->last : in + i * 2;
+		const int16_t *b = in + (i + 1) * 2;
+
+		*out++ = a[0] + (((b[0] - a[0]) * frac) >> 15);
+		*out++ = a[1] + (((b[1] - a[1]) * frac) >> 15);
+	}
+
+	asrc->phase = pos - end;
+	asrc->last[0] = in[(frames - 1) * 2];
+	asrc->last[1] = in[(frames - 1) * 2 + 1];
+
+	return count;
+}
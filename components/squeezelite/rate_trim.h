@@ -0,0 +1,45 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ Clock drift compensation. A PI controller turns a sync error (in ms, positive
+ when we play ahead of time) into a playback rate correction in ppm, which the
+ output applies by trimming the APLL or, when that's not possible, with a
+ linear interpolation resampler. Neither depends on the platform so both can
+ run on host against recorded error traces.
+*/
+
+// ppm per ms of error and ppm per ms of error and per second (see rate_trim.c)
+#define RATE_TRIM_KP		40
+#define RATE_TRIM_KI		1
+#define RATE_TRIM_LIMIT		300
+
+typedef struct {
+	float kp, ki;
+	float integral;		// ppm, bounded by limit
+	int32_t limit;
+	int32_t ppm;
+} rate_trim_t;
+
+typedef struct {
+	int64_t phase;		// Q32 position of next output frame after last input one
+	int16_t last[2];
+} rate_trim_asrc_t;
+
+void	rate_trim_init(rate_trim_t *trim, float kp, float ki, int32_t limit);
+int32_t	rate_trim_update(rate_trim_t *trim, float error_ms, uint32_t dt_ms);
+
+void	rate_trim_asrc_reset(rate_trim_asrc_t *asrc);
+size_t	rate_trim_asrc(rate_trim_asrc_t *asrc, int32_t ppm, const int16_t *in, size_t frames, int16_t *out);
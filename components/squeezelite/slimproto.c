@@ -24,6 +24,7 @@
 
 #include "squeezelite.h"
 #include "slimproto.h"
+#include "play_sync.h"
 
 static log_level loglevel;
 
@@ -32,6 +33,14 @@ static log_level loglevel;
 #define PORT 3483
 
 #define MAXBUF 4096
+#define RECVBUF (2 * MAXBUF)
+#define SENDBUF (2 * MAX_HEADER)	// a full RESP or META (MAX_HEADER + header) with room for what is queued around it
+#define STATS_PERIOD 60000
+
+#define DISCOVERY_MIN_MS 250
+#define DISCOVERY_MAX_MS 5000
+#define CONNECT_MIN_MS 250
+#define PROBE_PERIOD 30000
 
 #if SL_LITTLE_ENDIAN
 #define LOCAL_PLAYER_IP   0x0100007f // 127.0.0.1
@@ -78,6 +87,7 @@ event_event wake_e;
 
 static struct {
 	u32_t updated;
+	u64_t updated_us;
 	u32_t stream_start;
 	u32_t stream_full;
 	u32_t stream_size;
@@ -99,25 +109,148 @@ static char *new_server_cap;
 static char player_name[PLAYER_NAME_LEN + 1] = "";
 static const char *name_file = NULL;
 
+// packets are sent directly when possible, what the socket can't take is
+// queued and flushed by the controller when the socket is writable again
+static struct {
+	u8_t buf[SENDBUF];
+	size_t head, tail;	// sent up to head, queued up to tail
+	int stmt;			// position of a queued STMt not yet started, or -1
+	bool failed;
+} EXT_BSS sendq;
+
+static struct {
+	u32_t packets_in, bytes_in, bytes_out;
+	u32_t stat_sent, stat_coalesced;
+	u32_t queued_max, busy_us;
+	u32_t since;
+} stats;
+
+// another server found by probing while connected, used to fail over
+static struct {
+	int sock;
+	u32_t last, seen;
+	in_addr_t alternate;
+} probe = { -1 };
+
+// start of last (re)connection, for timing logs
+static u32_t reconnect_start;
+
+// small sync corrections from server are slewed instead of pause/skip
+static play_sync_t play_sync;
+
+static bool sync_trim(s32_t ppm) {
+#if EMBEDDED
+	return set_rate_trim(ppm);
+#else
+	return false;
+#endif
+}
+
+static void sync_reset(void) {
+	// external sources own the trim
+	if (play_sync.ppm && !output.external) sync_trim(0);
+	play_sync_init(&play_sync, gettime_ms());
+}
+
+// ms > 0 to pause, < 0 to skip, returns false if it must be done the usual way
+static bool sync_slew(s32_t ms) {
+	bool running;
+
+	LOCK_O;
+	running = output.state == OUTPUT_RUNNING && !output.external;
+	UNLOCK_O;
+
+	if (!running || !sync_trim(play_sync.ppm) || !play_sync_correct(&play_sync, ms, gettime_ms())) return false;
+
+	sync_trim(play_sync_update(&play_sync, gettime_ms()));
+	LOG_INFO("slewing %d ms at %d ppm (drift %d ppm)", ms, play_sync.ppm, (int) play_sync.drift);
+	return true;
+}
+
+static void sendq_reset(void) {
+	LOCK_P;
+	sendq.head = sendq.tail = 0;
+	sendq.stmt = -1;
+	sendq.failed = false;
+	UNLOCK_P;
+}
+
+// must be called with LOCK_P, returns where the packet has been queued if it was
+// queued entirely, -1 otherwise
+static int queue_packet(u8_t *packet, size_t len) {
+	bool partial = false;
+	int pos;
+
+	if (sendq.failed) return -1;
+
+	// nothing waiting, try to send directly
+	if (sendq.head == sendq.tail) {
+		ssize_t n = send(sock, packet, len, MSG_NOSIGNAL);
+
+		sendq.head = sendq.tail = 0;
+		sendq.stmt = -1;
+
+		if (n < 0 && last_error() != ERROR_WOULDBLOCK) {
+			LOG_INFO("failed writing to socket: %s", strerror(last_error()));
+			sendq.failed = true;
+			return -1;
+		}
+
+		if (n > 0) {
+			packet += n;
+			len -= n;
+			stats.bytes_out += n;
+			partial = true;
+		}
+
+		if (!len) return -1;
+	}
+
+	if (sendq.tail + len > SENDBUF && sendq.head) {
+		memmove(sendq.buf, sendq.buf + sendq.head, sendq.tail - sendq.head);
+		sendq.tail -= sendq.head;
+		if (sendq.stmt >= 0) sendq.stmt -= sendq.head;
+		sendq.head = 0;
+	}
+
+	// server does not read anymore, let the controller reconnect
+	if (sendq.tail + len > SENDBUF) {
+		LOG_WARN("send queue full (%u bytes pending), closing connection", sendq.tail - sendq.head);
+		sendq.failed = true;
+		return -1;
+	}
+
+	pos = sendq.tail;
+	memcpy(sendq.buf + pos, packet, len);
+	sendq.tail += len;
+	if (sendq.tail - sendq.head > stats.queued_max) stats.queued_max = sendq.tail - sendq.head;
+
+	wake_controller();
+
+	return partial ? -1 : pos;
+}
+
 void send_packet(u8_t *packet, size_t len) {
-	u8_t *ptr = packet;
-	unsigned try = 0;
-	ssize_t n;
+	queue_packet(packet, len);
+}
 
-	while (len) {
-		n = send(sock, ptr, len, MSG_NOSIGNAL);
+static void flush_packets(void) {
+	LOCK_P;
+	while (sendq.head != sendq.tail && !sendq.failed) {
+		ssize_t n = send(sock, sendq.buf + sendq.head, sendq.tail - sendq.head, MSG_NOSIGNAL);
 		if (n <= 0) {
-			if (n < 0 && last_error() == ERROR_WOULDBLOCK && try < 10) {
-				LOG_DEBUG("retrying (%d) writing to socket", ++try);
-				usleep(1000);
-				continue;
+			if (n < 0 && last_error() != ERROR_WOULDBLOCK) {
+				LOG_INFO("failed writing to socket: %s", strerror(last_error()));
+				sendq.failed = true;
 			}
-			LOG_INFO("failed writing to socket: %s", strerror(last_error()));
-			return;
+			break;
 		}
-		ptr += n;
-		len -= n;
+		sendq.head += n;
+		stats.bytes_out += n;
+		// a STMt partially sent can't be updated anymore
+		if (sendq.stmt >= 0 && sendq.head > sendq.stmt) sendq.stmt = -1;
 	}
+	UNLOCK_P;
 }
 
 static void sendHELO(bool reconnect, const char *fixed_cap, const char *var_cap, u8_t mac[6]) {
@@ -167,8 +300,19 @@ static void sendSTAT(const char *event, u32_t server_timestamp) {
 	u32_t ms_played;
 
 	if (status.current_sample_rate && status.frames_played && status.frames_played > status.device_frames) {
-		ms_played = (u32_t)(((u64_t)(status.frames_played - status.device_frames) * (u64_t)1000) / (u64_t)status.current_sample_rate);
-		if (now > status.updated) ms_played += (now - status.updated);
+		if (status.updated_us) {
+			// output has a finer clock, so don't add ms rounding
+			u64_t now_us = gettime_us();
+			u64_t us_played = (u64_t)(status.frames_played - status.device_frames) * 1000000 / status.current_sample_rate;
+			if (now_us > status.updated_us) us_played += now_us - status.updated_us;
+			now = now_us / 1000;
+			ms_played = us_played / 1000;
+		} else {
+			ms_played = (u32_t)(((u64_t)(status.frames_played - status.device_frames) * (u64_t)1000) / (u64_t)status.current_sample_rate);
+			if (now > status.updated) ms_played += (now - status.updated);
+		}
+		// report where we will be once slewing is done, or server will ask again
+		if ((s32_t) ms_played > play_sync_pending_ms(&play_sync)) ms_played -= play_sync_pending_ms(&play_sync);
 		LOG_SDEBUG("ms_played: %u (frames_played: %u device_frames: %u)", ms_played, status.frames_played, status.device_frames);
 	} else if (status.frames_played && now > status.stream_start) {
 		ms_played = now - status.stream_start;
@@ -204,6 +348,11 @@ static void sendSTAT(const char *event, u32_t server_timestamp) {
 
 	LOG_DEBUG("STAT: %s", event);
 
+	if (reconnect_start) {
+		LOG_INFO("first STAT %u ms after (re)connection start", now - reconnect_start);
+		reconnect_start = 0;
+	}
+
 	if (loglevel == lSDEBUG) {
 		LOG_SDEBUG("received bytesL: %u streambuf: %u outputbuf: %u calc elapsed: %u real elapsed: %u (diff: %d) device: %u delay: %d",
 				   (u32_t)status.stream_bytes, status.stream_full, status.output_full, ms_played, now - status.stream_start,
@@ -211,7 +360,15 @@ static void sendSTAT(const char *event, u32_t server_timestamp) {
 	}
 
 	LOCK_P;
-	send_packet((u8_t *)&pkt, sizeof(pkt));
+	// a STMt still waiting in queue is just refreshed, server only needs the latest
+	if (!memcmp(event, "STMt", 4) && sendq.stmt >= 0) {
+		memcpy(sendq.buf + sendq.stmt, &pkt, sizeof(pkt));
+		stats.stat_coalesced++;
+	} else {
+		int pos = queue_packet((u8_t *)&pkt, sizeof(pkt));
+		if (!memcmp(event, "STMt", 4)) sendq.stmt = pos;
+		stats.stat_sent++;
+	}
 	UNLOCK_P;
 }
 
@@ -308,6 +465,7 @@ static void process_strm(u8_t *pkt, int len) {
 	case 'q':
 		decode_flush();
 		if (!output.external) output_flush();
+		sync_reset();
 		status.frames_played = 0;
 		if (stream_disconnect() && strm->command == 'f') sendSTAT("STMf", 0);
 		buf_flush(streambuf);
@@ -316,6 +474,7 @@ static void process_strm(u8_t *pkt, int len) {
 	case 'p':
 		{
 			unsigned interval = unpackN(&strm->replay_gain);
+			if (interval && interval < 0x7fffffff && sync_slew(interval)) break;
 			LOCK_O;
 			output.pause_frames = interval * status.current_sample_rate / 1000;
 			if (interval) {
@@ -325,13 +484,17 @@ static void process_strm(u8_t *pkt, int len) {
 				output.stop_time = gettime_ms();
 			}
 			UNLOCK_O;
-			if (!interval) sendSTAT("STMp", 0);
+			if (!interval) {
+				sync_reset();
+				sendSTAT("STMp", 0);
+			}
 			LOG_DEBUG("pause interval: %u", interval);
 		}
 		break;
 	case 'a':
 		{
 			unsigned interval = unpackN(&strm->replay_gain);
+			if (interval < 0x7fffffff && sync_slew(-(s32_t) interval)) break;
 			LOCK_O;
 			output.skip_frames = interval * status.current_sample_rate / 1000;
 			output.state = OUTPUT_SKIP_FRAMES;				
@@ -342,6 +505,7 @@ static void process_strm(u8_t *pkt, int len) {
 	case 'u':
 		{
 			unsigned jiffies = unpackN(&strm->replay_gain);
+			sync_reset();
 			LOCK_O;
 			output.state = jiffies ? OUTPUT_START_AT : OUTPUT_RUNNING;
 			output.start_at = jiffies;
@@ -551,16 +715,71 @@ static void process(u8_t *pack, int len) {
 		LOG_DEBUG("%s", h->opcode);
 		h->handler(pack, len);
 	} else if (!slimp_handler || !(*slimp_handler)(pack, len)) {
-		pack[4] = '\0';
-		LOG_WARN("unhandled %s", (char *)pack);
+		// next packet may follow in buffer, don't terminate opcode in place
+		LOG_WARN("unhandled %.4s", (char *)pack);
+	}
+}
+
+static int discovery_request(char *buf) {
+	return sprintf(buf, "e%s%c%s", "JSON", '\0', "CLIP") + 1;
+}
+
+// only replies (starting with 'E') are valid, other players send requests on the same port
+static bool discovery_reply(char *buf, int len) {
+	char *p;
+
+	if (len <= 0 || *buf != 'E') return false;
+
+	if ((p = strstr(buf, "JSON")) != NULL) {
+		p += strlen("JSON");
+		slimproto_hport = atoi(p + 1);
+	}
+
+	if ((p = strstr(buf, "CLIP")) != NULL) {
+		p += strlen("CLIP");
+		slimproto_cport = atoi(p + 1);
+	}
+
+	return true;
+}
+
+// broadcast discovery from time to time while connected, so that when our server
+// is gone we already know another one
+static void probe_servers(u32_t now) {
+	char buf[32];
+	struct sockaddr_in s;
+	socklen_t slen = sizeof(s);
+	int n;
+
+	if (probe.sock < 0) return;
+
+	if (now - probe.last > PROBE_PERIOD) {
+		struct sockaddr_in d;
+
+		memset(&d, 0, sizeof(d));
+		d.sin_family = AF_INET;
+		d.sin_port = htons(PORT);
+		d.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+		n = discovery_request(buf);
+		sendto(probe.sock, buf, n, 0, (struct sockaddr *)&d, sizeof(d));
+		probe.last = now;
+	}
+
+	while ((n = recvfrom(probe.sock, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&s, &slen)) > 0) {
+		buf[n] = '\0';
+		// don't let a reply from another server change our ports
+		if (*buf != 'E' || s.sin_addr.s_addr == slimproto_ip) continue;
+		if (probe.alternate != s.sin_addr.s_addr) LOG_DEBUG("alternate server %s", inet_ntoa(s.sin_addr));
+		probe.alternate = s.sin_addr.s_addr;
+		probe.seen = now;
+		slen = sizeof(s);
 	}
 }
 
 static bool running;
 
 static void slimproto_run() {
-	static u8_t EXT_BSS buffer[MAXBUF];
-	int  expect = 0;
+	static u8_t EXT_BSS buffer[RECVBUF];
 	int  got    = 0;
 	u32_t now;
 	static u32_t last = 0;
@@ -568,52 +787,57 @@ static void slimproto_run() {
 	int timeouts = 0;
 	
 	set_readwake_handles(ehandles, sock, wake_e);
+	stats.since = gettime_ms();
 
 	while (running && !new_server) {
 
 		bool wake = false;
 		event_type ev;
+		u64_t start;
+
+#if !WINEVENT
+		// also wake up when socket can take what's pending
+		ehandles[0].events = sendq.head != sendq.tail ? POLLIN | POLLOUT : POLLIN;
+#endif
+
+		ev = wait_readwake(ehandles, 1000);
+		start = gettime_us();
 
-		if ((ev = wait_readwake(ehandles, 1000)) != EVENT_TIMEOUT) {
+		// socket only writable, flushed below but it says nothing about the server being alive
+		if (ev != EVENT_TIMEOUT && ev != EVENT_WRITE) {
 	
 			if (ev == EVENT_READ) {
 
-				if (expect > 0) {
-					int n = recv(sock, buffer + got, expect, 0);
-					if (n <= 0) {
-						if (n < 0 && last_error() == ERROR_WOULDBLOCK) {
-							continue;
-						}
-						LOG_INFO("error reading from socket: %s", n ? strerror(last_error()) : "closed");
-						return;
-					}
-					expect -= n;
-					got += n;
-					if (expect == 0) {
-						process(buffer, got);
-						got = 0;
-					}
-				} else if (expect == 0) {
-					int n = recv(sock, buffer + got, 2 - got, 0);
-					if (n <= 0) {
-						if (n < 0 && last_error() == ERROR_WOULDBLOCK) {
-							continue;
-						}
+				// read all we can at once and process all complete packets
+				int n = recv(sock, buffer + got, RECVBUF - got, 0);
+				if (n <= 0) {
+					if (n == 0 || last_error() != ERROR_WOULDBLOCK) {
 						LOG_INFO("error reading from socket: %s", n ? strerror(last_error()) : "closed");
 						return;
 					}
+				} else {
+					int pos = 0;
+
 					got += n;
-					if (got == 2) {
-						expect = buffer[0] << 8 | buffer[1]; // length pack 'n'
-						got = 0;
+					stats.bytes_in += n;
+
+					while (got - pos >= 2 && !new_server) {
+						int expect = buffer[pos] << 8 | buffer[pos + 1]; // length pack 'n'
 						if (expect > MAXBUF) {
 							LOG_ERROR("FATAL: slimproto packet too big: %d > %d", expect, MAXBUF);
 							return;
 						}
+						if (got - pos - 2 < expect) break;
+						process(buffer + pos + 2, expect);
+						pos += 2 + expect;
+						stats.packets_in++;
+					}
+
+					// a partial packet is always less than MAXBUF + 2, so there is room left
+					if (pos) {
+						memmove(buffer, buffer + pos, got - pos);
+						got -= pos;
 					}
-				} else {
-					LOG_ERROR("FATAL: negative expect");
-					return;
 				}
 
 			}
@@ -624,7 +848,7 @@ static void slimproto_run() {
 
 			timeouts = 0;
 
-		} else if (++timeouts > 35) {
+		} else if (ev == EVENT_TIMEOUT && ++timeouts > 35) {
 
 			// expect message from server every 5 seconds, but 30 seconds on mysb.com so timeout after 35 seconds
 			LOG_INFO("No messages from server - connection dead");
@@ -647,6 +871,7 @@ static void slimproto_run() {
 			bool _sendSTMn = false;
 			bool _stream_disconnect = false;
 			bool _start_output = false;
+			bool _sync_trim = false;
 			decode_state _decode_state;
 			disconnect_code disconnect_code;
 			static char EXT_BSS header[MAX_HEADER];
@@ -716,7 +941,16 @@ static void slimproto_run() {
 				status.frames_played = output.frames_played_dmp;
 				status.current_sample_rate = output.current_sample_rate;
 				status.updated = output.updated;
+				status.updated_us = output.updated_us;
 				status.device_frames = output.device_frames;
+
+				// slew pending sync correction while playing
+				if (output.state == OUTPUT_RUNNING) {
+					s32_t ppm = play_sync.ppm;
+					_sync_trim = play_sync_update(&play_sync, now) != ppm;
+				} else {
+					play_sync.updated = 0;
+				}
 									
 				if (output.track_started) {
 					_sendSTMs = true;
@@ -768,6 +1002,7 @@ static void slimproto_run() {
 #endif
 
 			if (_stream_disconnect) stream_disconnect();
+			if (_sync_trim) sync_trim(play_sync.ppm);
 
 			// send packets once locks released as packet sending can block
 			if (_sendDSCO) sendDSCO(disconnect_code);
@@ -785,6 +1020,27 @@ static void slimproto_run() {
 #endif
 			if (*slimp_loop) (*slimp_loop)();
 		}
+
+		if (sendq.head != sendq.tail) flush_packets();
+
+		probe_servers(now);
+
+		if (sendq.failed) {
+			LOG_INFO("can't send to server - closing connection");
+			return;
+		}
+
+		stats.busy_us += gettime_us() - start;
+
+		if (now - stats.since > STATS_PERIOD) {
+			u32_t elapsed = now - stats.since;
+			LOG_DEBUG("controller: in %u pkt/s %u B/s, out %u B/s, STAT %u (%u coalesced), queue max %u, busy %u us/s",
+					  (u32_t) ((u64_t) stats.packets_in * 1000 / elapsed), (u32_t) ((u64_t) stats.bytes_in * 1000 / elapsed),
+					  (u32_t) ((u64_t) stats.bytes_out * 1000 / elapsed), stats.stat_sent, stats.stat_coalesced, stats.queued_max,
+					  (u32_t) ((u64_t) stats.busy_us * 1000 / elapsed));
+			memset(&stats, 0, sizeof(stats));
+			stats.since = now;
+		}
 	}
 }
 
@@ -796,58 +1052,75 @@ void wake_controller(void) {
 in_addr_t discover_server(char *default_server, int max) {
 	struct sockaddr_in d;
 	struct sockaddr_in s;
-	char buf[32], port_d[] = "JSON", clip_d[] = "CLIP";
+	char buf[32];
 	struct pollfd pollinfo;
 	unsigned port;
 	u8_t len;
+	in_addr_t cached = 0;
+	u32_t start = gettime_ms(), next = start, backoff = DISCOVERY_MIN_MS;
+	bool replied = false;
 
 	int disc_sock = socket(AF_INET, SOCK_DGRAM, 0);
 
 	socklen_t enable = 1;
 	setsockopt(disc_sock, SOL_SOCKET, SO_BROADCAST, (const void *)&enable, sizeof(enable));
 
-	len = sprintf(buf,"e%s%c%s", port_d, '\0', clip_d) + 1;
+	len = discovery_request(buf);
 
 	memset(&d, 0, sizeof(d));
 	d.sin_family = AF_INET;
 	d.sin_port = htons(PORT);
-	d.sin_addr.s_addr = htonl(INADDR_BROADCAST);
 
 	pollinfo.fd = disc_sock;
 	pollinfo.events = POLLIN;
 
+#if EMBEDDED
+	if (!default_server) cached = get_server_cache();
+#endif
+
+	memset(&s, 0, sizeof(s));
+
 	do {
+		u32_t now = gettime_ms();
+
+		// last known server is asked directly along with broadcast, first valid reply wins
+		if ((s32_t) (now - next) >= 0) {
+			LOG_INFO("sending discovery%s", cached ? " (and to last server)" : "");
+
+			if (cached) {
+				d.sin_addr.s_addr = cached;
+				sendto(disc_sock, buf, len, 0, (struct sockaddr *)&d, sizeof(d));
+			}
 
-		LOG_INFO("sending discovery");
-		memset(&s, 0, sizeof(s));
+			d.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+			if (sendto(disc_sock, buf, len, 0, (struct sockaddr *)&d, sizeof(d)) < 0) {
+				LOG_INFO("error sending disovery");
+			}
 
-		if (sendto(disc_sock, buf, len, 0, (struct sockaddr *)&d, sizeof(d)) < 0) {
-			LOG_INFO("error sending disovery");
+			next = now + backoff;
+			backoff = backoff * 2 < DISCOVERY_MAX_MS ? backoff * 2 : DISCOVERY_MAX_MS;
 		}
 
-		if (poll(&pollinfo, 1, 5000) == 1) {
-			char readbuf[32], *p;
+		if (poll(&pollinfo, 1, next - now) == 1) {
+			char readbuf[32];
 			socklen_t slen = sizeof(s);
 			memset(readbuf, 0, 32);
-			recvfrom(disc_sock, readbuf, 32 - 1, 0, (struct sockaddr *)&s, &slen);
-			LOG_INFO("got response from: %s:%d", inet_ntoa(s.sin_addr), ntohs(s.sin_port));
-
-			 if ((p = strstr(readbuf, port_d)) != NULL) {
-				p += strlen(port_d);
-				slimproto_hport = atoi(p + 1);
-			}
+			int n = recvfrom(disc_sock, readbuf, 32 - 1, 0, (struct sockaddr *)&s, &slen);
 
-			 if ((p = strstr(readbuf, clip_d)) != NULL) {
-				p += strlen(clip_d);
-				slimproto_cport = atoi(p + 1);
+			if (discovery_reply(readbuf, n)) {
+				LOG_INFO("got response from: %s:%d in %u ms", inet_ntoa(s.sin_addr), ntohs(s.sin_port), gettime_ms() - start);
+				replied = true;
+			} else {
+				s.sin_addr.s_addr = 0;
 			}
 		}
 
-		if (default_server) {
+		// give discovery a chance to find ports of the default server
+		if (default_server && (replied || gettime_ms() - start >= DISCOVERY_MAX_MS)) {
 			server_addr(default_server, &s.sin_addr.s_addr, &port);
 		}
 
-	} while (s.sin_addr.s_addr == 0 && running && (!max || --max));
+	} while (s.sin_addr.s_addr == 0 && running && (!max || gettime_ms() - start < max * DISCOVERY_MAX_MS));
 
 	closesocket(disc_sock);
 
@@ -931,6 +1204,14 @@ void slimproto(log_level level, char *server, u8_t mac[6], const char *name, con
 	LOG_INFO("connecting to %s:%d", inet_ntoa(serv_addr.sin_addr), ntohs(serv_addr.sin_port));
 
 	new_server = 0;
+	reconnect_start = gettime_ms();
+
+	if (!server && probe.sock < 0) {
+		socklen_t enable = 1;
+		probe.sock = socket(AF_INET, SOCK_DGRAM, 0);
+		set_nonblock(probe.sock);
+		setsockopt(probe.sock, SOL_SOCKET, SO_BROADCAST, (const void *)&enable, sizeof(enable));
+	}
 
 	while (running) {
 
@@ -947,14 +1228,21 @@ void slimproto(log_level level, char *server, u8_t mac[6], const char *name, con
 		set_nonblock(sock);
 		set_nosigpipe(sock);
 
-		if (connect_timeout(sock, (struct sockaddr *) &serv_addr, sizeof(serv_addr), 5) != 0) {
+		// don't wait too long for a dead server if we know another one
+		if (connect_timeout(sock, (struct sockaddr *) &serv_addr, sizeof(serv_addr), probe.alternate ? 1 : 5) != 0) {
 
 			if (previous_server) {
 				slimproto_ip = serv_addr.sin_addr.s_addr = previous_server;
 				LOG_INFO("new server not reachable, reverting to previous server %s:%d", inet_ntoa(serv_addr.sin_addr), ntohs(serv_addr.sin_port));
+			} else if (!server && probe.alternate && gettime_ms() - probe.seen < 2 * PROBE_PERIOD) {
+				slimproto_ip = serv_addr.sin_addr.s_addr = probe.alternate;
+				probe.alternate = 0;
+				LOG_INFO("server not reachable, failing over to %s:%d", inet_ntoa(serv_addr.sin_addr), ntohs(serv_addr.sin_port));
 			} else {
-				LOG_INFO("unable to connect to server %u", failed_connect);
-				sleep(5);
+				// a restarting server refuses connections, so retry soon and then slow down
+				u32_t delay = failed_connect < 5 ? CONNECT_MIN_MS << failed_connect : DISCOVERY_MAX_MS;
+				LOG_INFO("unable to connect to server %u (retry in %u ms)", failed_connect, delay);
+				usleep(delay * 1000);
 			}
 
 #if EMBEDDED
@@ -975,10 +1263,16 @@ void slimproto(log_level level, char *server, u8_t mac[6], const char *name, con
 			struct sockaddr_in our_addr;
 			socklen_t len;
 
-			LOG_INFO("connected");
+			LOG_INFO("connected in %u ms", gettime_ms() - reconnect_start);
 
 			var_cap[0] = '\0';
 			failed_connect = 0;
+			probe.last = gettime_ms();
+			if (probe.alternate == slimproto_ip) probe.alternate = 0;
+
+#if EMBEDDED
+			if (!server) set_server_cache(slimproto_ip);
+#endif
 
 			// check if this is a local player now we are connected & signal to server via 'loc' format
 			// this requires LocalPlayer server plugin to enable direct file access
@@ -997,6 +1291,7 @@ void slimproto(log_level level, char *server, u8_t mac[6], const char *name, con
 				new_server_cap = NULL;
 			}
 
+			sendq_reset();
 			sendHELO(reconnect, fixed_cap, var_cap, mac);
 
 #if EMBEDDED
@@ -1005,6 +1300,8 @@ void slimproto(log_level level, char *server, u8_t mac[6], const char *name, con
 
 			slimproto_run();
 
+			reconnect_start = gettime_ms();
+
 			if (!reconnect) {
 				reconnect = true;
 			}
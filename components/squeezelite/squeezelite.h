@@ -406,6 +406,14 @@ typedef int sockfd;
 #include "embedded.h"
 #endif
 
+#if !defined(PROFILE_START)
+#define PROFILE_START(m)
+#define PROFILE_RESTART(m)
+#define PROFILE_STOP(stage, m)
+#define PROFILE_VALUE(stage, v)
+#define PROFILE_WAIT(stage, op)	op
+#endif
+
 #if !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -486,13 +494,14 @@ void _wake_create(event_event*);
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 
 // utils.c (non logging)
-typedef enum { EVENT_TIMEOUT = 0, EVENT_READ, EVENT_WAKE } event_type;
+typedef enum { EVENT_TIMEOUT = 0, EVENT_READ, EVENT_WAKE, EVENT_WRITE } event_type;
 #if WIN && USE_SSL
 char* strcasestr(const char *haystack, const char *needle);
 #endif
 
 char *next_param(char *src, char c);
 u32_t gettime_ms(void);
+u64_t gettime_us(void);
 void get_mac(u8_t *mac);
 void set_nonblock(sockfd s);
 int connect_timeout(sockfd sock, const struct sockaddr *addr, socklen_t addrlen, int timeout);
@@ -576,7 +585,7 @@ struct streamstate {
 	bool  meta_send;
 };
 
-void stream_init(log_level level, unsigned stream_buf_size);
+void stream_init(log_level level, unsigned stream_buf_size, unsigned stream_rcv_size);
 void stream_close(void);
 void stream_file(const char *header, size_t header_len, unsigned threshold);
 void stream_sock(u32_t ip, u16_t port, const char *header, size_t header_len, unsigned threshold, bool cont_wait);
@@ -684,6 +693,7 @@ struct outputstate {
 	unsigned device_frames;
 	unsigned frames_in_process;
 	u32_t updated;
+	u64_t updated_us;		   // same as updated, when output has a finer clock (0 otherwise)
 	u32_t track_start_time;
 	u32_t current_replay_gain;
 	union {
@@ -746,6 +756,7 @@ void _pa_open(void);
 // output_embedded.c
 #if EMBEDDED
 void set_volume(unsigned left, unsigned right);
+bool set_rate_trim(s32_t ppm);
 bool test_open(const char *device, unsigned rates[], bool userdef_rates);
 void output_init_embedded(log_level level, char *device, unsigned output_buf_size, char *params, unsigned rates[], unsigned rate_delay, unsigned idle);
 void output_close_embedded(void);
@@ -755,6 +766,12 @@ void output_init_stdout(log_level level, unsigned output_buf_size, char *params,
 void output_close_stdout(void);
 #endif
 
+// decode_pack.c
+bool _pack_planar_frames(ISAMPLE_T *optr, s32_t *lptr, s32_t *rptr, frames_t frames, unsigned bits);
+void _pack_mad_frames(ISAMPLE_T *optr, s32_t *lptr, s32_t *rptr, frames_t frames);
+void _pack_s16_frames(ISAMPLE_T *optr, s16_t *iptr, frames_t frames, unsigned channels);
+bool _pack_bytes_frames(ISAMPLE_T *optr, u8_t *iptr, frames_t frames, unsigned channels, unsigned size, bool bigendian);
+
 // output_pack.c
 void _scale_and_pack_frames(void *outputptr, s32_t *inputptr, frames_t cnt, s32_t gainL, s32_t gainR, output_format format);
 void _apply_cross(struct buffer *outputbuf, frames_t out_frames, s32_t cross_gain_in, s32_t cross_gain_out, ISAMPLE_T **cross_ptr);
@@ -762,6 +779,10 @@ void _apply_gain(struct buffer *outputbuf, frames_t count, s32_t gainL, s32_t ga
 s32_t gain(s32_t gain, s32_t sample);
 s32_t to_gain(float f);
 
+// output_spdif.c
+void spdif_convert(ISAMPLE_T *src, size_t frames, u32_t *dst, size_t *count);
+void spdif_split(ISAMPLE_T *src, size_t frames, ISAMPLE_T *dac, s32_t *dac_gain, u32_t *dst, s32_t *spdif_gain, size_t *count);
+
 // output_vis.c
 #if VISEXPORT
 void _vis_export(struct buffer *outputbuf, struct outputstate *output, frames_t out_frames, bool silence);
@@ -45,6 +45,10 @@ struct buffer *streambuf = &buf;
 #define LOCK     mutex_lock(streambuf->mutex)
 #define UNLOCK   mutex_unlock(streambuf->mutex)
 
+// most we read in one wake (with streambuf locked) and least free space before reading again
+#define STREAM_BURST_MAX	(64 * 1024)
+#define STREAM_REFILL_MIN	(8 * 1024)
+
 /* 
 When LMS sends a close/open sequence very quickly, the stream thread might
 still be waiting in the poll() on the closed socket. It is never recommended
@@ -61,6 +65,14 @@ static sockfd fd;
 
 struct streamstate stream;
 
+static unsigned rcvbuf_size, refill_min;
+
+// throughput and refill bursts of current stream, logged when it ends
+static struct {
+	u32_t start;
+	u32_t bursts, burst_max;
+} stats;
+
 #if USE_SSL
 static SSL_CTX *SSLctx;
 SSL *ssl;
@@ -145,7 +157,22 @@ static bool send_header(void) {
 
 static bool running = true;
 
+static void stream_stats(void) {
+	u32_t elapsed = gettime_ms() - stats.start;
+
+	LOG_INFO("received " FMT_u64 " bytes in %u ms (%u kB/s), %u refills, avg %u max %u bytes", stream.bytes, elapsed,
+			 elapsed ? (u32_t) (stream.bytes / elapsed) : 0, stats.bursts,
+			 stats.bursts ? (u32_t) (stream.bytes / stats.bursts) : 0, stats.burst_max);
+}
+
+static void stream_burst(unsigned n) {
+	stats.bursts++;
+	if (n > stats.burst_max) stats.burst_max = n;
+	PROFILE_VALUE(PROF_STREAM_BURST, n);
+}
+
 static void _disconnect(stream_state state, disconnect_code disconnect) {
+	stream_stats();
 	stream.state = state;
 	stream.disconnect = disconnect;
 #if USE_SSL
@@ -171,15 +198,19 @@ static void *stream_thread() {
 
 		space = min(_buf_space(streambuf), _buf_cont_write(streambuf));
 
-		if (fd < 0 || !space || stream.state <= STREAMING_WAIT) {
+		// when streambuf is almost full, don't spin on tiny reads, socket buffers have room
+		if (fd < 0 || _buf_space(streambuf) < refill_min || stream.state <= STREAMING_WAIT) {
+			bool full = _buf_space(streambuf) < refill_min;
 			UNLOCK;
-			usleep(space ? 100000 : 25000);
+			usleep(full ? 25000 : 100000);
 			continue;
 		}
 
 		if (stream.state == STREAMING_FILE) {
 
+			PROFILE_START(mark);
 			int n = read(fd, streambuf->writep, space);
+			PROFILE_STOP(PROF_STREAM_RECV, mark);
 			if (n == 0) {
 				LOG_INFO("end of stream");
 				_disconnect(DISCONNECT, DISCONNECT_OK);
@@ -187,6 +218,7 @@ static void *stream_thread() {
 			if (n > 0) {
 				_buf_inc_writep(streambuf, n);
 				stream.bytes += n;
+				stream_burst(n);
 				LOG_SDEBUG("streambuf read %d bytes", n);
 			}
 			if (n < 0) {
@@ -214,6 +246,7 @@ static void *stream_thread() {
 
 			polling = false;
 			LOCK;
+			PROFILE_START(lock);
 
 			// check socket has not been closed while in poll
 			if (fd < 0) {
@@ -325,15 +358,32 @@ static void *stream_thread() {
 
 				// stream body into streambuf
 				} else {
-					int n;
+					int n = 0, burst = 0;
 
-					space = min(_buf_space(streambuf), _buf_cont_write(streambuf));
-					if (stream.meta_interval) {
-						space = min(space, stream.meta_next);
+					// drain socket in one wake (wrapping around streambuf) so that TCP window
+					// re-opens as soon as possible, stop at icy meta data as it's read above
+					while (burst < STREAM_BURST_MAX) {
+						space = min(_buf_space(streambuf), _buf_cont_write(streambuf));
+						space = min(space, STREAM_BURST_MAX - burst);
+						if (stream.meta_interval) {
+							space = min(space, stream.meta_next);
+						}
+						if (!space) break;
+
+						PROFILE_START(mark);
+						n = _recv(ssl, fd, streambuf->writep, space, 0);
+						PROFILE_STOP(PROF_STREAM_RECV, mark);
+						if (n <= 0) break;
+
+						_buf_inc_writep(streambuf, n);
+						stream.bytes += n;
+						burst += n;
+						if (stream.meta_interval) {
+							stream.meta_next -= n;
+						}
 					}
-					
-					n = _recv(ssl, fd, streambuf->writep, space, 0);
-					if (n == 0) {
+
+					if (n == 0 && space) {
 						LOG_INFO("end of stream");
 						_disconnect(DISCONNECT, DISCONNECT_OK);
 					}
@@ -341,13 +391,9 @@ static void *stream_thread() {
 						LOG_INFO("error reading: %s", strerror(last_error()));
 						_disconnect(DISCONNECT, REMOTE_DISCONNECT);
 					}
-					
-					if (n > 0) {
-						_buf_inc_writep(streambuf, n);
-						stream.bytes += n;
-						if (stream.meta_interval) {
-							stream.meta_next -= n;
-						}
+
+					if (burst) {
+						stream_burst(burst);
 					} else {
 						UNLOCK;
 						continue;
@@ -358,10 +404,11 @@ static void *stream_thread() {
 						wake_controller();
 					}
 				
-					LOG_SDEBUG("streambuf read %d bytes", n);
+					LOG_SDEBUG("streambuf read %d bytes", burst);
 				}
 			}
 
+			PROFILE_STOP(PROF_LOCK_STREAMBUF, lock);
 			UNLOCK;
 			
 		} else {
@@ -381,11 +428,11 @@ static void *stream_thread() {
 
 static thread_type thread;
 
-void stream_init(log_level level, unsigned stream_buf_size) {
+void stream_init(log_level level, unsigned stream_buf_size, unsigned stream_rcv_size) {
 	loglevel = level;
 
 	LOG_INFO("init stream");
-	LOG_DEBUG("streambuf size: %u", stream_buf_size);
+	LOG_DEBUG("streambuf size: %u, socket receive buffer: %u", stream_buf_size, stream_rcv_size);
 
 	buf_init(streambuf, stream_buf_size);
 	if (streambuf->buf == NULL) {
@@ -413,6 +460,10 @@ void stream_init(log_level level, unsigned stream_buf_size) {
 #if SUN
 	signal(SIGPIPE, SIG_IGN);	/* Force sockets to return -1 with EPIPE on pipe signal */
 #endif
+	// socket buffer larger than a fraction of streambuf would just hold what we can't take
+	rcvbuf_size = min(stream_rcv_size, streambuf->size / 4);
+	refill_min = min(STREAM_REFILL_MIN, streambuf->size / 8);
+
 	stream.state = STOPPED;
 	stream.header = malloc(MAX_HEADER);
 	*stream.header = '\0';
@@ -481,6 +532,8 @@ void stream_file(const char *header, size_t header_len, unsigned threshold) {
 	stream.sent_headers = false;
 	stream.bytes = 0;
 	stream.threshold = threshold;
+	memset(&stats, 0, sizeof(stats));
+	stats.start = gettime_ms();
 
 	UNLOCK;
 }
@@ -510,6 +563,11 @@ void stream_sock(u32_t ip, u16_t port, const char *header, size_t header_len, un
 	set_nonblock(sock);
 	set_nosigpipe(sock);
 
+	// must be set before connect so that window scaling (if any) is negotiated accordingly
+	if (rcvbuf_size && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const void *) &rcvbuf_size, sizeof(rcvbuf_size)) < 0) {
+		LOG_DEBUG("can't set socket receive buffer to %u: %s", rcvbuf_size, strerror(last_error()));
+	}
+
 	if (connect_timeout(sock, (struct sockaddr *) &addr, sizeof(addr), 10) < 0) {
 		LOG_INFO("unable to connect to server");
 		LOCK;
@@ -587,6 +645,8 @@ void stream_sock(u32_t ip, u16_t port, const char *header, size_t header_len, un
 	stream.sent_headers = false;
 	stream.bytes = 0;
 	stream.threshold = threshold;
+	memset(&stats, 0, sizeof(stats));
+	stats.start = gettime_ms();
 
 	UNLOCK;
 }
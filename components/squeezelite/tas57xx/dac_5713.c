@@ -37,6 +37,9 @@
 #define TAS5713_VOL_HEADPHONE 0x0A
 #define TAS5713_OSC_TRIM 0x1B
 
+// channel volume at full scale, 0.5dB steps and 0xff is mute
+#define TAS5713_VOL_FULL 0x30
+
 static const char TAG[] = "TAS5713";
 
 static bool init(char *config, int i2c_port_num, i2s_config_t *i2s_config);
@@ -46,7 +49,8 @@ static void headset(bool active) { } ;
 static bool volume(unsigned left, unsigned right);
 static void power(adac_power_e mode) { };
 
-const struct adac_s dac_tas5713 = {"TAS5713", init, deinit, power, speaker, headset, volume};
+// volume slews between values by itself (register 0x0e)
+const struct adac_s dac_tas5713 = {"TAS5713", init, deinit, power, speaker, headset, volume, ADAC_CAP_VOLUME | ADAC_CAP_RAMP};
 
 struct tas5713_cmd_s {
     uint8_t reg;
@@ -107,8 +111,8 @@ static bool init(char *config, int i2c_port_num, i2s_config_t *i2s_config) {
     tas5713_set(TAS5713_SYSTEM_CTRL2, 0x00); /* exit all channel shutdown */
     tas5713_set(TAS5713_SOFT_MUTE, 0x00);    /* unmute */
     tas5713_set(TAS5713_VOL_MASTER, 0x20);
-    tas5713_set(TAS5713_VOL_CH1, 0x30);
-    tas5713_set(TAS5713_VOL_CH2, 0x30);
+    tas5713_set(TAS5713_VOL_CH1, TAS5713_VOL_FULL);
+    tas5713_set(TAS5713_VOL_CH2, TAS5713_VOL_FULL);
     tas5713_set(TAS5713_VOL_HEADPHONE, 0xFF);
     
     /* The tas5713 typically has the mclk connected to the sclk. In this
@@ -137,7 +141,12 @@ static void deinit(void) {
  * change volume
  */
 static bool volume(unsigned left, unsigned right) { 
-	return false; 
+	// master volume stays where init put it
+	adac_reg_t regs[] = { { TAS5713_VOL_CH1, TAS5713_VOL_FULL + adac_attenuation(left, 0.5, 0xff - TAS5713_VOL_FULL) },
+						  { TAS5713_VOL_CH2, TAS5713_VOL_FULL + adac_attenuation(right, 0.5, 0xff - TAS5713_VOL_FULL) } };
+	
+	adac_write_regs(i2c_port, TAS5713, regs, 2);
+	return true; 
 }
 
 
@@ -30,14 +30,10 @@ static void headset(bool active);
 static bool volume(unsigned left, unsigned right);
 static void power(adac_power_e mode);
 
-const struct adac_s dac_tas57xx = { "TAS57xx", init, deinit, power, speaker, headset, volume };
+// digital volume ramps by 0.5dB per sample (default of register 0x3f)
+const struct adac_s dac_tas57xx = { "TAS57xx", init, deinit, power, speaker, headset, volume, ADAC_CAP_VOLUME | ADAC_CAP_RAMP };
 
-struct tas57xx_cmd_s {
-	uint8_t reg;
-	uint8_t value;
-};
-
-static const struct tas57xx_cmd_s tas57xx_init_sequence[] = {
+static const adac_reg_t tas57xx_init_sequence[] = {
     { 0x00, 0x00 },		// select page 0
     { 0x02, 0x10 },		// standby
     { 0x0d, 0x10 },		// use SCK for PLL
@@ -45,13 +41,12 @@ static const struct tas57xx_cmd_s tas57xx_init_sequence[] = {
 	{ 0x08, 0x10 },		// Mute control enable (from TAS5780)
 	{ 0x54, 0x02 },		// Mute output control (from TAS5780)
 	{ 0x02, 0x00 },		// restart
-	{ 0xff, 0xff }		// end of table
 };
 
 // matching orders
 typedef enum { TAS57_ACTIVE = 0, TAS57_STANDBY, TAS57_DOWN, TAS57_ANALOGUE_OFF, TAS57_ANALOGUE_ON, TAS57_VOLUME } dac_cmd_e;
 
-static const struct tas57xx_cmd_s tas57xx_cmd[] = {
+static const adac_reg_t tas57xx_cmd[] = {
 	{ 0x02, 0x00 },	// TAS57_ACTIVE
 	{ 0x02, 0x10 },	// TAS57_STANDBY
 	{ 0x02, 0x01 },	// TAS57_DOWN
@@ -97,19 +92,7 @@ static bool init(char *config, int i2c_port_num, i2s_config_t *i2s_config) {
 		return false;
 	}
 
-	i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
-	
-	for (int i = 0; tas57xx_init_sequence[i].reg != 0xff; i++) {
-		i2c_master_start(i2c_cmd);
-		i2c_master_write_byte(i2c_cmd, tas57_addr | I2C_MASTER_WRITE, I2C_MASTER_NACK);
-		i2c_master_write_byte(i2c_cmd, tas57xx_init_sequence[i].reg, I2C_MASTER_NACK);
-		i2c_master_write_byte(i2c_cmd, tas57xx_init_sequence[i].value, I2C_MASTER_NACK);
-		ESP_LOGD(TAG, "i2c write %x at %u", tas57xx_init_sequence[i].reg, tas57xx_init_sequence[i].value);
-	}
-
-	i2c_master_stop(i2c_cmd);	
-	esp_err_t res = i2c_master_cmd_begin(i2c_port, i2c_cmd, 500 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(i2c_cmd);
+	esp_err_t res = adac_write_regs(i2c_port, tas57_addr, tas57xx_init_sequence, sizeof(tas57xx_init_sequence) / sizeof(adac_reg_t));
 
 	ESP_LOGI(TAG, "TAS57xx uses I2C sda:%d, scl:%d", i2c_config.sda_io_num, i2c_config.scl_io_num);
 	
@@ -132,7 +115,8 @@ static void deinit(void)	{
  * change volume
  */
 static bool volume(unsigned left, unsigned right) { 
-	return false; 
+	dac_cmd(TAS57_VOLUME, left, right);
+	return true; 
 }
 
 /****************************************************************************************
@@ -176,23 +160,20 @@ void dac_cmd(dac_cmd_e cmd, ...) {
 	esp_err_t ret = ESP_OK;
 	
 	va_start(args, cmd);
-	i2c_cmd_handle_t i2c_cmd = i2c_cmd_link_create();
 
 	switch(cmd) {
-	case TAS57_VOLUME:
-		ESP_LOGE(TAG, "DAC volume not handled yet");
+	case TAS57_VOLUME: {
+		// 0x30 is 0dB, 0.5dB steps and 0xff is mute
+		unsigned left = va_arg(args, unsigned), right = va_arg(args, unsigned);
+		adac_reg_t regs[] = { { 0x3d, 0x30 + adac_attenuation(left, 0.5, 0xff - 0x30) },
+							  { 0x3e, 0x30 + adac_attenuation(right, 0.5, 0xff - 0x30) } };
+		ret = adac_write_regs(i2c_port, tas57_addr, regs, 2);
 		break;
+	}
 	default:
-		i2c_master_start(i2c_cmd);
-		i2c_master_write_byte(i2c_cmd, tas57_addr | I2C_MASTER_WRITE, I2C_MASTER_NACK);
-		i2c_master_write_byte(i2c_cmd, tas57xx_cmd[cmd].reg, I2C_MASTER_NACK);
-		i2c_master_write_byte(i2c_cmd, tas57xx_cmd[cmd].value, I2C_MASTER_NACK);
-		i2c_master_stop(i2c_cmd);	
-		ret	= i2c_master_cmd_begin(i2c_port, i2c_cmd, 50 / portTICK_RATE_MS);
+		ret = adac_write_regs(i2c_port, tas57_addr, tas57xx_cmd + cmd, 1);
 	}
 	
-    i2c_cmd_link_delete(i2c_cmd);
-	
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "could not intialize TAS57xx %d", ret);
 	}
@@ -58,6 +58,10 @@
 
 #include <fcntl.h>
 
+#if EMBEDDED
+#include "log_ring.h"
+#endif
+
 // logging functions
 const char *logtime(void) {
 	static char buf[100];
@@ -77,9 +81,14 @@ const char *logtime(void) {
 void logprint(const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
+#if EMBEDDED
+	// audio threads must not wait on stdio/vfs locks
+	log_ring_vprintf(fmt, args);
+#else
 	vfprintf(stderr, fmt, args);
-	va_end(args);
 	fflush(stderr);
+#endif
+	va_end(args);
 }
 
 // cmdline parsing
@@ -122,6 +131,29 @@ u32_t gettime_ms(void) {
 }
 #endif
 
+// same clock as gettime_ms, in µs
+#if !defined(gettime_us)
+u64_t gettime_us(void) {
+#if WIN
+	return (u64_t) GetTickCount() * 1000;
+#else
+#if LINUX || FREEBSD || EMBEDDED
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts)) {
+#else
+	if (!clock_gettime(CLOCK_REALTIME, &ts)) {
+#endif
+		return (u64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+#endif
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (u64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+#endif
+
 // mac address
 #if LINUX && !defined(SUN)
 // search first 4 interfaces returned by IFCONF
@@ -378,13 +410,16 @@ event_type wait_readwake(event_handle handles[], int timeout) {
 	}
 #else
 	if (poll(handles, 2, timeout) > 0) {
-		if (handles[0].revents) {
+		if (handles[0].revents & ~POLLOUT) {
 			return EVENT_READ;
 		}
 		if (handles[1].revents) {
 			wake_clear(handles[1].fd);
 			return EVENT_WAKE;
 		}
+		if (handles[0].revents & POLLOUT) {
+			return EVENT_WRITE;
+		}
 	}
 	return EVENT_TIMEOUT;
 #endif
@@ -0,0 +1,228 @@
+/*
+ *  Squeezelite for esp32
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Server-Sent Events channel on /events. Clients receive a full "status" event
+ when they connect, then only the status keys that changed (removed keys are
+ set to null) and every messaging message (including stats) as "message"
+ events, formatted like the items of /messages.json. Sockets are kept open by
+ httpd and all sends happen in the httpd task through httpd_queue_work, so the
+ client list needs no lock. Nothing runs when nobody is connected.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "cJSON.h"
+#include "messaging.h"
+#include "wifi_manager.h"
+#include "trace.h"
+#include "http_server_handlers.h"
+
+#define EVENTS_MAX_CLIENTS	2
+#define EVENTS_PERIOD_MS	500
+#define EVENTS_PING_MS		15000
+#define EVENTS_BUF_SIZE		2048
+
+static const char TAG[] = "http_events";
+
+static struct events_client_s {
+	struct events_client_s *next;
+	int fd;
+} *clients;
+
+static struct {
+	httpd_handle_t server;
+	TimerHandle_t timer;
+	messaging_handle_t messages;
+	cJSON *status;
+	char *buf;
+	bool pending;
+	uint32_t last_send;
+} events;
+
+/****************************************************************************************
+ * Format one event in the static buffer and send it to one or all clients
+ */
+static void events_send(struct events_client_s *target, const char *event, cJSON *data) {
+	int len = snprintf(events.buf, EVENTS_BUF_SIZE, "event: %s\ndata: ", event);
+	char *text = NULL;
+
+	// don't use heap for usual events, but large ones (with tasks) might not fit
+	if (cJSON_PrintPreallocated(data, events.buf + len, EVENTS_BUF_SIZE - len - 2, false)) {
+		len += strlen(events.buf + len);
+		memcpy(events.buf + len, "\n\n", 2);
+		len += 2;
+	} else if ((text = cJSON_PrintUnformatted(data)) == NULL) {
+		return;
+	}
+
+	for (struct events_client_s *client = clients; client; client = client->next) {
+		bool failed;
+
+		if (target && target != client) continue;
+
+		if (text) {
+			failed = httpd_socket_send(events.server, client->fd, events.buf, len, 0) < 0 ||
+					 httpd_socket_send(events.server, client->fd, text, strlen(text), 0) < 0 ||
+					 httpd_socket_send(events.server, client->fd, "\n\n", 2, 0) < 0;
+		} else {
+			failed = httpd_socket_send(events.server, client->fd, events.buf, len, 0) < 0;
+		}
+
+		if (failed) {
+			ESP_LOGW(TAG, "can't send to client %d, closing", client->fd);
+			httpd_sess_trigger_close(events.server, client->fd);
+		}
+	}
+
+	events.last_send = xTaskGetTickCount();
+	free(text);
+}
+
+/****************************************************************************************
+ * Returns an object with all keys of status that differ from the previous one,
+ * items are references so it must be printed before status is updated
+ */
+static cJSON *status_delta(cJSON *status) {
+	cJSON *delta = cJSON_CreateObject();
+	cJSON *item;
+
+	cJSON_ArrayForEach(item, status) {
+		cJSON *previous = events.status ? cJSON_GetObjectItemCaseSensitive(events.status, item->string) : NULL;
+		if (!previous || !cJSON_Compare(item, previous, true)) cJSON_AddItemReferenceToObject(delta, item->string, item);
+	}
+
+	if (events.status) cJSON_ArrayForEach(item, events.status) {
+		if (!cJSON_GetObjectItemCaseSensitive(status, item->string)) cJSON_AddNullToObject(delta, item->string);
+	}
+
+	return delta;
+}
+
+/****************************************************************************************
+ * Runs in httpd task
+ */
+static void events_push(void *arg) {
+	cJSON *messages, *message;
+
+	events.pending = false;
+	if (!clients) return;
+
+	// status changes, if status is busy, we'll get it next time
+	if (wifi_manager_lock_json_buffer(0)) {
+		cJSON *status = wifi_manager_get_ip_info_json();
+		cJSON *delta = status_delta(status);
+
+		if (delta->child) {
+			events_send(NULL, "status", delta);
+			cJSON_Delete(events.status);
+			events.status = cJSON_Duplicate(status, true);
+		}
+
+		wifi_manager_unlock_json_buffer();
+		cJSON_Delete(delta);
+	}
+
+	// all messages, including stats
+	messages = messaging_retrieve_messages(events.messages);
+	cJSON_ArrayForEach(message, messages) events_send(NULL, "message", message);
+	cJSON_Delete(messages);
+
+	// comments are ignored by clients but tell us if they are gone
+	if (xTaskGetTickCount() - events.last_send > pdMS_TO_TICKS(EVENTS_PING_MS)) {
+		for (struct events_client_s *client = clients; client; client = client->next) {
+			if (httpd_socket_send(events.server, client->fd, ":\n\n", 3, 0) < 0) httpd_sess_trigger_close(events.server, client->fd);
+		}
+		events.last_send = xTaskGetTickCount();
+	}
+}
+
+/****************************************************************************************
+ *
+ */
+static void events_timer(TimerHandle_t xTimer) {
+	if (events.pending) return;
+	events.pending = true;
+	if (httpd_queue_work(events.server, events_push, NULL) != ESP_OK) events.pending = false;
+}
+
+/****************************************************************************************
+ * Called by httpd when the socket is closed, whoever closed it
+ */
+static void events_client_free(void *ctx) {
+	struct events_client_s **p = &clients;
+
+	while (*p && *p != ctx) p = &(*p)->next;
+	if (*p) *p = (*p)->next;
+
+	ESP_LOGI(TAG, "client %d disconnected", ((struct events_client_s*) ctx)->fd);
+	free(ctx);
+
+	if (!clients) {
+		xTimerStop(events.timer, 0);
+		FREE_AND_NULL(events.buf);
+		cJSON_Delete(events.status);
+		events.status = NULL;
+	}
+}
+
+/****************************************************************************************
+ *
+ */
+esp_err_t events_get_handler(httpd_req_t *req) {
+	static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+								 "Cache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+	struct events_client_s *client;
+	int count = 0;
+
+	ESP_LOGD_LOC(TAG, "serving [%s]", req->uri);
+
+	for (client = clients; client; client = client->next) count++;
+	if (count >= EVENTS_MAX_CLIENTS || !events.timer || (!events.buf && (events.buf = malloc(EVENTS_BUF_SIZE)) == NULL)) {
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		return httpd_resp_send(req, "Too many event clients", HTTPD_RESP_USE_STRLEN);
+	}
+
+	if (httpd_send(req, header, sizeof(header) - 1) < 0) return ESP_FAIL;
+
+	if ((client = calloc(1, sizeof(struct events_client_s))) == NULL) return ESP_FAIL;
+	client->fd = httpd_req_to_sockfd(req);
+	client->next = clients;
+	clients = client;
+
+	// socket stays open after we return, httpd frees the client when it closes
+	req->sess_ctx = client;
+	req->free_ctx = events_client_free;
+
+	// first event is the whole status
+	if (wifi_manager_lock_json_buffer(pdMS_TO_TICKS(50))) {
+		cJSON *status = wifi_manager_get_ip_info_json();
+		if (!events.status) events.status = cJSON_Duplicate(status, true);
+		events_send(client, "status", status);
+		wifi_manager_unlock_json_buffer();
+	}
+
+	xTimerStart(events.timer, 0);
+	ESP_LOGI(TAG, "client %d connected", client->fd);
+
+	return ESP_OK;
+}
+
+/****************************************************************************************
+ *
+ */
+void events_init(httpd_handle_t server) {
+	events.server = server;
+	events.messages = messaging_register_subscriber(10, "http_events");
+	events.timer = xTimerCreate("http_events", pdMS_TO_TICKS(EVENTS_PERIOD_MS), pdTRUE, NULL, events_timer);
+}
@@ -54,6 +54,10 @@ function to process requests, decode URLs, serve files, etc. etc.
 #include "argtable3/argtable3.h"
 #include "platform_console.h"
 #include "accessors.h"
+#include "profiler.h"
+#include "task_monitor.h"
+#include "esp_timer.h"
+#include "esp32/rom/crc.h"
  
 #define HTTP_STACK_SIZE	(5*1024)
 const char str_na[]="N/A";
@@ -63,7 +67,7 @@ static const char TAG[] = "httpd_handlers";
 /* @brief task handle for the http server */
 
 SemaphoreHandle_t http_server_config_mutex = NULL;
-extern RingbufHandle_t messaging;
+extern messaging_handle_t messaging;
 #define AUTH_TOKEN_SIZE 50
 typedef struct session_context {
     char * auth_token;
@@ -344,6 +348,8 @@ static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filena
         return httpd_resp_set_type(req, "text/javascript");
     } else if (IS_FILE_EXT(filename, ".json")) {
         return httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    } else if (IS_FILE_EXT(filename, ".bin")) {
+        return httpd_resp_set_type(req, HTTPD_TYPE_OCTET);
     }
 
     /* This is a limited set only */
@@ -388,8 +394,28 @@ esp_err_t root_get_handler(httpd_req_t *req){
     return err;
 }
 
+/* embedded resources, ETag is a crc of content, computed on first request */
+static struct resource_s {
+	const char *name;
+	const uint8_t *start, *end;
+	bool gzip;
+	char etag[11];
+} resources[] = {
+	{ "code.js", code_js_start, code_js_end, true },
+	{ "style.css", style_css_start, style_css_end, true },
+	{ "favicon.ico", favicon_ico_start, favicon_ico_end, false },
+	{ "jquery.js", jquery_gz_start, jquery_gz_end, true },
+	{ "bootstrap.js", bootstrap_js_gz_start, bootstrap_js_gz_end, true },
+	{ "bootstrap.css", bootstrap_css_gz_start, bootstrap_css_gz_end, true },
+};
+static struct {
+	uint32_t requests, not_modified, bytes;
+} resource_stats;
+
 esp_err_t resource_filehandler(httpd_req_t *req){
-    char filepath[FILE_PATH_MAX];
+    char filepath[FILE_PATH_MAX], buf[64], range[48];
+    struct resource_s *res = NULL;
+    int64_t start = esp_timer_get_time();
    ESP_LOGD_LOC(TAG, "serving [%s]", req->uri);
 
    const char *filename = get_path_from_uri(filepath, req->uri, sizeof(filepath));
@@ -407,48 +433,55 @@ esp_err_t resource_filehandler(httpd_req_t *req){
 	   return ESP_FAIL;
    }
 
-   if(strstr(filename, "code.js")) {
-	    set_content_type_from_file(req, filename);
-		httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-	    const size_t file_size = (code_js_end - code_js_start);
-	    httpd_resp_send(req, (const char *)code_js_start, file_size);
-	} else if(strstr(filename, "style.css")) {
-		set_content_type_from_file(req, filename);
-		httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-	    const size_t file_size = (style_css_end - style_css_start);
-	    httpd_resp_send(req, (const char *)style_css_start, file_size);
-    } else if(strstr(filename, "favicon.ico")) {
-		set_content_type_from_file(req, filename);
-	    const size_t file_size = (favicon_ico_end - favicon_ico_start);
-	    httpd_resp_send(req, (const char *)favicon_ico_start, file_size);
-	} else if(strstr(filename, "jquery.js")) {
-		set_content_type_from_file(req, filename);
-		httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-	    const size_t file_size = (jquery_gz_end - jquery_gz_start);
-	    httpd_resp_send(req, (const char *)jquery_gz_start, file_size);
-	// } else if(strstr(filename, "popper.js")) {
-	// 	set_content_type_from_file(req, filename);
-	// 	httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-	//     const size_t file_size = (popper_gz_end - popper_gz_start);
-	//     httpd_resp_send(req, (const char *)popper_gz_start, file_size);
-	} else if(strstr(filename, "bootstrap.js")) {
-			set_content_type_from_file(req, filename);
-			httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-		    const size_t file_size = (bootstrap_js_gz_end - bootstrap_js_gz_start);
-		    httpd_resp_send(req, (const char *)bootstrap_js_gz_start, file_size);
-	} else if(strstr(filename, "bootstrap.css")) {
-			set_content_type_from_file(req, filename);
-			httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-		    const size_t file_size = (bootstrap_css_gz_end - bootstrap_css_gz_start);
-		    httpd_resp_send(req, (const char *)bootstrap_css_gz_start, file_size);
-    } else {
+   for (int i = 0; i < sizeof(resources) / sizeof(*resources) && !res; i++) {
+	   if (strstr(filename, resources[i].name)) res = resources + i;
+   }
+
+   if (!res) {
 	   ESP_LOGE_LOC(TAG, "Unknown resource [%s] from path [%s] ", filename,filepath);
 	   /* Respond with 404 Not Found */
 	   httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
 	   return ESP_FAIL;
    }
-   ESP_LOGD_LOC(TAG, "Resource sending complete");
-   return ESP_OK;
+
+   size_t size = res->end - res->start, offset = 0, len = size;
+   if (!*res->etag) snprintf(res->etag, sizeof(res->etag), "\"%08x\"", crc32_le(0, res->start, size));
+
+   set_content_type_from_file(req, filename);
+   if (res->gzip) httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+   httpd_resp_set_hdr(req, "ETag", res->etag);
+   httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+   // URLs are not versioned so browser keeps a copy but revalidates it (304 below)
+   httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+   resource_stats.requests++;
+
+   if (httpd_req_get_hdr_value_str(req, "If-None-Match", buf, sizeof(buf)) == ESP_OK && strstr(buf, res->etag)) {
+	   resource_stats.not_modified++;
+	   httpd_resp_set_status(req, "304 Not Modified");
+	   httpd_resp_send(req, NULL, 0);
+	   ESP_LOGD_LOC(TAG, "[%s] not modified (%u/%u)", res->name, resource_stats.not_modified, resource_stats.requests);
+	   return ESP_OK;
+   }
+
+   // single range only, anything else gets the whole content
+   if (httpd_req_get_hdr_value_str(req, "Range", buf, sizeof(buf)) == ESP_OK) {
+	   unsigned first, last = size - 1;
+	   if (sscanf(buf, "bytes=%u-%u", &first, &last) >= 1 && first <= last && first < size) {
+		   if (last >= size) last = size - 1;
+		   offset = first;
+		   len = last - first + 1;
+		   snprintf(range, sizeof(range), "bytes %u-%u/%u", first, last, size);
+		   httpd_resp_set_hdr(req, "Content-Range", range);
+		   httpd_resp_set_status(req, "206 Partial Content");
+	   }
+   }
+
+   // no chunk encoding, httpd sends from flash in TCP sized pieces anyway
+   esp_err_t err = httpd_resp_send(req, (const char *)res->start + offset, len);
+   resource_stats.bytes += len;
+   ESP_LOGD_LOC(TAG, "[%s] sent %u bytes in %u ms (total %u bytes for %u requests)", res->name, len,
+		   (uint32_t) (esp_timer_get_time() - start) / 1000, resource_stats.bytes, resource_stats.requests);
+   return err;
 
 }
 esp_err_t ap_scan_handler(httpd_req_t *req){
@@ -1157,6 +1190,65 @@ esp_err_t messages_get_handler(httpd_req_t *req){
 	return ESP_OK;
 }
 
+esp_err_t perf_get_handler(httpd_req_t *req){
+    ESP_LOGD_LOC(TAG, "serving [%s]", req->uri);
+    if(!is_user_authenticated(req)){
+    	// todo:  redirect to login page
+    	// return ESP_OK;
+    }
+    esp_err_t err = set_content_type_from_req(req);
+	if(err != ESP_OK){
+		return err;
+	}
+	cJSON * json_perf = profiler_get_json();
+	char * json_text = json_perf ? cJSON_PrintUnformatted(json_perf) : NULL;
+	if(json_text!=NULL){
+		httpd_resp_send(req, (const char *)json_text, strlen(json_text));
+		free(json_text);
+	}
+	else {
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR , "Unable to retrieve profiler data");
+	}
+	cJSON_Delete(json_perf);
+	return ESP_OK;
+}
+
+esp_err_t monitor_get_handler(httpd_req_t *req){
+    ESP_LOGD_LOC(TAG, "serving [%s]", req->uri);
+    if(!is_user_authenticated(req)){
+    	// todo:  redirect to login page
+    	// return ESP_OK;
+    }
+    esp_err_t err = set_content_type_from_req(req);
+	if(err != ESP_OK){
+		return err;
+	}
+	// same content, packed records for /monitor.bin
+	if(strstr(req->uri, ".bin")){
+		size_t size = task_monitor_get_binary(NULL, 0);
+		uint8_t * buf = malloc(size);
+		if(buf && (size = task_monitor_get_binary(buf, size)) > 0){
+			httpd_resp_send(req, (const char *)buf, size);
+		}
+		else {
+			httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR , "Unable to retrieve monitor data");
+		}
+		free(buf);
+		return ESP_OK;
+	}
+	cJSON * json_monitor = task_monitor_get_json();
+	char * json_text = json_monitor ? cJSON_PrintUnformatted(json_monitor) : NULL;
+	if(json_text!=NULL){
+		httpd_resp_send(req, (const char *)json_text, strlen(json_text));
+		free(json_text);
+	}
+	else {
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR , "Unable to retrieve monitor data");
+	}
+	cJSON_Delete(json_monitor);
+	return ESP_OK;
+}
+
 esp_err_t status_get_handler(httpd_req_t *req){
     ESP_LOGD_LOC(TAG, "serving [%s]", req->uri);
     if(!is_user_authenticated(req)){
@@ -91,6 +91,10 @@ esp_err_t recovery_post_handler(httpd_req_t *req);
 esp_err_t flash_post_handler(httpd_req_t *req);
 esp_err_t status_get_handler(httpd_req_t *req);
 esp_err_t messages_get_handler(httpd_req_t *req);
+esp_err_t perf_get_handler(httpd_req_t *req);
+esp_err_t monitor_get_handler(httpd_req_t *req);
+esp_err_t events_get_handler(httpd_req_t *req);
+void events_init(httpd_handle_t server);
 esp_err_t console_cmd_get_handler(httpd_req_t *req);
 esp_err_t console_cmd_post_handler(httpd_req_t *req);
 esp_err_t ap_scan_handler(httpd_req_t *req);
@@ -148,6 +148,7 @@ var apList = null;
 var selectedSSID = "";
 var refreshAPInterval = null;
 var checkStatusInterval = null;
+var eventsConnected = false;
 var messagecount=0;
 var messageseverity="MESSAGING_INFO";
 var StatusIntervalActive = false;
@@ -739,6 +740,7 @@ $(document).ready(function() {
 	getCommands();
 
 	//start timers
+	startEvents();
 	startCheckStatusInterval();
 	//startRefreshAPInterval();
 
@@ -848,63 +850,67 @@ function refreshAPHTML(data) {
 
 	$("#wifi-list").html(h)
 }
+function handleMessage(msg) {
+	var msg_age = msg["current_time"] - msg["sent_time"];
+	var msg_time = new Date();
+	msg_time.setTime(msg_time.getTime() - msg_age);
+	switch (msg["class"]) {
+		case "MESSAGING_CLASS_OTA":
+			//message: "{"ota_dsc":"Erasing flash complete","ota_pct":0}"
+			var ota_data = JSON.parse(msg["message"]);
+			if (ota_data.hasOwnProperty('ota_pct') && ota_data['ota_pct'] != 0) {
+				otapct = ota_data['ota_pct'];
+				$('.progress-bar').css('width', otapct + '%').attr('aria-valuenow', otapct);
+				$('.progress-bar').html(otapct + '%');
+			}
+			if (ota_data.hasOwnProperty('ota_dsc') && ota_data['ota_dsc'] != '') {
+				otadsc = ota_data['ota_dsc'];
+				$("span#flash-status").html(otadsc);
+				if (msg.type == "MESSAGING_ERROR" || otapct > 95) {
+					blockFlashButton = false;
+					enableStatusTimer = true;
+				}
+			}
+			break;
+		case "MESSAGING_CLASS_STATS":
+			// for task states, check structure : task_state_t
+			var stats_data = JSON.parse(msg["message"]);
+			console.log(msg_time.toLocaleString() + " - Number of tasks on the ESP32: " + stats_data["ntasks"]);
+			console.log(msg_time.toLocaleString() + '\tname' + '\tcpu' + '\tstate' + '\tminstk' + '\tbprio' + '\tcprio' + '\tnum');
+			if(stats_data["tasks"]){
+				if($("#tasks_sect").css('visibility') =='collapse'){
+					$("#tasks_sect").css('visibility','visible');
+				}
+				var trows="";
+				stats_data["tasks"].sort(function(a, b){
+					return (b.cpu-a.cpu);
+				}).forEach(function(task) {
+					console.log(msg_time.toLocaleString() + '\t' + task["nme"] + '\t' + task["cpu"] + '\t' + task_state_t[task["st"]] + '\t' + task["minstk"] + '\t' + task["bprio"] + '\t' + task["cprio"] + '\t' + task["num"]);
+					trows+='<tr class="table-primary"><th scope="row">' + task["num"]+ '</th><td>' + task["nme"]  + '</td><td>' + task["cpu"] + '</td><td>' + task_state_t[task["st"]] + '</td><td>' + task["minstk"]+ '</td><td>' + task["bprio"]+ '</td><td>' + task["cprio"] + '</td></tr>'
+				});
+				$("tbody#tasks").html(trows);
+			}
+			else if($("#tasks_sect").css('visibility') =='visible'){
+					$("tbody#tasks").empty();
+					$("#tasks_sect").css('visibility','collapse');
+				}
+			break;
+		case "MESSAGING_CLASS_SYSTEM":
+			var r = showMessage(msg,msg_time, msg_age);
+			break;
+		case "MESSAGING_CLASS_CFGCMD":
+			var msgparts=msg["message"].split(/([^\n]*)\n(.*)/gs);
+			showCmdMessage(msgparts[1],msg['type'],msgparts[2],true);
+			break;
+		default:
+			break;
+	}
+}
+
 function getMessages() {
 	$.getJSON("/messages.json?1", async function(data) {
 			for (const msg of data) {
-				var msg_age = msg["current_time"] - msg["sent_time"];
-				var msg_time = new Date();
-				msg_time.setTime(msg_time.getTime() - msg_age);
-				switch (msg["class"]) {
-					case "MESSAGING_CLASS_OTA":
-						//message: "{"ota_dsc":"Erasing flash complete","ota_pct":0}"
-						var ota_data = JSON.parse(msg["message"]);
-						if (ota_data.hasOwnProperty('ota_pct') && ota_data['ota_pct'] != 0) {
-							otapct = ota_data['ota_pct'];
-							$('.progress-bar').css('width', otapct + '%').attr('aria-valuenow', otapct);
-							$('.progress-bar').html(otapct + '%');
-						}
-						if (ota_data.hasOwnProperty('ota_dsc') && ota_data['ota_dsc'] != '') {
-							otadsc = ota_data['ota_dsc'];
-							$("span#flash-status").html(otadsc);
-							if (msg.type == "MESSAGING_ERROR" || otapct > 95) {
-								blockFlashButton = false;
-								enableStatusTimer = true;
-							}
-						}
-						break;
-					case "MESSAGING_CLASS_STATS":
-						// for task states, check structure : task_state_t
-						var stats_data = JSON.parse(msg["message"]);
-						console.log(msg_time.toLocaleString() + " - Number of tasks on the ESP32: " + stats_data["ntasks"]);
-						console.log(msg_time.toLocaleString() + '\tname' + '\tcpu' + '\tstate' + '\tminstk' + '\tbprio' + '\tcprio' + '\tnum');
-						if(stats_data["tasks"]){
-							if($("#tasks_sect").css('visibility') =='collapse'){
-								$("#tasks_sect").css('visibility','visible');
-							}
-							var trows="";
-							stats_data["tasks"].sort(function(a, b){
-								return (b.cpu-a.cpu);
-							}).forEach(function(task) {
-								console.log(msg_time.toLocaleString() + '\t' + task["nme"] + '\t' + task["cpu"] + '\t' + task_state_t[task["st"]] + '\t' + task["minstk"] + '\t' + task["bprio"] + '\t' + task["cprio"] + '\t' + task["num"]);
-								trows+='<tr class="table-primary"><th scope="row">' + task["num"]+ '</th><td>' + task["nme"]  + '</td><td>' + task["cpu"] + '</td><td>' + task_state_t[task["st"]] + '</td><td>' + task["minstk"]+ '</td><td>' + task["bprio"]+ '</td><td>' + task["cprio"] + '</td></tr>'
-							});
-							$("tbody#tasks").html(trows);
-						}
-						else if($("#tasks_sect").css('visibility') =='visible'){
-								$("tbody#tasks").empty();
-								$("#tasks_sect").css('visibility','collapse');
-							}
-						break;
-					case "MESSAGING_CLASS_SYSTEM":
-						var r = showMessage(msg,msg_time, msg_age);
-						break;
-					case "MESSAGING_CLASS_CFGCMD":
-						var msgparts=msg["message"].split(/([^\n]*)\n(.*)/gs);
-						showCmdMessage(msgparts[1],msg['type'],msgparts[2],true);
-						break;
-					default:
-						break;
-				}
+				handleMessage(msg);
 			}
 		})
 		.fail( handleExceptionResponse);
@@ -1020,56 +1026,87 @@ function handleWifiStatus(data){
 	}
 }
 
+function handleStatus(data) {
+	handleRecoveryMode(data);
+	handleWifiStatus(data);
+	if (data.hasOwnProperty('project_name') && data['project_name'] != '') {
+		pname = data['project_name'];
+	}
+	if (data.hasOwnProperty('version') && data['version'] != '') {
+		ver = data['version'];
+		$("span#foot-fw").html("fw: <strong>" + ver + "</strong>, mode: <strong>" + pname + "</strong>");
+	} else {
+		$("span#flash-status").html('');
+	}
+	if (data.hasOwnProperty('Voltage')) {
+		var voltage = data['Voltage'];
+		var layer;
+
+		/* Assuming Li-ion 18650s as a power source, 3.9V per cell, or above is treated
+			as full charge (>75% of capacity).  3.4V is empty. The gauge is loosely
+			following the graph here:
+				https://learn.adafruit.com/li-ion-and-lipoly-batteries/voltages
+			using the 0.2C discharge profile for the rest of the values.
+		*/
+
+		if (voltage > 0) {
+			if (inRange(voltage, 5.8, 6.8) || inRange(voltage, 8.8, 10.2)) {
+				layer = bat0;
+			} else if (inRange(voltage, 6.8, 7.4) || inRange(voltage, 10.2, 11.1)) {
+				layer = bat1;
+			} else if (inRange(voltage, 7.4, 7.5) || inRange(voltage, 11.1, 11.25)) {
+				layer = bat2;
+			} else if (inRange(voltage, 7.5, 7.8) || inRange(voltage, 11.25, 11.7)) {
+				layer = bat3;	
+			} else {
+				layer = bat4;
+			}
+			layer.setAttribute("display","inline");
+		}
+	}
+	if (data.hasOwnProperty('Jack')) {
+		var jack = data['Jack'];
+		if (jack == '1') {
+			o_jack.setAttribute("display", "inline");
+		}
+	}
+}
+
+// server pushes status changes and messages, polling is only used when not connected
+function startEvents() {
+	if (!window.EventSource) return;
+	var status = {};
+	var events = new EventSource('/events');
+	events.onopen = function() {
+		eventsConnected = true;
+	};
+	events.onerror = function() {
+		// browser will reconnect by itself, poll meanwhile
+		eventsConnected = false;
+		status = {};
+	};
+	events.addEventListener('status', function(e) {
+		var delta = JSON.parse(e.data);
+		for (var key in delta) {
+			if (delta[key] === null) delete status[key];
+			else status[key] = delta[key];
+		}
+		handleStatus(status);
+	});
+	events.addEventListener('message', function(e) {
+		handleMessage(JSON.parse(e.data));
+	});
+}
+
 function checkStatus() {
 	RepeatCheckStatusInterval();
 	if (!enableStatusTimer) return;
+	if (eventsConnected) return;
 	if (blockAjax) return;
 	blockAjax = true;
 	getMessages();
 	$.getJSON("/status.json", function(data) {
-		handleRecoveryMode(data);
-		handleWifiStatus(data);
-		if (data.hasOwnProperty('project_name') && data['project_name'] != '') {
-			pname = data['project_name'];
-		}
-		if (data.hasOwnProperty('version') && data['version'] != '') {
-			ver = data['version'];
-			$("span#foot-fw").html("fw: <strong>" + ver + "</strong>, mode: <strong>" + pname + "</strong>");
-		} else {
-			$("span#flash-status").html('');
-		}
-		if (data.hasOwnProperty('Voltage')) {
-			var voltage = data['Voltage'];
-			var layer;
-
-			/* Assuming Li-ion 18650s as a power source, 3.9V per cell, or above is treated
-				as full charge (>75% of capacity).  3.4V is empty. The gauge is loosely
-				following the graph here:
-					https://learn.adafruit.com/li-ion-and-lipoly-batteries/voltages
-				using the 0.2C discharge profile for the rest of the values.
-			*/
-
-			if (voltage > 0) {
-				if (inRange(voltage, 5.8, 6.8) || inRange(voltage, 8.8, 10.2)) {
-					layer = bat0;
-				} else if (inRange(voltage, 6.8, 7.4) || inRange(voltage, 10.2, 11.1)) {
-					layer = bat1;
-				} else if (inRange(voltage, 7.4, 7.5) || inRange(voltage, 11.1, 11.25)) {
-					layer = bat2;
-				} else if (inRange(voltage, 7.5, 7.8) || inRange(voltage, 11.25, 11.7)) {
-					layer = bat3;	
-				} else {
-					layer = bat4;
-				}
-				layer.setAttribute("display","inline");
-			}
-		}
-		if (data.hasOwnProperty('Jack')) {
-			var jack = data['Jack'];
-			if (jack == '1') {
-				o_jack.setAttribute("display", "inline");
-			}
-		}
+		handleStatus(data);
 		blockAjax = false;
 	})
 	.fail(function(xhr, ajaxOptions, thrownError) {
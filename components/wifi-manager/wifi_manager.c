@@ -874,6 +874,10 @@ char* wifi_manager_alloc_get_ip_info_json(){
 	return cJSON_PrintUnformatted(ip_info_cjson);
 }
 
+cJSON * wifi_manager_get_ip_info_json(){
+	return ip_info_cjson;
+}
+
 void wifi_manager_destroy(){
 	vTaskDelete(task_wifi_manager);
 	task_wifi_manager = NULL;
@@ -1001,7 +1005,7 @@ void wifi_manager_config_ap(){
 		tcpip_adapter_ip_info_t info;
 		esp_err_t err=ESP_OK;
 		memset(&info, 0x00, sizeof(info));
-		char * value = NULL;
+		char value[16];
 		wifi_config_t ap_config = {
 			.ap = {
 				.ssid_len = 0,
@@ -1017,24 +1021,18 @@ void wifi_manager_config_ap(){
 		/*
 		 * Set access point mode IP adapter configuration
 		 */
-		value = config_alloc_get_default(NVS_TYPE_STR, "ap_ip_address", DEFAULT_AP_IP, 0);
-		if(value!=NULL){
-			ESP_LOGD(TAG,  "IP Address: %s", value);
-			inet_pton(AF_INET,value, &info.ip); /* access point is on a static IP */
-		}
-		FREE_AND_NULL(value);
-		value = config_alloc_get_default(NVS_TYPE_STR, "ap_ip_gateway", CONFIG_DEFAULT_AP_GATEWAY, 0);
-		if(value!=NULL){
-			ESP_LOGD(TAG,  "Gateway: %s", value);
-			inet_pton(AF_INET,value, &info.gw); /* access point is on a static IP */
-		}
-		FREE_AND_NULL(value);
-		value = config_alloc_get_default(NVS_TYPE_STR, "ap_ip_netmask", CONFIG_DEFAULT_AP_NETMASK, 0);
-		if(value!=NULL){
-			ESP_LOGD(TAG,  "Netmask: %s", value);
-			inet_pton(AF_INET,value, &info.netmask); /* access point is on a static IP */
-		}
-		FREE_AND_NULL(value);
+		strlcpy(value, DEFAULT_AP_IP, sizeof(value));
+		config_get_str("ap_ip_address", value, sizeof(value));
+		ESP_LOGD(TAG,  "IP Address: %s", value);
+		inet_pton(AF_INET,value, &info.ip); /* access point is on a static IP */
+		strlcpy(value, CONFIG_DEFAULT_AP_GATEWAY, sizeof(value));
+		config_get_str("ap_ip_gateway", value, sizeof(value));
+		ESP_LOGD(TAG,  "Gateway: %s", value);
+		inet_pton(AF_INET,value, &info.gw); /* access point is on a static IP */
+		strlcpy(value, CONFIG_DEFAULT_AP_NETMASK, sizeof(value));
+		config_get_str("ap_ip_netmask", value, sizeof(value));
+		ESP_LOGD(TAG,  "Netmask: %s", value);
+		inet_pton(AF_INET,value, &info.netmask); /* access point is on a static IP */
 
 		ESP_LOGD(TAG,  "Setting tcp_ip info for interface TCPIP_ADAPTER_IF_AP");
 		if((err=tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_AP, &info))!=ESP_OK){
@@ -1044,26 +1042,19 @@ void wifi_manager_config_ap(){
 		/*
 		 * Set Access Point configuration
 		 */
-		value = config_alloc_get_default(NVS_TYPE_STR, "ap_ssid", CONFIG_DEFAULT_AP_SSID, 0);
-		if(value!=NULL){
-			strlcpy((char *)ap_config.ap.ssid, value,sizeof(ap_config.ap.ssid) );
-			ESP_LOGI(TAG,  "AP SSID: %s", (char *)ap_config.ap.ssid);
-		}
-		FREE_AND_NULL(value);
+		// copied straight in place, truncated like before if too long
+		strlcpy((char *)ap_config.ap.ssid, CONFIG_DEFAULT_AP_SSID, sizeof(ap_config.ap.ssid));
+		config_get_str("ap_ssid", (char *)ap_config.ap.ssid, sizeof(ap_config.ap.ssid));
+		ESP_LOGI(TAG,  "AP SSID: %s", (char *)ap_config.ap.ssid);
 
-		value = config_alloc_get_default(NVS_TYPE_STR, "ap_pwd", DEFAULT_AP_PASSWORD, 0);
-		if(value!=NULL){
-			strlcpy((char *)ap_config.ap.password, value,sizeof(ap_config.ap.password) );
-			ESP_LOGI(TAG,  "AP Password: %s", (char *)ap_config.ap.password);
-		}
-		FREE_AND_NULL(value);
+		strlcpy((char *)ap_config.ap.password, DEFAULT_AP_PASSWORD, sizeof(ap_config.ap.password));
+		config_get_str("ap_pwd", (char *)ap_config.ap.password, sizeof(ap_config.ap.password));
+		ESP_LOGI(TAG,  "AP Password: %s", (char *)ap_config.ap.password);
 
-		value = config_alloc_get_default(NVS_TYPE_STR, "ap_channel", STR(CONFIG_DEFAULT_AP_CHANNEL), 0);
-		if(value!=NULL){
-			ESP_LOGD(TAG,  "Channel: %s", value);
-			ap_config.ap.channel=atoi(value);
-		}
-		FREE_AND_NULL(value);
+		strlcpy(value, STR(CONFIG_DEFAULT_AP_CHANNEL), sizeof(value));
+		config_get_str("ap_channel", value, sizeof(value));
+		ESP_LOGD(TAG,  "Channel: %s", value);
+		ap_config.ap.channel=atoi(value);
 
 		ap_config.ap.authmode = AP_AUTHMODE;
 		ap_config.ap.ssid_hidden = DEFAULT_AP_SSID_HIDDEN;
@@ -1286,14 +1277,14 @@ void wifi_manager( void * pvParameters ){
 					}
 					ESP_LOGD(TAG,   "MESSAGE: ORDER_CONNECT_STA - setting config for WIFI_IF_STA");
 					wifi_config_t* cfg = wifi_manager_get_wifi_sta_config();
-				    char * scan_mode = config_alloc_get_default(NVS_TYPE_STR, "wifi_smode", "f", 0);
-				    if (scan_mode && strcasecmp(scan_mode,"a")==0) {
+				    char scan_mode[4] = "f";
+				    config_get_str("wifi_smode", scan_mode, sizeof(scan_mode));
+				    if (strcasecmp(scan_mode,"a")==0) {
 				    	cfg->sta.scan_method=WIFI_ALL_CHANNEL_SCAN;
 				    }
 				    else {
 				    	cfg->sta.scan_method=WIFI_FAST_SCAN;
 				    }
-				    FREE_AND_NULL(scan_mode);
 					if((err=esp_wifi_set_config(WIFI_IF_STA, cfg))!=ESP_OK) {
 						ESP_LOGE(TAG,  "Failed to set STA configuration. Error %s",esp_err_to_name(err));
 						break;
@@ -269,6 +269,8 @@ void wifi_manager( void * pvParameters );
 
 char* wifi_manager_alloc_get_ap_list_json();
 char* wifi_manager_alloc_get_ip_info_json();
+/* @note not thread-safe, only valid while wifi_manager_lock_json_buffer is held */
+cJSON * wifi_manager_get_ip_info_json();
 cJSON * wifi_manager_clear_ap_list_json(cJSON **old);
 
 /**
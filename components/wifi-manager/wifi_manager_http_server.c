@@ -35,7 +35,7 @@ static const char TAG[] = "http_server";
 
 static httpd_handle_t _server = NULL;
 rest_server_context_t *rest_context = NULL;
-RingbufHandle_t messaging=NULL;
+messaging_handle_t messaging=NULL;
 
 void register_common_handlers(httpd_handle_t server){
 	httpd_uri_t res_get = { .uri = "/res/*", .method = HTTP_GET, .handler = resource_filehandler, .user_ctx = rest_context };
@@ -56,6 +56,14 @@ void register_regular_handlers(httpd_handle_t server){
 	httpd_register_uri_handler(server, &status_get);
 	httpd_uri_t messages_get = { .uri = "/messages.json", .method = HTTP_GET, .handler = messages_get_handler, .user_ctx = rest_context };
 	httpd_register_uri_handler(server, &messages_get);
+	httpd_uri_t perf_get = { .uri = "/perf.json", .method = HTTP_GET, .handler = perf_get_handler, .user_ctx = rest_context };
+	httpd_register_uri_handler(server, &perf_get);
+	httpd_uri_t monitor_get = { .uri = "/monitor.json", .method = HTTP_GET, .handler = monitor_get_handler, .user_ctx = rest_context };
+	httpd_register_uri_handler(server, &monitor_get);
+	httpd_uri_t monitor_bin_get = { .uri = "/monitor.bin", .method = HTTP_GET, .handler = monitor_get_handler, .user_ctx = rest_context };
+	httpd_register_uri_handler(server, &monitor_bin_get);
+	httpd_uri_t events_get = { .uri = "/events", .method = HTTP_GET, .handler = events_get_handler, .user_ctx = rest_context };
+	httpd_register_uri_handler(server, &events_get);
 
 	httpd_uri_t commands_get = { .uri = "/commands.json", .method = HTTP_GET, .handler = console_cmd_get_handler, .user_ctx = rest_context };
 	httpd_register_uri_handler(server, &commands_get);
@@ -128,7 +136,7 @@ esp_err_t http_server_start()
     strlcpy(rest_context->base_path, "/res/", sizeof(rest_context->base_path));
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 25;
+    config.max_uri_handlers = 28;
     config.max_open_sockets = 8;
     config.uri_match_fn = httpd_uri_match_wildcard;
     //todo:  use the endpoint below to configure session token?
@@ -143,6 +151,7 @@ esp_err_t http_server_start()
 
     	register_common_handlers(_server);
     	register_regular_handlers(_server);
+    	events_init(_server);
     }
 
     return err;
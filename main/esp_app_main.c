@@ -485,6 +485,22 @@ void register_default_nvs(){
 	config_set_default(NVS_TYPE_STR, "stats", "n", 0);
 //
         store_nvs_value(NVS_TYPE_STR,"stats", "n");
+
+	// read with config_get_str, which does not add missing keys like config_alloc_get_default does
+	ESP_LOGD(TAG,"Registering default value for key %s, value %s", "stats_window", "60");
+	config_set_default(NVS_TYPE_STR, "stats_window", "60", 0);
+
+	ESP_LOGD(TAG,"Registering default value for key %s", "dma_config");
+	config_set_default(NVS_TYPE_STR, "dma_config", "", 0);
+
+	ESP_LOGD(TAG,"Registering default value for key %s, value %s", "spdif_volume", "follow");
+	config_set_default(NVS_TYPE_STR, "spdif_volume", "follow", 0);
+
+	ESP_LOGD(TAG,"Registering default value for key %s, value %s", "spdif_eq", "y");
+	config_set_default(NVS_TYPE_STR, "spdif_eq", "y", 0);
+
+	ESP_LOGD(TAG,"Registering default value for key %s, value %s", "wifi_smode", "f");
+	config_set_default(NVS_TYPE_STR, "wifi_smode", "f", 0);
 	
 	ESP_LOGD(TAG,"Done setting default values in nvs.");
 }
@@ -655,6 +671,11 @@ void app_main()
 	ESP_LOGI(TAG,"Configuring services");
 	services_init();
 
+	config_access_stats_t config_stats;
+	config_get_access_stats(&config_stats);
+	ESP_LOGI(TAG,"Config access at boot: %u lookups (%u probes), %u allocations, %u us", config_stats.lookups, config_stats.probes,
+			config_stats.allocs, config_stats.us);
+
 	ESP_LOGI(TAG,"Initializing display");
 	display_init("SqueezeESP32");
 
@@ -673,8 +694,14 @@ void app_main()
 	fwurl = process_ota_url();
 
 	ESP_LOGD(TAG,"Getting value for WM bypass, nvs 'bypass_wm'");
-	char * bypass_wm = config_alloc_get_default(NVS_TYPE_STR, "bypass_wm", "0", 0);
-	if(bypass_wm==NULL)
+	char bypass_wm[4] = "0";
+	esp_err_t err = config_get_str("bypass_wm", bypass_wm, sizeof(bypass_wm));
+	if(err == ESP_ERR_NOT_FOUND)
+	{
+		// not set yet, default is "0"
+		bypass_wifi_manager = false;
+	}
+	else if(err != ESP_OK)
 	{
 		ESP_LOGE(TAG, "Unable to retrieve the Wifi Manager bypass flag");
 		bypass_wifi_manager = false;
@@ -684,13 +711,14 @@ void app_main()
 	}
 
 	ESP_LOGD(TAG,"Getting audio control mapping ");
-	char *actrls_config = config_alloc_get_default(NVS_TYPE_STR, "actrls_config", NULL, 0);
+	// a profile name, which is an NVS key
+	char actrls_config[16] = "";
+	config_get_str("actrls_config", actrls_config, sizeof(actrls_config));
 	if (actrls_init(actrls_config) == ESP_OK) {
 		ESP_LOGD(TAG,"Initializing audio control buttons type %s", actrls_config);	
 	} else {
 		ESP_LOGD(TAG,"No audio control buttons");
 	}
-	if (actrls_config) free(actrls_config);
 
 	/* start the wifi manager */
 	ESP_LOGD(TAG,"Blinking led");
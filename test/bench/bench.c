@@ -0,0 +1,503 @@
+/*
+ *  Squeezelite for esp32 - host pipeline benchmark
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Runs the regular stream buffer -> decode -> (process) -> output chain on a
+ host, with a file feeding the stream buffer and a null output consuming the
+ output buffer. Nothing here is compiled for the esp32, the squeezelite files
+ are linked unmodified, only slimproto and the output device are replaced.
+*/
+
+#include "squeezelite.h"
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+#define BENCH_CHUNK		4096
+#define BENCH_FRAMES	2048
+#define KERNEL_LOOPS	2000
+
+// rate list used by the null output (all are accepted)
+static unsigned rates[MAX_SUPPORTED_SAMPLERATES] = { 384000, 352800, 192000, 176400, 96000, 88200, 48000, 44100, 32000, 24000, 22500, 16000, 12000, 11025, 8000, 0 };
+
+extern struct buffer *outputbuf;
+extern struct outputstate output;
+extern struct decodestate decode;
+extern bool pcm_check_header;
+
+// normally owned by stream.c which needs slimproto
+static struct buffer buf;
+struct buffer *streambuf = &buf;
+struct streamstate stream;
+
+#define LOCK_S   mutex_lock(streambuf->mutex)
+#define UNLOCK_S mutex_unlock(streambuf->mutex)
+#define LOCK_O   mutex_lock(outputbuf->mutex)
+#define UNLOCK_O mutex_unlock(outputbuf->mutex)
+#define LOCK_D   mutex_lock(decode.mutex)
+#define UNLOCK_D mutex_unlock(decode.mutex)
+
+static struct {
+	atomic_uint_fast64_t locks, contended, wait_ns;
+} lock_stats[3];
+
+static struct {
+	u64_t played, silence;
+	u64_t recv_ns;
+	u32_t sample_rate;
+	bool realtime;
+	FILE *csv;
+	unsigned interval;
+	u64_t start_ns;
+} bench;
+
+static struct {
+	char *ext;
+	u8_t format, size, rate, channels, endianness;
+} formats[] = {
+	{ "flac", 'f', '?', '?', '?', '?' },
+	{ "flc",  'f', '?', '?', '?', '?' },
+	{ "mp3",  'm', '?', '?', '?', '?' },
+	{ "ogg",  'o', '?', '?', '?', '?' },
+	{ "opus", 'u', '?', '?', '?', '?' },
+	{ "aac",  'a', '?', '?', '?', '?' },
+	{ "m4a",  'a', '?', '?', '?', '?' },
+	{ "alac", 'l', '?', '?', '?', '?' },
+	{ "wav",  'p', '1', '3', '2', '1' },
+	{ "aif",  'p', '1', '3', '2', '0' },
+	{ "aiff", 'p', '1', '3', '2', '0' },
+	{ NULL },
+};
+
+/****************************************************************************************
+ * Replacement for slimproto and output devices
+ */
+void wake_controller(void) {
+}
+
+bool test_open(const char *device, unsigned rates[], bool userdef_rates) {
+	return true;
+}
+
+// mad is used for mp3
+struct codec *register_mpg(void) {
+	return NULL;
+}
+
+#if !BENCH_HELIXAAC
+struct codec *register_helixaac(void) {
+	return NULL;
+}
+#endif
+
+#if !BENCH_VORBIS
+struct codec *register_vorbis(void) {
+	return NULL;
+}
+#endif
+
+#if !BENCH_ALAC
+struct codec *register_alac(void) {
+	return NULL;
+}
+#endif
+
+static u64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/****************************************************************************************
+ * Lock contention, linked with --wrap=pthread_mutex_lock
+ */
+int __real_pthread_mutex_lock(pthread_mutex_t *mutex);
+
+int __wrap_pthread_mutex_lock(pthread_mutex_t *mutex) {
+	int i, rc;
+
+	if (mutex == &streambuf->mutex) i = 0;
+	else if (mutex == &outputbuf->mutex) i = 1;
+	else if (mutex == &decode.mutex) i = 2;
+	else return __real_pthread_mutex_lock(mutex);
+
+	lock_stats[i].locks++;
+	if (pthread_mutex_trylock(mutex) == 0) return 0;
+
+	u64_t start = now_ns();
+	rc = __real_pthread_mutex_lock(mutex);
+	lock_stats[i].contended++;
+	lock_stats[i].wait_ns += now_ns() - start;
+
+	return rc;
+}
+
+/****************************************************************************************
+ * Null output, only counts what it is given
+ */
+static int _null_write_frames(frames_t out_frames, bool silence, s32_t gainL, s32_t gainR,
+								s32_t cross_gain_in, s32_t cross_gain_out, ISAMPLE_T **cross_ptr) {
+	if (silence) bench.silence += out_frames;
+	else bench.played += out_frames;
+	bench.sample_rate = output.current_sample_rate;
+	return out_frames;
+}
+
+/****************************************************************************************
+ * Stream buffer fed from file
+ */
+static void *feed_thread(void *arg) {
+	int fd = *(int*) arg;
+
+	while (1) {
+		size_t space;
+		ssize_t n;
+
+		LOCK_S;
+		space = min(_buf_space(streambuf), _buf_cont_write(streambuf));
+		space = min(space, BENCH_CHUNK);
+		UNLOCK_S;
+
+		if (!space) {
+			usleep(1000);
+			continue;
+		}
+
+		// we are the only writer so writep can't move
+		u64_t start = now_ns();
+		n = read(fd, streambuf->writep, space);
+		bench.recv_ns += now_ns() - start;
+
+		LOCK_S;
+		if (n > 0) {
+			_buf_inc_writep(streambuf, n);
+			stream.bytes += n;
+		} else {
+			stream.state = DISCONNECT;
+			stream.disconnect = DISCONNECT_OK;
+		}
+		UNLOCK_S;
+
+		if (n <= 0) break;
+	}
+
+	return NULL;
+}
+
+/****************************************************************************************
+ * Buffer fill curves
+ */
+static void *sample_thread(void *arg) {
+	volatile bool *running = (bool*) arg;
+
+	while (*running) {
+		size_t sused, oused;
+
+		LOCK_S;
+		sused = _buf_used(streambuf);
+		UNLOCK_S;
+		LOCK_O;
+		oused = _buf_used(outputbuf);
+		UNLOCK_O;
+
+		fprintf(bench.csv, "%.3f,%.1f,%.1f,%" PRIu64 "\n", (now_ns() - bench.start_ns) / 1e6,
+				sused * 100.0 / streambuf->size, oused * 100.0 / outputbuf->size, bench.played);
+		usleep(bench.interval * 1000);
+	}
+
+	return NULL;
+}
+
+/****************************************************************************************
+ * Open a file and its codec, as a strm command would
+ */
+static int open_track(const char *file, char force, int *fd) {
+	char *ext = strrchr(file, '.');
+	int i;
+
+	for (i = 0; formats[i].ext; i++) {
+		if (force ? formats[i].format == force : (ext && !strcasecmp(ext + 1, formats[i].ext))) break;
+	}
+
+	if (!formats[i].ext) {
+		fprintf(stderr, "%s: unknown format\n", file);
+		return -1;
+	}
+
+	if ((*fd = open(file, O_RDONLY)) < 0) {
+		fprintf(stderr, "%s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	LOCK_S;
+	stream.bytes = 0;
+	stream.state = STREAMING_FILE;
+	UNLOCK_S;
+
+	codec_open(formats[i].format, formats[i].size, formats[i].rate, formats[i].channels, formats[i].endianness);
+
+	LOCK_D;
+	if (decode.state != DECODE_READY) {
+		UNLOCK_D;
+		fprintf(stderr, "%s: codec '%c' not available\n", file, formats[i].format);
+		close(*fd);
+		return -1;
+	}
+	decode.state = DECODE_RUNNING;
+	UNLOCK_D;
+
+	return i;
+}
+
+/****************************************************************************************
+ * Files through the pipeline, back to back when more than one (gapless)
+ */
+static int run(char *files[], int count, char force) {
+	pthread_t feeder, sampler;
+	bool sampling = true;
+	int i, fd, track = 0, started = 0;
+	u64_t gap = 0, track_frames = 0;
+
+	// reset the chain as a new track would
+	decode_flush();
+	output_flush();
+	buf_flush(streambuf);
+	memset(lock_stats, 0, sizeof(lock_stats));
+	bench.played = bench.silence = bench.recv_ns = 0;
+
+	if ((i = open_track(files[0], force, &fd)) < 0) return -1;
+
+	LOCK_O;
+	output.state = OUTPUT_RUNNING;
+	UNLOCK_O;
+
+	bench.start_ns = now_ns();
+	pthread_create(&feeder, NULL, feed_thread, &fd);
+	if (bench.csv) pthread_create(&sampler, NULL, sample_thread, &sampling);
+
+	while (1) {
+		decode_state state;
+		frames_t frames = 0;
+		bool drain, request;
+		size_t used;
+
+		LOCK_D;
+		state = decode.state;
+		UNLOCK_D;
+
+		// next track is sent once current one is fully decoded, like LMS does
+		if (state == DECODE_COMPLETE && track + 1 < count) {
+			pthread_join(feeder, NULL);
+			close(fd);
+			if ((i = open_track(files[++track], force, &fd)) < 0) break;
+			pthread_create(&feeder, NULL, feed_thread, &fd);
+			continue;
+		}
+
+		drain = state != DECODE_RUNNING && track + 1 >= count;
+
+		// unless paced, only request full chunks so that short ones only come from track changes
+		LOCK_O;
+		used = _buf_used(outputbuf);
+		request = bench.realtime ? true : (drain ? used > 0 : used >= BENCH_FRAMES * BYTES_PER_FRAME);
+		if (request) frames = _output_frames(BENCH_FRAMES);
+		if (request && !drain) gap += BENCH_FRAMES - frames;
+		if (output.track_started) {
+			u64_t boundary = bench.played - output.frames_played;
+			output.track_started = false;
+			if (started++) {
+				printf("  track %d => %d: %" PRIu64 " frames, gap %" PRIu64 " frames\n", started - 1, started, boundary - track_frames, gap);
+			}
+			track_frames = boundary;
+			gap = 0;
+		}
+		used = _buf_used(outputbuf);
+		UNLOCK_O;
+
+		if (drain && !used) break;
+
+		// pace like a DAC would, otherwise consume as fast as decoder produces
+		if (bench.realtime && bench.sample_rate) usleep(BENCH_FRAMES * 1000000LL / bench.sample_rate);
+		else if (!request) usleep(100);
+	}
+
+	u64_t elapsed = now_ns() - bench.start_ns;
+
+	sampling = false;
+	pthread_join(feeder, NULL);
+	if (bench.csv) pthread_join(sampler, NULL);
+	close(fd);
+
+	double duration = bench.sample_rate ? (double) bench.played / bench.sample_rate : 0;
+
+	printf("%s%s: codec '%c' %s\n", files[0], count > 1 ? " (gapless)" : "", formats[i].format, decode.state == DECODE_COMPLETE ? "complete" : "error");
+	printf("  %" PRIu64 " frames @%u in %.3fs => %.1fx realtime (read %.3fs), silence frames %" PRIu64 "\n",
+		   bench.played, bench.sample_rate, elapsed / 1e9, elapsed ? duration * 1e9 / elapsed : 0,
+		   bench.recv_ns / 1e9, bench.silence);
+
+	char *names[] = { "streambuf", "outputbuf", "decode" };
+	for (i = 0; i < 3; i++) {
+		u64_t locks = lock_stats[i].locks, contended = lock_stats[i].contended;
+		printf("  %-10s locks %10" PRIu64 " contended %8" PRIu64 " (%.2f%%) wait %.3fms\n", names[i], locks, contended,
+			   locks ? contended * 100.0 / locks : 0, lock_stats[i].wait_ns / 1e6);
+	}
+
+	return decode.state == DECODE_COMPLETE && track + 1 == count ? 0 : -1;
+}
+
+/****************************************************************************************
+ * Decoders output conversion kernels (decode_pack.c), SPDIF encoding (output_spdif.c)
+ * and software volume (output_pack.c), on cached buffers. Load is one core's at 44.1
+ * and 48 kHz. Software volume is what output thread saves when DAC does volume
+ */
+static void kernels(void) {
+	static s32_t left[BENCH_FRAMES], right[BENCH_FRAMES];
+	static u8_t bytes[BENCH_FRAMES * 2 * 4];
+	static ISAMPLE_T out[BENCH_FRAMES * 2], dac[BENCH_FRAMES * 2];
+	static u32_t spdif[BENCH_FRAMES * 4];
+	s32_t dac_gain[2] = { FIXED_ONE, FIXED_ONE }, spdif_gain[2] = { FIXED_ONE / 2, FIXED_ONE / 2 };
+	size_t count = 0;
+	struct buffer buf = { .readp = (u8_t*) out };
+	struct {
+		char *name;
+		int kind, channels, size;
+	} list[] = {
+		{ "planar 16 (flac)", 0, 2, 16 }, { "planar 24 (flac)", 0, 2, 24 },
+		{ "mad", 1, 2, 0 },
+		{ "s16 stereo", 2, 2, 0 }, { "s16 mono", 2, 1, 0 },
+		{ "le16 stereo", 3, 2, 2 }, { "be16 stereo", 4, 2, 2 },
+		{ "le24 stereo", 3, 2, 3 }, { "be24 stereo", 4, 2, 3 },
+		{ "le16 mono", 3, 1, 2 }, { "le32 stereo", 3, 2, 4 },
+		{ "spdif", 5, 2, 0 }, { "dac + spdif split", 6, 2, 0 },
+		{ "software volume", 7, 2, 0 },
+	};
+
+	for (int i = 0; i < BENCH_FRAMES; i++) {
+		left[i] = rand() - RAND_MAX / 2;
+		right[i] = rand() - RAND_MAX / 2;
+	}
+	for (int i = 0; i < sizeof(bytes); i++) bytes[i] = rand();
+	for (int i = 0; i < BENCH_FRAMES * 2; i++) out[i] = rand();
+
+	printf("kernel               ns/frame  %%@44.1k  %%@48k");
+#ifdef CYCLES
+	printf("  cycles/frame");
+#endif
+	printf("\n");
+
+	for (int k = 0; k < sizeof(list) / sizeof(*list); k++) {
+		u64_t start = now_ns();
+#ifdef CYCLES
+		u64_t cycles = CYCLES();
+#endif
+		for (int n = 0; n < KERNEL_LOOPS; n++) {
+			switch (list[k].kind) {
+			case 0: _pack_planar_frames(out, left, right, BENCH_FRAMES, list[k].size); break;
+			case 1: _pack_mad_frames(out, left, right, BENCH_FRAMES); break;
+			case 2: _pack_s16_frames(out, (s16_t*) bytes, BENCH_FRAMES, list[k].channels); break;
+			case 5: spdif_convert(out, BENCH_FRAMES, spdif, &count); break;
+			case 6: spdif_split(out, BENCH_FRAMES, dac, dac_gain, spdif, spdif_gain, &count); break;
+			case 7: _apply_gain(&buf, BENCH_FRAMES, FIXED_ONE / 2, FIXED_ONE / 3); break;
+			default: _pack_bytes_frames(out, bytes, BENCH_FRAMES, list[k].channels, list[k].size, list[k].kind == 4); break;
+			}
+			// prevent the compiler from dropping or merging iterations
+			__asm__ __volatile__("" : : "r" (out) : "memory");
+		}
+		double frames = (double) BENCH_FRAMES * KERNEL_LOOPS;
+		double ns = (now_ns() - start) / frames;
+		printf("%-20s %9.3f %8.3f %6.3f", list[k].name, ns, ns * 44100 / 1e7, ns * 48000 / 1e7);
+#ifdef CYCLES
+		printf("  %12.2f", (CYCLES() - cycles) / frames);
+#endif
+		printf("\n");
+	}
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("%s [-k] [-r] [-g] [-f <format>] [-c <csv> [-i <ms>]] [-s <stream_kb>] [-o <output_kb>] [-d <log>] file...\n"
+		   "  -k\t\tbenchmark decoders output conversion kernels, no file needed\n"
+		   "  -r\t\tconsume output at the track's sample rate instead of as fast as possible\n"
+		   "  -g\t\tplay files back to back and report gap in frames at each track change\n"
+		   "  -f <format>\tforce codec (f,m,o,u,a,l,p) instead of using file extension\n"
+		   "  -c <csv>\tbuffers fill level (%%) over time\n"
+		   "  -i <ms>\tsampling interval for csv (default 10)\n"
+		   "  -s, -o\tstream and output buffer size in kB (defaults to esp32 ones)\n"
+		   "  -d <log>\tlog level (error, warn, info, debug, sdebug)\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	unsigned stream_size = STREAMBUF_SIZE, output_size = OUTPUTBUF_SIZE;
+	log_level level = lWARN;
+	char force = 0;
+	bool gapless = false;
+	int opt, errors = 0;
+
+	bench.interval = 10;
+
+	while ((opt = getopt(argc, argv, "krgf:c:i:s:o:d:h")) != -1) {
+		switch (opt) {
+		case 'k': kernels(); return 0;
+		case 'r': bench.realtime = true; break;
+		case 'g': gapless = true; break;
+		case 'f': force = *optarg; break;
+		case 'c':
+			if ((bench.csv = fopen(optarg, "w")) == NULL) {
+				fprintf(stderr, "can't open %s\n", optarg);
+				return 1;
+			}
+			fprintf(bench.csv, "ms,streambuf,outputbuf,frames\n");
+			break;
+		case 'i': bench.interval = atoi(optarg); break;
+		case 's': stream_size = atoi(optarg) * 1024; break;
+		case 'o': output_size = atoi(optarg) * 1024; break;
+		case 'd':
+			if (!strcmp(optarg, "error")) level = lERROR;
+			else if (!strcmp(optarg, "warn")) level = lWARN;
+			else if (!strcmp(optarg, "info")) level = lINFO;
+			else if (!strcmp(optarg, "debug")) level = lDEBUG;
+			else if (!strcmp(optarg, "sdebug")) level = lSDEBUG;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	pcm_check_header = true;
+
+	buf_init(streambuf, stream_size);
+	output_init_common(level, "-", output_size, rates, 0);
+	output.write_cb = &_null_write_frames;
+	output.current_sample_rate = output.default_sample_rate;
+	decode_init(level, NULL, "");
+#if PROCESS
+	process_init("");
+#endif
+
+	if (gapless) errors = run(argv + optind, argc - optind, force) ? 1 : 0;
+	else for (; optind < argc; optind++) if (run(argv + optind, 1, force)) errors++;
+
+	if (bench.csv) fclose(bench.csv);
+
+	return errors ? 2 : 0;
+}
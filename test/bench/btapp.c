@@ -0,0 +1,327 @@
+/*
+ *  Squeezelite for esp32 - host checks of BT app events dispatch
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ bt_app_core.c is built against host stubs (the queue is a pthread ring).
+ A "BT stack" and a "timer" thread dispatch what playback produces (play
+ position, track change with its metadata, volume bursts) while handlers
+ take some CPU, for a bit more than a minute so that bt_app_core prints its
+ stats line. Heap allocations made while dispatching are counted by
+ wrapping malloc. Then pool exhaustion, slot release, deep copies that
+ survive a change of their source, arena bounds and large parameters are
+ checked. Returns non-zero if any check fails.
+
+	make btapp && ./btapp
+	./btapp -T 120 -p 100 -t 5 -v 2 -w 500
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "bt_app_core.h"
+
+enum { EVT_PLAY_POS, EVT_TRACK, EVT_META, EVT_VOLUME, EVT_STATE, EVT_TIMER, EVT_LARGE };
+
+// like esp_avrc_ct_cb_param_t's meta_rsp
+typedef struct {
+	uint8_t attr_id;
+	uint8_t *attr_text;
+	int attr_length;
+} meta_param_t;
+
+__thread int bench_core;
+static __thread bool dispatching;
+static uint32_t dispatch_mallocs;
+
+static struct {
+	uint32_t duration, pos_ms, track_s, volume_s, work_us;
+} sim = { 65, 1000, 30, 10, 200 };
+
+static int checks, failures;
+static volatile bool gate;
+static volatile uint32_t handled, corrupted;
+static char seen[256];
+
+#define CHECK(cond, ...) do {				\
+	checks++;								\
+	if (!(cond)) {							\
+		failures++;							\
+		printf("FAIL line %d: ", __LINE__);	\
+		printf(__VA_ARGS__);				\
+		printf("\n");						\
+	}										\
+} while (0)
+
+void *__real_malloc(size_t size);
+
+void *__wrap_malloc(size_t size) {
+	if (dispatching) __sync_fetch_and_add(&dispatch_mallocs, 1);
+	return __real_malloc(size);
+}
+
+/****************************************************************************************
+ * Copy callback, same as the sink's metadata one
+ */
+static void copy_meta(bt_app_msg_t *msg, void *p_dest, void *p_src) {
+	meta_param_t *dst = p_dest, *src = p_src;
+	uint8_t *text = bt_app_msg_alloc(msg, src->attr_length + 1);
+
+	if (!text) {
+		dst->attr_text = (uint8_t*) "";
+		dst->attr_length = 0;
+		return;
+	}
+
+	memcpy(text, src->attr_text, src->attr_length);
+	text[src->attr_length] = 0;
+	dst->attr_text = text;
+}
+
+// takes the whole arena in 2 and asks for more
+static void copy_arena(bt_app_msg_t *msg, void *p_dest, void *p_src) {
+	int *ok = p_dest;
+	ok[0] = bt_app_msg_alloc(msg, BT_APP_ARENA_SIZE + 1) == NULL;
+	ok[1] = bt_app_msg_alloc(msg, BT_APP_ARENA_SIZE / 2) != NULL;
+	ok[2] = bt_app_msg_alloc(msg, BT_APP_ARENA_SIZE / 2) != NULL;
+	ok[3] = bt_app_msg_alloc(msg, 1) == NULL;
+}
+
+static bool dispatch(uint16_t event, void *param, int len, bt_app_copy_cb_t copy);
+
+/****************************************************************************************
+ * Handler, waits for gate when asked
+ */
+static void handler(uint16_t event, void *param) {
+	while (gate) usleep(1000);
+
+	switch (event) {
+	case EVT_META: {
+		meta_param_t *meta = param;
+		strncpy(seen, (char*) meta->attr_text, sizeof(seen) - 1);
+		if (strncmp(seen, "track", 5)) corrupted++;
+		break;
+	}
+	case EVT_LARGE: {
+		uint8_t *p = param;
+		for (int i = 0; i < 200; i++) if (p[i] != (uint8_t) i) corrupted++;
+		break;
+	}
+	case EVT_TIMER:
+		break;
+	default:
+		memcpy(seen, param, 4);
+		break;
+	}
+
+	// some work (update metadata, log, send commands)
+	for (int64_t start = esp_timer_get_time(); esp_timer_get_time() - start < sim.work_us; );
+
+	__sync_fetch_and_add(&handled, 1);
+}
+
+static bool dispatch(uint16_t event, void *param, int len, bt_app_copy_cb_t copy) {
+	dispatching = true;
+	bool ok = bt_app_work_dispatch(handler, event, param, len, copy);
+	dispatching = false;
+	return ok;
+}
+
+static void drain(uint32_t count) {
+	while (handled < count) usleep(1000);
+}
+
+/****************************************************************************************
+ * Functional checks
+ */
+static void check_pool(void) {
+	uint8_t param[16] = { 0 };
+	uint32_t base = handled;
+	int sent = 0;
+
+	// task is stuck in first handler, pool is full after BT_APP_POOL_SIZE
+	gate = true;
+	for (int i = 0; i < BT_APP_POOL_SIZE; i++) sent += dispatch(EVT_STATE, param, sizeof(param), NULL);
+	CHECK(sent == BT_APP_POOL_SIZE, "only %d dispatched", sent);
+	CHECK(!dispatch(EVT_STATE, param, sizeof(param), NULL), "dispatched with pool exhausted");
+	gate = false;
+	drain(base + sent);
+
+	// slots are back
+	sent = 0;
+	for (int i = 0; i < BT_APP_POOL_SIZE; i++) sent += dispatch(EVT_STATE, param, sizeof(param), NULL);
+	CHECK(sent == BT_APP_POOL_SIZE, "slots not released, %d dispatched", sent);
+	drain(base + 2 * BT_APP_POOL_SIZE);
+}
+
+static void check_copy(void) {
+	char text[64] = "track title";
+	meta_param_t meta = { 1, (uint8_t*) text, strlen(text) };
+	uint32_t base = handled;
+
+	// source changes before handler runs
+	gate = true;
+	CHECK(dispatch(EVT_META, &meta, sizeof(meta), copy_meta), "metadata not dispatched");
+	strcpy(text, "overwritten");
+	gate = false;
+	drain(base + 1);
+	CHECK(!strcmp(seen, "track title"), "deep copy lost: %s", seen);
+}
+
+static int arena_ok[4];
+
+static void arena_handler(uint16_t event, void *param) {
+	memcpy(arena_ok, param, sizeof(arena_ok));
+	__sync_fetch_and_add(&handled, 1);
+}
+
+static void check_arena(void) {
+	int param[4];
+	uint32_t base = handled;
+
+	CHECK(bt_app_work_dispatch(arena_handler, 0, param, sizeof(param), copy_arena), "arena not dispatched");
+	drain(base + 1);
+	CHECK(arena_ok[0] && arena_ok[1] && arena_ok[2] && arena_ok[3], "arena bounds %d %d %d %d",
+		  arena_ok[0], arena_ok[1], arena_ok[2], arena_ok[3]);
+}
+
+static void check_large(void) {
+	uint8_t param[200];
+	uint32_t base = handled, mallocs = dispatch_mallocs;
+
+	for (int i = 0; i < sizeof(param); i++) param[i] = i;
+	CHECK(dispatch(EVT_LARGE, param, sizeof(param), NULL), "large not dispatched");
+	memset(param, 0, sizeof(param));
+	drain(base + 1);
+	CHECK(dispatch_mallocs == mallocs + 1, "large parameters took %u allocations", dispatch_mallocs - mallocs);
+	CHECK(!corrupted, "large parameters corrupted");
+}
+
+/****************************************************************************************
+ * Playback load
+ */
+static volatile bool running;
+static uint32_t dispatched, failed;
+
+static void *stack_thread(void *arg) {
+	int64_t start = esp_timer_get_time(), next_pos = start, next_track = start, next_volume = start;
+	uint8_t param[16] = { 0 };
+	char text[64];
+
+	while (running) {
+		int64_t now = esp_timer_get_time();
+
+		if (now >= next_pos) {
+			bool ok = dispatch(EVT_PLAY_POS, param, sizeof(param), NULL);
+			__sync_fetch_and_add(ok ? &dispatched : &failed, 1);
+			next_pos += sim.pos_ms * 1000LL;
+		}
+
+		// track change, then title, artist and album
+		if (now >= next_track) {
+			bool ok = dispatch(EVT_TRACK, param, sizeof(param), NULL);
+			ok &= dispatch(EVT_STATE, param, sizeof(param), NULL);
+			for (int i = 0; i < 3; i++) {
+				meta_param_t meta = { i, (uint8_t*) text, snprintf(text, sizeof(text), "track %u attribute %d of some length", dispatched, i) };
+				ok &= dispatch(EVT_META, &meta, sizeof(meta), copy_meta);
+			}
+			__sync_fetch_and_add(ok ? &dispatched : &failed, 5);
+			next_track += sim.track_s * 1000000LL;
+		}
+
+		// volume held down on phone
+		if (now >= next_volume) {
+			for (int i = 0; i < 10; i++) {
+				bool ok = dispatch(EVT_VOLUME, param, sizeof(param), NULL);
+				__sync_fetch_and_add(ok ? &dispatched : &failed, 1);
+				usleep(20000);
+			}
+			next_volume += sim.volume_s * 1000000LL;
+		}
+
+		usleep(1000);
+	}
+
+	return NULL;
+}
+
+static void *timer_thread(void *arg) {
+	while (running) {
+		bool ok = dispatch(EVT_TIMER, NULL, 0, NULL);
+		__sync_fetch_and_add(ok ? &dispatched : &failed, 1);
+		usleep(1000000);
+	}
+	return NULL;
+}
+
+static void run(void) {
+	pthread_t threads[2];
+	uint32_t mallocs = dispatch_mallocs;
+
+	dispatched = failed = 0;
+	corrupted = 0;
+	running = true;
+	pthread_create(threads, NULL, stack_thread, NULL);
+	pthread_create(threads + 1, NULL, timer_thread, NULL);
+	sleep(sim.duration);
+	running = false;
+	pthread_join(threads[0], NULL);
+	pthread_join(threads[1], NULL);
+
+	printf("load: %u dispatched, %u failed, %u heap allocations while dispatching, %u corrupted\n",
+		   dispatched, failed, dispatch_mallocs - mallocs, corrupted);
+	CHECK(!failed && dispatch_mallocs == mallocs && !corrupted, "load");
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-T <duration s>] [-p <play position ms>] [-t <track s>] [-v <volume burst s>] [-w <handler us>]\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	int opt;
+
+	while ((opt = getopt(argc, argv, "T:p:t:v:w:h")) != -1) {
+		switch (opt) {
+		case 'T': sim.duration = atoi(optarg); break;
+		case 'p': sim.pos_ms = atoi(optarg); break;
+		case 't': sim.track_s = atoi(optarg); break;
+		case 'v': sim.volume_s = atoi(optarg); break;
+		case 'w': sim.work_us = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	bt_app_task_start_up();
+
+	// load first, so that stats line is only about it
+	printf("play position every %u ms, track every %u s, volume burst every %u s, handlers %u us, %u s\n",
+		   sim.pos_ms, sim.track_s, sim.volume_s, sim.work_us, sim.duration);
+	run();
+
+	check_pool();
+	check_copy();
+	check_arena();
+	check_large();
+
+	printf("%d checks, %d failures\n", checks, failures);
+	return failures != 0;
+}
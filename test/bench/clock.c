@@ -0,0 +1,135 @@
+/*
+ *  Squeezelite for esp32 - host checks of I2S clock estimators
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Checks i2s_clock_elapsed/played/pending on snapshots like i2s_get_clock
+ gives: interpolation between EOFs, clamping to the current descriptor and
+ to what is queued, times before the snapshot, long gaps and wrap of the
+ frames counter. Then a stream of EOFs is replayed across the wrap and the
+ play head read at random times must never go back or jump more than time
+ allows. Returns non-zero if any check fails.
+
+	make clock && ./clock
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "i2s_clock.h"
+
+static int checks, failures;
+
+#define CHECK(cond, ...) do {				\
+	checks++;								\
+	if (!(cond)) {							\
+		failures++;							\
+		printf("FAIL line %d: ", __LINE__);	\
+		printf(__VA_ARGS__);				\
+		printf("\n");						\
+	}										\
+} while (0)
+
+/****************************************************************************************
+ * Single snapshot
+ */
+static void check_snapshot(void) {
+	i2s_clock_t clock = { .played = 1000, .time = 5000000, .queued = 4096, .desc_frames = 512, .rate = 44100 };
+
+	// not yet at snapshot time (reader's clock a bit behind ISR's)
+	CHECK(i2s_clock_elapsed(&clock, clock.time - 100) == 0, "elapsed before snapshot");
+	CHECK(i2s_clock_pending(&clock, clock.time - 100) == clock.queued, "pending before snapshot");
+	CHECK(i2s_clock_elapsed(&clock, clock.time) == 0, "elapsed at snapshot");
+
+	// 10 ms later
+	CHECK(i2s_clock_elapsed(&clock, clock.time + 10000) == 441, "elapsed 10 ms = %u", i2s_clock_elapsed(&clock, clock.time + 10000));
+	CHECK(i2s_clock_played(&clock, clock.time + 10000) == 1441, "played 10 ms");
+	CHECK(i2s_clock_pending(&clock, clock.time + 10000) == 4096 - 441, "pending 10 ms");
+
+	// never beyond next EOF, whatever the delay (EOF late or missed)
+	CHECK(i2s_clock_elapsed(&clock, clock.time + 12000) == 512, "elapsed clamped to descriptor");
+	CHECK(i2s_clock_elapsed(&clock, clock.time + 3600LL * 1000000) == 512, "elapsed after 1 hour");
+	CHECK(i2s_clock_played(&clock, clock.time + 3600LL * 1000000) == 1512, "played after 1 hour");
+
+	// less queued than a descriptor (underrun coming)
+	clock.queued = 300;
+	CHECK(i2s_clock_pending(&clock, clock.time + 5000) == 300 - 220, "pending 5 ms = %u", i2s_clock_pending(&clock, clock.time + 5000));
+	CHECK(i2s_clock_pending(&clock, clock.time + 10000) == 0, "pending clamped to 0");
+	clock.queued = 0;
+	CHECK(i2s_clock_pending(&clock, clock.time + 10000) == 0, "pending nothing queued");
+
+	// large rate and gap must not overflow the intermediate product
+	clock = (i2s_clock_t) { .played = 0, .time = 0, .queued = 1 << 20, .desc_frames = 1 << 20, .rate = 768000 };
+	CHECK(i2s_clock_elapsed(&clock, 1000000) == 768000, "elapsed 1 s at 768 kHz");
+	CHECK(i2s_clock_elapsed(&clock, 1LL << 40) == 1 << 20, "elapsed huge gap");
+
+	// not started
+	clock = (i2s_clock_t) { 0 };
+	CHECK(i2s_clock_elapsed(&clock, 1000000) == 0 && i2s_clock_pending(&clock, 1000000) == 0, "empty clock");
+}
+
+/****************************************************************************************
+ * Frames counter wraps
+ */
+static void check_wrap(void) {
+	i2s_clock_t clock = { .played = UINT32_MAX - 200, .time = 1000, .queued = 2048, .desc_frames = 512, .rate = 48000 };
+
+	uint32_t played = i2s_clock_played(&clock, clock.time + 10000);
+	CHECK(played == 480 - 201, "played across wrap = %u", played);
+	CHECK(played - clock.played == 480, "distance across wrap");
+	CHECK((int32_t) (played - clock.played) > 0, "ordering across wrap");
+}
+
+/****************************************************************************************
+ * EOF stream across wrap, play head read at random times
+ */
+static void check_stream(void) {
+	const uint32_t rate = 44100, desc = 512;
+	i2s_clock_t clock = { .played = UINT32_MAX - 100 * desc, .time = 0, .queued = 16 * desc, .desc_frames = desc, .rate = rate };
+	int64_t eof = 0, now = 0;
+	uint32_t last = clock.played;
+	int64_t last_time = 0;
+	int backward = 0, jumps = 0;
+
+	srand(1);
+
+	for (int i = 0; i < 1000; i++) {
+		// next EOF, a bit late sometimes (ISR latency)
+		int64_t next = eof + (int64_t) desc * 1000000 / rate + (rand() % 8 ? 0 : rand() % 200);
+
+		// reads until then, some after the nominal EOF time
+		while ((now += 1 + rand() % 3000) < next) {
+			uint32_t played = i2s_clock_played(&clock, now);
+			if ((int32_t) (played - last) < 0) backward++;
+			if (played - last > (uint64_t) (now - last_time) * rate / 1000000 + 1) jumps++;
+			last = played;
+			last_time = now;
+		}
+
+		eof = next;
+		clock.played += desc;
+		clock.time = eof;
+		now = eof;
+	}
+
+	CHECK(!backward, "play head went back %d times", backward);
+	CHECK(!jumps, "play head jumped %d times", jumps);
+	CHECK(clock.played == UINT32_MAX - 100 * desc + 1000 * desc, "wrapped counter");
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	check_snapshot();
+	check_wrap();
+	check_stream();
+
+	printf("%d checks, %d failures\n", checks, failures);
+	return failures != 0;
+}
@@ -0,0 +1,168 @@
+/*
+ *  Squeezelite for esp32 - host comparison of I2S DMA geometries
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ For each output mode and sample rate, prints the DMA geometry that fixed
+ buffers gave (12 x 512 frames DAC, 24 x 128 frames SPDIF, half of the DAC's
+ in dual mode) and the one planned by dma_plan, with its latency, interrupt
+ rate and memory. Then the output thread is played against the DMA: it
+ writes blocks of FRAME_BLOCK frames, taking some CPU for each and being
+ stalled now and then (WiFi, decoder, flash), and underruns are counted when
+ a descriptor ends with nothing written after it.
+
+	make dmaplan && ./dmaplan
+	./dmaplan -s 120 -p 0.05 -l 100
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "dma_plan.h"
+
+#define FRAME_BLOCK		2048
+#define STEP_US			50
+#define LOAD			0.25		// CPU time for a block, relative to its duration
+
+typedef struct {
+	char *name;
+	uint32_t frame_bytes;		// 0 for dual mode
+	uint32_t len, count;		// fixed buffers, in audio frames
+} output_mode_t;
+
+static const output_mode_t modes[] = {
+	{ "DAC 16 bits", 4, 512, 12 },
+	{ "DAC 32 bits", 8, 511, 12 },	// driver cut 512 to fit 4092 bytes
+	{ "SPDIF", 16, 128, 24 },
+	{ "I2S+SPDIF", 0, 128, 24 },
+};
+
+static const uint32_t rates[] = { 22050, 32000, 44100, 48000, 88200, 96000 };
+
+// budgets are output_i2s.c defaults
+static struct {
+	double max_ms, prob;
+	uint32_t duration, irq_max, latency_ms, bytes_max;
+} sim = { 60, 0.02, 600, 200, 140, 48 * 1024 };
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+/****************************************************************************************
+ * Underruns of a geometry, time in µs and frames are audio frames
+ */
+static uint32_t underruns(uint32_t rate, uint32_t len, uint32_t count) {
+	double queued = count * len, played = 0, pending = 0, ready = 0;
+	uint32_t underruns = 0;
+
+	for (double now = 0; now < sim.duration * 1e6; now += STEP_US) {
+		double frames = (double) rate * STEP_US / 1e6;
+
+		// descriptor ends, nothing was written after it so it's replayed (cleared)
+		played += frames;
+		queued -= frames;
+		if (played >= len) {
+			played -= len;
+			if (queued < len) {
+				underruns++;
+				queued += len;
+			}
+		}
+
+		// writer has a block ready, i2s_write blocks until it all had room
+		if (now >= ready && !pending) pending = FRAME_BLOCK;
+		if (pending) {
+			double room = (count - 1) * len - queued;
+			double n = room < pending ? room : pending;
+			if (n > 0) {
+				queued += n;
+				pending -= n;
+			}
+			if (!pending) {
+				ready = now + LOAD * FRAME_BLOCK * 1e6 / rate;
+				if (uniform(0, 1) < sim.prob) ready += uniform(0, sim.max_ms) * 1000;
+			}
+		}
+	}
+
+	return underruns;
+}
+
+/****************************************************************************************
+ *
+ */
+static void print(const char *what, uint32_t rate, uint32_t len, uint32_t count, uint32_t frame_bytes, int limits) {
+	srand(rate);
+	printf("  %-8s %6u %4u x %-4u %6.1f ms %5u irq/s %6.1f kB %6u underruns%s%s\n", what, rate, count, len,
+		   count * len * 1000.0 / rate, (rate + len - 1) / len, count * len * frame_bytes / 1024.0,
+		   underruns(rate, len, count), limits & DMA_PLAN_IRQ ? " (irq)" : "", limits & DMA_PLAN_MEMORY ? " (memory)" : "");
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-i <irq/s budget>] [-l <latency ms>] [-m <memory kB>] [-s <max stall ms>] [-p <stall probability per block>] [-T <duration s>]\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:l:m:s:p:T:h")) != -1) {
+		switch (opt) {
+		case 'i': sim.irq_max = atoi(optarg); break;
+		case 'l': sim.latency_ms = atoi(optarg); break;
+		case 'm': sim.bytes_max = atoi(optarg) * 1024; break;
+		case 's': sim.max_ms = atof(optarg); break;
+		case 'p': sim.prob = atof(optarg); break;
+		case 'T': sim.duration = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	printf("stalls up to %.0f ms for %.0f%% of blocks, %u s per configuration\n", sim.max_ms, sim.prob * 100, sim.duration);
+
+	for (int m = 0; m < sizeof(modes) / sizeof(*modes); m++) {
+		const output_mode_t *mode = modes + m;
+		printf("%s\n", mode->name);
+
+		for (int r = 0; r < sizeof(rates) / sizeof(*rates); r++) {
+			uint32_t rate = rates[r];
+			dma_plan_req_t req = { .rate = rate, .block = FRAME_BLOCK, .irq_max = sim.irq_max,
+								   .latency_ms = sim.latency_ms, .bytes_max = sim.bytes_max,
+								   .frame_bytes = mode->frame_bytes ? mode->frame_bytes : 16 };
+			dma_plan_t plan, dac;
+
+			print("fixed", rate, mode->len, mode->count, req.frame_bytes, 0);
+
+			if (!dma_plan(&req, &plan)) {
+				printf("  no plan\n");
+				continue;
+			}
+			print("planned", rate, plan.len, plan.count, req.frame_bytes, plan.limits);
+
+			// DAC follows SPDIF's depth
+			if (!mode->frame_bytes) {
+				req.frame_bytes = 4;
+				req.frames = plan.frames;
+				print(" fixed", rate, 512, 6, 4, 0);
+				if (dma_plan(&req, &dac)) print(" planned", rate, dac.len, dac.count, 4, dac.limits);
+			}
+		}
+	}
+
+	return 0;
+}
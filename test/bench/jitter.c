@@ -0,0 +1,179 @@
+/*
+ *  Squeezelite for esp32 - host simulation of BT sink jitter buffer
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Replays A2DP packet arrivals through bt_jitter as decode_external.c does,
+ against a player consuming at nominal rate plus the trim. The trace is what
+ the BT sink logs at sdebug level, "rx <time ms> <bytes>" per line (or just
+ "<time ms> <bytes>"). Without a trace, arrivals are generated from a drift
+ (phone against us), a per packet jitter and stalls where the phone holds
+ packets and then sends them all at once.
+
+	make jitter && ./jitter -d 80 -j 5 -s 250
+	./jitter -c out.csv trace.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+#include "bt_jitter.h"
+
+#define BYTES_PER_FRAME	4
+
+static struct {
+	unsigned packets, underruns, drops;
+	double underrun_ms, sum, sum2;
+	unsigned count;
+	float max_ms, min_ms;
+} stats = { .min_ms = 1e9 };
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-r <rate>] [-f <frames per packet>] [-d <drift ppm>] [-j <jitter ms>] [-s <stall ms>]\n"
+		   "          [-e <stall every s>] [-t <duration s>] [-b <buffer ms>] [-l <min ms>[:<max ms>]] [-c <csv>] [-0] [trace]\n"
+		   "  -0\tno jitter buffer, write and play as it comes (as before)\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	unsigned rate = 44100, packet = 512, duration = 3600, buffer_ms = 2000;
+	unsigned min_ms = BT_JITTER_MIN_MS, max_ms = BT_JITTER_MAX_MS;
+	float drift = 50, jitter_ms = 5, stall_ms = 200, every = 10;
+	bool enabled = true;
+	FILE *trace = NULL, *csv = NULL;
+	bt_jitter_t jitter;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:f:d:j:s:e:t:b:l:c:0h")) != -1) {
+		switch (opt) {
+		case 'r': rate = atoi(optarg); break;
+		case 'f': packet = atoi(optarg); break;
+		case 'd': drift = atof(optarg); break;
+		case 'j': jitter_ms = atof(optarg); break;
+		case 's': stall_ms = atof(optarg); break;
+		case 'e': every = atof(optarg); break;
+		case 't': duration = atoi(optarg); break;
+		case 'b': buffer_ms = atoi(optarg); break;
+		case 'l': sscanf(optarg, "%u:%u", &min_ms, &max_ms); break;
+		case '0': enabled = false; break;
+		case 'c':
+			if ((csv = fopen(optarg, "w")) == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			fprintf(csv, "time_ms,level_ms,target_ms,ppm\n");
+			break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	if (optind < argc && (trace = fopen(argv[optind], "r")) == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	bt_jitter_init(&jitter, rate, min_ms, max_ms);
+	srand(1);
+
+	// player state, in frames
+	double level = 0, pause = 0, sent = 0, last = 0;
+	double capacity = (double) buffer_ms * rate / 1000;
+	double period = packet * 1000.0 / (rate * (1 + drift / 1e6));
+	double next_stall = every * 1000, held = 0;
+
+	for (unsigned n = 0; ; n++) {
+		double t;
+		unsigned frames;
+
+		if (trace) {
+			char line[256], *p;
+			unsigned ms, bytes;
+			if (!fgets(line, sizeof(line), trace)) break;
+			p = strstr(line, "rx ");
+			if (sscanf(p ? p + 3 : line, "%u %u", &ms, &bytes) != 2) continue;
+			t = ms;
+			frames = bytes / BYTES_PER_FRAME;
+		} else {
+			// phone sends on its clock, with jitter and from time to time holds packets
+			t = n * period;
+			if (t > duration * 1000.0) break;
+			if (t >= next_stall) {
+				held = t + stall_ms * rand() / RAND_MAX;
+				next_stall += every * 1000;
+			}
+			if (t < held) t = held;
+			t += jitter_ms * rand() / RAND_MAX;
+			if (t < last) t = last;
+			frames = packet;
+		}
+
+		// play what elapsed since last packet, silence when dry
+		double elapsed = (t - last) * rate * (1 + jitter.trim.ppm / 1e6) / 1000;
+		double paused = elapsed < pause ? elapsed : pause;
+		pause -= paused;
+		elapsed -= paused;
+		if (elapsed > level) {
+			if (stats.packets && t > 60000) stats.underrun_ms += (elapsed - level) * 1000 / rate;
+			if (level > 0 && t > 60000) stats.underruns++;
+			level = 0;
+		} else level -= elapsed;
+		last = t;
+
+		// write what fits
+		if (level + frames > capacity) {
+			stats.drops += level + frames - capacity;
+			level = capacity;
+		} else level += frames;
+		stats.packets++;
+		sent += frames;
+
+		if (enabled) {
+			int32_t correction = bt_jitter_update(&jitter, t, frames, level);
+			if (correction > 0) pause += correction;
+			else if (correction < 0) level = level + correction > 0 ? level + correction : 0;
+		}
+
+		// latency once settled
+		float latency = (level + pause) * 1000 / rate;
+		if (t > 60000) {
+			stats.sum += latency;
+			stats.sum2 += latency * latency;
+			stats.count++;
+			if (latency > stats.max_ms) stats.max_ms = latency;
+			if (latency < stats.min_ms) stats.min_ms = latency;
+		}
+
+		if (csv) fprintf(csv, "%.0f,%.1f,%u,%d\n", t, latency, jitter.target_ms, jitter.trim.ppm);
+	}
+
+	double mean = stats.count ? stats.sum / stats.count : 0;
+	printf("%s: %u packets, latency %.0f ms (sd %.1f, min %.0f, max %.0f), %u underruns (%.0f ms), "
+		   "%u frames dropped on full\n", enabled ? "jitter" : "direct", stats.packets, mean,
+		   stats.count ? sqrt(stats.sum2 / stats.count - mean * mean) : 0, stats.min_ms, stats.max_ms,
+		   stats.underruns, stats.underrun_ms, stats.drops);
+	if (enabled) {
+		printf("target %u ms, trim %d ppm, counters: %u underruns, %u dropped, %u silence (frames)\n",
+			   jitter.target_ms, jitter.trim.ppm, jitter.stats.underruns, jitter.stats.dropped, jitter.stats.silence);
+	}
+
+	if (trace) fclose(trace);
+	if (csv) fclose(csv);
+
+	return 0;
+}
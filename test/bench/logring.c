@@ -0,0 +1,200 @@
+/*
+ *  Squeezelite for esp32 - host measurement of logging latency
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Audio-like threads, one per core, log bursts of lines at a fixed period
+ while stdout and stderr go to a pipe that is drained at a serial console
+ rate, like the UART or the telnet ring buffer do on the esp32. The time
+ each log call takes is measured when it writes to stderr directly (what
+ logprint did, and what log_ring_vprintf still does before log_ring_init)
+ and then when it goes through the log ring.
+
+	make logring && ./logring
+	./logring -r 11520 -p 100 -k 12
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include "esp_timer.h"
+#include "log_ring.h"
+
+#define PIPE_SIZE	4096
+#define MAX_CALLS	100000
+
+__thread int bench_core;
+
+static struct {
+	uint32_t rate, period_ms, burst, duration;
+} sim = { 11520, 100, 4, 10 };
+
+static int sink[2];
+static volatile int sinking = 1;
+
+typedef struct {
+	int core;
+	uint32_t count;
+	uint32_t us[MAX_CALLS];
+} producer_t;
+
+static producer_t producers[2];
+
+/****************************************************************************************
+ * Reads the pipe at console rate
+ */
+static void *sink_thread(void *arg) {
+	char buf[256];
+	int64_t start = esp_timer_get_time();
+	uint64_t bytes = 0;
+
+	while (sinking) {
+		int64_t due = start + bytes * 1000000 / sim.rate;
+		int64_t now = esp_timer_get_time();
+		if (due > now) usleep(due - now);
+		ssize_t n = read(sink[0], buf, sizeof(buf));
+		if (n > 0) bytes += n;
+	}
+
+	return NULL;
+}
+
+/****************************************************************************************
+ *
+ */
+static int log_line(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int len = log_ring_vprintf(fmt, args);
+	va_end(args);
+	return len;
+}
+
+/****************************************************************************************
+ * Logs bursts of lines and measures each call
+ */
+static void *producer_thread(void *arg) {
+	producer_t *p = arg;
+	int64_t next = esp_timer_get_time(), end = next + (int64_t) sim.duration * 1000000;
+
+	bench_core = p->core;
+
+	while (next < end && p->count + sim.burst <= MAX_CALLS) {
+		for (int i = 0; i < sim.burst; i++) {
+			int64_t start = esp_timer_get_time();
+			log_line("[%8.3f] output_thread:%d frames %u, buffer %u, core %d, level %u\n",
+					 start / 1e6, 100 + i, p->count * 512, 65536 - i * 1024, p->core, p->count);
+			p->us[p->count++] = esp_timer_get_time() - start;
+		}
+		next += sim.period_ms * 1000;
+		int64_t now = esp_timer_get_time();
+		if (next > now) usleep(next - now);
+	}
+
+	return NULL;
+}
+
+static int compare(const void *a, const void *b) {
+	return *(uint32_t*) a - *(uint32_t*) b;
+}
+
+/****************************************************************************************
+ * Run producers and print latency of their log calls
+ */
+static void run(FILE *out, const char *what) {
+	pthread_t threads[2];
+	uint32_t *all = malloc(2 * MAX_CALLS * sizeof(uint32_t)), n = 0;
+	double sum = 0;
+
+	for (int i = 0; i < 2; i++) {
+		producers[i].core = i;
+		producers[i].count = 0;
+		pthread_create(threads + i, NULL, producer_thread, producers + i);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+		memcpy(all + n, producers[i].us, producers[i].count * sizeof(uint32_t));
+		n += producers[i].count;
+	}
+
+	qsort(all, n, sizeof(uint32_t), compare);
+	for (int i = 0; i < n; i++) sum += all[i];
+
+	fprintf(out, "  %-7s %6u calls  mean %8.1f us  p50 %6u us  p99 %7u us  max %7u us\n", what, n,
+			sum / n, all[n / 2], all[n * 99 / 100], all[n - 1]);
+	free(all);
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-r <sink bytes/s>] [-p <period ms>] [-k <lines per burst>] [-T <duration s>]\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	pthread_t thread;
+	log_ring_stats_t stats;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:p:k:T:h")) != -1) {
+		switch (opt) {
+		case 'r': sim.rate = atoi(optarg); break;
+		case 'p': sim.period_ms = atoi(optarg); break;
+		case 'k': sim.burst = atoi(optarg); break;
+		case 'T': sim.duration = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	// results go to the real stdout, logs to the slow sink
+	FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+	setvbuf(out, NULL, _IOLBF, 0);
+
+	if (pipe(sink) < 0) return 1;
+#ifdef F_SETPIPE_SZ
+	fcntl(sink[1], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+	dup2(sink[1], STDOUT_FILENO);
+	dup2(sink[1], STDERR_FILENO);
+	pthread_create(&thread, NULL, sink_thread, NULL);
+
+	fprintf(out, "2 threads logging %u lines every %u ms, console at %u bytes/s, %u s\n",
+			sim.burst, sim.period_ms, sim.rate, sim.duration);
+
+	run(out, "direct");
+
+	// let the sink empty before ring starts
+	sleep(2);
+	log_ring_init();
+	run(out, "ring");
+
+	log_ring_get_stats(&stats);
+	fprintf(out, "  ring: %u lines, %u dropped, %u truncated, max %u us\n", stats.lines, stats.dropped,
+			stats.truncated, stats.max_us);
+
+	sinking = 0;
+	close(sink[1]);
+	close(STDOUT_FILENO);
+	close(STDERR_FILENO);
+	pthread_join(thread, NULL);
+
+	return 0;
+}
@@ -0,0 +1,14 @@
+/*
+ *  Squeezelite for esp32 - host stubs of the few esp-idf calls benches need
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#define EXT_RAM_ATTR
+#define IRAM_ATTR
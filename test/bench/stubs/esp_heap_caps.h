@@ -0,0 +1,21 @@
+/*
+ *  Squeezelite for esp32 - host stubs of the few esp-idf calls benches need
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT		0x04
+#define MALLOC_CAP_DMA		0x08
+#define MALLOC_CAP_SPIRAM	0x400
+#define MALLOC_CAP_INTERNAL	0x800
+
+#define heap_caps_malloc(size, caps)		malloc(size)
+#define heap_caps_calloc(n, size, caps)		calloc(n, size)
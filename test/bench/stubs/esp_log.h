@@ -0,0 +1,24 @@
+/*
+ *  Squeezelite for esp32 - host stubs of the few esp-idf calls benches need
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdarg.h>
+
+typedef int (*vprintf_like_t)(const char *, va_list);
+
+static inline vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) { return vprintf; }
+
+#define ESP_LOGE(tag, fmt, ...)	fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)	fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)	fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)
+#define ESP_LOGV(tag, fmt, ...)
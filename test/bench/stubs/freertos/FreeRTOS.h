@@ -0,0 +1,36 @@
+/*
+ *  Squeezelite for esp32 - host stubs of the few esp-idf calls benches need
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define portNUM_PROCESSORS	2
+#define tskIDLE_PRIORITY	0
+#define pdPASS				1
+#define pdTRUE				1
+#define pdFALSE				0
+#define pdMS_TO_TICKS(ms)	(ms)
+#define portTICK_RATE_MS	1
+#define portMAX_DELAY		0xffffffffu
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t, portTickType;
+typedef void * TaskHandle_t, * xTaskHandle;
+typedef void (*TaskFunction_t)(void *);
+
+// benches set the core their threads run on
+extern __thread int bench_core;
+static inline int xPortGetCoreID(void) { return bench_core; }
@@ -0,0 +1,90 @@
+/*
+ *  Squeezelite for esp32 - host stubs of the few esp-idf calls benches need
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+
+// fixed size items copied in a ring, like FreeRTOS queues
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	size_t size, length, head, count;
+	uint8_t *items;
+} *QueueHandle_t, *xQueueHandle;
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t size) {
+	QueueHandle_t queue = calloc(1, sizeof(*queue));
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+	queue->size = size;
+	queue->length = length;
+	queue->items = malloc(length * size);
+	return queue;
+}
+
+static inline void vQueueDelete(QueueHandle_t queue) {
+	free(queue->items);
+	free(queue);
+}
+
+// true when cond can be waited for up to ticks (ms)
+static inline bool queue_wait(QueueHandle_t queue, TickType_t ticks, struct timespec *deadline) {
+	if (ticks == portMAX_DELAY) return !pthread_cond_wait(&queue->cond, &queue->mutex);
+	return !pthread_cond_timedwait(&queue->cond, &queue->mutex, deadline);
+}
+
+static inline void queue_deadline(TickType_t ticks, struct timespec *deadline) {
+	clock_gettime(CLOCK_REALTIME, deadline);
+	if (ticks == portMAX_DELAY) return;
+	deadline->tv_sec += ticks / 1000;
+	deadline->tv_nsec += (ticks % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+static inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+	struct timespec deadline;
+	queue_deadline(ticks, &deadline);
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->count == queue->length) {
+		if (!queue_wait(queue, ticks, &deadline)) {
+			pthread_mutex_unlock(&queue->mutex);
+			return pdFALSE;
+		}
+	}
+	memcpy(queue->items + (queue->head + queue->count++) % queue->length * queue->size, item, queue->size);
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+	return pdTRUE;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+	struct timespec deadline;
+	queue_deadline(ticks, &deadline);
+	pthread_mutex_lock(&queue->mutex);
+	while (!queue->count) {
+		if (!queue_wait(queue, ticks, &deadline)) {
+			pthread_mutex_unlock(&queue->mutex);
+			return pdFALSE;
+		}
+	}
+	memcpy(item, queue->items + queue->head * queue->size, queue->size);
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+	return pdTRUE;
+}
@@ -0,0 +1,27 @@
+/*
+ *  Squeezelite for esp32 - host stubs of the few esp-idf calls benches need
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+static inline void vTaskDelay(uint32_t ticks) { usleep(ticks * 1000); }
+
+static inline BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg,
+									 UBaseType_t prio, TaskHandle_t *handle) {
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, (void *(*)(void *)) task, arg)) return !pdPASS;
+	pthread_detach(thread);
+	if (handle) *handle = (TaskHandle_t) thread;
+	return pdPASS;
+}
+
+// tasks run forever in benches
+static inline void vTaskDelete(TaskHandle_t handle) { }
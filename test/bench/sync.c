@@ -0,0 +1,193 @@
+/*
+ *  Squeezelite for esp32 - host simulation of LMS synchronized playback
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Plays a group of players, each with its own clock drift, against a server
+ that keeps them together like LMS does: it compares the position reported in
+ STMt by each one with the master's and, when the average difference over a
+ few reports is beyond a threshold, asks for a pause ('strm p') or a skip
+ ('strm a'). Before, players started at a ms with what DMA buffers held only
+ known by chunks, reported positions with the same error and applied every
+ correction with pause/skip. Now start and reports use the DMA clock (µs) and
+ small corrections are slewed through play_sync. Reported skew is the real
+ difference in what is heard.
+
+	make sync && ./sync -n 4 -d 80
+	./sync -0 -n 4 -d 80
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+#include "play_sync.h"
+
+#define MAX_PLAYERS		8
+#define STEP_MS			10
+#define REPORT_MS		1000
+#define UPDATE_MS		100
+#define LMS_AVERAGE		5
+
+typedef struct {
+	double drift;		// ppm of sample clock against server
+	double played;		// ms really heard
+	double pause;		// ms of silence left to play
+	int32_t ppm;
+	play_sync_t sync;
+	double diffs[LMS_AVERAGE];
+	int n;
+	unsigned pauses, skips;
+} player_t;
+
+static double uniform(double lo, double hi) {
+	return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-n <players>] [-d <max drift ppm>] [-g <dma granularity ms>] [-t <lms threshold ms>]\n"
+		   "          [-T <duration s>] [-s <seed>] [-c <csv>] [-0]\n"
+		   "  -0\tms start, chunk granular reports and pause/skip only (as before)\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	unsigned count = 4, duration = 3600, seed = 1;
+	double drift = 50, granularity = 11.6, threshold = 30;
+	bool enabled = true;
+	FILE *csv = NULL;
+	player_t players[MAX_PLAYERS];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:g:t:T:s:c:0h")) != -1) {
+		switch (opt) {
+		case 'n': count = atoi(optarg); break;
+		case 'd': drift = atof(optarg); break;
+		case 'g': granularity = atof(optarg); break;
+		case 't': threshold = atof(optarg); break;
+		case 'T': duration = atoi(optarg); break;
+		case 's': seed = atoi(optarg); break;
+		case '0': enabled = false; break;
+		case 'c':
+			if ((csv = fopen(optarg, "w")) == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			fprintf(csv, "time_ms,skew_ms\n");
+			break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	if (count < 2 || count > MAX_PLAYERS) {
+		printf("2 to %d players\n", MAX_PLAYERS);
+		return 1;
+	}
+
+	srand(seed);
+	memset(players, 0, sizeof(players));
+
+	// same drifts with and without slewing
+	for (int i = 0; i < count; i++) players[i].drift = uniform(-drift, drift);
+
+	for (int i = 0; i < count; i++) {
+		player_t *p = players + i;
+		play_sync_init(&p->sync, 0);
+		// start at truncated to ms and buffered audio known by DMA chunks, or by EOF time
+		if (enabled) p->played = -uniform(0, 0.02);
+		else p->played = -uniform(0, 1) - uniform(0, granularity);
+	}
+
+	double sum2 = 0, max = 0, first = 0;
+	unsigned samples = 0;
+
+	for (uint32_t now = 0; now < duration * 1000; now += STEP_MS) {
+		double lo = 1e9, hi = -1e9;
+
+		for (int i = 0; i < count; i++) {
+			player_t *p = players + i;
+			double elapsed = STEP_MS * (1 + (p->drift + p->ppm) / 1e6);
+			double paused = elapsed < p->pause ? elapsed : p->pause;
+			p->pause -= paused;
+			p->played += elapsed - paused;
+
+			if (enabled && now % UPDATE_MS == 0) p->ppm = play_sync_update(&p->sync, now);
+
+			if (p->played < lo) lo = p->played;
+			if (p->played > hi) hi = p->played;
+		}
+
+		// server compares each player with master
+		if (now % REPORT_MS == 0) {
+			// device_frames was only known by chunks before, so was what's reported
+			double master = players[0].played - (enabled ? 0 : uniform(0, granularity));
+
+			for (int i = 1; i < count; i++) {
+				player_t *p = players + i;
+				double reported = p->played - (enabled ? play_sync_pending_ms(&p->sync) : uniform(0, granularity));
+				double diff = 0;
+
+				p->diffs[p->n++ % LMS_AVERAGE] = reported - master;
+				if (p->n < LMS_AVERAGE) continue;
+				for (int j = 0; j < LMS_AVERAGE; j++) diff += p->diffs[j] / LMS_AVERAGE;
+				if (fabs(diff) < threshold) continue;
+
+				// corrections come in ms
+				int32_t ms = diff > 0 ? floor(diff) : ceil(diff);
+				p->n = 0;
+				if (enabled && play_sync_correct(&p->sync, ms, now)) continue;
+				if (ms > 0) {
+					p->pause += ms;
+					p->pauses++;
+				} else {
+					p->played -= ms;
+					p->skips++;
+				}
+			}
+		}
+
+		// skip first minute, start is not what we measure
+		if (now < 60000) {
+			first = hi - lo > first ? hi - lo : first;
+			continue;
+		}
+		sum2 += (hi - lo) * (hi - lo);
+		if (hi - lo > max) max = hi - lo;
+		samples++;
+		if (csv && now % REPORT_MS == 0) fprintf(csv, "%u,%.2f\n", now, hi - lo);
+	}
+
+	unsigned pauses = 0, skips = 0, smoothed = 0;
+	for (int i = 1; i < count; i++) {
+		pauses += players[i].pauses;
+		skips += players[i].skips;
+		smoothed += players[i].sync.stats.smoothed;
+	}
+
+	printf("%s: %u players, skew rms %.2f ms max %.2f ms (first minute %.2f ms), %u pauses %u skips (audible), %u slewed\n",
+		   enabled ? "slew" : "pause/skip", count, sqrt(sum2 / samples), max, first, pauses, skips, smoothed);
+	if (enabled) {
+		for (int i = 1; i < count; i++) {
+			printf("player %d: drift %.1f ppm, learnt %.1f ppm\n", i, players[i].drift - players[0].drift, players[i].sync.drift);
+		}
+	}
+
+	if (csv) fclose(csv);
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ *  Squeezelite for esp32 - host simulation of rate trim
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Replays AirPlay sync errors through the same logic as decode_external.c: a
+ sliding average, skip/pause for large errors and rate_trim for the rest. The
+ trace is the raw error sync measures, one "<time ms> <error ms>" per line,
+ and what we correct (frames skipped or paused, ppm applied over time) is
+ subtracted from it. Without a trace, errors are generated from a drift and a
+ noise level.
+
+	make trim && ./trim -d 80 -n 4 -s 3600
+	./trim -c out.csv trace.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+#include "rate_trim.h"
+
+// same as decode_external.c
+#define SYNC_WIN_SLOW	32
+#define SYNC_WIN_CHECK	8
+#define SYNC_WIN_FAST	2
+#define SYNC_GROSS_MS	30
+
+static struct {
+	int sum, count, win, errors[SYNC_WIN_SLOW];
+	rate_trim_t trim;
+} sync;
+
+static struct {
+	unsigned samples, skips, pauses;
+	double sum2;
+	float max_error, max_ppm;
+} stats;
+
+/****************************************************************************************
+ * one timing event, returns the correction (ms) applied by skip/pause
+ */
+static int sync_event(int error, unsigned dt, bool trim) {
+	int correction = 0;
+
+	sync.sum -= sync.errors[sync.count % sync.win];
+	sync.errors[sync.count++ % sync.win] = error;
+	sync.sum += error;
+	error = sync.sum / (sync.count < sync.win ? sync.count : sync.win);
+
+	if ((sync.count >= sync.win && abs(error) > (sync.win == SYNC_WIN_SLOW && trim ? SYNC_GROSS_MS : 10)) ||
+		(sync.count >= SYNC_WIN_CHECK && abs(error) > 100)) {
+		if (error < 0) stats.skips++;
+		else stats.pauses++;
+		correction = error;
+		sync.sum = sync.count = 0;
+		memset(sync.errors, 0, sizeof(sync.errors));
+	} else if (trim && sync.win == SYNC_WIN_SLOW && sync.count >= sync.win) {
+		rate_trim_update(&sync.trim, error, dt);
+	}
+
+	if (sync.win == 1) sync.win = SYNC_WIN_FAST;
+	else if (sync.win == SYNC_WIN_FAST && sync.count >= SYNC_WIN_FAST && abs(error) < 10) sync.win = SYNC_WIN_SLOW;
+
+	return correction;
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-d <drift ppm>] [-n <noise ms>] [-p <period ms>] [-s <duration s>] [-c <csv>] [-k <kp>] [-i <ki>] [-0] [trace]\n"
+		   "  -0\tno trimming, skip/pause only (as before)\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	float drift = 50, noise = 3, kp = RATE_TRIM_KP, ki = RATE_TRIM_KI;
+	unsigned period = 1000, duration = 3600, last = 0;
+	bool trim = true;
+	FILE *trace = NULL, *csv = NULL;
+	double offset = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:n:p:s:c:k:i:0h")) != -1) {
+		switch (opt) {
+		case 'd': drift = atof(optarg); break;
+		case 'n': noise = atof(optarg); break;
+		case 'p': period = atoi(optarg); break;
+		case 's': duration = atoi(optarg); break;
+		case 'k': kp = atof(optarg); break;
+		case 'i': ki = atof(optarg); break;
+		case '0': trim = false; break;
+		case 'c':
+			if ((csv = fopen(optarg, "w")) == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			fprintf(csv, "time_ms,error_ms,ppm\n");
+			break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	if (optind < argc && (trace = fopen(argv[optind], "r")) == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	rate_trim_init(&sync.trim, kp, ki, RATE_TRIM_LIMIT);
+	sync.win = 1;
+	srand(1);
+
+	for (unsigned t = 0; trace || t <= duration * 1000; t += period) {
+		float raw;
+
+		if (trace) {
+			char line[256];
+			if (!fgets(line, sizeof(line), trace)) break;
+			if (*line == '#' || sscanf(line, "%u %f", &t, &raw) != 2) continue;
+		} else {
+			// playing ahead by drift ppm, with uniform noise
+			raw = drift * t / 1e6 + noise * (2.0 * rand() / RAND_MAX - 1);
+		}
+
+		// a ppm applied for dt moves error by ppm * dt / 10^6
+		offset -= (double) sync.trim.ppm * (t - last) / 1e6;
+		float error = raw - offset;
+		offset += sync_event(lroundf(error), t - last, trim);
+		last = t;
+
+		// stats once settled (first minute is just about acquiring drift)
+		if (t > 60000) {
+			stats.samples++;
+			stats.sum2 += error * error;
+			if (fabsf(error) > stats.max_error) stats.max_error = fabsf(error);
+			if (abs(sync.trim.ppm) > stats.max_ppm) stats.max_ppm = abs(sync.trim.ppm);
+		}
+
+		if (csv) fprintf(csv, "%u,%.2f,%d\n", t, error, sync.trim.ppm);
+	}
+
+	printf("%s: %u events, rms %.2f ms, max %.2f ms, %u skips, %u pauses, final %d ppm (max %.0f)\n",
+		   trim ? "trim" : "skip/pause", stats.samples, stats.samples ? sqrt(stats.sum2 / stats.samples) : 0,
+		   stats.max_error, stats.skips, stats.pauses, sync.trim.ppm, stats.max_ppm);
+
+	if (trace) fclose(trace);
+	if (csv) fclose(csv);
+
+	return 0;
+}
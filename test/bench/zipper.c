@@ -0,0 +1,192 @@
+/*
+ *  Squeezelite for esp32 - host measurement of volume change clicks (zipper noise)
+ *
+ *  (c) Philippe G. 2020, philippe_44@outlook.com
+ *
+ *  This software is released under the MIT License.
+ *  https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ Plays a low frequency sine and changes volume in the middle, the way each
+ volume path does it:
+ - software: gain changes at once between two output blocks (output_pack.c)
+ - TAS57xx: 0.5dB steps, DAC ramps by one step per sample (register 0x3f default)
+ - ES8388: 0.5dB steps, DAC soft ramp by one step every 4 samples
+ - AC101: 0.75dB steps, no ramp in DAC so 8 steps 10ms apart (adac_core.c)
+ Anything above a few kHz in the result is the click or zipper noise that
+ the change makes, so it's measured after a 4th order high-pass filter, as a
+ peak and as energy over 100ms.
+
+	make zipper && ./zipper
+	./zipper -f -30 -t -10 -s 1000
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#define RATE		44100
+#define LENGTH		(RATE / 2)
+#define CHANGE		(RATE / 4)
+#define HPF			4000
+#define RAMP_MS		80
+#define RAMP_STEP_MS	10
+#define FLOOR_DB	-60
+#define MUTE		-200
+
+typedef struct {
+	double b0, b1, b2, a1, a2;
+	double x1, x2, y1, y2;
+} biquad_t;
+
+typedef enum { SOFTWARE, TAS57XX, ES8388, AC101 } path_e;
+
+static const struct {
+	char *name;
+	double step_db, min_db;
+	int ramp;		// samples per DAC step, 0 when caller ramps
+} paths[] = {
+	{ "software", 0, 0, 0 }, { "TAS57xx", 0.5, -103, 1 }, { "ES8388", 0.5, -96, 4 }, { "AC101", 0.75, -119.25, 0 },
+};
+
+/****************************************************************************************
+ * RBJ high-pass
+ */
+static void biquad_init(biquad_t *f, double freq, double q) {
+	double w = 2 * M_PI * freq / RATE, alpha = sin(w) / (2 * q), a0 = 1 + alpha;
+	memset(f, 0, sizeof(*f));
+	f->b0 = (1 + cos(w)) / 2 / a0;
+	f->b1 = -(1 + cos(w)) / a0;
+	f->b2 = f->b0;
+	f->a1 = -2 * cos(w) / a0;
+	f->a2 = (1 - alpha) / a0;
+}
+
+static double biquad(biquad_t *f, double x) {
+	double y = f->b0 * x + f->b1 * f->x1 + f->b2 * f->x2 - f->a1 * f->y1 - f->a2 * f->y2;
+	f->x2 = f->x1; f->x1 = x;
+	f->y2 = f->y1; f->y1 = y;
+	return y;
+}
+
+/****************************************************************************************
+ * dB set in DAC, as adac_attenuation() does (mute is lowest value)
+ */
+static double quantize(path_e path, double db) {
+	double step = paths[path].step_db;
+	if (!step) return db;
+	if (db < paths[path].min_db) return paths[path].min_db;
+	return -floor(-db / step + 0.5) * step;
+}
+
+/****************************************************************************************
+ * Gain of each sample for a change from from_db to to_db (MUTE for mute)
+ */
+static void gains(path_e path, double from_db, double to_db, double *gain) {
+	double step = paths[path].step_db;
+	double level = quantize(path, from_db), target = quantize(path, to_db);
+	int steps = RAMP_MS / RAMP_STEP_MS;
+
+	for (int n = 0; n < LENGTH; n++) {
+		if (n < CHANGE) {
+			gain[n] = from_db <= MUTE ? 0 : pow(10, level / 20);
+			continue;
+		}
+
+		if (path == SOFTWARE) {
+			level = target;
+		} else if (paths[path].ramp) {
+			// DAC moves one step at a time towards target
+			if ((n - CHANGE) % paths[path].ramp == 0) {
+				if (level < target) level = fmin(level + step, target);
+				else level = fmax(level - step, target);
+			}
+		} else {
+			// stepped by control task, geometric from where it was, each step is quantized
+			int k = (n - CHANGE) / (RATE * RAMP_STEP_MS / 1000) + 1;
+			double a = from_db > FLOOR_DB ? from_db : FLOOR_DB, b = to_db > FLOOR_DB ? to_db : FLOOR_DB;
+			level = k >= steps ? target : quantize(path, a + (b - a) * k / steps);
+		}
+
+		gain[n] = to_db <= MUTE && level == target ? 0 : pow(10, level / 20);
+	}
+}
+
+/****************************************************************************************
+ * Peak and energy (dBFS) of what the change adds above HPF Hz
+ */
+static void measure(double *gain, double freq, double *peak, double *energy) {
+	biquad_t f[2];
+	double max = 0, sum = 0;
+
+	biquad_init(f, HPF, 0.5412);
+	biquad_init(f + 1, HPF, 1.3066);
+
+	for (int n = 0; n < LENGTH; n++) {
+		// change happens at a peak, worst case for a step
+		double x = gain[n] * 0.5 * cos(2 * M_PI * freq * (n - CHANGE) / RATE);
+		double y = biquad(f + 1, biquad(f, x));
+		// filter must settle and only what follows change matters
+		if (n < CHANGE - RATE / 100) continue;
+		if (fabs(y) > max) max = fabs(y);
+		if (n < CHANGE + RATE / 10) sum += y * y;
+	}
+
+	*peak = 20 * log10(max + 1e-12);
+	*energy = 10 * log10(sum / (RATE / 10) + 1e-24);
+}
+
+/****************************************************************************************
+ *
+ */
+static void usage(const char *name) {
+	printf("usage: %s [-f <from dB>] [-t <to dB, -200 is mute>] [-s <sine Hz>]\n"
+		   "  without -f/-t, a set of usual changes is measured\n", name);
+}
+
+/****************************************************************************************
+ *
+ */
+int main(int argc, char *argv[]) {
+	double freq = 100, changes[][2] = { { 0, -3 }, { -20, -10 }, { -40, 0 }, { -10, MUTE }, { 0, 0 } };
+	int count = sizeof(changes) / sizeof(*changes), opt;
+	double *gain = malloc(LENGTH * sizeof(double));
+
+	while ((opt = getopt(argc, argv, "f:t:s:h")) != -1) {
+		switch (opt) {
+		case 'f': changes[0][0] = atof(optarg); count = 1; break;
+		case 't': changes[0][1] = atof(optarg); count = 1; break;
+		case 's': freq = atof(optarg); break;
+		default:
+			usage(argv[0]);
+			return opt != 'h';
+		}
+	}
+
+	printf("%.0f Hz sine at -6dBFS, noise above %u Hz, peak / energy over 100ms in dBFS\n", freq, HPF);
+	printf("%-16s", "change (dB)");
+	for (int p = 0; p < sizeof(paths) / sizeof(*paths); p++) printf("%20s", paths[p].name);
+	printf("\n");
+
+	for (int c = 0; c < count; c++) {
+		char label[32];
+		if (changes[c][1] <= MUTE) sprintf(label, "%.0f > mute", changes[c][0]);
+		else sprintf(label, "%.0f > %.0f", changes[c][0], changes[c][1]);
+		printf("%-16s", label);
+
+		for (int p = 0; p < sizeof(paths) / sizeof(*paths); p++) {
+			double peak, energy;
+			gains(p, changes[c][0], changes[c][1], gain);
+			measure(gain, freq, &peak, &energy);
+			printf("%11.1f /%7.1f", peak, energy);
+		}
+		printf("\n");
+	}
+
+	free(gain);
+	return 0;
+}